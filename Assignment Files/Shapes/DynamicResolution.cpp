@@ -0,0 +1,297 @@
+//***************************************************************************************
+// DynamicResolution.cpp
+//***************************************************************************************
+
+#include "DynamicResolution.h"
+#include "../../Common/MathHelper.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // Scale changes smaller than this are not made, so the scale holds still while
+    // the frame time is near the target.
+    const float Deadband = 0.02f;
+
+    // Largest steps the scale takes per frame measured.  It drops fast when over
+    // budget and creeps back up, since the frame time read is already a few
+    // frames old.
+    const float MaxStepDown = 0.1f;
+    const float MaxStepUp = 0.02f;
+}
+
+DynamicResolution::DynamicResolution(ID3D12Device* device, d3dUtil::ShaderSource shaderSource,
+    PipelineCache* pipelineCache, const Settings& settings)
+    : md3dDevice(device), mShaderSource(shaderSource), mPipelineCache(pipelineCache), mSettings(settings)
+{
+    mScale = mSettings.MaxScale;
+
+    BuildRootSignature();
+    BuildDescriptorHeaps();
+}
+
+void DynamicResolution::Resize(UINT width, UINT height, DXGI_FORMAT format, DXGI_SAMPLE_DESC sampleDesc,
+    const float clearColor[4])
+{
+    mWidth = width;
+    mHeight = height;
+    mFormat = format;
+    mSampleDesc = sampleDesc;
+
+    D3D12_CLEAR_VALUE optClear;
+    optClear.Format = format;
+    memcpy(optClear.Color, clearColor, sizeof(optClear.Color));
+
+    D3D12_RESOURCE_DESC sceneDesc = CD3DX12_RESOURCE_DESC::Tex2D(format, width, height, 1, 1,
+        sampleDesc.Count, sampleDesc.Quality, D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+
+    mSceneTarget = nullptr;
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &sceneDesc,
+        D3D12_RESOURCE_STATE_RENDER_TARGET,
+        &optClear,
+        IID_PPV_ARGS(&mSceneTarget)));
+    md3dDevice->CreateRenderTargetView(mSceneTarget.Get(), nullptr, mRtvHeap->GetCPUDescriptorHandleForHeapStart());
+
+    // The filter reads a single sampled texture, the scene target itself unless it
+    // is multisampled.
+    ID3D12Resource* filtered = mSceneTarget.Get();
+    mResolveTarget = nullptr;
+    if(sampleDesc.Count > 1)
+    {
+        D3D12_RESOURCE_DESC resolveDesc = CD3DX12_RESOURCE_DESC::Tex2D(format, width, height, 1, 1);
+        ThrowIfFailed(md3dDevice->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &resolveDesc,
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+            nullptr,
+            IID_PPV_ARGS(&mResolveTarget)));
+        filtered = mResolveTarget.Get();
+    }
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = format;
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    srvDesc.Texture2D.MipLevels = 1;
+    md3dDevice->CreateShaderResourceView(filtered, &srvDesc, mSrvHeap->GetCPUDescriptorHandleForHeapStart());
+
+    // The upscale draws into the back buffer, which shares the target's format and
+    // multisampling.
+    if(format != mPsoFormat || sampleDesc.Count != mPsoSampleDesc.Count || sampleDesc.Quality != mPsoSampleDesc.Quality)
+        BuildPSO(format, sampleDesc);
+}
+
+bool DynamicResolution::Update(float gpuFrameMs)
+{
+    if(gpuFrameMs <= 0.0f)
+        return false;
+
+    // GPU time grows about with the pixels drawn, the square of the scale, so the
+    // scale that would have met the target is the current one times the square
+    // root of the ratio of the two times.
+    float wanted = mScale*sqrtf(mSettings.TargetMs / gpuFrameMs);
+    float step = MathHelper::Clamp(wanted - mScale, -MaxStepDown, MaxStepUp);
+    float scale = MathHelper::Clamp(mScale + step, mSettings.MinScale, mSettings.MaxScale);
+
+    // Small steps are still taken onto the ends of the range, so it is reached.
+    bool isAtBound = (scale == mSettings.MinScale || scale == mSettings.MaxScale);
+    if(scale == mScale || (fabsf(scale - mScale) < Deadband && !isAtBound))
+        return false;
+
+    mScale = scale;
+    return true;
+}
+
+float DynamicResolution::Scale()const
+{
+    return mScale;
+}
+
+float DynamicResolution::ScalePixels(float pixels)const
+{
+    return std::floor(mScale*pixels + 0.5f);
+}
+
+UINT DynamicResolution::SceneWidth()const
+{
+    return std::max<UINT>((UINT)ScalePixels((float)mWidth), 1u);
+}
+
+UINT DynamicResolution::SceneHeight()const
+{
+    return std::max<UINT>((UINT)ScalePixels((float)mHeight), 1u);
+}
+
+ID3D12Resource* DynamicResolution::SceneTarget()const
+{
+    return mSceneTarget.Get();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DynamicResolution::SceneRtv()const
+{
+    return mRtvHeap->GetCPUDescriptorHandleForHeapStart();
+}
+
+void DynamicResolution::Upscale(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtv)
+{
+    if(mResolveTarget != nullptr)
+    {
+        D3D12_RESOURCE_BARRIER toResolve[] =
+        {
+            CD3DX12_RESOURCE_BARRIER::Transition(mSceneTarget.Get(),
+                D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_RESOLVE_SOURCE),
+            CD3DX12_RESOURCE_BARRIER::Transition(mResolveTarget.Get(),
+                D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RESOLVE_DEST),
+        };
+        cmdList->ResourceBarrier(_countof(toResolve), toResolve);
+
+        cmdList->ResolveSubresource(mResolveTarget.Get(), 0, mSceneTarget.Get(), 0, mFormat);
+
+        D3D12_RESOURCE_BARRIER toRead[] =
+        {
+            CD3DX12_RESOURCE_BARRIER::Transition(mSceneTarget.Get(),
+                D3D12_RESOURCE_STATE_RESOLVE_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
+            CD3DX12_RESOURCE_BARRIER::Transition(mResolveTarget.Get(),
+                D3D12_RESOURCE_STATE_RESOLVE_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+        };
+        cmdList->ResourceBarrier(_countof(toRead), toRead);
+    }
+    else
+    {
+        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mSceneTarget.Get(),
+            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+    }
+
+    // The scene covers the whole texels of the target's top left corner.  The
+    // filter's taps are kept off the texels past its edge, which were not drawn
+    // this frame.
+    float sceneWidth = (float)SceneWidth();
+    float sceneHeight = (float)SceneHeight();
+    float constants[4] =
+    {
+        sceneWidth / mWidth, sceneHeight / mHeight,
+        (sceneWidth - 0.5f) / mWidth, (sceneHeight - 0.5f) / mHeight
+    };
+
+    D3D12_VIEWPORT viewport = { 0.0f, 0.0f, (float)mWidth, (float)mHeight, 0.0f, 1.0f };
+    D3D12_RECT scissorRect = { 0, 0, (LONG)mWidth, (LONG)mHeight };
+
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+    cmdList->SetPipelineState(mPSO.Get());
+    cmdList->SetGraphicsRoot32BitConstants(0, 4, constants, 0);
+    cmdList->SetGraphicsRootDescriptorTable(1, mSrvHeap->GetGPUDescriptorHandleForHeapStart());
+
+    cmdList->RSSetViewports(1, &viewport);
+    cmdList->RSSetScissorRects(1, &scissorRect);
+    cmdList->OMSetRenderTargets(1, &rtv, true, nullptr);
+
+    // A single triangle covers the screen; its vertices come from SV_VertexID.
+    cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    cmdList->DrawInstanced(3, 1, 0, 0);
+
+    if(mResolveTarget == nullptr)
+    {
+        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mSceneTarget.Get(),
+            D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET));
+    }
+}
+
+void DynamicResolution::BuildRootSignature()
+{
+    CD3DX12_DESCRIPTOR_RANGE sceneRange;
+    sceneRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+
+    CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+
+    // The drawn fraction of the target and the farthest texture coordinates read.
+    slotRootParameter[0].InitAsConstants(4, 0);
+    slotRootParameter[1].InitAsDescriptorTable(1, &sceneRange, D3D12_SHADER_VISIBILITY_PIXEL);
+
+    CD3DX12_STATIC_SAMPLER_DESC linearClamp(0, D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+        D3D12_TEXTURE_ADDRESS_MODE_CLAMP, D3D12_TEXTURE_ADDRESS_MODE_CLAMP, D3D12_TEXTURE_ADDRESS_MODE_CLAMP);
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter, 1, &linearClamp,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void DynamicResolution::BuildPSO(DXGI_FORMAT format, DXGI_SAMPLE_DESC sampleDesc)
+{
+    ComPtr<ID3DBlob> vs = d3dUtil::LoadShader(L"Shaders\\upscale.hlsl", nullptr, "UpscaleVS", "vs_5_1", mShaderSource);
+    ComPtr<ID3DBlob> ps = d3dUtil::LoadShader(L"Shaders\\upscale.hlsl", nullptr, "UpscalePS", "ps_5_1", mShaderSource);
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
+    psoDesc.InputLayout = { nullptr, 0 };
+    psoDesc.pRootSignature = mRootSignature.Get();
+    psoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(vs->GetBufferPointer()),
+        vs->GetBufferSize()
+    };
+    psoDesc.PS =
+    {
+        reinterpret_cast<BYTE*>(ps->GetBufferPointer()),
+        ps->GetBufferSize()
+    };
+    psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    psoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
+    psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    psoDesc.DepthStencilState.DepthEnable = FALSE;
+    psoDesc.SampleMask = UINT_MAX;
+    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    psoDesc.NumRenderTargets = 1;
+    psoDesc.RTVFormats[0] = format;
+    psoDesc.SampleDesc = sampleDesc;
+    psoDesc.DSVFormat = DXGI_FORMAT_UNKNOWN;
+
+    // Each multisample state is stored under a name of its own, so toggling it
+    // does not replace the other's PSO in the cache.
+    std::wstring name = L"upscale_" + std::to_wstring(sampleDesc.Count);
+
+    mPSO = nullptr;
+    if(mPipelineCache != nullptr)
+        mPSO = mPipelineCache->CreateGraphicsPipelineState(name, psoDesc);
+    else
+        ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&mPSO)));
+
+    mPsoFormat = format;
+    mPsoSampleDesc = sampleDesc;
+}
+
+void DynamicResolution::BuildDescriptorHeaps()
+{
+    D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
+    rtvHeapDesc.NumDescriptors = 1;
+    rtvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+    rtvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+    ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&rtvHeapDesc, IID_PPV_ARGS(&mRtvHeap)));
+
+    D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+    srvHeapDesc.NumDescriptors = 1;
+    srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvHeap)));
+}
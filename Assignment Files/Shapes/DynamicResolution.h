@@ -0,0 +1,98 @@
+//***************************************************************************************
+// DynamicResolution.h
+//
+// Draws the scene at a fraction of the back buffer's resolution and stretches it
+// over the back buffer, with the fraction steered by the measured GPU frame time
+// so the frame stays within a budget.  The scene target is allocated at the full
+// size once, and the scene drawn into its top left corner, so changing the scale
+// only changes viewports: nothing is reallocated and the queue is not flushed.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/PipelineCache.h"
+
+class DynamicResolution
+{
+public:
+    // The GPU frame time the controller aims for, and the scales it keeps to.
+    struct Settings
+    {
+        float TargetMs = 16.0f;
+        float MinScale = 0.5f;
+        float MaxScale = 1.0f;
+    };
+
+    // The upscale PSOs are created through pipelineCache, which may be null.
+    DynamicResolution(ID3D12Device* device, d3dUtil::ShaderSource shaderSource,
+        PipelineCache* pipelineCache, const Settings& settings);
+    DynamicResolution(const DynamicResolution& rhs) = delete;
+    DynamicResolution& operator=(const DynamicResolution& rhs) = delete;
+    ~DynamicResolution() = default;
+
+    // Recreates the scene target at the back buffer's size, format and
+    // multisampling, with clearColor as its optimized clear value.  The GPU must
+    // be done with the old one.
+    void Resize(UINT width, UINT height, DXGI_FORMAT format, DXGI_SAMPLE_DESC sampleDesc,
+        const float clearColor[4]);
+
+    // Steers the scale by the GPU time of a finished frame.  Returns whether the
+    // scale changed.
+    bool Update(float gpuFrameMs);
+
+    // Fraction of the back buffer's width and height the scene is drawn at.
+    float Scale()const;
+
+    // A length in the back buffer's pixels scaled by Scale() and rounded to whole
+    // pixels.  Viewports laid out from these edges cover whole texels of the scene
+    // target, and the whole back buffer scales to SceneWidth() by SceneHeight().
+    float ScalePixels(float pixels)const;
+    UINT SceneWidth()const;
+    UINT SceneHeight()const;
+
+    // The target the scene is drawn into, in the RENDER_TARGET state between
+    // upscales, and its view.
+    ID3D12Resource* SceneTarget()const;
+    D3D12_CPU_DESCRIPTOR_HANDLE SceneRtv()const;
+
+    // Records the stretch of the top left SceneWidth() by SceneHeight() pixels of
+    // the scene target over the whole of
+    // the back buffer rtv views, which is in the RENDER_TARGET state.  Sets the
+    // graphics root signature, PSO and the descriptor heap of the scene target's
+    // view, and binds rtv with no depth buffer.
+    void Upscale(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtv);
+
+private:
+    void BuildRootSignature();
+    void BuildPSO(DXGI_FORMAT format, DXGI_SAMPLE_DESC sampleDesc);
+    void BuildDescriptorHeaps();
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    d3dUtil::ShaderSource mShaderSource;
+    PipelineCache* mPipelineCache = nullptr;
+
+    Settings mSettings;
+    float mScale = 1.0f;
+
+    UINT mWidth = 0;
+    UINT mHeight = 0;
+    DXGI_FORMAT mFormat = DXGI_FORMAT_UNKNOWN;
+    DXGI_SAMPLE_DESC mSampleDesc = { 1, 0 };
+
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mPSO = nullptr;
+
+    // The PSO is rebuilt when the back buffer's format or multisampling changes.
+    DXGI_FORMAT mPsoFormat = DXGI_FORMAT_UNKNOWN;
+    DXGI_SAMPLE_DESC mPsoSampleDesc = { 0, 0 };
+
+    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mRtvHeap = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mSrvHeap = nullptr;
+
+    // A multisampled scene is resolved into a target of its own before it is
+    // filtered.
+    Microsoft::WRL::ComPtr<ID3D12Resource> mSceneTarget = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mResolveTarget = nullptr;
+};
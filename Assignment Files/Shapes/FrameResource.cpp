@@ -1,16 +1,57 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT objectCount, UINT workerCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
+    WorkerCmdListAllocs.resize(workerCount);
+    WorkerCmdLists.resize(workerCount);
+    for(UINT i = 0; i < workerCount; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
+
+        ThrowIfFailed(device->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            WorkerCmdListAllocs[i].Get(),
+            nullptr,
+            IID_PPV_ARGS(WorkerCmdLists[i].GetAddressOf())));
+
+        // Start off in a closed state, since the first thing a worker does is Reset.
+        WorkerCmdLists[i]->Close();
+    }
+
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, objectCount, false);
+    ObjectCapacity = objectCount;
 }
 
 FrameResource::~FrameResource()
 {
 
+}
+
+void FrameResource::ReserveObjects(ID3D12Device* device, UINT objectCount)
+{
+    if(objectCount <= ObjectCapacity)
+        return;
+
+    // Grow geometrically, so objects added a few at a time rarely copy the buffers.
+    // Reading the old ones back is slow, since upload heaps are not cached for the
+    // CPU, but it spares rewriting every object's constants.
+    UINT capacity = std::max<UINT>(objectCount, 2*ObjectCapacity);
+
+    auto objectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, capacity, true);
+    memcpy(objectCB->MappedData(), ObjectCB->MappedData(), (size_t)ObjectCapacity*ObjectCB->ElementByteSize());
+    ObjectCB = std::move(objectCB);
+
+    auto instanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(device, capacity, false);
+    memcpy(instanceBuffer->MappedData(), InstanceBuffer->MappedData(), (size_t)ObjectCapacity*InstanceBuffer->ElementByteSize());
+    InstanceBuffer = std::move(instanceBuffer);
+
+    ObjectCapacity = capacity;
 }
\ No newline at end of file
@@ -4,9 +4,36 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 
+// Most views a frame is drawn from.  Must match MAX_VIEWS in Shaders/color.hlsl.
+const UINT MaxViewCount = 3;
+
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+
+    // Maps the object's stored vertex positions back to object space.  Only the
+    // world matrix is streamed each frame; these are written once.
+    DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+    float Pad0 = 0.0f;
+    DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+    float Pad1 = 0.0f;
+};
+
+// Per-instance data read by the instanced vertex shader through SV_InstanceID.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+
+    // As in ObjectConstants.
+    DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+
+    // LOD selected for the object this frame, read by the GPU culler.
+    UINT LodIndex = 0;
+    DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+
+    // Bit v is set when the object is in view v this frame.  Only written, and
+    // read, when the views are drawn in a single pass.
+    UINT ViewMask = 0;
 };
 
 struct PassConstants
@@ -27,10 +54,14 @@ struct PassConstants
     float DeltaTime = 0.0f;
 };
 
-struct Vertex
+// The view-projection of every view, for drawing them all in a single pass.
+struct MultiViewConstants
 {
-    DirectX::XMFLOAT3 Pos;
-    DirectX::XMFLOAT4 Color;
+    DirectX::XMFLOAT4X4 ViewProj[MaxViewCount];
+    UINT ViewCount = 0;
+    UINT Pad0 = 0;
+    UINT Pad1 = 0;
+    UINT Pad2 = 0;
 };
 
 // Stores the resources needed for the CPU to build the command lists
@@ -39,20 +70,45 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount);
+    FrameResource(ID3D12Device* device, UINT objectCount, UINT workerCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
 
+    // Grows ObjectCB and InstanceBuffer to hold at least objectCount objects,
+    // keeping what they hold.  Only called once the GPU is done with this frame
+    // resource, so the old buffers can go at once.
+    void ReserveObjects(ID3D12Device* device, UINT objectCount);
+
     // We cannot reset the allocator until the GPU is done processing the commands.
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // Each worker thread records its share of the scene into its own command list,
+    // so it needs its own allocator per frame as well.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>> WorkerCmdLists;
+
+    // The pass constants are rewritten every frame, so they are allocated from
+    // the app's upload ring instead of living in a buffer of their own.  There
+    // is one per view, the main view's first, and the multi-view constants when
+    // the views are drawn in a single pass.
+    std::vector<D3D12_GPU_VIRTUAL_ADDRESS> PassCBAddresses;
+    D3D12_GPU_VIRTUAL_ADDRESS MultiViewCBAddress = 0;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
+    // that reference it.  So each frame needs their own cbuffers.  The object
+    // constants only change for dirty objects, so they persist between uses of
+    // the frame resource.
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
+    // Structured buffer of per-instance world matrices, indexed the same way
+    // as ObjectCB, used when render items are drawn as instanced batches.
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
+    // Objects ObjectCB and InstanceBuffer have room for.
+    UINT ObjectCapacity = 0;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
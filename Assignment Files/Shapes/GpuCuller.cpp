@@ -0,0 +1,384 @@
+//***************************************************************************************
+// GpuCuller.cpp
+//***************************************************************************************
+
+#include "GpuCuller.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+static_assert(sizeof(IndirectCommand) == 80, "IndirectCommand must match the HLSL layout.");
+static_assert(sizeof(CullObject) == 32, "CullObject must match the HLSL layout.");
+
+GpuCuller::GpuCuller(ID3D12Device* device, ID3D12RootSignature* graphicsRootSig,
+    UINT objectCBRootParameter, UINT objectCBByteSize, UINT objectCount, UINT lodCount,
+    d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache)
+    : md3dDevice(device), mObjectCBByteSize(objectCBByteSize), mObjectCount(objectCount), mLodCount(lodCount)
+{
+    BuildRootSignature();
+    BuildPSOs(shaderSource, pipelineCache);
+    BuildCommandSignature(graphicsRootSig, objectCBRootParameter);
+    BuildResources();
+}
+
+UINT GpuCuller::ObjectCount()const
+{
+    return mObjectCount;
+}
+
+UINT GpuCuller::LodCount()const
+{
+    return mLodCount;
+}
+
+void GpuCuller::Upload(ID3D12GraphicsCommandList* cmdList,
+    const std::vector<CullObject>& objects,
+    const std::vector<IndirectCommand>& commands)
+{
+    assert(objects.size() == mObjectCount);
+    assert(commands.size() == (size_t)mObjectCount*mLodCount);
+
+    mObjects = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+        objects.data(), objects.size()*sizeof(CullObject), mObjectsUploader);
+
+    mCommands = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+        commands.data(), commands.size()*sizeof(IndirectCommand), mCommandsUploader);
+}
+
+void GpuCuller::Reserve(ID3D12GraphicsCommandList* cmdList, UINT objectCount, UINT64 fenceValue)
+{
+    if(objectCount <= mObjectCount)
+        return;
+
+    // Grow geometrically, so a scene that keeps growing is only copied a few times.
+    UINT oldCount = mObjectCount;
+    UINT newCount = std::max<UINT>(objectCount, 2*oldCount);
+    UINT64 objectByteSize = sizeof(CullObject);
+    UINT64 lodCommandsByteSize = (UINT64)mLodCount*sizeof(IndirectCommand);
+
+    ComPtr<ID3D12Resource> objects = CreateBuffer(newCount*objectByteSize, D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+    ComPtr<ID3D12Resource> commands = CreateBuffer(newCount*lodCommandsByteSize, D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+    ComPtr<ID3D12Resource> visibleCommands = CreateBuffer((UINT64)newCount*sizeof(IndirectCommand), D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+
+    // The new objects are inactive until UpdateObjects gives them bounds.  Their
+    // commands are never read before then, so they are left as they are.
+    UINT64 tailByteSize = (newCount - oldCount)*objectByteSize;
+    ComPtr<ID3D12Resource> tailUploader = CreateBuffer(tailByteSize, D3D12_HEAP_TYPE_UPLOAD,
+        D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ);
+
+    CullObject* tail = nullptr;
+    ThrowIfFailed(tailUploader->Map(0, nullptr, reinterpret_cast<void**>(&tail)));
+    for(UINT i = 0; i < newCount - oldCount; ++i)
+    {
+        tail[i] = CullObject();
+        tail[i].ObjectIndex = InactiveObject;
+    }
+    tailUploader->Unmap(0, nullptr);
+
+    D3D12_RESOURCE_BARRIER toCopySource[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mObjects.Get(),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE),
+        CD3DX12_RESOURCE_BARRIER::Transition(mCommands.Get(),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE),
+    };
+    cmdList->ResourceBarrier(_countof(toCopySource), toCopySource);
+
+    cmdList->CopyBufferRegion(objects.Get(), 0, mObjects.Get(), 0, oldCount*objectByteSize);
+    cmdList->CopyBufferRegion(objects.Get(), oldCount*objectByteSize, tailUploader.Get(), 0, tailByteSize);
+    cmdList->CopyBufferRegion(commands.Get(), 0, mCommands.Get(), 0, oldCount*lodCommandsByteSize);
+
+    D3D12_RESOURCE_BARRIER toRead[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(objects.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+        CD3DX12_RESOURCE_BARRIER::Transition(commands.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+    };
+    cmdList->ResourceBarrier(_countof(toRead), toRead);
+
+    // The frames in flight still cull with the old buffers, and this one copies
+    // from them.
+    mRetiredBuffers.push_back({ mObjects, fenceValue });
+    mRetiredBuffers.push_back({ mCommands, fenceValue });
+    mRetiredBuffers.push_back({ mVisibleCommands, fenceValue });
+    mRetiredBuffers.push_back({ tailUploader, fenceValue });
+
+    mObjects = objects;
+    mCommands = commands;
+    mVisibleCommands = visibleCommands;
+    mObjectCount = newCount;
+}
+
+void GpuCuller::UpdateObjects(ID3D12GraphicsCommandList* cmdList, UploadRing& uploadRing,
+    const std::vector<UINT>& indices, const std::vector<CullObject>& objects,
+    const std::vector<IndirectCommand>& commands)
+{
+    assert(objects.size() == indices.size());
+    assert(commands.size() == indices.size()*mLodCount);
+
+    if(indices.empty())
+        return;
+
+    // Stage the objects, then their commands, in one allocation.
+    UINT64 objectsByteSize = objects.size()*sizeof(CullObject);
+    UINT64 lodCommandsByteSize = (UINT64)mLodCount*sizeof(IndirectCommand);
+    UploadRing::Allocation staging = uploadRing.Allocate(objectsByteSize + commands.size()*sizeof(IndirectCommand), 16);
+    memcpy(staging.CpuAddress, objects.data(), objectsByteSize);
+    memcpy(staging.CpuAddress + objectsByteSize, commands.data(), commands.size()*sizeof(IndirectCommand));
+
+    D3D12_RESOURCE_BARRIER toCopyDest[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mObjects.Get(),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST),
+        CD3DX12_RESOURCE_BARRIER::Transition(mCommands.Get(),
+            D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST),
+    };
+    cmdList->ResourceBarrier(_countof(toCopyDest), toCopyDest);
+
+    for(size_t i = 0; i < indices.size(); ++i)
+    {
+        assert(indices[i] < mObjectCount);
+
+        cmdList->CopyBufferRegion(mObjects.Get(), indices[i]*sizeof(CullObject),
+            staging.Resource, staging.Offset + i*sizeof(CullObject), sizeof(CullObject));
+        cmdList->CopyBufferRegion(mCommands.Get(), indices[i]*lodCommandsByteSize,
+            staging.Resource, staging.Offset + objectsByteSize + i*lodCommandsByteSize, lodCommandsByteSize);
+    }
+
+    D3D12_RESOURCE_BARRIER toRead[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mObjects.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+        CD3DX12_RESOURCE_BARRIER::Transition(mCommands.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+    };
+    cmdList->ResourceBarrier(_countof(toRead), toRead);
+}
+
+void GpuCuller::Retire(UINT64 completedFenceValue)
+{
+    mRetiredBuffers.erase(std::remove_if(mRetiredBuffers.begin(), mRetiredBuffers.end(),
+        [=](const RetiredBuffer& b) { return b.FenceValue <= completedFenceValue; }),
+        mRetiredBuffers.end());
+}
+
+void GpuCuller::Cull(ID3D12GraphicsCommandList* cmdList, D3D12_GPU_VIRTUAL_ADDRESS objectCB,
+    D3D12_GPU_VIRTUAL_ADDRESS instanceBuffer, FXMMATRIX viewProj, const HiZBuffer* hiZ,
+    const D3D12_VIEWPORT* viewport)
+{
+    // Extract the frustum planes from the view-projection matrix.  A point p is
+    // inside when 0 <= z <= w and -w <= x, y <= w for (x, y, z, w) = p*viewProj,
+    // so each plane is a sum or difference of the matrix's columns.
+    XMMATRIX columns = XMMatrixTranspose(viewProj);
+
+    XMFLOAT4 planes[6];
+    XMStoreFloat4(&planes[0], XMPlaneNormalize(columns.r[3] + columns.r[0])); // left
+    XMStoreFloat4(&planes[1], XMPlaneNormalize(columns.r[3] - columns.r[0])); // right
+    XMStoreFloat4(&planes[2], XMPlaneNormalize(columns.r[3] + columns.r[1])); // bottom
+    XMStoreFloat4(&planes[3], XMPlaneNormalize(columns.r[3] - columns.r[1])); // top
+    XMStoreFloat4(&planes[4], XMPlaneNormalize(columns.r[2]));                // near
+    XMStoreFloat4(&planes[5], XMPlaneNormalize(columns.r[3] - columns.r[2])); // far
+
+    // Start compacting from an empty list.
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCount.Get(),
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST));
+
+    cmdList->CopyBufferRegion(mVisibleCount.Get(), 0, mZero->Resource(), 0, sizeof(UINT));
+
+    D3D12_RESOURCE_BARRIER toUav[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCount.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+        CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCommands.Get(),
+            D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+    };
+    cmdList->ResourceBarrier(_countof(toUav), toUav);
+
+    cmdList->SetComputeRootSignature(mRootSignature.Get());
+    cmdList->SetPipelineState(hiZ != nullptr ? mHiZPSO.Get() : mPSO.Get());
+
+    // The shader points the visible commands at this frame's object constants.
+    UINT objectCBAddress[2] = { (UINT)objectCB, (UINT)(objectCB >> 32) };
+
+    cmdList->SetComputeRoot32BitConstants(0, 24, planes, 0);
+    cmdList->SetComputeRoot32BitConstant(0, mObjectCount, 24);
+    cmdList->SetComputeRoot32BitConstant(0, mLodCount, 25);
+    cmdList->SetComputeRoot32BitConstant(0, mObjectCBByteSize, 27);
+    cmdList->SetComputeRoot32BitConstants(0, 2, objectCBAddress, 48);
+    cmdList->SetComputeRootShaderResourceView(1, mCommands->GetGPUVirtualAddress());
+    cmdList->SetComputeRootShaderResourceView(2, mObjects->GetGPUVirtualAddress());
+    cmdList->SetComputeRootShaderResourceView(3, instanceBuffer);
+    cmdList->SetComputeRootUnorderedAccessView(4, mVisibleCommands->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(5, mVisibleCount->GetGPUVirtualAddress());
+
+    if(hiZ != nullptr)
+    {
+        XMFLOAT4X4 viewProjT;
+        XMStoreFloat4x4(&viewProjT, XMMatrixTranspose(viewProj));
+        float viewportRect[4] = { 0.0f, 0.0f, (float)hiZ->DepthWidth(), (float)hiZ->DepthHeight() };
+        if(viewport != nullptr)
+        {
+            viewportRect[0] = viewport->TopLeftX;
+            viewportRect[1] = viewport->TopLeftY;
+            viewportRect[2] = viewport->Width;
+            viewportRect[3] = viewport->Height;
+        }
+
+        // The matrix starts a new register of cbCull.
+        cmdList->SetComputeRoot32BitConstant(0, hiZ->LevelCount(), 26);
+        cmdList->SetComputeRoot32BitConstants(0, 16, &viewProjT, 28);
+        cmdList->SetComputeRoot32BitConstants(0, 4, viewportRect, 44);
+
+        ID3D12DescriptorHeap* descriptorHeaps[] = { hiZ->DescriptorHeap() };
+        cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+        cmdList->SetComputeRootDescriptorTable(6, hiZ->PyramidSrv());
+    }
+
+    UINT numGroups = (mObjectCount + ThreadGroupSize - 1) / ThreadGroupSize;
+    cmdList->Dispatch(numGroups, 1, 1);
+
+    D3D12_RESOURCE_BARRIER toIndirect[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCount.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+        CD3DX12_RESOURCE_BARRIER::Transition(mVisibleCommands.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+    };
+    cmdList->ResourceBarrier(_countof(toIndirect), toIndirect);
+}
+
+void GpuCuller::Draw(ID3D12GraphicsCommandList* cmdList)
+{
+    // The GPU reads the number of commands from mVisibleCount, up to mObjectCount.
+    cmdList->ExecuteIndirect(mCommandSignature.Get(), mObjectCount,
+        mVisibleCommands.Get(), 0, mVisibleCount.Get(), 0);
+}
+
+void GpuCuller::BuildRootSignature()
+{
+    CD3DX12_ROOT_PARAMETER slotRootParameter[7];
+
+    // Frustum planes, the object count, the LOD count, the Hi-Z parameters and
+    // the frame's object cbuffer.
+    slotRootParameter[0].InitAsConstants(50, 0);
+
+    // Commands, bounds and world matrices in; visible commands and their count out.
+    slotRootParameter[1].InitAsShaderResourceView(0);
+    slotRootParameter[2].InitAsShaderResourceView(1);
+    slotRootParameter[3].InitAsShaderResourceView(2);
+    slotRootParameter[4].InitAsUnorderedAccessView(0);
+    slotRootParameter[5].InitAsUnorderedAccessView(1);
+
+    // The Hi-Z pyramid, only read by the occlusion culling PSO.
+    CD3DX12_DESCRIPTOR_RANGE hiZRange;
+    hiZRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3);
+    slotRootParameter[6].InitAsDescriptorTable(1, &hiZRange);
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(7, slotRootParameter, 0, nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void GpuCuller::BuildPSOs(d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache)
+{
+    const D3D_SHADER_MACRO hiZDefines[] =
+    {
+        { "HIZ_OCCLUSION", "1" },
+        { nullptr, nullptr }
+    };
+
+    auto createPso = [&](const wchar_t* name, const D3D_SHADER_MACRO* defines)
+    {
+        ComPtr<ID3DBlob> cullCS = d3dUtil::LoadShader(L"Shaders\\cull.hlsl", defines, "CullCS", "cs_5_1", shaderSource);
+
+        D3D12_COMPUTE_PIPELINE_STATE_DESC cullPsoDesc = {};
+        cullPsoDesc.pRootSignature = mRootSignature.Get();
+        cullPsoDesc.CS =
+        {
+            reinterpret_cast<BYTE*>(cullCS->GetBufferPointer()),
+            cullCS->GetBufferSize()
+        };
+        cullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+
+        ComPtr<ID3D12PipelineState> pso;
+        if(pipelineCache != nullptr)
+            pso = pipelineCache->CreateComputePipelineState(name, cullPsoDesc);
+        else
+            ThrowIfFailed(md3dDevice->CreateComputePipelineState(&cullPsoDesc, IID_PPV_ARGS(&pso)));
+        return pso;
+    };
+
+    mPSO = createPso(L"gpu_cull", nullptr);
+    mHiZPSO = createPso(L"gpu_cull_hiz", hiZDefines);
+}
+
+void GpuCuller::BuildCommandSignature(ID3D12RootSignature* graphicsRootSig, UINT objectCBRootParameter)
+{
+    // Each command rebinds the object constants and the geometry, then draws.
+    // Slot 1 holds the attribute stream of split vertex formats, and a null view
+    // otherwise.
+    D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[5] = {};
+    argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
+    argumentDescs[0].ConstantBufferView.RootParameterIndex = objectCBRootParameter;
+    argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+    argumentDescs[1].VertexBuffer.Slot = 0;
+    argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+    argumentDescs[2].VertexBuffer.Slot = 1;
+    argumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+    argumentDescs[4].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+    D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
+    commandSignatureDesc.pArgumentDescs = argumentDescs;
+    commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
+    commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+
+    // A root signature is required since the commands change a root argument.
+    ThrowIfFailed(md3dDevice->CreateCommandSignature(&commandSignatureDesc,
+        graphicsRootSig, IID_PPV_ARGS(&mCommandSignature)));
+}
+
+void GpuCuller::BuildResources()
+{
+    mVisibleCommands = CreateBuffer((UINT64)mObjectCount*sizeof(IndirectCommand), D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+
+    mVisibleCount = CreateBuffer(sizeof(UINT), D3D12_HEAP_TYPE_DEFAULT,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+
+    mZero = std::make_unique<UploadBuffer<UINT>>(md3dDevice, 1, false);
+    mZero->CopyData(0, 0);
+}
+
+ComPtr<ID3D12Resource> GpuCuller::CreateBuffer(UINT64 byteSize, D3D12_HEAP_TYPE heapType,
+    D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState)
+{
+    ComPtr<ID3D12Resource> buffer;
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(heapType),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize, flags),
+        initialState,
+        nullptr,
+        IID_PPV_ARGS(&buffer)));
+    return buffer;
+}
@@ -0,0 +1,146 @@
+//***************************************************************************************
+// GpuCuller.h
+//
+// Tests object bounds against the view frustum in a compute shader and compacts the
+// draw commands of the visible objects into an indirect argument buffer, which is
+// then submitted with a single ExecuteIndirect.  Each object has a command per LOD,
+// and the one of the LOD in InstanceData::LodIndex is drawn.  Given a hierarchical-Z
+// pyramid of what has been drawn so far, it also drops the objects hidden behind it.
+// Objects can be replaced, switched off and added between frames without the
+// queue being flushed.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/UploadBuffer.h"
+#include "../../Common/UploadRing.h"
+#include "../../Common/PipelineCache.h"
+#include "HiZBuffer.h"
+
+// Arguments of one indirect draw, in the order the command signature expects them.
+// The culling shader fills in ObjectCBAddress for the frame drawn, so the commands
+// are shared by every frame resource.  Must match IndirectCommand in Shaders/cull.hlsl.
+struct IndirectCommand
+{
+    D3D12_GPU_VIRTUAL_ADDRESS ObjectCBAddress;
+    D3D12_VERTEX_BUFFER_VIEW VertexBufferView;
+    D3D12_VERTEX_BUFFER_VIEW AttributeBufferView;
+    D3D12_INDEX_BUFFER_VIEW IndexBufferView;
+    D3D12_DRAW_INDEXED_ARGUMENTS DrawArgs;
+};
+
+// Local space bounds of an object.  ObjectIndex selects the object's world
+// matrix in the instance buffer and its constants in the object cbuffer, or is
+// GpuCuller::InactiveObject for an object that is never drawn.  Must match
+// CullObject in Shaders/cull.hlsl.
+struct CullObject
+{
+    DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+    UINT ObjectIndex = 0;
+    DirectX::XMFLOAT3 Extents = { 0.0f, 0.0f, 0.0f };
+    float Pad = 0.0f;
+};
+
+class GpuCuller
+{
+public:
+    // Marks a CullObject that is skipped.  Must match Shaders/cull.hlsl.
+    static const UINT InactiveObject = 0xffffffff;
+
+    // objectCBRootParameter is the root CBV of graphicsRootSig that each indirect
+    // command points at the object's constants, which are objectCBByteSize apart.
+    // The culling PSO is created through pipelineCache, which may be null.
+    GpuCuller(ID3D12Device* device, ID3D12RootSignature* graphicsRootSig,
+        UINT objectCBRootParameter, UINT objectCBByteSize, UINT objectCount, UINT lodCount,
+        d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache);
+    GpuCuller(const GpuCuller& rhs) = delete;
+    GpuCuller& operator=(const GpuCuller& rhs) = delete;
+    ~GpuCuller() = default;
+
+    UINT ObjectCount()const;
+    UINT LodCount()const;
+
+    // Uploads the object bounds and the draw commands, LodCount() commands for
+    // each of the ObjectCount() objects.  Objects with fewer LODs repeat their
+    // coarsest command.  The uploaders must stay alive until cmdList has executed.
+    void Upload(ID3D12GraphicsCommandList* cmdList,
+        const std::vector<CullObject>& objects,
+        const std::vector<IndirectCommand>& commands);
+
+    // Grows the buffers to hold at least objectCount objects, copying the current
+    // ones over on the GPU.  The new objects start out inactive.  The old buffers
+    // are released by Retire once the GPU reaches fenceValue.
+    void Reserve(ID3D12GraphicsCommandList* cmdList, UINT objectCount, UINT64 fenceValue);
+
+    // Replaces the bounds and LodCount() commands of each of the objects in
+    // indices.  The frames in flight have culled with the old ones by the time
+    // cmdList executes, so the shared buffers are written in place.
+    void UpdateObjects(ID3D12GraphicsCommandList* cmdList, UploadRing& uploadRing,
+        const std::vector<UINT>& indices, const std::vector<CullObject>& objects,
+        const std::vector<IndirectCommand>& commands);
+
+    // Releases the buffers replaced by Reserve that the GPU is done with.
+    void Retire(UINT64 completedFenceValue);
+
+    // Records the frustum test of every object.  objectCB and instanceBuffer hold
+    // this frame resource's per-object constants and world matrices, indexed by
+    // CullObject::ObjectIndex.  If hiZ is not null, the objects behind its
+    // pyramid, built for viewProj, are culled too, and its descriptor heap is set.
+    // viewport is where viewProj draws on the depth buffer the pyramid was built
+    // from, all of it when null.
+    void Cull(ID3D12GraphicsCommandList* cmdList, D3D12_GPU_VIRTUAL_ADDRESS objectCB,
+        D3D12_GPU_VIRTUAL_ADDRESS instanceBuffer, DirectX::FXMMATRIX viewProj,
+        const HiZBuffer* hiZ = nullptr, const D3D12_VIEWPORT* viewport = nullptr);
+
+    // Records the draws of the objects that survived the last Cull.  The caller
+    // sets the graphics root signature, PSO, pass constants, render targets and
+    // primitive topology beforehand.
+    void Draw(ID3D12GraphicsCommandList* cmdList);
+
+private:
+    void BuildRootSignature();
+    void BuildPSOs(d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache);
+    void BuildCommandSignature(ID3D12RootSignature* graphicsRootSig, UINT objectCBRootParameter);
+    void BuildResources();
+    Microsoft::WRL::ComPtr<ID3D12Resource> CreateBuffer(UINT64 byteSize, D3D12_HEAP_TYPE heapType,
+        D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initialState);
+
+private:
+    struct RetiredBuffer
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        UINT64 FenceValue;
+    };
+
+    // Threads per group of the culling shader.  Must match Shaders/cull.hlsl.
+    static const UINT ThreadGroupSize = 64;
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    UINT mObjectCBByteSize = 0;
+    UINT mObjectCount = 0;
+    UINT mLodCount = 1;
+
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mPSO = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mHiZPSO = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
+
+    // Inputs, written by Upload and changed by UpdateObjects.
+    Microsoft::WRL::ComPtr<ID3D12Resource> mObjects = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mObjectsUploader = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mCommands = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mCommandsUploader = nullptr;
+
+    // Commands of the visible objects and how many there are.  The queue runs the
+    // frames in order, so one copy is shared by all frame resources.
+    Microsoft::WRL::ComPtr<ID3D12Resource> mVisibleCommands = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mVisibleCount = nullptr;
+
+    // Source for resetting mVisibleCount to zero each frame.
+    std::unique_ptr<UploadBuffer<UINT>> mZero = nullptr;
+
+    // Buffers Reserve replaced, kept alive for the frames still reading them.
+    std::vector<RetiredBuffer> mRetiredBuffers;
+};
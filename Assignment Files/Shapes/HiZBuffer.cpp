@@ -0,0 +1,252 @@
+//***************************************************************************************
+// HiZBuffer.cpp
+//***************************************************************************************
+
+#include "HiZBuffer.h"
+
+using Microsoft::WRL::ComPtr;
+
+HiZBuffer::HiZBuffer(ID3D12Device* device, d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache)
+    : md3dDevice(device)
+{
+    mDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    BuildRootSignature();
+    BuildPSOs(shaderSource, pipelineCache);
+    BuildDescriptorHeap();
+}
+
+void HiZBuffer::Resize(ID3D12Resource* depthBuffer, DXGI_FORMAT srvFormat)
+{
+    D3D12_RESOURCE_DESC depthDesc = depthBuffer->GetDesc();
+    mDepthBuffer = depthBuffer;
+    mDepthWidth = (UINT)depthDesc.Width;
+    mDepthHeight = depthDesc.Height;
+    mDepthSampleCount = depthDesc.SampleDesc.Count;
+
+    // Level 0 is half the depth buffer, and the chain goes down to a single texel.
+    UINT width = std::max<UINT>(mDepthWidth / 2, 1u);
+    UINT height = std::max<UINT>(mDepthHeight / 2, 1u);
+    mLevelCount = 1;
+    while((std::max<UINT>(width, height) >> mLevelCount) > 0 && mLevelCount < MaxLevelCount)
+        ++mLevelCount;
+
+    D3D12_RESOURCE_DESC pyramidDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R32_FLOAT,
+        width, height, 1, (UINT16)mLevelCount, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    // Left in the state the culler reads it in between builds.
+    mPyramid = nullptr;
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &pyramidDesc,
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        nullptr,
+        IID_PPV_ARGS(&mPyramid)));
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC depthSrvDesc = {};
+    depthSrvDesc.Format = srvFormat;
+    depthSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    if(mDepthSampleCount > 1)
+    {
+        depthSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DMS;
+    }
+    else
+    {
+        depthSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        depthSrvDesc.Texture2D.MipLevels = 1;
+    }
+    md3dDevice->CreateShaderResourceView(mDepthBuffer, &depthSrvDesc, CpuDescriptor(DepthSrvIndex));
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC pyramidSrvDesc = {};
+    pyramidSrvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+    pyramidSrvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    pyramidSrvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    pyramidSrvDesc.Texture2D.MipLevels = mLevelCount;
+    md3dDevice->CreateShaderResourceView(mPyramid.Get(), &pyramidSrvDesc, CpuDescriptor(PyramidSrvIndex));
+
+    for(UINT level = 0; level < mLevelCount; ++level)
+    {
+        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+        uavDesc.Texture2D.MipSlice = level;
+        md3dDevice->CreateUnorderedAccessView(mPyramid.Get(), nullptr, &uavDesc, CpuDescriptor(LevelUavIndex + level));
+    }
+}
+
+void HiZBuffer::Build(ID3D12GraphicsCommandList* cmdList)
+{
+    D3D12_RESOURCE_BARRIER toBuild[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mDepthBuffer,
+            D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+        CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+    };
+    cmdList->ResourceBarrier(_countof(toBuild), toBuild);
+
+    ID3D12DescriptorHeap* descriptorHeaps[] = { mDescriptorHeap.Get() };
+    cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    cmdList->SetComputeRootSignature(mRootSignature.Get());
+    cmdList->SetComputeRootDescriptorTable(1, GpuDescriptor(DepthSrvIndex));
+
+    UINT srcSize[2] = { mDepthWidth, mDepthHeight };
+    for(UINT level = 0; level < mLevelCount; ++level)
+    {
+        UINT dstSize[2] = { std::max<UINT>(srcSize[0] / 2, 1u), std::max<UINT>(srcSize[1] / 2, 1u) };
+
+        // Level 0 reads the depth buffer, and every other level the one below it
+        // through its UAV, which has to be finished first.
+        if(level == 0)
+        {
+            cmdList->SetPipelineState(mDepthSampleCount > 1 ? mDownsampleMsaaDepthPSO.Get() : mDownsampleDepthPSO.Get());
+            cmdList->SetComputeRootDescriptorTable(3, GpuDescriptor(LevelUavIndex));
+        }
+        else
+        {
+            cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(mPyramid.Get()));
+
+            if(level == 1)
+                cmdList->SetPipelineState(mDownsampleHiZPSO.Get());
+            cmdList->SetComputeRootDescriptorTable(3, GpuDescriptor(LevelUavIndex + level - 1));
+        }
+
+        cmdList->SetComputeRoot32BitConstants(0, 2, srcSize, 0);
+        cmdList->SetComputeRoot32BitConstants(0, 2, dstSize, 2);
+        cmdList->SetComputeRootDescriptorTable(2, GpuDescriptor(LevelUavIndex + level));
+
+        cmdList->Dispatch((dstSize[0] + ThreadGroupSize - 1) / ThreadGroupSize,
+            (dstSize[1] + ThreadGroupSize - 1) / ThreadGroupSize, 1);
+
+        srcSize[0] = dstSize[0];
+        srcSize[1] = dstSize[1];
+    }
+
+    D3D12_RESOURCE_BARRIER toRead[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mDepthBuffer,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE),
+        CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+    };
+    cmdList->ResourceBarrier(_countof(toRead), toRead);
+}
+
+UINT HiZBuffer::DepthWidth()const
+{
+    return mDepthWidth;
+}
+
+UINT HiZBuffer::DepthHeight()const
+{
+    return mDepthHeight;
+}
+
+UINT HiZBuffer::LevelCount()const
+{
+    return mLevelCount;
+}
+
+ID3D12DescriptorHeap* HiZBuffer::DescriptorHeap()const
+{
+    return mDescriptorHeap.Get();
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE HiZBuffer::PyramidSrv()const
+{
+    return GpuDescriptor(PyramidSrvIndex);
+}
+
+void HiZBuffer::BuildRootSignature()
+{
+    CD3DX12_DESCRIPTOR_RANGE depthRange;
+    depthRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+    CD3DX12_DESCRIPTOR_RANGE dstRange;
+    dstRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
+    CD3DX12_DESCRIPTOR_RANGE srcRange;
+    srcRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
+
+    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+
+    // Source and destination sizes.
+    slotRootParameter[0].InitAsConstants(4, 0);
+
+    // The depth buffer, the level written and the level below it.
+    slotRootParameter[1].InitAsDescriptorTable(1, &depthRange);
+    slotRootParameter[2].InitAsDescriptorTable(1, &dstRange);
+    slotRootParameter[3].InitAsDescriptorTable(1, &srcRange);
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter, 0, nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void HiZBuffer::BuildPSOs(d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache)
+{
+    const D3D_SHADER_MACRO msaaDefines[] =
+    {
+        { "MULTISAMPLED_DEPTH", "1" },
+        { nullptr, nullptr }
+    };
+
+    auto createPso = [&](const wchar_t* name, const D3D_SHADER_MACRO* defines, const char* entrypoint)
+    {
+        ComPtr<ID3DBlob> cs = d3dUtil::LoadShader(L"Shaders\\hiz.hlsl", defines, entrypoint, "cs_5_1", shaderSource);
+
+        D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+        psoDesc.pRootSignature = mRootSignature.Get();
+        psoDesc.CS =
+        {
+            reinterpret_cast<BYTE*>(cs->GetBufferPointer()),
+            cs->GetBufferSize()
+        };
+        psoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+
+        ComPtr<ID3D12PipelineState> pso;
+        if(pipelineCache != nullptr)
+            pso = pipelineCache->CreateComputePipelineState(name, psoDesc);
+        else
+            ThrowIfFailed(md3dDevice->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&pso)));
+        return pso;
+    };
+
+    mDownsampleDepthPSO = createPso(L"hiz_depth", nullptr, "DownsampleDepthCS");
+    mDownsampleMsaaDepthPSO = createPso(L"hiz_depth_msaa", msaaDefines, "DownsampleDepthCS");
+    mDownsampleHiZPSO = createPso(L"hiz_level", nullptr, "DownsampleHiZCS");
+}
+
+void HiZBuffer::BuildDescriptorHeap()
+{
+    D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+    heapDesc.NumDescriptors = LevelUavIndex + MaxLevelCount;
+    heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&mDescriptorHeap)));
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE HiZBuffer::CpuDescriptor(UINT index)const
+{
+    return CD3DX12_CPU_DESCRIPTOR_HANDLE(mDescriptorHeap->GetCPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE HiZBuffer::GpuDescriptor(UINT index)const
+{
+    return CD3DX12_GPU_DESCRIPTOR_HANDLE(mDescriptorHeap->GetGPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
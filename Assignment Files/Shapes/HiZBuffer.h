@@ -0,0 +1,83 @@
+//***************************************************************************************
+// HiZBuffer.h
+//
+// Hierarchical-Z pyramid of a depth buffer: a chain of levels, each half the size
+// of the one below, whose texels hold the farthest depth of the pixels they cover.
+// Built on the GPU from whatever has been drawn into the depth buffer, so the GPU
+// culler can drop objects that lie behind it.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/PipelineCache.h"
+
+class HiZBuffer
+{
+public:
+    // The build PSOs are created through pipelineCache, which may be null.
+    HiZBuffer(ID3D12Device* device, d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache);
+    HiZBuffer(const HiZBuffer& rhs) = delete;
+    HiZBuffer& operator=(const HiZBuffer& rhs) = delete;
+    ~HiZBuffer() = default;
+
+    // Recreates the pyramid for depthBuffer, a typeless resource whose depth bits
+    // srvFormat views.  Any multisample count is accepted.  The GPU must be done
+    // with the old pyramid.
+    void Resize(ID3D12Resource* depthBuffer, DXGI_FORMAT srvFormat);
+
+    // Records the build of the pyramid from the depth buffer, which is in the
+    // DEPTH_WRITE state before and after.  Sets the compute root signature and
+    // PSO, and the descriptor heap that PyramidSrv is in.
+    void Build(ID3D12GraphicsCommandList* cmdList);
+
+    // Size of the depth buffer the pyramid is built from.
+    UINT DepthWidth()const;
+    UINT DepthHeight()const;
+
+    UINT LevelCount()const;
+
+    // Shader visible heap of the pyramid's views, and the view of all its levels
+    // that shaders run after Build read.
+    ID3D12DescriptorHeap* DescriptorHeap()const;
+    D3D12_GPU_DESCRIPTOR_HANDLE PyramidSrv()const;
+
+private:
+    void BuildRootSignature();
+    void BuildPSOs(d3dUtil::ShaderSource shaderSource, PipelineCache* pipelineCache);
+    void BuildDescriptorHeap();
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE CpuDescriptor(UINT index)const;
+    CD3DX12_GPU_DESCRIPTOR_HANDLE GpuDescriptor(UINT index)const;
+
+private:
+    // Threads per group a side of the build shaders.  Must match Shaders/hiz.hlsl.
+    static const UINT ThreadGroupSize = 8;
+
+    // Enough levels for the largest texture, 16384 texels a side.
+    static const UINT MaxLevelCount = 15;
+
+    // Descriptor heap layout: the depth buffer's SRV, the pyramid's SRV, then a
+    // UAV of each level.
+    static const UINT DepthSrvIndex = 0;
+    static const UINT PyramidSrvIndex = 1;
+    static const UINT LevelUavIndex = 2;
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mDownsampleDepthPSO = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mDownsampleMsaaDepthPSO = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mDownsampleHiZPSO = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mDescriptorHeap = nullptr;
+    UINT mDescriptorSize = 0;
+
+    ID3D12Resource* mDepthBuffer = nullptr;
+    UINT mDepthWidth = 0;
+    UINT mDepthHeight = 0;
+    UINT mDepthSampleCount = 1;
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> mPyramid = nullptr;
+    UINT mLevelCount = 0;
+};
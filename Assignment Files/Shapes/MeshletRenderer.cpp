@@ -0,0 +1,298 @@
+//***************************************************************************************
+// MeshletRenderer.cpp
+//***************************************************************************************
+
+#include "MeshletRenderer.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+// Mesh shaders came with the Windows 10 SDK 10.0.19041.  Older SDKs build a
+// renderer that is never supported.
+#if defined(NTDDI_WIN10_VB)
+#define MESH_SHADERS_IN_SDK 1
+#else
+#define MESH_SHADERS_IN_SDK 0
+#endif
+
+namespace
+{
+    const wchar_t* const MeshletShaderFile = L"Shaders\\meshlet.hlsl";
+    const char* const MeshletShaderEntryPoints[] = { "MeshletAS", "MeshletMS", "PS" };
+
+    // Per-frame constants of cbMeshletFrame in Shaders/meshlet.hlsl.
+    struct FrameConstants
+    {
+        XMFLOAT4 FrustumPlanes[6];
+        UINT PositionFormat;
+        UINT ColorFormat;
+        UINT PositionStride;
+        UINT ColorStride;
+        UINT ColorOffset;
+    };
+
+    // Per-draw constants of cbMeshletDraw in Shaders/meshlet.hlsl.
+    struct DrawConstants
+    {
+        UINT FirstInstance;
+        UINT MeshletOffset;
+        UINT MeshletCount;
+        INT BaseVertex;
+    };
+
+    // The key without its program, which every PSO here shares.
+    PsoKey StateKey(const PsoKey& key)
+    {
+        PsoKey stateKey = key;
+        stateKey.Program = PsoManager::ProgramHandle();
+        return stateKey;
+    }
+
+#if MESH_SHADERS_IN_SDK
+    // A pipeline state stream subobject, laid out as the runtime parses them.
+    template<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE Type, typename T>
+    struct alignas(void*) StreamSubobject
+    {
+        D3D12_PIPELINE_STATE_SUBOBJECT_TYPE SubobjectType = Type;
+        T Desc;
+    };
+
+    struct MeshletPsoStream
+    {
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE, ID3D12RootSignature*> RootSignature;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_AS, D3D12_SHADER_BYTECODE> AS;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_MS, D3D12_SHADER_BYTECODE> MS;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS, D3D12_SHADER_BYTECODE> PS;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_BLEND, D3D12_BLEND_DESC> BlendState;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_MASK, UINT> SampleMask;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER, D3D12_RASTERIZER_DESC> RasterizerState;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL, D3D12_DEPTH_STENCIL_DESC> DepthStencilState;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS, D3D12_RT_FORMAT_ARRAY> RtvFormats;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT, DXGI_FORMAT> DsvFormat;
+        StreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_DESC, DXGI_SAMPLE_DESC> SampleDesc;
+    };
+#endif
+
+    inline D3D12_SHADER_BYTECODE Bytecode(ID3DBlob* blob)
+    {
+        return { reinterpret_cast<BYTE*>(blob->GetBufferPointer()), blob->GetBufferSize() };
+    }
+}
+
+bool MeshletRenderer::IsSupported(ID3D12Device* device)
+{
+#if MESH_SHADERS_IN_SDK
+    // Runtimes that predate shader model 6.5 reject the query outright.
+    D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { D3D_SHADER_MODEL_6_5 };
+    if(FAILED(device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel))) ||
+       shaderModel.HighestShaderModel < D3D_SHADER_MODEL_6_5)
+    {
+        return false;
+    }
+
+    D3D12_FEATURE_DATA_D3D12_OPTIONS7 options7 = {};
+    if(FAILED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS7, &options7, sizeof(options7))) ||
+       options7.MeshShaderTier == D3D12_MESH_SHADER_TIER_NOT_SUPPORTED)
+    {
+        return false;
+    }
+
+    // The shaders are only built where dxc was found, and can not be compiled at
+    // run time like the fxc ones.
+    for(const char* entryPoint : MeshletShaderEntryPoints)
+    {
+        std::wstring binaryName = d3dUtil::ShaderBinaryName(MeshletShaderFile, nullptr, entryPoint);
+        if(GetFileAttributesW(binaryName.c_str()) == INVALID_FILE_ATTRIBUTES)
+            return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+MeshletRenderer::MeshletRenderer(ID3D12Device* device, const VertexFormat& vertexFormat)
+    : md3dDevice(device)
+{
+    // The colors follow the positions in the same stream, unless they are split out.
+    mPositionFormat = (UINT)vertexFormat.Position;
+    mColorFormat = (UINT)vertexFormat.Color;
+    mPositionStride = vertexFormat.PositionStreamStride();
+    mSplitPositions = vertexFormat.SplitPositions;
+    mColorStride = mSplitPositions ? vertexFormat.AttributeStreamStride() : mPositionStride;
+    mColorOffset = mSplitPositions ? 0 : vertexFormat.PositionByteSize();
+
+    BuildRootSignature();
+    LoadShaders();
+}
+
+void MeshletRenderer::BuildPso(const PsoKey& key)
+{
+    PsoKey stateKey = StateKey(key);
+    if(mPSOs.count(stateKey) != 0)
+        return;
+
+#if MESH_SHADERS_IN_SDK
+    MeshletPsoStream stream;
+    stream.RootSignature.Desc = mRootSignature.Get();
+    stream.AS.Desc = Bytecode(mAS.Get());
+    stream.MS.Desc = Bytecode(mMS.Get());
+    stream.PS.Desc = Bytecode(mPS.Get());
+    stream.BlendState.Desc = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    stream.SampleMask.Desc = UINT_MAX;
+    stream.RasterizerState.Desc = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    stream.RasterizerState.Desc.FillMode = key.FillMode;
+    stream.RasterizerState.Desc.CullMode = key.CullMode;
+    stream.DepthStencilState.Desc = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    stream.DepthStencilState.Desc.DepthFunc = key.DepthFunc;
+    stream.RtvFormats.Desc = {};
+    stream.RtvFormats.Desc.NumRenderTargets = key.RtvFormat == DXGI_FORMAT_UNKNOWN ? 0 : 1;
+    stream.RtvFormats.Desc.RTFormats[0] = key.RtvFormat;
+    stream.DsvFormat.Desc = key.DsvFormat;
+    stream.SampleDesc.Desc = { key.SampleCount, key.SampleQuality };
+
+    D3D12_PIPELINE_STATE_STREAM_DESC streamDesc = { sizeof(stream), &stream };
+
+    ComPtr<ID3D12Device2> device2;
+    ThrowIfFailed(md3dDevice->QueryInterface(IID_PPV_ARGS(&device2)));
+
+    ComPtr<ID3D12PipelineState> pso;
+    ThrowIfFailed(device2->CreatePipelineState(&streamDesc, IID_PPV_ARGS(&pso)));
+    mPSOs[stateKey] = pso;
+#else
+    throw DxException(E_NOTIMPL, L"MeshletRenderer::BuildPso", AnsiToWString(__FILE__), __LINE__);
+#endif
+}
+
+ID3D12PipelineState* MeshletRenderer::GetPso(const PsoKey& key)const
+{
+    auto it = mPSOs.find(StateKey(key));
+    return it != mPSOs.end() ? it->second.Get() : nullptr;
+}
+
+void MeshletRenderer::Draw(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso,
+    D3D12_GPU_VIRTUAL_ADDRESS passCB, D3D12_GPU_VIRTUAL_ADDRESS instanceBuffer,
+    FXMMATRIX viewProj, const MeshletDraw* draws, size_t drawCount)
+{
+#if MESH_SHADERS_IN_SDK
+    ComPtr<ID3D12GraphicsCommandList6> meshCmdList;
+    ThrowIfFailed(cmdList->QueryInterface(IID_PPV_ARGS(&meshCmdList)));
+
+    // The frustum planes are the sums and differences of the view-projection
+    // matrix's columns, as for the GPU culler.
+    XMMATRIX columns = XMMatrixTranspose(viewProj);
+
+    FrameConstants frame;
+    XMStoreFloat4(&frame.FrustumPlanes[0], XMPlaneNormalize(columns.r[3] + columns.r[0])); // left
+    XMStoreFloat4(&frame.FrustumPlanes[1], XMPlaneNormalize(columns.r[3] - columns.r[0])); // right
+    XMStoreFloat4(&frame.FrustumPlanes[2], XMPlaneNormalize(columns.r[3] + columns.r[1])); // bottom
+    XMStoreFloat4(&frame.FrustumPlanes[3], XMPlaneNormalize(columns.r[3] - columns.r[1])); // top
+    XMStoreFloat4(&frame.FrustumPlanes[4], XMPlaneNormalize(columns.r[2]));                // near
+    XMStoreFloat4(&frame.FrustumPlanes[5], XMPlaneNormalize(columns.r[3] - columns.r[2])); // far
+    frame.PositionFormat = mPositionFormat;
+    frame.ColorFormat = mColorFormat;
+    frame.PositionStride = mPositionStride;
+    frame.ColorStride = mColorStride;
+    frame.ColorOffset = mColorOffset;
+
+    cmdList->SetPipelineState(pso);
+    cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+    cmdList->SetGraphicsRoot32BitConstants(0, sizeof(FrameConstants) / 4, &frame, 0);
+    cmdList->SetGraphicsRootConstantBufferView(2, passCB);
+    cmdList->SetGraphicsRootShaderResourceView(3, instanceBuffer);
+
+    const MeshGeometry* boundGeo = nullptr;
+    for(size_t i = 0; i < drawCount; ++i)
+    {
+        const MeshletDraw& draw = draws[i];
+        if(draw.MeshletCount == 0)
+            continue;
+
+        if(draw.Geo != boundGeo)
+        {
+            D3D12_GPU_VIRTUAL_ADDRESS meshlets = draw.Geo->MeshletBufferGPU->GetGPUVirtualAddress() + draw.Geo->MeshletBufferOffset;
+            D3D12_GPU_VIRTUAL_ADDRESS positions = draw.Geo->VertexBufferGPU->GetGPUVirtualAddress() + draw.Geo->VertexBufferOffset;
+            D3D12_GPU_VIRTUAL_ADDRESS colors = mSplitPositions ?
+                draw.Geo->AttributeBufferGPU->GetGPUVirtualAddress() + draw.Geo->AttributeBufferOffset : positions;
+
+            cmdList->SetGraphicsRootShaderResourceView(4, meshlets);
+            cmdList->SetGraphicsRootShaderResourceView(5, meshlets + draw.Geo->MeshletCullDataOffset);
+            cmdList->SetGraphicsRootShaderResourceView(6, meshlets + draw.Geo->MeshletVertexIndexOffset);
+            cmdList->SetGraphicsRootShaderResourceView(7, meshlets + draw.Geo->MeshletPrimitiveOffset);
+            cmdList->SetGraphicsRootShaderResourceView(8, positions);
+            cmdList->SetGraphicsRootShaderResourceView(9, colors);
+            boundGeo = draw.Geo;
+        }
+
+        // A group along X per ThreadGroupSize meshlets, and one along Y per
+        // instance.  Draws past the per-dimension or total group limits are split
+        // over several dispatches, each starting at a meshlet and an instance of
+        // its own.
+        const UINT maxMeshlets = MaxDispatchGroups*ThreadGroupSize;
+        for(UINT firstMeshlet = 0; firstMeshlet < draw.MeshletCount; firstMeshlet += maxMeshlets)
+        {
+            UINT meshletCount = std::min<UINT>(draw.MeshletCount - firstMeshlet, maxMeshlets);
+            UINT groupCountX = (meshletCount + ThreadGroupSize - 1) / ThreadGroupSize;
+            UINT maxInstances = std::min<UINT>(MaxDispatchGroups, MaxDispatchGroupTotal / groupCountX);
+
+            for(UINT first = 0; first < draw.InstanceCount; first += maxInstances)
+            {
+                DrawConstants constants = { draw.StartInstanceLocation + first,
+                    draw.MeshletOffset + firstMeshlet, meshletCount, draw.BaseVertexLocation };
+                cmdList->SetGraphicsRoot32BitConstants(1, sizeof(DrawConstants) / 4, &constants, 0);
+
+                UINT instanceCount = std::min<UINT>(draw.InstanceCount - first, maxInstances);
+                meshCmdList->DispatchMesh(groupCountX, instanceCount, 1);
+            }
+        }
+    }
+#else
+    throw DxException(E_NOTIMPL, L"MeshletRenderer::Draw", AnsiToWString(__FILE__), __LINE__);
+#endif
+}
+
+void MeshletRenderer::BuildRootSignature()
+{
+    CD3DX12_ROOT_PARAMETER slotRootParameter[10];
+
+    // The frustum and vertex format of the frame, then the instances and
+    // meshlets of the draw.
+    slotRootParameter[0].InitAsConstants(sizeof(FrameConstants) / 4, 3);
+    slotRootParameter[1].InitAsConstants(sizeof(DrawConstants) / 4, 4);
+
+    // The pass constants and instance buffer color.hlsl declares.
+    slotRootParameter[2].InitAsConstantBufferView(1);
+    slotRootParameter[3].InitAsShaderResourceView(0, 1);
+
+    // The geometry's meshlet arrays and its raw vertex streams.
+    for(UINT i = 0; i < 6; ++i)
+        slotRootParameter[4 + i].InitAsShaderResourceView(i);
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(_countof(slotRootParameter), slotRootParameter, 0, nullptr,
+        D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void MeshletRenderer::LoadShaders()
+{
+    mAS = d3dUtil::LoadBinary(d3dUtil::ShaderBinaryName(MeshletShaderFile, nullptr, MeshletShaderEntryPoints[0]));
+    mMS = d3dUtil::LoadBinary(d3dUtil::ShaderBinaryName(MeshletShaderFile, nullptr, MeshletShaderEntryPoints[1]));
+    mPS = d3dUtil::LoadBinary(d3dUtil::ShaderBinaryName(MeshletShaderFile, nullptr, MeshletShaderEntryPoints[2]));
+}
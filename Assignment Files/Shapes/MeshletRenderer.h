@@ -0,0 +1,93 @@
+//***************************************************************************************
+// MeshletRenderer.h
+//
+// Draws instanced runs of submeshes from their meshlets with an amplification and a
+// mesh shader in place of the input assembler and vertex shader.  The amplification
+// shader tests every meshlet of every instance against the view frustum, and its
+// normal cone against the eye, and only launches mesh shader groups for the
+// survivors.  Building it takes the Windows 10 SDK 10.0.19041 or later, and running
+// it a device with mesh shader support and the shaders CompileShaders.bat builds
+// with dxc.  IsSupported tells whether all of that is there.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/PsoManager.h"
+#include "../../Common/VertexFormat.h"
+#include <unordered_map>
+
+// An instanced draw of a submesh's meshlets.  The instances are consecutive in
+// the instance buffer, as for an instanced DrawIndexedInstanced.
+struct MeshletDraw
+{
+    const MeshGeometry* Geo = nullptr;
+    UINT MeshletOffset = 0;
+    UINT MeshletCount = 0;
+    INT BaseVertexLocation = 0;
+    UINT InstanceCount = 0;
+    UINT StartInstanceLocation = 0;
+};
+
+class MeshletRenderer
+{
+public:
+    // Whether this build, the device and its driver can draw with mesh shaders, and
+    // their precompiled shaders are there.
+    static bool IsSupported(ID3D12Device* device);
+
+    // Geometry drawn must be packed in vertexFormat.  Only to be created when
+    // IsSupported.
+    MeshletRenderer(ID3D12Device* device, const VertexFormat& vertexFormat);
+    MeshletRenderer(const MeshletRenderer& rhs) = delete;
+    MeshletRenderer& operator=(const MeshletRenderer& rhs) = delete;
+    ~MeshletRenderer() = default;
+
+    // Creates the PSO of key's fill, cull and depth state, formats and
+    // multisampling; its program is not used.  Unlike the PSO manager's, these
+    // compile on the calling thread, and are not kept in the pipeline cache,
+    // which only stores PSOs it is given descriptions of.
+    void BuildPso(const PsoKey& key);
+
+    // The PSO BuildPso created for key, or nullptr.  Safe to call from any thread
+    // once the PSOs are built.
+    ID3D12PipelineState* GetPso(const PsoKey& key)const;
+
+    // Records the draws.  Sets the PSO, root signature and root arguments; the
+    // caller sets the render targets, viewport and scissor rectangle.  The
+    // instance buffer holds InstanceData, and the frustum of viewProj is the one
+    // meshlets are culled against.
+    void Draw(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso,
+        D3D12_GPU_VIRTUAL_ADDRESS passCB, D3D12_GPU_VIRTUAL_ADDRESS instanceBuffer,
+        DirectX::FXMMATRIX viewProj, const MeshletDraw* draws, size_t drawCount);
+
+private:
+    void BuildRootSignature();
+    void LoadShaders();
+
+private:
+    // Meshlets tested by an amplification shader group.  Must match
+    // Shaders/meshlet.hlsl.
+    static const UINT ThreadGroupSize = 32;
+
+    // Most groups a dispatch may have along any one dimension, and in all.
+    static const UINT MaxDispatchGroups = 65535;
+    static const UINT MaxDispatchGroupTotal = 1 << 22;
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    // How the mesh shader decodes the vertices, see cbMeshletFrame.
+    UINT mPositionFormat = 0;
+    UINT mColorFormat = 0;
+    UINT mPositionStride = 0;
+    UINT mColorStride = 0;
+    UINT mColorOffset = 0;
+    bool mSplitPositions = false;
+
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+    Microsoft::WRL::ComPtr<ID3DBlob> mAS = nullptr;
+    Microsoft::WRL::ComPtr<ID3DBlob> mMS = nullptr;
+    Microsoft::WRL::ComPtr<ID3DBlob> mPS = nullptr;
+
+    std::unordered_map<PsoKey, Microsoft::WRL::ComPtr<ID3D12PipelineState>, PsoKeyHash> mPSOs;
+};
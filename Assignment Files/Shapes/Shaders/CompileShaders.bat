@@ -0,0 +1,73 @@
+@echo off
+rem ***************************************************************************************
+rem CompileShaders.bat
+rem
+rem Compiles every shader entry point and permutation the app loads into
+rem Shaders\Compiled, named the way d3dUtil::ShaderBinaryName expects.  Run as a
+rem pre-build step of Shapes.vcxproj.
+rem
+rem The mesh shaders need shader model 6.5, which only dxc compiles.  The Windows
+rem 10 SDK ships dxc.exe next to fxc.exe from 10.0.19041 on; without it they are
+rem skipped, and the app draws with its vertex shaders.
+rem
+rem Usage: CompileShaders.bat <path to fxc.exe> [Debug|Release]
+rem ***************************************************************************************
+
+setlocal
+
+set FXC=%~1
+if "%FXC%"=="" set FXC=fxc.exe
+
+set FLAGS=/nologo /O3
+if /I "%~2"=="Debug" set FLAGS=/nologo /Zi /Od
+
+set DXC=%~dp1dxc.exe
+set DXCFLAGS=-O3
+if /I "%~2"=="Debug" set DXCFLAGS=-Zi -Od -Qembed_debug
+
+set SRC=%~dp0
+set OUT=%~dp0Compiled
+if not exist "%OUT%" mkdir "%OUT%"
+
+call :compile color VS vs_5_1 || exit /b 1
+call :compile color VS vs_5_1 PACKED_POSITIONS || exit /b 1
+call :compile color InstancedVS vs_5_1 || exit /b 1
+call :compile color InstancedVS vs_5_1 PACKED_POSITIONS || exit /b 1
+call :compile color InstancedDepthVS vs_5_1 || exit /b 1
+call :compile color InstancedDepthVS vs_5_1 PACKED_POSITIONS || exit /b 1
+call :compile color InstancedMultiViewVS vs_5_1 || exit /b 1
+call :compile color InstancedMultiViewVS vs_5_1 PACKED_POSITIONS || exit /b 1
+call :compile color PS ps_5_1 || exit /b 1
+call :compile color PS ps_5_1 PACKED_POSITIONS || exit /b 1
+call :compile cull CullCS cs_5_1 || exit /b 1
+call :compile cull CullCS cs_5_1 HIZ_OCCLUSION || exit /b 1
+call :compile hiz DownsampleDepthCS cs_5_1 || exit /b 1
+call :compile hiz DownsampleDepthCS cs_5_1 MULTISAMPLED_DEPTH || exit /b 1
+call :compile hiz DownsampleHiZCS cs_5_1 || exit /b 1
+call :compile upscale UpscaleVS vs_5_1 || exit /b 1
+call :compile upscale UpscalePS ps_5_1 || exit /b 1
+
+if not exist "%DXC%" exit /b 0
+call :compiledxc meshlet MeshletAS as_6_5 || exit /b 1
+call :compiledxc meshlet MeshletMS ms_6_5 || exit /b 1
+call :compiledxc meshlet PS ps_6_5 || exit /b 1
+
+exit /b 0
+
+rem :compile <file> <entry point> <target> [define]
+:compile
+setlocal
+set NAME=%1_%2
+set DEFINES=
+if "%~4"=="" goto build
+set NAME=%NAME%_%4
+set DEFINES=/D %4=1
+
+:build
+"%FXC%" %FLAGS% /T %3 /E %2 %DEFINES% /Fo "%OUT%\%NAME%.cso" "%SRC%%1.hlsl" >nul
+endlocal & exit /b %ERRORLEVEL%
+
+rem :compiledxc <file> <entry point> <target>
+:compiledxc
+"%DXC%" %DXCFLAGS% -T %3 -E %2 -Fo "%OUT%\%1_%2.cso" "%SRC%%1.hlsl" >nul
+exit /b %ERRORLEVEL%
@@ -1,12 +1,19 @@
 //***************************************************************************************
 // color.hlsl by Frank Luna (C) 2015 All Rights Reserved.
 //
-// Transforms and colors geometry.
+// Transforms and colors geometry.  InstancedDepthVS draws the occluders of the
+// depth pre-pass from the position stream alone, and InstancedMultiViewVS draws
+// every view in a single pass.  meshlet.hlsl includes this file for its
+// constants, instance data and PS.
 //***************************************************************************************
  
 cbuffer cbPerObject : register(b0)
 {
 	float4x4 gWorld; 
+	float3 gPositionScale;
+	float cbPerObjectPad0;
+	float3 gPositionBias;
+	float cbPerObjectPad2;
 };
 
 cbuffer cbPass : register(b1)
@@ -27,6 +34,34 @@ cbuffer cbPass : register(b1)
     float gDeltaTime;
 };
 
+struct InstanceData
+{
+	float4x4 World;
+	float3 PositionScale;
+	uint LodIndex;
+	float3 PositionBias;
+	uint ViewMask;
+};
+
+// Per-instance world matrices for instanced batches.  gBaseInstance is the
+// index of the batch's first instance, since SV_InstanceID always starts at 0.
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+
+cbuffer cbInstanceBatch : register(b2)
+{
+	uint gBaseInstance;
+};
+
+// Must match MaxViewCount in FrameResource.h.
+#define MAX_VIEWS 3
+
+// The views drawn in a single pass.  Past the registers meshlet.hlsl uses.
+cbuffer cbMultiView : register(b5)
+{
+	float4x4 gMultiViewProj[MAX_VIEWS];
+	uint gViewCount;
+};
+
 struct VertexIn
 {
 	float3 PosL  : POSITION;
@@ -39,13 +74,26 @@ struct VertexOut
     float4 Color : COLOR;
 };
 
+// Packed vertex formats store positions relative to the submesh bounds, see
+// VertexFormat.h.  The input assembler has already converted them to floats.
+float3 UnpackPosition(float3 posL, float3 scale, float3 bias)
+{
+#ifdef PACKED_POSITIONS
+	return posL*scale + bias;
+#else
+	return posL;
+#endif
+}
+
 VertexOut VS(VertexIn vin)
 {
 	VertexOut vout;
 	
 	// Transform to homogeneous clip space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
-    vout.PosH = mul(posW, gViewProj);
+    float3 posL = UnpackPosition(vin.PosL, gPositionScale, gPositionBias);
+    float4 posW = mul(float4(posL, 1.0f), gWorld);
+    precise float4 posH = mul(posW, gViewProj);
+    vout.PosH = posH;
 	
 	// Just pass vertex color into the pixel shader.
     vout.Color = vin.Color;
@@ -53,6 +101,72 @@ VertexOut VS(VertexIn vin)
     return vout;
 }
 
+VertexOut InstancedVS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout;
+
+	// Fetch the world matrix of this instance.
+	InstanceData instance = gInstanceData[gBaseInstance + instanceID];
+
+	// Transform to homogeneous clip space.
+	float3 posL = UnpackPosition(vin.PosL, instance.PositionScale, instance.PositionBias);
+	float4 posW = mul(float4(posL, 1.0f), instance.World);
+	precise float4 posH = mul(posW, gViewProj);
+	vout.PosH = posH;
+
+	// Just pass vertex color into the pixel shader.
+	vout.Color = vin.Color;
+
+	return vout;
+}
+
+struct MultiViewVertexOut
+{
+	float4 PosH     : SV_POSITION;
+	float4 Color    : COLOR;
+	uint   Viewport : SV_ViewportArrayIndex;
+};
+
+// Draws every object once for each view, the instances of an object's views
+// next to each other, and sends each into its view's viewport.
+MultiViewVertexOut InstancedMultiViewVS(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	MultiViewVertexOut vout;
+
+	uint view = instanceID % gViewCount;
+	InstanceData instance = gInstanceData[gBaseInstance + instanceID / gViewCount];
+
+	// The transform matches InstancedVS, so the main view's depths match the
+	// pre-pass's.
+	float3 posL = UnpackPosition(vin.PosL, instance.PositionScale, instance.PositionBias);
+	float4 posW = mul(float4(posL, 1.0f), instance.World);
+	precise float4 posH = mul(posW, gMultiViewProj[view]);
+
+	// An object drawn for a view it is not in is moved behind the near plane,
+	// where the clipper drops its triangles before they are rasterized.
+	if(((instance.ViewMask >> view) & 1) == 0)
+		posH = float4(0.0f, 0.0f, -1.0f, 1.0f);
+
+	vout.PosH = posH;
+	vout.Color = vin.Color;
+	vout.Viewport = view;
+
+	return vout;
+}
+
+// The depth pre-pass lays down the same depths the opaque pass draws at, so the
+// transform must match InstancedVS and VS exactly.  precise keeps the compiler
+// from fusing or reordering the math differently in each.
+float4 InstancedDepthVS(float3 posL : POSITION, uint instanceID : SV_InstanceID) : SV_POSITION
+{
+	InstanceData instance = gInstanceData[gBaseInstance + instanceID];
+
+	posL = UnpackPosition(posL, instance.PositionScale, instance.PositionBias);
+	float4 posW = mul(float4(posL, 1.0f), instance.World);
+	precise float4 posH = mul(posW, gViewProj);
+	return posH;
+}
+
 float4 PS(VertexOut pin) : SV_Target
 {
     return pin.Color;
@@ -0,0 +1,192 @@
+//***************************************************************************************
+// cull.hlsl
+//
+// Tests the bounds of every object against the view frustum and appends the draw
+// commands of the visible ones, at the LOD the CPU selected for them, to an
+// indirect argument buffer.  With HIZ_OCCLUSION defined, objects whose bounds lie
+// behind the farthest depth of the hierarchical-Z pyramid over them are dropped too.
+//***************************************************************************************
+
+#define THREAD_GROUP_SIZE 64
+
+// Mirrors IndirectCommand in GpuCuller.h.  The commands are copied, never
+// interpreted, so the GPU addresses are kept as pairs of uints.  Only the object
+// cbuffer address is written, for the frame being drawn.
+struct IndirectCommand
+{
+	uint2 ObjectCBAddress;
+	uint2 VertexBufferAddress;
+	uint  VertexBufferSize;
+	uint  VertexBufferStride;
+	uint2 AttributeBufferAddress;
+	uint  AttributeBufferSize;
+	uint  AttributeBufferStride;
+	uint2 IndexBufferAddress;
+	uint  IndexBufferSize;
+	uint  IndexBufferFormat;
+	uint  IndexCountPerInstance;
+	uint  InstanceCount;
+	uint  StartIndexLocation;
+	int   BaseVertexLocation;
+	uint  StartInstanceLocation;
+	uint  Pad;
+};
+
+// Mirrors GpuCuller::InactiveObject.
+#define INACTIVE_OBJECT 0xffffffff
+
+// Mirrors CullObject in GpuCuller.h.
+struct CullObject
+{
+	float3 Center;
+	uint   ObjectIndex;
+	float3 Extents;
+	float  Pad;
+};
+
+// Mirrors InstanceData in FrameResource.h.
+struct InstanceData
+{
+	float4x4 World;
+	float3 PositionScale;
+	uint LodIndex;
+	float3 PositionBias;
+	uint ViewMask;
+};
+
+cbuffer cbCull : register(b0)
+{
+	// Normalized planes whose normals point into the frustum.
+	float4 gFrustumPlanes[6];
+	uint gObjectCount;
+
+	// Commands per object, one for each LOD.
+	uint gLodCount;
+
+	// Levels of gHiZ.
+	uint gHiZLevelCount;
+
+	// Distance between the objects' constants in the frame's object cbuffer.
+	uint gObjectCBByteSize;
+
+	// The view-projection tested against gHiZ, and the pixels of the depth buffer
+	// it draws to.
+	float4x4 gViewProj;
+	float2 gViewportOrigin;
+	float2 gViewportSize;
+
+	// Where the frame's object cbuffer starts.
+	uint2 gObjectCBAddress;
+};
+
+StructuredBuffer<IndirectCommand> gCommands  : register(t0);
+StructuredBuffer<CullObject> gObjects        : register(t1);
+StructuredBuffer<InstanceData> gInstanceData : register(t2);
+
+RWStructuredBuffer<IndirectCommand> gVisibleCommands : register(u0);
+RWByteAddressBuffer gVisibleCount                    : register(u1);
+
+#ifdef HIZ_OCCLUSION
+Texture2D<float> gHiZ : register(t3);
+
+// Whether the world space box is hidden behind the depths of the pyramid.  The
+// box's nearest depth is tested against the farthest depth over its screen
+// rectangle, read from the level where the rectangle spans at most 2x2 texels.
+bool IsOccluded(float3 centerW, float3 extentsW)
+{
+	float2 ndcMin = float2(1.0f, 1.0f);
+	float2 ndcMax = float2(-1.0f, -1.0f);
+	float nearestZ = 1.0f;
+
+	[unroll]
+	for(int c = 0; c < 8; ++c)
+	{
+		float3 corner = centerW + extentsW*float3((c & 1) ? 1.0f : -1.0f,
+			(c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f);
+		float4 posH = mul(float4(corner, 1.0f), gViewProj);
+
+		// A box that reaches in front of the near plane can not be placed on screen.
+		if(posH.z < 0.0f)
+			return false;
+
+		float3 ndc = posH.xyz / posH.w;
+		ndcMin = min(ndcMin, ndc.xy);
+		ndcMax = max(ndcMax, ndc.xy);
+		nearestZ = min(nearestZ, ndc.z);
+	}
+
+	// Depth buffer pixels the rectangle covers.  NDC y points up, texture rows down.
+	float2 uvMin = float2(ndcMin.x, -ndcMax.y)*0.5f + 0.5f;
+	float2 uvMax = float2(ndcMax.x, -ndcMin.y)*0.5f + 0.5f;
+	int2 viewportMin = (int2)gViewportOrigin;
+	int2 viewportMax = viewportMin + (int2)gViewportSize - 1;
+	int2 pixelMin = clamp((int2)floor(gViewportOrigin + uvMin*gViewportSize), viewportMin, viewportMax);
+	int2 pixelMax = clamp((int2)floor(gViewportOrigin + uvMax*gViewportSize), viewportMin, viewportMax);
+
+	// A texel of level L covers 2^(L+1) depth pixels a side, and the last texel of
+	// a row or column also covers what is left over past the level's size.
+	int2 span = pixelMax - pixelMin + 1;
+	int level = max((int)ceil(log2((float)max(span.x, span.y))) - 1, 0);
+	level = min(level, (int)gHiZLevelCount - 1);
+
+	uint width, height, levelCount;
+	gHiZ.GetDimensions(level, width, height, levelCount);
+	int2 lastTexel = int2(width, height) - 1;
+
+	int2 texelMin = min(pixelMin >> (level + 1), lastTexel);
+	int2 texelMax = min(pixelMax >> (level + 1), lastTexel);
+
+	float farthestZ = max(
+		max(gHiZ.Load(int3(texelMin.x, texelMin.y, level)), gHiZ.Load(int3(texelMax.x, texelMin.y, level))),
+		max(gHiZ.Load(int3(texelMin.x, texelMax.y, level)), gHiZ.Load(int3(texelMax.x, texelMax.y, level))));
+
+	return nearestZ > farthestZ;
+}
+#endif
+
+[numthreads(THREAD_GROUP_SIZE, 1, 1)]
+void CullCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint i = dispatchThreadID.x;
+	if(i >= gObjectCount)
+		return;
+
+	CullObject obj = gObjects[i];
+	if(obj.ObjectIndex == INACTIVE_OBJECT)
+		return;
+
+	InstanceData instance = gInstanceData[obj.ObjectIndex];
+	float4x4 world = instance.World;
+
+	// Transform the local box to a world space box that contains it.  The
+	// matrix is used the same way the vertex shader uses it.
+	float3 centerW = mul(float4(obj.Center, 1.0f), world).xyz;
+	float3 extentsW = mul(float4(obj.Extents, 0.0f), abs(world)).xyz;
+
+	[unroll]
+	for(int p = 0; p < 6; ++p)
+	{
+		float4 plane = gFrustumPlanes[p];
+
+		// Distance of the box's farthest point along the plane normal.
+		float d = dot(plane.xyz, centerW) + plane.w + dot(abs(plane.xyz), extentsW);
+		if(d < 0.0f)
+			return;
+	}
+
+#ifdef HIZ_OCCLUSION
+	if(IsOccluded(centerW, extentsW))
+		return;
+#endif
+
+	IndirectCommand command = gCommands[i*gLodCount + min(instance.LodIndex, gLodCount - 1)];
+
+	// 64-bit address of the object's constants, carrying out of the low half.
+	uint offset = obj.ObjectIndex*gObjectCBByteSize;
+	uint low = gObjectCBAddress.x + offset;
+	command.ObjectCBAddress = uint2(low, gObjectCBAddress.y + (low < offset ? 1 : 0));
+
+	uint slot;
+	gVisibleCount.InterlockedAdd(0, 1, slot);
+	gVisibleCommands[slot] = command;
+}
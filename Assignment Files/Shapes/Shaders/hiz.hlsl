@@ -0,0 +1,92 @@
+//***************************************************************************************
+// hiz.hlsl
+//
+// Builds the hierarchical-Z pyramid: each texel holds the farthest depth of the
+// texels it covers in the level below, or in the depth buffer for level 0.  Every
+// level is half the size of the one below, rounded down, so the last texel of a
+// row or column covers the odd texel left over as well.
+//***************************************************************************************
+
+#define THREAD_GROUP_SIZE 8
+
+cbuffer cbHiZ : register(b0)
+{
+	uint2 gSrcSize;
+	uint2 gDstSize;
+};
+
+#ifdef MULTISAMPLED_DEPTH
+Texture2DMS<float> gDepth : register(t0);
+#else
+Texture2D<float> gDepth : register(t0);
+#endif
+
+RWTexture2D<float> gDst : register(u0);
+RWTexture2D<float> gSrc : register(u1);
+
+// The source texels dst covers, as a corner and a count per axis.
+void Footprint(uint2 dst, out uint2 first, out uint2 count)
+{
+	first = dst*2;
+	count = uint2(2, 2);
+
+	if(dst.x == gDstSize.x - 1 && (gSrcSize.x & 1) != 0)
+		count.x = 3;
+	if(dst.y == gDstSize.y - 1 && (gSrcSize.y & 1) != 0)
+		count.y = 3;
+}
+
+float LoadDepth(uint2 p)
+{
+#ifdef MULTISAMPLED_DEPTH
+	uint width, height, sampleCount;
+	gDepth.GetDimensions(width, height, sampleCount);
+
+	float depth = 0.0f;
+	for(uint s = 0; s < sampleCount; ++s)
+		depth = max(depth, gDepth.Load(p, s));
+	return depth;
+#else
+	return gDepth.Load(int3(p, 0));
+#endif
+}
+
+[numthreads(THREAD_GROUP_SIZE, THREAD_GROUP_SIZE, 1)]
+void DownsampleDepthCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint2 dst = dispatchThreadID.xy;
+	if(any(dst >= gDstSize))
+		return;
+
+	uint2 first, count;
+	Footprint(dst, first, count);
+
+	float depth = 0.0f;
+	for(uint y = 0; y < count.y; ++y)
+	{
+		for(uint x = 0; x < count.x; ++x)
+			depth = max(depth, LoadDepth(min(first + uint2(x, y), gSrcSize - 1)));
+	}
+
+	gDst[dst] = depth;
+}
+
+[numthreads(THREAD_GROUP_SIZE, THREAD_GROUP_SIZE, 1)]
+void DownsampleHiZCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint2 dst = dispatchThreadID.xy;
+	if(any(dst >= gDstSize))
+		return;
+
+	uint2 first, count;
+	Footprint(dst, first, count);
+
+	float depth = 0.0f;
+	for(uint y = 0; y < count.y; ++y)
+	{
+		for(uint x = 0; x < count.x; ++x)
+			depth = max(depth, gSrc[min(first + uint2(x, y), gSrcSize - 1)]);
+	}
+
+	gDst[dst] = depth;
+}
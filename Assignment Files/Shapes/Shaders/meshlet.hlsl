@@ -0,0 +1,187 @@
+//***************************************************************************************
+// meshlet.hlsl
+//
+// Draws the meshlets of instanced submeshes.  Each MeshletAS group tests a span of
+// the meshlets of one instance against the frustum and their normal cones, and
+// launches a MeshletMS group for every one that survives, which emits its vertices
+// and triangles.  The vertices are decoded from the raw streams in whichever
+// format the geometry was packed in.  Shader model 6.5, so built with dxc.
+//***************************************************************************************
+
+#include "color.hlsl"
+
+// Must match MeshletRenderer::ThreadGroupSize.
+#define AS_GROUP_SIZE 32
+#define MS_GROUP_SIZE 128
+
+// Must match Meshlets.h.
+#define MAX_MESHLET_VERTICES 64
+#define MAX_MESHLET_PRIMITIVES 126
+
+// VertexPositionFormat and VertexColorFormat.
+#define POSITION_FLOAT3 0
+#define POSITION_HALF4 1
+#define POSITION_UNORM16X4 2
+#define COLOR_FLOAT4 0
+#define COLOR_UNORM8X4 1
+
+struct Meshlet
+{
+	uint VertexCount;
+	uint VertexOffset;
+	uint PrimitiveCount;
+	uint PrimitiveOffset;
+};
+
+struct MeshletCullData
+{
+	float3 Center;
+	float Radius;
+	float3 ConeAxis;
+	float ConeCutoff;
+};
+
+cbuffer cbMeshletFrame : register(b3)
+{
+	float4 gFrustumPlanes[6];
+	uint gPositionFormat;
+	uint gColorFormat;
+	uint gPositionStride;
+	uint gColorStride;
+	uint gColorOffset;
+};
+
+cbuffer cbMeshletDraw : register(b4)
+{
+	uint gFirstInstance;
+	uint gMeshletOffset;
+	uint gMeshletCount;
+	int gBaseVertex;
+};
+
+StructuredBuffer<Meshlet> gMeshlets : register(t0);
+StructuredBuffer<MeshletCullData> gMeshletCullData : register(t1);
+StructuredBuffer<uint> gVertexIndices : register(t2);
+StructuredBuffer<uint> gPrimitives : register(t3);
+ByteAddressBuffer gPositions : register(t4);
+ByteAddressBuffer gColors : register(t5);
+
+// The visible meshlets of a MeshletAS group, relative to gMeshletOffset, and the
+// instance they are drawn for.
+struct Payload
+{
+	uint MeshletIndices[AS_GROUP_SIZE];
+	uint InstanceIndex;
+};
+
+groupshared Payload sPayload;
+groupshared uint sVisibleCount;
+
+bool IsMeshletVisible(MeshletCullData cull, InstanceData instance)
+{
+	float3 scale = float3(length(instance.World[0].xyz), length(instance.World[1].xyz), length(instance.World[2].xyz));
+	float3 centerW = mul(float4(cull.Center, 1.0f), instance.World).xyz;
+	float radiusW = cull.Radius*max(scale.x, max(scale.y, scale.z));
+
+	for(uint i = 0; i < 6; ++i)
+	{
+		if(dot(gFrustumPlanes[i].xyz, centerW) + gFrustumPlanes[i].w < -radiusW)
+			return false;
+	}
+
+	// The normals only turn with the world matrix when it scales uniformly, and a
+	// mirroring one flips which side of the triangles is drawn, so the cone is
+	// only tested otherwise.
+	float3x3 world = (float3x3)instance.World;
+	bool isConformal = all(abs(scale - scale.x) <= 1e-3f*scale.x) && determinant(world) > 0.0f;
+	if(cull.ConeCutoff < 1.0f && isConformal)
+	{
+		float3 axisW = normalize(mul(cull.ConeAxis, world));
+		float3 view = centerW - gEyePosW;
+		if(dot(view, axisW) >= cull.ConeCutoff*length(view) + radiusW)
+			return false;
+	}
+
+	return true;
+}
+
+[numthreads(AS_GROUP_SIZE, 1, 1)]
+void MeshletAS(uint groupThreadID : SV_GroupIndex, uint3 groupID : SV_GroupID)
+{
+	uint meshlet = groupID.x*AS_GROUP_SIZE + groupThreadID;
+	uint instanceIndex = gFirstInstance + groupID.y;
+
+	if(groupThreadID == 0)
+	{
+		sVisibleCount = 0;
+		sPayload.InstanceIndex = instanceIndex;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	// The group may span several waves, so the survivors are compacted with a
+	// groupshared counter rather than wave intrinsics.
+	if(meshlet < gMeshletCount &&
+	   IsMeshletVisible(gMeshletCullData[gMeshletOffset + meshlet], gInstanceData[instanceIndex]))
+	{
+		uint slot;
+		InterlockedAdd(sVisibleCount, 1, slot);
+		sPayload.MeshletIndices[slot] = meshlet;
+	}
+	GroupMemoryBarrierWithGroupSync();
+
+	DispatchMesh(sVisibleCount, 1, 1, sPayload);
+}
+
+float3 LoadPosition(uint vertex)
+{
+	uint address = vertex*gPositionStride;
+	if(gPositionFormat == POSITION_FLOAT3)
+		return asfloat(gPositions.Load3(address));
+
+	uint2 packed = gPositions.Load2(address);
+	if(gPositionFormat == POSITION_HALF4)
+		return f16tofloat(uint3(packed.x, packed.x >> 16, packed.y));
+
+	return float3(packed.x & 0xffff, packed.x >> 16, packed.y & 0xffff) / 65535.0f;
+}
+
+float4 LoadColor(uint vertex)
+{
+	uint address = vertex*gColorStride + gColorOffset;
+	if(gColorFormat == COLOR_FLOAT4)
+		return asfloat(gColors.Load4(address));
+
+	uint packed = gColors.Load(address);
+	return float4(packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff, packed >> 24) / 255.0f;
+}
+
+[outputtopology("triangle")]
+[numthreads(MS_GROUP_SIZE, 1, 1)]
+void MeshletMS(uint groupThreadID : SV_GroupIndex, uint3 groupID : SV_GroupID,
+	in payload Payload payload,
+	out vertices VertexOut verts[MAX_MESHLET_VERTICES],
+	out indices uint3 tris[MAX_MESHLET_PRIMITIVES])
+{
+	Meshlet meshlet = gMeshlets[gMeshletOffset + payload.MeshletIndices[groupID.x]];
+	SetMeshOutputCounts(meshlet.VertexCount, meshlet.PrimitiveCount);
+
+	if(groupThreadID < meshlet.VertexCount)
+	{
+		InstanceData instance = gInstanceData[payload.InstanceIndex];
+		uint vertex = gBaseVertex + gVertexIndices[meshlet.VertexOffset + groupThreadID];
+
+		// Float positions have an identity scale and bias, so every format takes it.
+		float3 posL = LoadPosition(vertex)*instance.PositionScale + instance.PositionBias;
+		float4 posW = mul(float4(posL, 1.0f), instance.World);
+		precise float4 posH = mul(posW, gViewProj);
+
+		verts[groupThreadID].PosH = posH;
+		verts[groupThreadID].Color = LoadColor(vertex);
+	}
+
+	if(groupThreadID < meshlet.PrimitiveCount)
+	{
+		uint primitive = gPrimitives[meshlet.PrimitiveOffset + groupThreadID];
+		tris[groupThreadID] = uint3(primitive & 0xff, (primitive >> 8) & 0xff, (primitive >> 16) & 0xff);
+	}
+}
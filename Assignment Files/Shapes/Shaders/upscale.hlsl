@@ -0,0 +1,40 @@
+//***************************************************************************************
+// upscale.hlsl
+//
+// Stretches the part of the scene target the scene was drawn into over the whole
+// back buffer with a bilinear filter, for dynamic resolution.
+//***************************************************************************************
+
+cbuffer cbUpscale : register(b0)
+{
+	// Fraction of the target drawn into, and the farthest texture coordinates
+	// whose bilinear taps stay inside it.
+	float2 gUvScale;
+	float2 gUvMax;
+};
+
+Texture2D gScene : register(t0);
+SamplerState gLinearClamp : register(s0);
+
+struct VertexOut
+{
+	float4 PosH : SV_POSITION;
+	float2 TexC : TEXCOORD;
+};
+
+// A triangle that covers the screen: texture coordinates (0,0), (2,0) and (0,2).
+VertexOut UpscaleVS(uint vertexID : SV_VertexID)
+{
+	VertexOut vout;
+
+	vout.TexC = float2((vertexID << 1) & 2, vertexID & 2);
+	vout.PosH = float4(vout.TexC*float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+
+	return vout;
+}
+
+float4 UpscalePS(VertexOut pin) : SV_Target
+{
+	float2 uv = min(pin.TexC*gUvScale, gUvMax);
+	return gScene.SampleLevel(gLinearClamp, uv, 0.0f);
+}
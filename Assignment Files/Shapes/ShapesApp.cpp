@@ -2,19 +2,210 @@
 // ShapesApp.cpp by Frank Luna (C) 2015 All Rights Reserved.
 //
 // Hold down '1' key to view scene in wireframe mode.
+// Hold down '2' key to draw every render item separately instead of instanced.
+// Hold down '3' key to cull against a BVH and submit the draws from the CPU instead
+// of culling on the GPU.
+// Hold down '4' key to show the overlay of GPU pass timings, or to hide it when
+// started with -gpuoverlay.
+// Press F3 to write the recorded CPU scopes to CpuTrace.json, a Chrome trace, and
+// CpuTrace.csv in the working directory.
+//
+// Frame pacing command line options:
+//   -frames N         number of frame resources the CPU may fill ahead of the GPU (default 3)
+//   -latency N        maximum frames queued on the swap chain, 1 to 16 (default 3)
+//   -present MODE     vsync, immediate or tearing (default immediate)
+//   -nowaitable       do not wait on the swap chain's frame latency object
+//
+// Vertex format command line options:
+//   -positions FORMAT float, half or unorm16 (default unorm16)
+//   -colors FORMAT    float or unorm8 (default unorm8)
+//   -splitpositions   keep positions in a vertex stream of their own
+//   -nomeshopt        skip the vertex cache and overdraw optimization of the shapes
+//
+// Shader command line options:
+//   -compileshaders   compile the HLSL at startup instead of loading the .cso files
+//                     built by Shaders\CompileShaders.bat
+//   -nomeshshaders    draw the CPU culled instanced path with the vertex shader even
+//                     where the device supports mesh shaders
+//
+// Level of detail command line options:
+//   -lodpixels N      screen space error, in pixels, a LOD may introduce (default 1)
+//
+// Occlusion command line options:
+//   -depthprepass     draw the occluders, the castle's walls and towers, depth-only
+//                     before the scene
+//   -hiz              also cull the GPU culled scene against a hierarchical-Z pyramid
+//                     of the pre-pass depths; implies -depthprepass
+//
+// View command line options:
+//   -views N          views drawn each frame, 1 to 3 (default 1): the orbit camera,
+//                     then a top-down map and a fixed camera in a column on its right
+//   -multiview        draw the views of the CPU culled instanced path in a single pass
+//
+// Dynamic resolution command line options:
+//   -dynres           draw the scene at a fraction of the window's resolution, scaled
+//                     to hold the GPU frame time, and stretch it over the window
+//   -targetms MS      GPU frame time the scale is steered to (default 16)
+//   -minscale S       smallest fraction of the width and height drawn (default 0.5)
+//
+// Profiling command line options:
+//   -gpuoverlay       show the overlay of GPU pass timings unless '4' is held
+//   -nocputrace       do not record CPU scopes, so F3 writes an empty trace
+//
+// Scene and device command line options:
+//   -stress N         scatter N shapes with a seeded generator in place of the castle
+//   -seed N           seed of the stress scene (default 1)
+//   -projectiles N    keep about N short-lived spheres flying over the scene, each
+//                     added and removed at runtime (default 0)
+//   -warp             draw with the WARP software rasterizer
+//
+// Benchmark command line options:
+//   -benchmark        fly a scripted camera path at a fixed timestep, ignoring input,
+//                     then write a report of the frame times and exit
+//   -benchframes N    frames measured (default 1000)
+//   -warmup N         frames drawn unmeasured first, once the geometry is resident
+//                     and the PSOs are compiled (default 60)
+//   -timestep S       seconds of camera path per frame (default 1/60)
+//   -drawpath PATH    gpu, instanced or direct: the draw path measured (default gpu)
+//   -report FILE      where the report is written (default BenchmarkReport.json)
+//   -headless         keep the window hidden
 //***************************************************************************************
 
 #include "../../Common/d3dApp.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/ThreadPool.h"
+#include "../../Common/TransformArray.h"
+#include "../../Common/ChangeLog.h"
+#include "../../Common/BoundingVolumeHierarchy.h"
+#include "../../Common/CommandLine.h"
+#include "../../Common/UploadRing.h"
+#include "../../Common/UploadQueue.h"
+#include "../../Common/BufferAllocator.h"
+#include "../../Common/MeshBatchBuilder.h"
+#include "../../Common/MeshCache.h"
+#include "../../Common/MeshOptimizer.h"
+#include "../../Common/VertexFormat.h"
+#include "../../Common/PipelineCache.h"
+#include "../../Common/PsoManager.h"
+#include "../../Common/GpuProfiler.h"
+#include "../../Common/BenchmarkReport.h"
+#include "../../Common/RadixSort.h"
+#include "../../Common/SlotAllocator.h"
 #include "FrameResource.h"
+#include "GpuCuller.h"
+#include "HiZBuffer.h"
+#include "MeshletRenderer.h"
+#include "DynamicResolution.h"
+#include <cstring>
+#include <random>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 
-const int gNumFrameResources = 3;
+// Set from the command line in WinMain, before the app is created.
+int gNumFrameResources = 3;
+
+// Fewest draws worth giving to a command-list recording worker.
+const size_t MinDrawsPerWorker = 256;
+
+// GPU time that fills the width of the profiler overlay: a frame at 60 Hz.
+const float GpuOverlayBudgetMs = 1000.0f / 60.0f;
+
+// Size of the ring that per-frame transient data is allocated from.  It also
+// stages the GPU culler's copies of the objects added and removed each frame.
+const UINT64 UploadRingByteSize = 4 << 20;
+
+// Where the generated shape geometry is kept between launches.
+const wchar_t* const ShapeMeshCacheFile = L"ShapeGeometry.meshcache";
+
+// Where the driver's compiled PSOs are kept between launches, before the adapter
+// and driver version are appended.
+const wchar_t* const ShapePipelineCacheFile = L"ShapePipelines";
+
+// Width of the cell each shape of the stress scene is scattered in.
+const float StressCellSize = 3.0f;
+
+// Seconds the benchmark camera takes to orbit the scene once.
+const float BenchmarkOrbitSeconds = 20.0f;
+
+// Average seconds a projectile flies for, its scale, and the pull of gravity on it.
+const float ProjectileLifetime = 2.5f;
+const float ProjectileScale = 0.4f;
+const float ProjectileGravity = 9.8f;
+
+// Most levels in the LOD chain of a shape.
+const UINT MaxLodCount = 4;
+
+// Bumped whenever GeometryGenerator's output changes, so caches of the old shapes
+// are regenerated.
+const UINT ShapeGeneratorVersion = 3;
+
+// Generator parameters and color of every shape in the shape geometry.  The mesh
+// cache is keyed on this table, so editing it regenerates the cache.  Create
+// emits the shape's LOD chain, finest first.
+struct ShapeRecipe
+{
+	const char* Name;
+	float Params[5];
+	XMFLOAT4 Color;
+	GeometryGenerator::LodChain (*Create)(GeometryGenerator& geoGen, const float* p);
+};
+
+const ShapeRecipe ShapeRecipes[] =
+{
+	{ "box", { 2.0f, 3.0f, 15.0f, 3 }, XMFLOAT4(Colors::Purple),
+		[](GeometryGenerator& g, const float* p) { return g.CreateBoxLods(p[0], p[1], p[2], (UINT)p[3], MaxLodCount); } },
+	{ "grid", { 50.0f, 50.0f, 60, 40 }, XMFLOAT4(Colors::Gray),
+		[](GeometryGenerator& g, const float* p) { return g.CreateGridLods(p[0], p[1], (UINT)p[2], (UINT)p[3], MaxLodCount); } },
+	{ "sphere", { 0.5f, 20, 20 }, XMFLOAT4(Colors::LightBlue),
+		[](GeometryGenerator& g, const float* p) { return g.CreateSphereLods(p[0], (UINT)p[1], (UINT)p[2], MaxLodCount); } },
+	{ "cylinder", { 0.5f, 0.5f, 3.0f, 20, 20 }, XMFLOAT4(Colors::SteelBlue),
+		[](GeometryGenerator& g, const float* p) { return g.CreateCylinderLods(p[0], p[1], p[2], (UINT)p[3], (UINT)p[4], MaxLodCount); } },
+	//------------------------------
+	// CUSTOM SHAPES - TEST HERE
+	//------------------------------
+	{ "pyramid", { 1.0f, 1.0f }, XMFLOAT4(Colors::Yellow),
+		[](GeometryGenerator& g, const float* p) { return g.CreateSimplifiedLods(g.CreatePyramid(p[0], p[1]), MaxLodCount); } },
+	{ "wedge", { 1.0f, 1.0f, 1.0f }, XMFLOAT4(Colors::Crimson),
+		[](GeometryGenerator& g, const float* p) { return g.CreateSimplifiedLods(g.CreateWedge(p[0], p[1], p[2]), MaxLodCount); } },
+	{ "cone", { 1.0f, 1.0f, 16 }, XMFLOAT4(Colors::Pink),
+		[](GeometryGenerator& g, const float* p) { return g.CreateConeLods(p[0], p[1], (UINT)p[2], MaxLodCount); } },
+	{ "halfCone", { 0.5f, 1.0f, 1.0f, 16 }, XMFLOAT4(Colors::LightGreen),
+		[](GeometryGenerator& g, const float* p) { return g.CreateHalfConeLods(p[0], p[1], p[2], (UINT)p[3], MaxLodCount); } },
+	{ "prism", { 2.0f, 1.0f, 1.0f }, XMFLOAT4(Colors::Orange),
+		[](GeometryGenerator& g, const float* p) { return g.CreateSimplifiedLods(g.CreatePrism(p[0], p[1], p[2]), MaxLodCount); } },
+	{ "diamond", { 1.0f, 1.0f, 1.0f }, XMFLOAT4(Colors::Silver),
+		[](GeometryGenerator& g, const float* p) { return g.CreateSimplifiedLods(g.CreateDiamond(p[0], p[1], p[2]), MaxLodCount); } },
+};
+
+// Name of a level of a shape's LOD chain in the shape geometry.  The finest
+// level goes by the name of the shape.
+std::string ShapeLodName(const std::string& shapeName, UINT lod)
+{
+	return lod == 0 ? shapeName : shapeName + "_lod" + std::to_string(lod);
+}
+
+// DrawIndexedInstanced parameters of one level of a render item's LOD chain.
+struct RenderItemLod
+{
+	MeshGeometry* Geo = nullptr;
+
+	// Index of Geo in ShapesApp::mGeometries, for the draw sort key.
+	UINT GeoIndex = 0;
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// The level's meshlets in Geo's meshlet buffer.
+	UINT MeshletOffset = 0;
+	UINT MeshletCount = 0;
+
+	// Object space error of the level, see SubmeshGeometry::LodError.
+	float Error = 0.0f;
+};
 
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
@@ -22,18 +213,10 @@ struct RenderItem
 {
 	RenderItem() = default;
 
-	// World matrix of the shape that describes the object's local space
-	// relative to the world space, which defines the position, orientation,
-	// and scale of the object in the world.
-	XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
 	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// The world matrix of the item lives at the same index in ShapesApp::mTransforms,
+	// and the item has the same index in the BVH and the GPU culler.  The index is
+	// the item's slot in ShapesApp::mObjectSlots.
 	UINT ObjCBIndex = -1;
 
 	MeshGeometry* Geo = nullptr;
@@ -45,12 +228,90 @@ struct RenderItem
 	UINT IndexCount = 0;
 	UINT StartIndexLocation = 0;
 	int BaseVertexLocation = 0;
+
+	// Local space bounds of the submesh, used for culling.
+	BoundingBox Bounds;
+
+	// Dequantization of the submesh's vertex positions.
+	XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+	XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+
+	// Drawn by the depth pre-pass: large, solid shapes that hide much of the scene.
+	bool IsOccluder = false;
+
+	// The LOD chain, finest first.  Geo and the draw parameters above are those
+	// of the selected level, Lod.  All levels share the bounds and dequantization.
+	std::vector<RenderItemLod> Lods;
+	UINT Lod = 0;
+};
+
+// Render items that share the same geometry, submesh and topology, drawn with
+// a single DrawIndexedInstanced call.  The object indices of the members are
+// contiguous, so instance i of the batch reads its world matrix from the
+// instance buffer at StartInstanceLocation + i.
+struct InstanceBatch
+{
+	MeshGeometry* Geo = nullptr;
+
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	// DrawIndexedInstanced parameters.
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+	UINT InstanceCount = 0;
+	UINT StartInstanceLocation = 0;
+
+	// The submesh's meshlets, for drawing with mesh shaders.
+	UINT MeshletOffset = 0;
+	UINT MeshletCount = 0;
+};
+
+// Visible draws are sorted by this key, with the state that costs the most to
+// change in the highest bits: the PSO, then the vertex and index buffers, then
+// the topology.  The squared distance from the eye fills the low bits, so each
+// group of draws sharing state goes front to back for early-Z.
+UINT64 DrawSortKey(UINT psoId, UINT geoIndex, D3D12_PRIMITIVE_TOPOLOGY topology, float distanceSq)
+{
+	// Non-negative floats order the same as their bit patterns.
+	UINT depthBits = 0;
+	std::memcpy(&depthBits, &distanceSq, sizeof(depthBits));
+
+	return ((UINT64)(psoId & 0xff) << 56) |
+		((UINT64)(geoIndex & 0xffff) << 40) |
+		((UINT64)(topology & 0xff) << 32) |
+		depthBits;
+}
+
+// A short-lived render item thrown over the scene, added and removed at runtime.
+struct Projectile
+{
+	RenderItem* Item = nullptr;
+	XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT3 Velocity = { 0.0f, 0.0f, 0.0f };
+	float Age = 0.0f;
+	float Lifetime = 0.0f;
+};
+
+// A camera the scene is drawn from, into a viewport of the back buffer of its own.
+struct SceneView
+{
+	D3D12_VIEWPORT Viewport = {};
+	D3D12_RECT ScissorRect = {};
+
+	XMFLOAT3 EyePos = { 0.0f, 0.0f, 0.0f };
+	XMFLOAT4X4 View = MathHelper::Identity4x4();
+	XMFLOAT4X4 Proj = MathHelper::Identity4x4();
+	float FarZ = 1000.0f;
+
+	// Rebuilt from the above every frame.
+	PassConstants PassCB;
 };
 
 class ShapesApp : public D3DApp
 {
 public:
-	ShapesApp(HINSTANCE hInstance);
+	ShapesApp(HINSTANCE hInstance, const CommandLine& cmdLine);
 	ShapesApp(const ShapesApp& rhs) = delete;
 	ShapesApp& operator=(const ShapesApp& rhs) = delete;
 	~ShapesApp();
@@ -61,6 +322,7 @@ private:
 	virtual void OnResize()override;
 	virtual void Update(const GameTimer& gt)override;
 	virtual void Draw(const GameTimer& gt)override;
+	virtual std::wstring GetFrameStatsText()const override;
 
 	virtual void OnMouseDown(WPARAM btnState, int x, int y)override;
 	virtual void OnMouseUp(WPARAM btnState, int x, int y)override;
@@ -68,47 +330,260 @@ private:
 
 	void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
+	void LayoutViews();
+	void UpdateViews();
+	bool IsMultiViewPass()const;
+	float ScalePixels(float pixels)const;
+	D3D12_CPU_DESCRIPTOR_HANDLE SceneRenderTargetView()const;
 	void UpdateObjectCBs(const GameTimer& gt);
-	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdatePassCBs(const GameTimer& gt);
+	void SelectLods();
+	void UpdateObjectData();
+	void UpdateProjectiles(const GameTimer& gt);
+	void CullRenderItems();
+	void QueryView(const SceneView& view);
+	void AppendViewDraws(const SceneView& view);
+	bool AppendToRun(std::vector<InstanceBatch>& runs, const RenderItem* ri)const;
+	void BuildOccluderRuns();
+	template<typename T>
+	void SortDraws(std::vector<T>& draws, const std::vector<UINT64>& keys, std::vector<T>& scratch);
+	void SetWorld(RenderItem* ri, FXMMATRIX world);
+	RenderItem* AddRenderItem(const RenderItem& prototype, FXMMATRIX world);
+	void RemoveRenderItem(RenderItem* ri);
+	UINT FindInstanceBatch(const RenderItem& ri);
+	void GetCullObject(UINT objIndex, CullObject& object, IndirectCommand* lodCommands)const;
+	void UpdateBenchmarkCamera();
+	void RecordBenchmarkGpuTimes(int frameIndex, bool isReadBack);
+	void EndBenchmarkFrame();
+	void FinishBenchmark();
 
-	void BuildDescriptorHeaps();
-	void BuildConstantBufferViews();
 	void BuildRootSignature();
 	void BuildShadersAndInputLayout();
 	void BuildShapeGeometry();
+	std::vector<BYTE> GenerateShapeGeometry(UINT64 cacheKey);
+	MeshGeometry* FindShapeGeometry(const std::string& submeshName);
+	std::vector<RenderItemLod> GetShapeLods(const std::string& shapeName);
 	void BuildPSOs();
+	PsoKey OpaquePsoKey(bool isInstanced, bool isWireframe, bool isMsaa, bool isMultiView = false)const;
+	PsoKey DepthPsoKey(bool isMsaa)const;
 	void BuildFrameResources();
 	void BuildRenderItems();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BuildCastleRenderItems();
+	void BuildStressRenderItems();
+	void BuildInstanceBatches();
+	void BuildBvh();
+	void BuildGpuCuller();
+	void RecordCullerUpdates(ID3D12GraphicsCommandList* cmdList);
+	void BindSceneState(ID3D12GraphicsCommandList* cmdList, UINT view = 0);
+	void BindMultiViewState(ID3D12GraphicsCommandList* cmdList);
+	void RecordDepthPrepass();
+	void RecordGpuCulledScene(ID3D12PipelineState* pso, bool isOcclusionCulled);
+	void RecordSceneChunk(UINT worker, ID3D12PipelineState* pso, ID3D12PipelineState* meshletPso,
+		size_t begin, size_t end, bool isLast);
+	void RecordPresentTransition(ID3D12GraphicsCommandList* cmdList);
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, size_t begin, size_t end);
+	void DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches,
+		size_t begin, size_t end, UINT viewCount = 1);
+	void DrawMeshletBatches(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso, UINT view,
+		const std::vector<InstanceBatch>& batches, size_t begin, size_t end);
 
 private:
 
+	// Workers that record the scene into the frame resource's worker command lists.
+	std::unique_ptr<ThreadPool> mThreadPool;
+
+	// Transient upload memory, shared by all frame resources.
+	std::unique_ptr<UploadRing> mUploadRing;
+
+	// Streams static data in on the copy queue.
+	std::unique_ptr<UploadQueue> mUploadQueue;
+
+	// Pages the static vertex and index buffers are sub-allocated from.
+	std::unique_ptr<BufferAllocator> mBufferAllocator;
+
+	// Set once every geometry's upload has arrived.  The scene is not drawn before.
+	bool mIsSceneResident = false;
+
 	std::vector<std::unique_ptr<FrameResource>> mFrameResources;
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
-	ComPtr<ID3D12DescriptorHeap> mCbvHeap = nullptr;
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
-
+	Registry<std::unique_ptr<MeshGeometry>> mGeometries;
+	// How the shape geometry is packed.  Drives the input layout and the shaders.
+	VertexFormat mVertexFormat;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
 
-	// List of all the render items.
+	// Reorder the generated shapes for the post-transform vertex cache and overdraw.
+	bool mOptimizeMeshes = true;
+
+	// Release builds only load precompiled shaders; debug builds compile any
+	// that were not built.
+#ifdef _DEBUG
+	d3dUtil::ShaderSource mShaderSource = d3dUtil::ShaderSource::PrecompiledOrHlsl;
+#else
+	d3dUtil::ShaderSource mShaderSource = d3dUtil::ShaderSource::Precompiled;
+#endif
+
+	std::unique_ptr<PipelineCache> mPipelineCache;
+
+	// Compiles the opaque PSOs of these programs in the background, as each fill
+	// mode and multisample state is first asked for.
+	std::unique_ptr<PsoManager> mPsoManager;
+	PsoManager::ProgramHandle mOpaqueProgram;
+	PsoManager::ProgramHandle mOpaqueInstancedProgram;
+	PsoManager::ProgramHandle mOpaqueMultiViewProgram;
+	PsoManager::ProgramHandle mDepthInstancedProgram;
+
+	// Set once the startup compiles are done and the pipeline cache was reported.
+	bool mIsPipelineCacheReported = false;
+
+	// Times the passes of each frame on the GPU, for the caption and the overlay.
+	std::unique_ptr<GpuProfiler> mGpuProfiler;
+	bool mGpuOverlayOption = false;
+	bool mShowGpuOverlay = false;
+
+	// Largest screen space error, in pixels, that LOD selection accepts.
+	float mLodPixelError = 1.0f;
+
+	// Shapes in the stress scene, or 0 to build the castle.
+	UINT mStressObjectCount = 0;
+	UINT mStressSeed = 1;
+
+	// The projectiles in flight, about mProjectileCount of them, and the render
+	// item they are copied from.  The spawn budget carries the fraction of a
+	// projectile over to the next frame.
+	UINT mProjectileCount = 0;
+	std::vector<Projectile> mProjectiles;
+	RenderItem mProjectilePrototype;
+	std::mt19937 mProjectileRandom;
+	float mProjectileSpawnBudget = 0.0f;
+
+	// Distance the benchmark camera orbits the scene at.
+	float mSceneRadius = 15.0f;
+
+	// Benchmark settings, see the command line options above.
+	bool mIsBenchmark = false;
+	UINT mBenchmarkFrameCount = 1000;
+	UINT mBenchmarkWarmupFrames = 60;
+	float mBenchmarkTimestep = 1.0f / 60.0f;
+	std::wstring mBenchmarkReportFile = L"BenchmarkReport.json";
+
+	// Set once the scene is ready to be measured.  Frames are counted from then,
+	// warm-up frames included.
+	bool mIsBenchmarkStarted = false;
+	UINT mBenchmarkFrame = 0;
+
+	// When Update began this frame and the last.
+	__int64 mFrameBeginTime = 0;
+	__int64 mPrevFrameBeginTime = 0;
+
+	// Frame resources whose last frame was measured, so its GPU times are reported
+	// when they are read back.
+	std::vector<bool> mIsFrameMeasured = std::vector<bool>(gNumFrameResources, false);
+
+	BenchmarkReport mBenchmarkReport;
+
+	// Hands out the render items' ObjCBIndex.  The slot of a removed item is
+	// reused once the frames in flight are done with it.
+	SlotAllocator mObjectSlots;
+
+	// List of all the render items, by ObjCBIndex.  Free slots are null.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
-	// Render items divided by PSO.
-	std::vector<RenderItem*> mOpaqueRitems;
+	// World matrices of the render items, indexed by ObjCBIndex.
+	TransformArray mTransforms{ (UINT)gNumFrameResources };
+
+	// Render items, by ObjCBIndex, whose Lod changed, or that were added, since
+	// each frame resource's buffers last took them.
+	ChangeLog mObjectChanges{ (UINT)gNumFrameResources };
+	std::vector<UINT> mChangedObjects;
 
-	PassConstants mMainPassCB;
+	// Render items divided by PSO, by ObjCBIndex.  Free slots are null.
+	std::vector<RenderItem*> mOpaqueRitems;
 
-	UINT mPassCbvOffset = 0;
+	// The opaque render items grouped by submesh for instanced drawing.  Items
+	// added after the scene was built join their submesh's batch, but not its
+	// range of object indices.
+	std::vector<InstanceBatch> mInstanceBatches;
+
+	// Index into mInstanceBatches of the batch each object belongs to, by ObjCBIndex.
+	std::vector<UINT> mBatchOfObject;
+
+	// Hierarchy over the world space bounds of the opaque render items, by
+	// ObjCBIndex, and the items added since it was built.  Free slots are
+	// inactive in it.  Items moved while the GPU culls are not refit into it,
+	// since nothing would drain their refits; it is rebuilt on the next CPU cull.
+	BoundingVolumeHierarchy mOpaqueBvh;
+	UINT mBvhInsertCount = 0;
+	bool mIsBvhStale = false;
+
+	// The opaque render items and batch runs that passed the BVH cull this frame,
+	// view after view, each view's in draw sort order.  The begin arrays hold
+	// where each view's draws start, and where the last one's end.  A multi-view
+	// pass has a single list for all the views.
+	std::vector<UINT> mVisibleObjects;
+	std::vector<RenderItem*> mVisibleRitems;
+	std::vector<InstanceBatch> mVisibleBatches;
+	std::vector<size_t> mViewRitemBegin;
+	std::vector<size_t> mViewBatchBegin;
+
+	// The draws of the view being culled, and the views each object is in, by
+	// ObjCBIndex, while the views of a multi-view pass are culled.
+	std::vector<RenderItem*> mViewRitems;
+	std::vector<InstanceBatch> mViewBatches;
+	std::vector<UINT> mObjectViewMasks;
+
+	// Draw sort keys of the visible render items and batch runs, and the buffers
+	// they are sorted through.
+	std::vector<UINT64> mVisibleKeys;
+	std::vector<UINT64> mVisibleBatchKeys;
+	std::vector<RadixSortEntry> mDrawSortEntries;
+	std::vector<RadixSortEntry> mDrawSortScratch;
+	std::vector<RenderItem*> mSortedRitems;
+	std::vector<InstanceBatch> mSortedBatches;
+
+	// Culls the opaque render items on the GPU and draws the survivors indirectly.
+	// The objects added or removed since its buffers were last written are queued
+	// for the next frame's command list.
+	std::unique_ptr<GpuCuller> mGpuCuller;
+	std::vector<UINT> mCullerUpdates;
+
+	// Occlusion settings, see the command line options above.
+	bool mIsDepthPrepass = false;
+	bool mIsHiZ = false;
+
+	// The occluders, by ObjCBIndex, and their runs of consecutive objects at the
+	// same LOD that this frame's depth pre-pass draws instanced.
+	std::vector<RenderItem*> mOccluderRitems;
+	std::vector<InstanceBatch> mOccluderRuns;
+
+	// Pyramid of the pre-pass depths that the GPU culler tests occlusion against.
+	std::unique_ptr<HiZBuffer> mHiZBuffer;
+
+	// Draws the CPU culled instanced runs with mesh shaders where the device
+	// supports them.  Null otherwise, and the vertex shader draws them.
+	bool mUseMeshShaders = true;
+	std::unique_ptr<MeshletRenderer> mMeshletRenderer;
+
+	// Draws the scene at a fraction of the window's resolution, steered by the GPU
+	// frame time, and stretches it over the back buffer.  Null unless -dynres.
+	bool mUseDynamicResolution = false;
+	DynamicResolution::Settings mDynamicResolutionSettings;
+	std::unique_ptr<DynamicResolution> mDynamicResolution;
+
+	// The views drawn each frame, the main view first, and whether the CPU culled
+	// instanced path draws them in a single pass.
+	UINT mViewCount = 1;
+	bool mIsMultiView = false;
+	std::vector<SceneView> mViews;
 
 	bool mIsWireframe = false;
+	bool mIsInstanced = true;
+	bool mIsGpuCulled = true;
 
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
 	XMFLOAT4X4 mView = MathHelper::Identity4x4();
@@ -131,7 +606,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 
 	try
 	{
-		ShapesApp theApp(hInstance);
+		CommandLine options(cmdLine);
+
+		// Members of ShapesApp are sized by the frame resource count, so it has to be
+		// known before the app is created.
+		gNumFrameResources = MathHelper::Clamp(options.GetInt("frames", gNumFrameResources), 1, 16);
+
+		ShapesApp theApp(hInstance, options);
 		if (!theApp.Initialize())
 			return 0;
 
@@ -142,17 +623,79 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 		MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
 		return 0;
 	}
+	catch (std::exception& e)
+	{
+		MessageBoxA(nullptr, e.what(), "Error", MB_OK);
+		return 0;
+	}
 }
 
-ShapesApp::ShapesApp(HINSTANCE hInstance)
+ShapesApp::ShapesApp(HINSTANCE hInstance, const CommandLine& cmdLine)
 	: D3DApp(hInstance)
 {
+	mMaxFrameLatency = (UINT)MathHelper::Clamp(cmdLine.GetInt("latency", (int)mMaxFrameLatency), 1, 16);
+	mUseWaitableSwapChain = !cmdLine.Has("nowaitable");
+
+	std::string present = cmdLine.Get("present", "immediate");
+	if (present == "vsync")
+		mPresentMode = PresentMode::VSync;
+	else if (present == "tearing")
+		mPresentMode = PresentMode::Tearing;
+	else
+		mPresentMode = PresentMode::Immediate;
+
+	mVertexFormat.SetPosition(cmdLine.Get("positions", "unorm16"));
+	mVertexFormat.SetColor(cmdLine.Get("colors", "unorm8"));
+	mVertexFormat.SplitPositions = cmdLine.Has("splitpositions");
+	mOptimizeMeshes = !cmdLine.Has("nomeshopt");
+	if (cmdLine.Has("compileshaders"))
+		mShaderSource = d3dUtil::ShaderSource::Hlsl;
+	mUseMeshShaders = !cmdLine.Has("nomeshshaders");
+	mLodPixelError = std::max<float>(cmdLine.GetFloat("lodpixels", mLodPixelError), 0.0f);
+	mIsHiZ = cmdLine.Has("hiz");
+	mIsDepthPrepass = mIsHiZ || cmdLine.Has("depthprepass");
+	mViewCount = (UINT)MathHelper::Clamp(cmdLine.GetInt("views", (int)mViewCount), 1, (int)MaxViewCount);
+	mIsMultiView = cmdLine.Has("multiview");
+	mUseDynamicResolution = cmdLine.Has("dynres");
+	mDynamicResolutionSettings.TargetMs = std::max<float>(cmdLine.GetFloat("targetms", mDynamicResolutionSettings.TargetMs), 1.0f);
+	mDynamicResolutionSettings.MinScale = MathHelper::Clamp(cmdLine.GetFloat("minscale", mDynamicResolutionSettings.MinScale), 0.1f, 1.0f);
+	mGpuOverlayOption = cmdLine.Has("gpuoverlay");
+	CpuProfiler::SetEnabled(!cmdLine.Has("nocputrace"));
+
+	md3dDriverType = cmdLine.Has("warp") ? D3D_DRIVER_TYPE_WARP : D3D_DRIVER_TYPE_HARDWARE;
+	mStressObjectCount = (UINT)std::max<int>(cmdLine.GetInt("stress", 0), 0);
+	mStressSeed = (UINT)cmdLine.GetInt("seed", (int)mStressSeed);
+	mProjectileCount = (UINT)std::max<int>(cmdLine.GetInt("projectiles", 0), 0);
+	mProjectileRandom.seed(mStressSeed);
+
+	mIsBenchmark = cmdLine.Has("benchmark");
+	if (mIsBenchmark)
+	{
+		mBenchmarkFrameCount = (UINT)std::max<int>(cmdLine.GetInt("benchframes", (int)mBenchmarkFrameCount), 1);
+		mBenchmarkWarmupFrames = (UINT)std::max<int>(cmdLine.GetInt("warmup", (int)mBenchmarkWarmupFrames), 0);
+		float timestep = cmdLine.GetFloat("timestep", mBenchmarkTimestep);
+		if (timestep > 0.0f)
+			mBenchmarkTimestep = timestep;
+		mBenchmarkReportFile = AnsiToWString(cmdLine.Get("report", "BenchmarkReport.json"));
+
+		// The keys that pick the draw path are not read during a benchmark.
+		std::string drawPath = cmdLine.Get("drawpath", "gpu");
+		mIsGpuCulled = (drawPath == "gpu");
+		mIsInstanced = (drawPath != "direct");
+
+		mShowWindow = !cmdLine.Has("headless");
+		mRunWhenInactive = true;
+		mTimer.SetFixedTimestep(mBenchmarkTimestep);
+	}
 }
 
 ShapesApp::~ShapesApp()
 {
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	// Waits for any uploads still in flight.
+	mUploadQueue = nullptr;
 }
 
 bool ShapesApp::Initialize()
@@ -163,23 +706,79 @@ bool ShapesApp::Initialize()
 	// Reset the command list to prep for initialization commands.
 	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
+	mThreadPool = std::make_unique<ThreadPool>();
+	mUploadQueue = std::make_unique<UploadQueue>(md3dDevice.Get());
+	mBufferAllocator = std::make_unique<BufferAllocator>(md3dDevice.Get());
+	mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(), ShapePipelineCacheFile);
+	mPsoManager = std::make_unique<PsoManager>(mPipelineCache.get(), mShaderSource);
+	mGpuProfiler = std::make_unique<GpuProfiler>(md3dDevice.Get(), mCommandQueue.Get(), gNumFrameResources);
+
+	// OnResize ran before the pyramid existed, so it is sized here the first time.
+	if (mIsHiZ)
+	{
+		mHiZBuffer = std::make_unique<HiZBuffer>(md3dDevice.Get(), mShaderSource, mPipelineCache.get());
+		mHiZBuffer->Resize(mDepthStencilBuffer.Get(), DXGI_FORMAT_R24_UNORM_X8_TYPELESS);
+	}
+
+	// Likewise the scene target, and the views are laid out again at its scale.
+	if (mUseDynamicResolution)
+	{
+		mDynamicResolution = std::make_unique<DynamicResolution>(md3dDevice.Get(), mShaderSource,
+			mPipelineCache.get(), mDynamicResolutionSettings);
+		mDynamicResolution->Resize(mClientWidth, mClientHeight, mBackBufferFormat,
+			{ m4xMsaaState ? 4u : 1u, m4xMsaaState ? (m4xMsaaQuality - 1) : 0 }, Colors::LightSteelBlue);
+		LayoutViews();
+	}
+
+	// Everything mesh shaders need is checked up front; without it the vertex
+	// shader path draws alone.
+	if (mUseMeshShaders && MeshletRenderer::IsSupported(md3dDevice.Get()))
+		mMeshletRenderer = std::make_unique<MeshletRenderer>(md3dDevice.Get(), mVertexFormat);
+	else if (mUseMeshShaders)
+		OutputDebugString(L"Mesh shaders are not supported, drawing with the vertex shader\n");
+
+	// The multi-view pass picks each vertex's viewport in the vertex shader, which
+	// some devices emulate with a geometry shader, costing more than it saves.
+	if (mIsMultiView && mViewCount > 1)
+	{
+		D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+		if (FAILED(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) ||
+			!options.VPAndRTArrayIndexFromAnyShaderFeedingRasterizerSupportedWithoutGSEmulation)
+		{
+			mIsMultiView = false;
+			OutputDebugString(L"Viewport indices from the vertex shader are not supported, drawing the views one by one\n");
+		}
+	}
+
+	// The PSOs compile on the manager's workers while the geometry is built.
 	BuildRootSignature();
 	BuildShadersAndInputLayout();
+	BuildPSOs();
 	BuildShapeGeometry();
 	BuildRenderItems();
 	BuildFrameResources();
-	BuildDescriptorHeaps();
-	BuildConstantBufferViews();
-	BuildPSOs();
+	BuildGpuCuller();
 
 	// Execute the initialization commands.
 	ThrowIfFailed(mCommandList->Close());
 	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
 	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
-	// Wait until initialization is complete.
+	// Wait until initialization is complete.  The geometry is still streaming in on
+	// the copy queue, and frames are drawn without it until it arrives.
 	FlushCommandQueue();
 
+#ifdef _DEBUG
+	BufferAllocator::Stats stats = mBufferAllocator->GetStats();
+	std::wstring text = L"Buffer allocator: " +
+		std::to_wstring(stats.AllocationCount) + L" buffers in " +
+		std::to_wstring(stats.PageCount) + L" pages, " +
+		std::to_wstring(stats.AllocatedBytes) + L" of " +
+		std::to_wstring(stats.ReservedBytes) + L" bytes used, fragmentation " +
+		std::to_wstring(stats.Fragmentation) + L"\n";
+	OutputDebugString(text.c_str());
+#endif
+
 	return true;
 }
 
@@ -187,14 +786,41 @@ void ShapesApp::OnResize()
 {
 	D3DApp::OnResize();
 
-	// The window resized, so update the aspect ratio and recompute the projection matrix.
-	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+	LayoutViews();
+
+	// The window resized, so update the aspect ratio and recompute the projection
+	// matrix.  The main view may only take part of the window.
+	const D3D12_VIEWPORT& mainViewport = mViews[0].Viewport;
+	float aspect = mainViewport.Width / std::max<float>(mainViewport.Height, 1.0f);
+	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, aspect, 1.0f, 1000.0f);
 	XMStoreFloat4x4(&mProj, P);
+
+	// The depth buffer was recreated, at the new size and multisample state.
+	// D3DApp::OnResize flushed the queue, so the old pyramid is no longer in use.
+	if (mHiZBuffer != nullptr)
+		mHiZBuffer->Resize(mDepthStencilBuffer.Get(), DXGI_FORMAT_R24_UNORM_X8_TYPELESS);
+
+	// The scene target follows the back buffer.  Its scale carries over.
+	if (mDynamicResolution != nullptr)
+	{
+		mDynamicResolution->Resize(mClientWidth, mClientHeight, mBackBufferFormat,
+			{ m4xMsaaState ? 4u : 1u, m4xMsaaState ? (m4xMsaaQuality - 1) : 0 }, Colors::LightSteelBlue);
+	}
 }
 
 void ShapesApp::Update(const GameTimer& gt)
 {
-	OnKeyboardInput(gt);
+	// A benchmark is not steered by the keyboard or mouse.
+	if (mIsBenchmark)
+	{
+		mFrameBeginTime = GameTimer::Now();
+		UpdateBenchmarkCamera();
+	}
+	else
+	{
+		OnKeyboardInput(gt);
+	}
+
 	UpdateCamera(gt);
 
 	// Cycle through the circular frame resource array.
@@ -203,20 +829,144 @@ void ShapesApp::Update(const GameTimer& gt)
 
 	// Has the GPU finished processing the commands of the current frame resource?
 	// If not, wait until the GPU has completed commands up to this fence point.
-	if (mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
+	if (mCurrFrameResource->Fence != 0)
+		WaitForFence(mCurrFrameResource->Fence);
+
+	// The frame that last used this frame resource is done, so its timings can be read.
+	bool isGpuFrameReadBack = mGpuProfiler->BeginFrame(mCurrFrameResourceIndex);
+	if (mIsBenchmark)
+		RecordBenchmarkGpuTimes(mCurrFrameResourceIndex, isGpuFrameReadBack);
+
+	// The scale is steered by the GPU time of the frame just read back.  Only the
+	// viewports change with it.
+	if (mDynamicResolution != nullptr && isGpuFrameReadBack)
+	{
+		const GpuProfiler::ScopeStats* frameStats = mGpuProfiler->FindStats("frame");
+		if (frameStats != nullptr && mDynamicResolution->Update(frameStats->LastMs))
+			LayoutViews();
+	}
+
+	// Everything the GPU has finished with can be handed out again.
+	mUploadRing->Retire(mFence->GetCompletedValue());
+	mBufferAllocator->Retire(mFence->GetCompletedValue());
+	mUploadQueue->Retire();
+	mObjectSlots.Retire(mFence->GetCompletedValue());
+	mGpuCuller->Retire(mFence->GetCompletedValue());
+
+	// The fence of a finished upload has passed on the CPU, so commands recorded
+	// from here on can read the geometry without waiting for the copy queue.
+	if (!mIsSceneResident)
+	{
+		mIsSceneResident = true;
+		for (auto& geo : mGeometries)
+			mIsSceneResident &= mUploadQueue->IsComplete(geo->UploadTicket);
+	}
+
+	// The PSO manager saves the pipeline cache itself once its compiles are done.
+	if (!mIsPipelineCacheReported && mPsoManager->PendingCount() == 0)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
+		mIsPipelineCacheReported = true;
+
+		std::wstring pipelineText = L"Pipeline cache " + mPipelineCache->FileName() + L": " +
+			std::to_wstring(mPipelineCache->HitCount()) + L" PSOs loaded, " +
+			std::to_wstring(mPipelineCache->MissCount()) + L" compiled\n";
+		OutputDebugString(pipelineText.c_str());
 	}
 
+	// A benchmark only throws projectiles once it is measured, so every run sees
+	// the same ones.
+	if (mProjectileCount > 0 && (!mIsBenchmark || mIsBenchmarkStarted))
+		UpdateProjectiles(gt);
+
+	// Items added past the end of this frame resource's buffers grow them.  Its
+	// last frame is done, so nothing waits.
+	mCurrFrameResource->ReserveObjects(md3dDevice.Get(), mObjectSlots.SlotCount());
+
 	UpdateObjectCBs(gt);
-	UpdateMainPassCB(gt);
+	UpdateViews();
+	UpdatePassCBs(gt);
+	SelectLods();
+	UpdateObjectData();
+
+	if (mIsDepthPrepass)
+		BuildOccluderRuns();
+
+	// The GPU culled path tests the objects itself.
+	if (!mIsGpuCulled)
+		CullRenderItems();
 }
 
 void ShapesApp::Draw(const GameTimer& gt)
 {
+	// GPU culled draws bind per-object constants, like the non-instanced path.
+	bool isInstanced = mIsInstanced && !mIsGpuCulled;
+	bool isMultiView = IsMultiViewPass();
+
+	// Until a wireframe PSO has compiled, draw solid in its place.  A PSO of
+	// another multisample state can not stand in, so that one is waited for.
+	PsoKey opaqueKey = OpaquePsoKey(isInstanced, mIsWireframe, m4xMsaaState, isMultiView);
+	ID3D12PipelineState* opaquePso = nullptr;
+	if (mIsWireframe)
+		opaquePso = mPsoManager->GetOrFallback(opaqueKey, OpaquePsoKey(isInstanced, false, m4xMsaaState, isMultiView));
+	else
+		opaquePso = mPsoManager->Get(opaqueKey);
+
+	// Wireframe shows the hidden objects too, so nothing is drawn ahead of it to
+	// hide them.
+	bool isDepthPrepass = mIsDepthPrepass && !mIsWireframe;
+
+	// Mesh shaders take over the instanced runs.  They decode packed positions
+	// themselves, which need not match the input assembler bit for bit, so they
+	// are kept from drawing over the pre-pass's depths.  A multi-view pass is
+	// left to the vertex shader, which picks the viewports.
+	ID3D12PipelineState* meshletPso = nullptr;
+	if (mMeshletRenderer != nullptr && isInstanced && !isDepthPrepass && !isMultiView)
+		meshletPso = mMeshletRenderer->GetPso(opaqueKey);
+
+	// The GPU culled scene is only a dispatch and an ExecuteIndirect, so it is
+	// recorded on the main command list without any workers.
+	std::vector<std::future<void>> workers;
+	size_t workerCount = 0;
+
+	// Should this thread throw while the workers record, they are waited for on
+	// the way out, so none is left recording into this frame resource's lists.
+	struct WorkerJoin
+	{
+		std::vector<std::future<void>>& Workers;
+		~WorkerJoin()
+		{
+			for (auto& worker : Workers)
+			{
+				if (worker.valid())
+					worker.wait();
+			}
+		}
+	} workerJoin{ workers };
+
+	if (mIsSceneResident && !mIsGpuCulled)
+	{
+		// Split the scene into one chunk per worker, but do not hand out chunks so small
+		// that the cost of an extra command list outweighs the recording it saves.
+		size_t drawCount = mIsInstanced ? mVisibleBatches.size() : mVisibleRitems.size();
+		size_t maxWorkers = mCurrFrameResource->WorkerCmdLists.size();
+		workerCount = (drawCount + MinDrawsPerWorker - 1) / MinDrawsPerWorker;
+		workerCount = MathHelper::Clamp<size_t>(workerCount, 1, maxWorkers);
+
+		// Kick off the workers first so they record the scene while this thread
+		// records the frame setup.
+		for (size_t i = 0; i < workerCount; ++i)
+		{
+			size_t begin = drawCount * i / workerCount;
+			size_t end = drawCount * (i + 1) / workerCount;
+			bool isLast = (i == workerCount - 1);
+
+			workers.push_back(mThreadPool->Enqueue([=]()
+			{
+				RecordSceneChunk((UINT)i, opaquePso, meshletPso, begin, end, isLast);
+			}));
+		}
+	}
+
 	auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
 	// Reuse the memory associated with command recording.
@@ -225,63 +975,291 @@ void ShapesApp::Draw(const GameTimer& gt)
 
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	if (mIsWireframe)
-	{
-		ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque_wireframe"].Get()));
-	}
-	else
-	{
-		ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
-	}
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
+
+	// Left open, so the profiler ends it after the last list of the frame.
+	mGpuProfiler->BeginScope(mCommandList.Get(), "frame");
 
-	mCommandList->RSSetViewports(1, &mScreenViewport);
-	mCommandList->RSSetScissorRects(1, &mScissorRect);
+	// The culler's buffers hold every object, so they take this frame's added and
+	// removed ones whichever path draws.
+	RecordCullerUpdates(mCommandList.Get());
+
+	GpuProfiler::Scope clearScope = mGpuProfiler->BeginScope(mCommandList.Get(), "clear");
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
 
-	// Clear the back buffer and depth buffer.
-	mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::LightSteelBlue, 0, nullptr);
+	// Clear the back buffer and depth buffer.  With dynamic resolution the scene
+	// target stands in for the back buffer, which the upscale covers whole.
+	mCommandList->ClearRenderTargetView(SceneRenderTargetView(), Colors::LightSteelBlue, 0, nullptr);
 	mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-	// Specify the buffers we are going to render to.
-	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mCbvHeap.Get() };
-	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
-
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	mGpuProfiler->EndScope(mCommandList.Get(), clearScope);
 
-	int passCbvIndex = mPassCbvOffset + mCurrFrameResourceIndex;
-	auto passCbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
-	passCbvHandle.Offset(passCbvIndex, mCbvSrvUavDescriptorSize);
-	mCommandList->SetGraphicsRootDescriptorTable(1, passCbvHandle);
+	// The workers' lists run after this one, behind the pre-pass.
+	if (mIsSceneResident && isDepthPrepass)
+		RecordDepthPrepass();
 
-	DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+	if (mIsSceneResident && mIsGpuCulled)
+		RecordGpuCulledScene(opaquePso, isDepthPrepass && mHiZBuffer != nullptr);
 
-	// Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+	// Without workers, this is the last list of the submission.
+	if (workerCount == 0)
+		RecordPresentTransition(mCommandList.Get());
 
 	// Done recording commands.
 	ThrowIfFailed(mCommandList->Close());
 
-	// Add the command list to the queue for execution.
-	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	// Wait for the workers.  get() rethrows anything a worker threw, and the
+	// guard above waits for the rest.
+	std::vector<ID3D12CommandList*> cmdsLists = { mCommandList.Get() };
+	for (size_t i = 0; i < workerCount; ++i)
+	{
+		workers[i].get();
+		cmdsLists.push_back(mCurrFrameResource->WorkerCmdLists[i].Get());
+	}
+
+	// Resolves the timestamps once everything else in the frame has executed.
+	cmdsLists.push_back(mGpuProfiler->EndFrame());
+
+	// Add the command lists to the queue for execution in a single submission.
+	{
+		CpuScope scope("ExecuteCommandLists");
+		mCommandQueue->ExecuteCommandLists((UINT)cmdsLists.size(), cmdsLists.data());
+	}
 
 	// Swap the back and front buffers
-	ThrowIfFailed(mSwapChain->Present(0, 0));
-	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+	Present();
 
 	// Advance the fence value to mark commands up to this fence point.
 	mCurrFrameResource->Fence = ++mCurrentFence;
+	mUploadRing->EndFrame(mCurrentFence);
 
 	// Add an instruction to the command queue to set a new fence point. 
 	// Because we are on the GPU timeline, the new fence point won't be 
 	// set until the GPU finishes processing all the commands prior to this Signal().
 	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	if (mIsBenchmark)
+		EndBenchmarkFrame();
+}
+
+void ShapesApp::RecordCullerUpdates(ID3D12GraphicsCommandList* cmdList)
+{
+	// The old buffers of a grown culler are read by the frames in flight, and
+	// copied from by this one.
+	mGpuCuller->Reserve(cmdList, mObjectSlots.SlotCount(), mCurrentFence + 1);
+
+	if (mCullerUpdates.empty())
+		return;
+
+	// An object added and removed again since the last frame is written once, as
+	// it is now.
+	std::sort(mCullerUpdates.begin(), mCullerUpdates.end());
+	mCullerUpdates.erase(std::unique(mCullerUpdates.begin(), mCullerUpdates.end()), mCullerUpdates.end());
+
+	std::vector<CullObject> objects(mCullerUpdates.size());
+	std::vector<IndirectCommand> commands(mCullerUpdates.size()*MaxLodCount);
+	for (size_t i = 0; i < mCullerUpdates.size(); ++i)
+		GetCullObject(mCullerUpdates[i], objects[i], &commands[i*MaxLodCount]);
+
+	mGpuCuller->UpdateObjects(cmdList, *mUploadRing, mCullerUpdates, objects, commands);
+	mCullerUpdates.clear();
+}
+
+void ShapesApp::BindSceneState(ID3D12GraphicsCommandList* cmdList, UINT view)
+{
+	cmdList->RSSetViewports(1, &mViews[view].Viewport);
+	cmdList->RSSetScissorRects(1, &mViews[view].ScissorRect);
+
+	// Specify the buffers we are going to render to.
+	cmdList->OMSetRenderTargets(1, &SceneRenderTargetView(), true, &DepthStencilView());
+
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+	// The constant buffers are bound as root descriptors, so no descriptor heap is needed.
+	cmdList->SetGraphicsRootConstantBufferView(1, mCurrFrameResource->PassCBAddresses[view]);
+}
+
+void ShapesApp::BindMultiViewState(ID3D12GraphicsCommandList* cmdList)
+{
+	// The vertex shader sends each instance to its view's viewport, and the
+	// scissor rectangle of the same index applies.
+	D3D12_VIEWPORT viewports[MaxViewCount];
+	D3D12_RECT scissorRects[MaxViewCount];
+	for (UINT v = 0; v < mViewCount; ++v)
+	{
+		viewports[v] = mViews[v].Viewport;
+		scissorRects[v] = mViews[v].ScissorRect;
+	}
+
+	cmdList->RSSetViewports(mViewCount, viewports);
+	cmdList->RSSetScissorRects(mViewCount, scissorRects);
+	cmdList->SetGraphicsRootConstantBufferView(4, mCurrFrameResource->MultiViewCBAddress);
+}
+
+void ShapesApp::RecordDepthPrepass()
+{
+	mCommandList->SetPipelineState(mPsoManager->Get(DepthPsoKey(m4xMsaaState)));
+	BindSceneState(mCommandList.Get());
+
+	// The PSO writes no color, so only the depth buffer is bound.
+	mCommandList->OMSetRenderTargets(0, nullptr, false, &DepthStencilView());
+
+	GpuProfiler::Scope prepassScope = mGpuProfiler->BeginScope(mCommandList.Get(), "prepass");
+	DrawInstanceBatches(mCommandList.Get(), mOccluderRuns, 0, mOccluderRuns.size());
+	mGpuProfiler->EndScope(mCommandList.Get(), prepassScope);
+}
+
+void ShapesApp::RecordGpuCulledScene(ID3D12PipelineState* pso, bool isOcclusionCulled)
+{
+	// The pre-pass depths are this frame's, so the pyramid built from them hides
+	// nothing that is in view.
+	if (isOcclusionCulled)
+	{
+		GpuProfiler::Scope hiZScope = mGpuProfiler->BeginScope(mCommandList.Get(), "hiz");
+		mHiZBuffer->Build(mCommandList.Get());
+		mGpuProfiler->EndScope(mCommandList.Get(), hiZScope);
+	}
+
+	// Each view is culled and drawn in turn, reusing the culler's output.  The
+	// pyramid holds the main view's depths, so only the main view is tested
+	// against it.
+	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+	for (UINT v = 0; v < mViewCount; ++v)
+	{
+		const SceneView& view = mViews[v];
+		bool isViewOcclusionCulled = isOcclusionCulled && v == 0;
+
+		// Test the objects against the frustum of this frame's camera, using the
+		// world matrices that were just written to the instance buffer.
+		XMMATRIX viewProj = XMMatrixTranspose(XMLoadFloat4x4(&view.PassCB.ViewProj));
+		GpuProfiler::Scope cullScope = mGpuProfiler->BeginScope(mCommandList.Get(), "cull");
+		mGpuCuller->Cull(mCommandList.Get(), objectCB->GetGPUVirtualAddress(), instanceBuffer->GetGPUVirtualAddress(),
+			viewProj, isViewOcclusionCulled ? mHiZBuffer.get() : nullptr, &view.Viewport);
+		mGpuProfiler->EndScope(mCommandList.Get(), cullScope);
+
+		// Cull changed the pipeline state and root signature.
+		mCommandList->SetPipelineState(pso);
+		BindSceneState(mCommandList.Get(), v);
+
+		// The indirect commands set the object constants and geometry, but not the
+		// topology, which is why only triangle lists are sent down this path.
+		mCommandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		GpuProfiler::Scope opaqueScope = mGpuProfiler->BeginScope(mCommandList.Get(), "opaque");
+		mGpuCuller->Draw(mCommandList.Get());
+		mGpuProfiler->EndScope(mCommandList.Get(), opaqueScope);
+	}
+}
+
+void ShapesApp::RecordSceneChunk(UINT worker, ID3D12PipelineState* pso, ID3D12PipelineState* meshletPso,
+	size_t begin, size_t end, bool isLast)
+{
+	CpuScope scope("RecordSceneChunk");
+
+	auto cmdListAlloc = mCurrFrameResource->WorkerCmdListAllocs[worker];
+	auto cmdList = mCurrFrameResource->WorkerCmdLists[worker];
+
+	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(cmdList->Reset(cmdListAlloc.Get(), pso));
+
+	// Command lists do not inherit state from each other, so every worker has to
+	// set up the pipeline state itself.
+	BindSceneState(cmdList.Get());
+
+	// Every worker times its own chunk; the profiler adds them up.
+	GpuProfiler::Scope opaqueScope = mGpuProfiler->BeginScope(cmdList.Get(), "opaque");
+	if (IsMultiViewPass())
+	{
+		// Each run is drawn for every view at once.
+		BindMultiViewState(cmdList.Get());
+		DrawInstanceBatches(cmdList.Get(), mVisibleBatches, begin, end, mViewCount);
+	}
+	else
+	{
+		// The chunk may hold the draws of several views, which each draw into
+		// their own viewport with their own pass constants.
+		const std::vector<size_t>& viewBegin = mIsInstanced ? mViewBatchBegin : mViewRitemBegin;
+		for (UINT v = 0; v < mViewCount; ++v)
+		{
+			size_t viewDrawBegin = std::max<size_t>(begin, viewBegin[v]);
+			size_t viewDrawEnd = std::min<size_t>(end, viewBegin[v + 1]);
+			if (viewDrawBegin >= viewDrawEnd)
+				continue;
+
+			cmdList->RSSetViewports(1, &mViews[v].Viewport);
+			cmdList->RSSetScissorRects(1, &mViews[v].ScissorRect);
+
+			// The meshlet renderer binds its own root signature and pass constants.
+			if (meshletPso != nullptr)
+			{
+				DrawMeshletBatches(cmdList.Get(), meshletPso, v, mVisibleBatches, viewDrawBegin, viewDrawEnd);
+				continue;
+			}
+
+			cmdList->SetGraphicsRootConstantBufferView(1, mCurrFrameResource->PassCBAddresses[v]);
+			if (mIsInstanced)
+				DrawInstanceBatches(cmdList.Get(), mVisibleBatches, viewDrawBegin, viewDrawEnd);
+			else
+				DrawRenderItems(cmdList.Get(), mVisibleRitems, viewDrawBegin, viewDrawEnd);
+		}
+	}
+	mGpuProfiler->EndScope(cmdList.Get(), opaqueScope);
+
+	// The last list in the submission hands the back buffer back for presenting.
+	if (isLast)
+		RecordPresentTransition(cmdList.Get());
+
+	ThrowIfFailed(cmdList->Close());
+}
+
+void ShapesApp::RecordPresentTransition(ID3D12GraphicsCommandList* cmdList)
+{
+	// The scene was drawn at a reduced resolution, and is stretched over the back
+	// buffer ahead of the overlay.
+	if (mDynamicResolution != nullptr)
+	{
+		GpuProfiler::Scope upscaleScope = mGpuProfiler->BeginScope(cmdList, "upscale");
+		mDynamicResolution->Upscale(cmdList, CurrentBackBufferView());
+		mGpuProfiler->EndScope(cmdList, upscaleScope);
+	}
+
+	// The overlay shows the timings of earlier frames, so it is drawn over this one
+	// without being timed itself.
+	if (mShowGpuOverlay)
+	{
+		D3D12_RECT area = { 8, 8, 8 + mClientWidth / 3, mClientHeight - 8 };
+		mGpuProfiler->DrawOverlay(cmdList, CurrentBackBufferView(), area, GpuOverlayBudgetMs);
+	}
+
+	GpuProfiler::Scope presentScope = mGpuProfiler->BeginScope(cmdList, "present");
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+	mGpuProfiler->EndScope(cmdList, presentScope);
+}
+
+std::wstring ShapesApp::GetFrameStatsText()const
+{
+	// The average GPU time of the frame next to the CPU's mspf tells which of the
+	// two bounds it, and the passes tell where the GPU time goes.
+	std::wstring text;
+	for (const GpuProfiler::ScopeStats& scope : mGpuProfiler->GetStats())
+	{
+		wchar_t buffer[128];
+		swprintf_s(buffer, L"   %S: %.2f ms (p99 %.2f)", scope.Name.c_str(), scope.AvgMs, scope.P99Ms);
+		text += buffer;
+	}
+
+	if (mDynamicResolution != nullptr)
+	{
+		wchar_t buffer[64];
+		swprintf_s(buffer, L"   scale: %.2f", mDynamicResolution->Scale());
+		text += buffer;
+	}
+
+	return text;
 }
 
 void ShapesApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -299,6 +1277,9 @@ void ShapesApp::OnMouseUp(WPARAM btnState, int x, int y)
 
 void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
 {
+	if (mIsBenchmark)
+		return;
+
 	if ((btnState & MK_LBUTTON) != 0)
 	{
 		// Make each pixel correspond to a quarter of a degree.
@@ -331,10 +1312,25 @@ void ShapesApp::OnMouseMove(WPARAM btnState, int x, int y)
 
 void ShapesApp::OnKeyboardInput(const GameTimer& gt)
 {
+	CpuScope scope("OnKeyboardInput");
+
 	if (GetAsyncKeyState('1') & 0x8000)
 		mIsWireframe = true;
 	else
 		mIsWireframe = false;
+
+	if (GetAsyncKeyState('2') & 0x8000)
+		mIsInstanced = false;
+	else
+		mIsInstanced = true;
+
+	if (GetAsyncKeyState('3') & 0x8000)
+		mIsGpuCulled = false;
+	else
+		mIsGpuCulled = true;
+
+	// Holding 4 shows the GPU profiler overlay, or hides it with -gpuoverlay.
+	mShowGpuOverlay = mGpuOverlayOption != ((GetAsyncKeyState('4') & 0x8000) != 0);
 }
 
 void ShapesApp::UpdateCamera(const GameTimer& gt)
@@ -353,144 +1349,743 @@ void ShapesApp::UpdateCamera(const GameTimer& gt)
 	XMStoreFloat4x4(&mView, view);
 }
 
-void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+void ShapesApp::LayoutViews()
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for (auto& e : mAllRitems)
+	// Alone, the main view fills the window.  Beside other views it keeps the left
+	// three quarters, and they stack in a column on its right.  The viewports do
+	// not overlap, so all the views share the one depth buffer.  Drawn at a
+	// reduced resolution, the layout shrinks into the top left of the targets,
+	// keeping each view's aspect ratio.  The edges are rounded to whole pixels
+	// after scaling, so the scissor rects and the upscale see the same ones.
+	float width = (float)mClientWidth;
+	float height = (float)mClientHeight;
+	float mainWidth = mViewCount > 1 ? std::floor(0.75f*width) : width;
+	float sideHeight = mViewCount > 1 ? std::floor(height / (mViewCount - 1)) : 0.0f;
+
+	mViews.resize(mViewCount);
+	for (UINT v = 0; v < mViewCount; ++v)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+		float left = ScalePixels(v == 0 ? 0.0f : mainWidth);
+		float top = ScalePixels(v == 0 ? 0.0f : (v - 1)*sideHeight);
+		float right = ScalePixels(v == 0 ? mainWidth : width);
+		float bottom = ScalePixels(v == 0 ? height : v*sideHeight);
+
+		D3D12_VIEWPORT& viewport = mViews[v].Viewport;
+		viewport.TopLeftX = left;
+		viewport.TopLeftY = top;
+		viewport.Width = right - left;
+		viewport.Height = bottom - top;
+		viewport.MinDepth = 0.0f;
+		viewport.MaxDepth = 1.0f;
+
+		mViews[v].ScissorRect = { (LONG)viewport.TopLeftX, (LONG)viewport.TopLeftY,
+			(LONG)(viewport.TopLeftX + viewport.Width), (LONG)(viewport.TopLeftY + viewport.Height) };
 	}
 }
 
-void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
+void ShapesApp::UpdateViews()
 {
-	XMMATRIX view = XMLoadFloat4x4(&mView);
-	XMMATRIX proj = XMLoadFloat4x4(&mProj);
-
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mMainPassCB.EyePosW = mEyePos;
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = 1000.0f;
-	mMainPassCB.TotalTime = gt.TotalTime();
-	mMainPassCB.DeltaTime = gt.DeltaTime();
+	// The main view is the orbit camera.
+	mViews[0].EyePos = mEyePos;
+	mViews[0].View = mView;
+	mViews[0].Proj = mProj;
+
+	// The map looks straight down from high enough to take in the scene, and the
+	// fixed camera looks on from above one of its corners.  Their far planes are
+	// pushed back to keep a large stress scene in.
+	XMVECTOR target = XMVectorZero();
+	for (UINT v = 1; v < mViewCount; ++v)
+	{
+		SceneView& view = mViews[v];
 
-	auto currPassCB = mCurrFrameResource->PassCB.get();
-	currPassCB->CopyData(0, mMainPassCB);
+		XMVECTOR pos, up;
+		float fovY = 0.25f*MathHelper::Pi;
+		if (v == 1)
+		{
+			pos = XMVectorSet(0.0f, 3.0f*mSceneRadius, 0.0f, 1.0f);
+			up = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		}
+		else
+		{
+			pos = XMVectorSet(mSceneRadius, 0.5f*mSceneRadius, -mSceneRadius, 1.0f);
+			up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+			fovY = 0.3f*MathHelper::Pi;
+		}
+
+		float aspect = view.Viewport.Width / std::max<float>(view.Viewport.Height, 1.0f);
+		view.FarZ = std::max<float>(1000.0f, 5.0f*mSceneRadius);
+
+		XMStoreFloat3(&view.EyePos, pos);
+		XMStoreFloat4x4(&view.View, XMMatrixLookAtLH(pos, target, up));
+		XMStoreFloat4x4(&view.Proj, XMMatrixPerspectiveFovLH(fovY, aspect, 1.0f, view.FarZ));
+	}
 }
 
-void ShapesApp::BuildDescriptorHeaps()
+float ShapesApp::ScalePixels(float pixels)const
 {
-	UINT objCount = (UINT)mOpaqueRitems.size();
+	return mDynamicResolution != nullptr ? mDynamicResolution->ScalePixels(pixels) : pixels;
+}
 
-	// Need a CBV descriptor for each object for each frame resource,
-	// +1 for the perPass CBV for each frame resource.
-	UINT numDescriptors = (objCount + 1) * gNumFrameResources;
+D3D12_CPU_DESCRIPTOR_HANDLE ShapesApp::SceneRenderTargetView()const
+{
+	return mDynamicResolution != nullptr ? mDynamicResolution->SceneRtv() : CurrentBackBufferView();
+}
 
-	// Save an offset to the start of the pass CBVs.  These are the last 3 descriptors.
-	mPassCbvOffset = objCount * gNumFrameResources;
+bool ShapesApp::IsMultiViewPass()const
+{
+	// Only the CPU culled instanced path draws instances of its own, which the
+	// pass multiplies by the views.  The others draw the views one by one.
+	return mIsMultiView && mViewCount > 1 && mIsInstanced && !mIsGpuCulled;
+}
 
-	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDesc;
-	cbvHeapDesc.NumDescriptors = numDescriptors;
-	cbvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	cbvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	cbvHeapDesc.NodeMask = 0;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&cbvHeapDesc,
-		IID_PPV_ARGS(&mCbvHeap)));
+void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
+{
+	CpuScope scope("UpdateObjectCBs");
+
+	// The instance buffer is indexed the same way as the object cbuffer, and the
+	// world matrix is the first member of both, so every dirty transform is
+	// streamed into the two buffers in one pass.  Dirty state is tracked per
+	// frame resource by the transform array.
+	TransformArray::StreamTarget targets[2];
+	targets[0].MappedData = mCurrFrameResource->ObjectCB->MappedData();
+	targets[0].ElementByteSize = mCurrFrameResource->ObjectCB->ElementByteSize();
+	targets[1].MappedData = mCurrFrameResource->InstanceBuffer->MappedData();
+	targets[1].ElementByteSize = mCurrFrameResource->InstanceBuffer->ElementByteSize();
+
+	mTransforms.StreamDirty(mCurrFrameResourceIndex, targets, _countof(targets), mThreadPool.get());
 }
 
-void ShapesApp::BuildConstantBufferViews()
+void ShapesApp::UpdatePassCBs(const GameTimer& gt)
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	CpuScope scope("UpdatePassCBs");
+
+	MultiViewConstants multiViewCB;
+	multiViewCB.ViewCount = mViewCount;
 
-	UINT objCount = (UINT)mOpaqueRitems.size();
+	mCurrFrameResource->PassCBAddresses.resize(mViewCount);
+	for (UINT v = 0; v < mViewCount; ++v)
+	{
+		SceneView& sceneView = mViews[v];
+		PassConstants& passCB = sceneView.PassCB;
+
+		XMMATRIX view = XMLoadFloat4x4(&sceneView.View);
+		XMMATRIX proj = XMLoadFloat4x4(&sceneView.Proj);
+
+		XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+		XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+		XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+		XMStoreFloat4x4(&passCB.View, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&passCB.InvView, XMMatrixTranspose(invView));
+		XMStoreFloat4x4(&passCB.Proj, XMMatrixTranspose(proj));
+		XMStoreFloat4x4(&passCB.InvProj, XMMatrixTranspose(invProj));
+		XMStoreFloat4x4(&passCB.ViewProj, XMMatrixTranspose(viewProj));
+		XMStoreFloat4x4(&passCB.InvViewProj, XMMatrixTranspose(invViewProj));
+		passCB.EyePosW = sceneView.EyePos;
+		passCB.RenderTargetSize = XMFLOAT2(sceneView.Viewport.Width, sceneView.Viewport.Height);
+		passCB.InvRenderTargetSize = XMFLOAT2(1.0f / sceneView.Viewport.Width, 1.0f / sceneView.Viewport.Height);
+		passCB.NearZ = 1.0f;
+		passCB.FarZ = sceneView.FarZ;
+		passCB.TotalTime = gt.TotalTime();
+		passCB.DeltaTime = gt.DeltaTime();
+
+		mCurrFrameResource->PassCBAddresses[v] = mUploadRing->AllocateConstants(passCB).GpuAddress;
+		multiViewCB.ViewProj[v] = passCB.ViewProj;
+	}
+
+	if (mIsMultiView)
+		mCurrFrameResource->MultiViewCBAddress = mUploadRing->AllocateConstants(multiViewCB).GpuAddress;
+}
+
+void ShapesApp::SelectLods()
+{
+	// Pixels covered by one unit of length at unit distance from the eye.  The
+	// levels are picked for the main view, and the other views draw them too.
+	// Drawn at a reduced resolution, the error is measured in the pixels drawn.
+	float pixelsPerUnit = 0.5f * mProj(1, 1) * mViews[0].Viewport.Height;
+	XMVECTOR eyePos = XMLoadFloat3(&mEyePos);
 
-	// Need a CBV descriptor for each object for each frame resource.
-	for (int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
+	for (RenderItem* ri : mOpaqueRitems)
 	{
-		auto objectCB = mFrameResources[frameIndex]->ObjectCB->Resource();
-		for (UINT i = 0; i < objCount; ++i)
+		if (ri != nullptr && ri->Lods.size() > 1)
 		{
-			D3D12_GPU_VIRTUAL_ADDRESS cbAddress = objectCB->GetGPUVirtualAddress();
+			// Project the error of each level from the nearest point of the item's
+			// bounding sphere.  The world matrix may scale, which scales the error
+			// and the sphere alike.
+			XMMATRIX world = XMLoadFloat4x4(&mTransforms.Get(ri->ObjCBIndex));
+			float scale = std::max<float>(std::max<float>(XMVectorGetX(XMVector3Length(world.r[0])),
+				XMVectorGetX(XMVector3Length(world.r[1]))), XMVectorGetX(XMVector3Length(world.r[2])));
+
+			XMVECTOR center = XMVector3Transform(XMLoadFloat3(&ri->Bounds.Center), world);
+			float radius = scale * XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->Bounds.Extents)));
+			float distance = std::max<float>(XMVectorGetX(XMVector3Length(center - eyePos)) - radius, mViews[0].PassCB.NearZ);
+
+			// The coarsest level whose error stays under the threshold.
+			float errorToPixels = scale * pixelsPerUnit / distance;
+			UINT lod = 0;
+			while (lod + 1 < ri->Lods.size() && ri->Lods[lod + 1].Error * errorToPixels <= mLodPixelError)
+				++lod;
+
+			if (lod != ri->Lod)
+			{
+				const RenderItemLod& level = ri->Lods[lod];
+				ri->Lod = lod;
+				ri->Geo = level.Geo;
+				ri->IndexCount = level.IndexCount;
+				ri->StartIndexLocation = level.StartIndexLocation;
+				ri->BaseVertexLocation = level.BaseVertexLocation;
+				mObjectChanges.MarkChanged(ri->ObjCBIndex);
+			}
+		}
+	}
+}
 
-			// Offset to the ith object constant buffer in the buffer.
-			cbAddress += i * objCBByteSize;
+void ShapesApp::UpdateObjectData()
+{
+	CpuScope scope("UpdateObjectData");
+
+	// The GPU culler picks the command of the selected level from the instance
+	// buffer.  An item added into a slot brings its own dequantization, which
+	// never changes after.  The world matrices are streamed by UpdateObjectCBs, and
+	// free slots are left as they are, since nothing draws them.
+	UINT objCBByteSize = mCurrFrameResource->ObjectCB->ElementByteSize();
+	BYTE* objectCB = mCurrFrameResource->ObjectCB->MappedData();
+	UINT instanceByteSize = mCurrFrameResource->InstanceBuffer->ElementByteSize();
+	BYTE* instances = mCurrFrameResource->InstanceBuffer->MappedData();
+
+	mObjectChanges.TakeChanges(mCurrFrameResourceIndex, mChangedObjects);
+	for (UINT objIndex : mChangedObjects)
+	{
+		const RenderItem* ri = mAllRitems[objIndex].get();
+		if (ri == nullptr)
+			continue;
+
+		auto objConstants = reinterpret_cast<ObjectConstants*>(objectCB + (size_t)objIndex*objCBByteSize);
+		objConstants->PositionScale = ri->PositionScale;
+		objConstants->PositionBias = ri->PositionBias;
+
+		auto instance = reinterpret_cast<InstanceData*>(instances + (size_t)objIndex*instanceByteSize);
+		instance->PositionScale = ri->PositionScale;
+		instance->PositionBias = ri->PositionBias;
+		instance->LodIndex = ri->Lod;
+	}
+}
 
-			// Offset to the object cbv in the descriptor heap.
-			int heapIndex = frameIndex * objCount + i;
-			auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
-			handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
+void ShapesApp::UpdateProjectiles(const GameTimer& gt)
+{
+	CpuScope scope("UpdateProjectiles");
 
-			D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-			cbvDesc.BufferLocation = cbAddress;
-			cbvDesc.SizeInBytes = objCBByteSize;
+	float dt = gt.DeltaTime();
 
-			md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+	// Move the projectiles along their arcs, and remove the ones whose time is up.
+	size_t flying = 0;
+	for (Projectile& projectile : mProjectiles)
+	{
+		projectile.Age += dt;
+		if (projectile.Age >= projectile.Lifetime)
+		{
+			RemoveRenderItem(projectile.Item);
+			continue;
 		}
+
+		projectile.Velocity.y -= ProjectileGravity*dt;
+		XMVECTOR position = XMLoadFloat3(&projectile.Position) + dt*XMLoadFloat3(&projectile.Velocity);
+		XMStoreFloat3(&projectile.Position, position);
+		SetWorld(projectile.Item, XMMatrixScaling(ProjectileScale, ProjectileScale, ProjectileScale)*
+			XMMatrixTranslationFromVector(position));
+
+		mProjectiles[flying++] = projectile;
+	}
+	mProjectiles.resize(flying);
+
+	// Spawn at the rate that keeps mProjectileCount in flight over their average
+	// lifetime, so the slots of the ones removed are soon reused.  They are thrown
+	// up from anywhere over the middle of the scene.
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	mProjectileSpawnBudget += dt*mProjectileCount / ProjectileLifetime;
+	while (mProjectileSpawnBudget >= 1.0f && mProjectiles.size() < mProjectileCount)
+	{
+		mProjectileSpawnBudget -= 1.0f;
+
+		float angle = XM_2PI*unit(mProjectileRandom);
+		float distance = 0.5f*mSceneRadius*unit(mProjectileRandom);
+		float heading = XM_2PI*unit(mProjectileRandom);
+		float speed = 2.0f + 4.0f*unit(mProjectileRandom);
+
+		Projectile projectile;
+		projectile.Position = XMFLOAT3(distance*cosf(angle), 1.0f, distance*sinf(angle));
+		projectile.Velocity = XMFLOAT3(speed*cosf(heading), 8.0f + 6.0f*unit(mProjectileRandom), speed*sinf(heading));
+		projectile.Lifetime = ProjectileLifetime*(0.5f + unit(mProjectileRandom));
+		projectile.Item = AddRenderItem(mProjectilePrototype,
+			XMMatrixScaling(ProjectileScale, ProjectileScale, ProjectileScale)*
+			XMMatrixTranslation(projectile.Position.x, projectile.Position.y, projectile.Position.z));
+		mProjectiles.push_back(projectile);
 	}
 
-	UINT passCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassConstants));
+	// Spawning does not fall behind while the count is full.
+	mProjectileSpawnBudget = std::min<float>(mProjectileSpawnBudget, 1.0f);
+}
 
-	// Last three descriptors are the pass CBVs for each frame resource.
-	for (int frameIndex = 0; frameIndex < gNumFrameResources; ++frameIndex)
+void ShapesApp::CullRenderItems()
+{
+	// Items added past the end of the hierarchy are only placed by a rebuild, as
+	// are items moved while the GPU culled, and enough of them in the slots of
+	// removed ones that its boxes have grown loose.
+	if (mIsBvhStale || mOpaqueBvh.ObjectCount() < mObjectSlots.SlotCount() ||
+		mBvhInsertCount > mOpaqueBvh.ObjectCount() / 4)
 	{
-		auto passCB = mFrameResources[frameIndex]->PassCB->Resource();
-		D3D12_GPU_VIRTUAL_ADDRESS cbAddress = passCB->GetGPUVirtualAddress();
+		BuildBvh();
+	}
+
+	// Fold the items that moved since the last frame into the hierarchy.
+	mOpaqueBvh.Refit();
 
-		// Offset to the pass cbv in the descriptor heap.
-		int heapIndex = mPassCbvOffset + frameIndex;
-		auto handle = CD3DX12_CPU_DESCRIPTOR_HANDLE(mCbvHeap->GetCPUDescriptorHandleForHeapStart());
-		handle.Offset(heapIndex, mCbvSrvUavDescriptorSize);
+	mVisibleRitems.clear();
+	mVisibleBatches.clear();
+	mViewRitemBegin.clear();
+	mViewBatchBegin.clear();
 
-		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc;
-		cbvDesc.BufferLocation = cbAddress;
-		cbvDesc.SizeInBytes = passCBByteSize;
+	if (IsMultiViewPass())
+	{
+		// One list of draws serves every view: the items in any of them, each
+		// with the mask of the views it is in, which the vertex shader reads to
+		// drop its instances in the others.
+		mObjectViewMasks.resize(mAllRitems.size(), 0);
+		mViewRitems.clear();
+		for (UINT v = 0; v < mViewCount; ++v)
+		{
+			QueryView(mViews[v]);
+			for (UINT i : mVisibleObjects)
+			{
+				RenderItem* ri = mOpaqueRitems[i];
+				if (mObjectViewMasks[ri->ObjCBIndex] == 0)
+					mViewRitems.push_back(ri);
+				mObjectViewMasks[ri->ObjCBIndex] |= 1u << v;
+			}
+		}
 
-		md3dDevice->CreateConstantBufferView(&cbvDesc, handle);
+		// The masks are left cleared for the next frame.
+		UINT instanceByteSize = mCurrFrameResource->InstanceBuffer->ElementByteSize();
+		BYTE* instances = mCurrFrameResource->InstanceBuffer->MappedData();
+		for (RenderItem* ri : mViewRitems)
+		{
+			auto instance = reinterpret_cast<InstanceData*>(instances + (size_t)ri->ObjCBIndex*instanceByteSize);
+			instance->ViewMask = mObjectViewMasks[ri->ObjCBIndex];
+			mObjectViewMasks[ri->ObjCBIndex] = 0;
+		}
+
+		AppendViewDraws(mViews[0]);
 	}
+	else
+	{
+		// Each view is culled on its own, and its draws follow the last view's.
+		for (UINT v = 0; v < mViewCount; ++v)
+		{
+			QueryView(mViews[v]);
+
+			mViewRitems.clear();
+			for (UINT i : mVisibleObjects)
+				mViewRitems.push_back(mOpaqueRitems[i]);
+
+			AppendViewDraws(mViews[v]);
+		}
+	}
+
+	mViewRitemBegin.push_back(mVisibleRitems.size());
+	mViewBatchBegin.push_back(mVisibleBatches.size());
 }
 
-void ShapesApp::BuildRootSignature()
+void ShapesApp::QueryView(const SceneView& view)
+{
+	// Bring the camera frustum into world space, where the BVH lives.
+	XMMATRIX viewMatrix = XMLoadFloat4x4(&view.View);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(viewMatrix), viewMatrix);
+
+	BoundingFrustum frustumV;
+	BoundingFrustum::CreateFromMatrix(frustumV, XMLoadFloat4x4(&view.Proj));
+
+	BoundingFrustum frustumW;
+	frustumV.Transform(frustumW, invView);
+
+	mVisibleObjects.clear();
+	mOpaqueBvh.Query(frustumW, mVisibleObjects);
+}
+
+void ShapesApp::AppendViewDraws(const SceneView& view)
+{
+	mViewRitemBegin.push_back(mVisibleRitems.size());
+	mViewBatchBegin.push_back(mVisibleBatches.size());
+
+	std::sort(mViewRitems.begin(), mViewRitems.end(),
+		[](const RenderItem* a, const RenderItem* b) { return a->ObjCBIndex < b->ObjCBIndex; });
+
+	// Every opaque draw shares the one PSO of the pass.
+	const UINT opaquePsoId = 0;
+
+	XMVECTOR eyePos = XMLoadFloat3(&view.EyePos);
+	mVisibleKeys.resize(mViewRitems.size());
+	for (size_t i = 0; i < mViewRitems.size(); ++i)
+	{
+		RenderItem* ri = mViewRitems[i];
+
+		XMMATRIX world = XMLoadFloat4x4(&mTransforms.Get(ri->ObjCBIndex));
+		XMVECTOR center = XMVector3Transform(XMLoadFloat3(&ri->Bounds.Center), world);
+		float distanceSq = XMVectorGetX(XMVector3LengthSq(center - eyePos));
+
+		mVisibleKeys[i] = DrawSortKey(opaquePsoId, ri->Lods[ri->Lod].GeoIndex, ri->PrimitiveType, distanceSq);
+	}
+
+	// Each batch covers a contiguous range of object indices, so its visible
+	// members form runs of consecutive indices at the same LOD that are each one
+	// instanced draw.  A run sorts by the key of its nearest member.
+	mViewBatches.clear();
+	mVisibleBatchKeys.clear();
+	for (size_t i = 0; i < mViewRitems.size(); ++i)
+	{
+		if (AppendToRun(mViewBatches, mViewRitems[i]))
+			mVisibleBatchKeys.push_back(mVisibleKeys[i]);
+		else
+			mVisibleBatchKeys.back() = std::min<UINT64>(mVisibleBatchKeys.back(), mVisibleKeys[i]);
+	}
+
+	// The runs needed the items in ObjCBIndex order, so both are only sorted now.
+	SortDraws(mViewRitems, mVisibleKeys, mSortedRitems);
+	SortDraws(mViewBatches, mVisibleBatchKeys, mSortedBatches);
+
+	mVisibleRitems.insert(mVisibleRitems.end(), mViewRitems.begin(), mViewRitems.end());
+	mVisibleBatches.insert(mVisibleBatches.end(), mViewBatches.begin(), mViewBatches.end());
+}
+
+bool ShapesApp::AppendToRun(std::vector<InstanceBatch>& runs, const RenderItem* ri)const
+{
+	// The item continues the last run if it is the next object of the same batch
+	// and draws the same LOD.
+	if (!runs.empty())
+	{
+		InstanceBatch& run = runs.back();
+		if (run.StartInstanceLocation + run.InstanceCount == ri->ObjCBIndex)
+		{
+			const RenderItem* prev = mAllRitems[ri->ObjCBIndex - 1].get();
+			if (mBatchOfObject[prev->ObjCBIndex] == mBatchOfObject[ri->ObjCBIndex] && prev->Lod == ri->Lod)
+			{
+				run.InstanceCount++;
+				return false;
+			}
+		}
+	}
+
+	InstanceBatch run = mInstanceBatches[mBatchOfObject[ri->ObjCBIndex]];
+	run.Geo = ri->Geo;
+	run.IndexCount = ri->IndexCount;
+	run.StartIndexLocation = ri->StartIndexLocation;
+	run.BaseVertexLocation = ri->BaseVertexLocation;
+	run.MeshletOffset = ri->Lods[ri->Lod].MeshletOffset;
+	run.MeshletCount = ri->Lods[ri->Lod].MeshletCount;
+	run.StartInstanceLocation = ri->ObjCBIndex;
+	run.InstanceCount = 1;
+	runs.push_back(run);
+
+	return true;
+}
+
+void ShapesApp::BuildOccluderRuns()
+{
+	// Every occluder is drawn, in view or not: the runs keep it to a few draws,
+	// and the rasterizer discards what is off screen.  Each is drawn at the LOD the
+	// opaque pass draws it at, so both passes write the same depths.
+	mOccluderRuns.clear();
+	for (RenderItem* ri : mOccluderRitems)
+		AppendToRun(mOccluderRuns, ri);
+}
+
+template<typename T>
+void ShapesApp::SortDraws(std::vector<T>& draws, const std::vector<UINT64>& keys, std::vector<T>& scratch)
+{
+	mDrawSortEntries.resize(draws.size());
+	for (size_t i = 0; i < draws.size(); ++i)
+		mDrawSortEntries[i] = { keys[i], (UINT)i };
+
+	RadixSort(mDrawSortEntries, mDrawSortScratch);
+
+	scratch.resize(draws.size());
+	for (size_t i = 0; i < draws.size(); ++i)
+		scratch[i] = draws[mDrawSortEntries[i].Value];
+
+	draws.swap(scratch);
+}
+
+void ShapesApp::SetWorld(RenderItem* ri, FXMMATRIX world)
+{
+	XMFLOAT4X4 w;
+	XMStoreFloat4x4(&w, world);
+	mTransforms.Set(ri->ObjCBIndex, w);
+
+	// The BVH nodes above the item are refit on the next cull.  An item past the
+	// end of the BVH, or moved while the GPU culls, is placed by its next rebuild.
+	if (mIsGpuCulled)
+		mIsBvhStale = true;
+	else if (ri->ObjCBIndex < mOpaqueBvh.ObjectCount())
+	{
+		BoundingBox worldBounds;
+		ri->Bounds.Transform(worldBounds, world);
+		mOpaqueBvh.SetBounds(ri->ObjCBIndex, worldBounds);
+	}
+}
+
+RenderItem* ShapesApp::AddRenderItem(const RenderItem& prototype, FXMMATRIX world)
 {
-	CD3DX12_DESCRIPTOR_RANGE cbvTable0;
-	cbvTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
+	// The item's draw state is the prototype's, which must be at its finest level.
+	// The slot may be a removed item's that no frame in flight reads any more, or
+	// a new one that every array indexed by slot grows by.
+	UINT slot = mObjectSlots.Allocate();
+	if (slot == (UINT)mAllRitems.size())
+	{
+		mAllRitems.emplace_back();
+		mOpaqueRitems.push_back(nullptr);
+		mBatchOfObject.push_back(0);
+		mTransforms.Add(world);
+	}
 
-	CD3DX12_DESCRIPTOR_RANGE cbvTable1;
-	cbvTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 1);
+	auto ritem = std::make_unique<RenderItem>(prototype);
+	ritem->ObjCBIndex = slot;
+	RenderItem* ri = ritem.get();
+
+	mAllRitems[slot] = std::move(ritem);
+	mOpaqueRitems[slot] = ri;
+	mBatchOfObject[slot] = FindInstanceBatch(*ri);
+
+	SetWorld(ri, world);
+	if (slot < mOpaqueBvh.ObjectCount())
+		mOpaqueBvh.SetActive(slot, true);
+	++mBvhInsertCount;
+
+	// The occluders are kept by ObjCBIndex, for their runs.
+	if (ri->IsOccluder)
+	{
+		auto pos = std::lower_bound(mOccluderRitems.begin(), mOccluderRitems.end(), ri,
+			[](const RenderItem* a, const RenderItem* b) { return a->ObjCBIndex < b->ObjCBIndex; });
+		mOccluderRitems.insert(pos, ri);
+	}
 
+	// Each frame resource takes the item's constants on its next use, and the
+	// culler its bounds and commands on the next frame.
+	mObjectChanges.MarkChanged(slot);
+	mCullerUpdates.push_back(slot);
+
+	return ri;
+}
+
+void ShapesApp::RemoveRenderItem(RenderItem* ri)
+{
+	UINT slot = ri->ObjCBIndex;
+
+	if (slot < mOpaqueBvh.ObjectCount())
+		mOpaqueBvh.SetActive(slot, false);
+
+	if (ri->IsOccluder)
+		mOccluderRitems.erase(std::find(mOccluderRitems.begin(), mOccluderRitems.end(), ri));
+
+	// The frames in flight may still draw the item from its slot, so it is only
+	// handed out again once the frame being built is done too.
+	mObjectSlots.Free(slot, mCurrentFence + 1);
+	mCullerUpdates.push_back(slot);
+
+	mOpaqueRitems[slot] = nullptr;
+	mAllRitems[slot] = nullptr;
+}
+
+UINT ShapesApp::FindInstanceBatch(const RenderItem& ri)
+{
+	for (UINT i = 0; i < (UINT)mInstanceBatches.size(); ++i)
+	{
+		const InstanceBatch& batch = mInstanceBatches[i];
+		if (batch.Geo == ri.Geo &&
+			batch.PrimitiveType == ri.PrimitiveType &&
+			batch.IndexCount == ri.IndexCount &&
+			batch.StartIndexLocation == ri.StartIndexLocation &&
+			batch.BaseVertexLocation == ri.BaseVertexLocation)
+		{
+			return i;
+		}
+	}
+
+	// A submesh the scene was built without gets a batch with no range of its own.
+	InstanceBatch batch;
+	batch.Geo = ri.Geo;
+	batch.PrimitiveType = ri.PrimitiveType;
+	batch.IndexCount = ri.IndexCount;
+	batch.StartIndexLocation = ri.StartIndexLocation;
+	batch.BaseVertexLocation = ri.BaseVertexLocation;
+	mInstanceBatches.push_back(batch);
+
+	return (UINT)mInstanceBatches.size() - 1;
+}
+
+void ShapesApp::GetCullObject(UINT objIndex, CullObject& object, IndirectCommand* lodCommands)const
+{
+	// A free slot is skipped by the culler, and its commands never read.
+	const RenderItem* ri = mAllRitems[objIndex].get();
+	if (ri == nullptr)
+	{
+		object = CullObject();
+		object.ObjectIndex = GpuCuller::InactiveObject;
+		std::fill(lodCommands, lodCommands + MaxLodCount, IndirectCommand());
+		return;
+	}
+
+	assert(ri->PrimitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	object.Center = ri->Bounds.Center;
+	object.Extents = ri->Bounds.Extents;
+	object.ObjectIndex = ri->ObjCBIndex;
+
+	// One command per LOD.  Items with a shorter chain repeat their coarsest level.
+	// The culler points each command at the object's constants.
+	for (UINT lod = 0; lod < MaxLodCount; ++lod)
+	{
+		const RenderItemLod& level = ri->Lods[std::min<size_t>(lod, ri->Lods.size() - 1)];
+
+		IndirectCommand& cmd = lodCommands[lod];
+		cmd = IndirectCommand();
+		cmd.VertexBufferView = level.Geo->VertexBufferView();
+		cmd.AttributeBufferView = level.Geo->AttributeBufferView();
+		cmd.IndexBufferView = level.Geo->IndexBufferView();
+		cmd.DrawArgs.IndexCountPerInstance = level.IndexCount;
+		cmd.DrawArgs.InstanceCount = 1;
+		cmd.DrawArgs.StartIndexLocation = level.StartIndexLocation;
+		cmd.DrawArgs.BaseVertexLocation = level.BaseVertexLocation;
+		cmd.DrawArgs.StartInstanceLocation = 0;
+	}
+}
+
+void ShapesApp::UpdateBenchmarkCamera()
+{
+	// Orbit the scene while rising and falling and moving in and out, so the
+	// visible set and the LODs change as they would under a user.  The path only
+	// depends on the frame number, so every run sees the same views.
+	float time = (float)mBenchmarkFrame * mBenchmarkTimestep;
+	float angle = XM_2PI * time / BenchmarkOrbitSeconds;
+
+	mTheta = 1.5f*XM_PI + angle;
+	mPhi = 0.3f*XM_PI + 0.1f*XM_PI*sinf(2.0f*angle);
+	mRadius = mSceneRadius * (1.0f + 0.4f*cosf(3.0f*angle));
+}
+
+void ShapesApp::RecordBenchmarkGpuTimes(int frameIndex, bool isReadBack)
+{
+	bool isMeasured = mIsFrameMeasured[frameIndex];
+	mIsFrameMeasured[frameIndex] = false;
+
+	if (!isMeasured || !isReadBack)
+		return;
+
+	for (const GpuProfiler::ScopeStats& scope : mGpuProfiler->GetStats())
+		mBenchmarkReport.AddSample("gpu." + scope.Name, scope.LastMs);
+}
+
+void ShapesApp::EndBenchmarkFrame()
+{
+	__int64 frameEndTime = GameTimer::Now();
+	__int64 frameInterval = mFrameBeginTime - mPrevFrameBeginTime;
+	mPrevFrameBeginTime = mFrameBeginTime;
+
+	// Frames drawn while the geometry streams in or PSOs compile would time the
+	// loading, so the run starts once both are done.
+	if (!mIsBenchmarkStarted)
+	{
+		mIsBenchmarkStarted = mIsSceneResident && mPsoManager->PendingCount() == 0;
+		return;
+	}
+
+	if (++mBenchmarkFrame > mBenchmarkWarmupFrames)
+	{
+		// The CPU time of a frame, and the time between frames, which also
+		// counts the waits on the swap chain.
+		double msPerCount = GameTimer::SecondsPerCount() * 1000.0;
+		mBenchmarkReport.AddSample("cpu.frame", (double)(frameEndTime - mFrameBeginTime) * msPerCount);
+		mBenchmarkReport.AddSample("cpu.interval", (double)frameInterval * msPerCount);
+
+		mIsFrameMeasured[mCurrFrameResourceIndex] = true;
+	}
+
+	if (mBenchmarkFrame == mBenchmarkWarmupFrames + mBenchmarkFrameCount)
+		FinishBenchmark();
+}
+
+void ShapesApp::FinishBenchmark()
+{
+	// Read back the measured frames still in flight, oldest first.
+	FlushCommandQueue();
+	for (int i = 1; i <= gNumFrameResources; ++i)
+	{
+		int frameIndex = (mCurrFrameResourceIndex + i) % gNumFrameResources;
+		RecordBenchmarkGpuTimes(frameIndex, mGpuProfiler->BeginFrame(frameIndex));
+	}
+
+	DXGI_ADAPTER_DESC adapterDesc = {};
+	ComPtr<IDXGIAdapter> adapter;
+	if (SUCCEEDED(mdxgiFactory->EnumAdapterByLuid(md3dDevice->GetAdapterLuid(), IID_PPV_ARGS(&adapter))))
+		adapter->GetDesc(&adapterDesc);
+
+	const char* presentModes[] = { "vsync", "immediate", "tearing" };
+	const char* drawPath = mIsGpuCulled ? "gpu" : (mIsInstanced ? "instanced" : "direct");
+
+	mBenchmarkReport.SetInfo("adapter", std::wstring(adapterDesc.Description));
+	mBenchmarkReport.SetInfo("driver", md3dDriverType == D3D_DRIVER_TYPE_WARP ? "warp" : "hardware");
+	mBenchmarkReport.SetInfo("width", mClientWidth);
+	mBenchmarkReport.SetInfo("height", mClientHeight);
+	mBenchmarkReport.SetInfo("msaa", m4xMsaaState ? 4 : 1);
+	mBenchmarkReport.SetInfo("present", presentModes[(int)mPresentMode]);
+	mBenchmarkReport.SetInfo("frame_resources", gNumFrameResources);
+	mBenchmarkReport.SetInfo("max_frame_latency", mMaxFrameLatency);
+	mBenchmarkReport.SetInfo("draw_path", drawPath);
+	mBenchmarkReport.SetInfo("depth_prepass", mIsDepthPrepass ? 1 : 0);
+	mBenchmarkReport.SetInfo("hiz", mIsHiZ ? 1 : 0);
+	mBenchmarkReport.SetInfo("mesh_shaders", mMeshletRenderer != nullptr ? 1 : 0);
+	mBenchmarkReport.SetInfo("views", mViewCount);
+	mBenchmarkReport.SetInfo("multiview", mIsMultiView && mViewCount > 1 ? 1 : 0);
+	mBenchmarkReport.SetInfo("dynamic_resolution", mDynamicResolution != nullptr ? 1 : 0);
+	mBenchmarkReport.SetInfo("target_ms", mDynamicResolution != nullptr ? mDynamicResolutionSettings.TargetMs : 0.0f);
+	mBenchmarkReport.SetInfo("objects", (double)mObjectSlots.LiveCount());
+	mBenchmarkReport.SetInfo("projectiles", (double)mProjectileCount);
+	mBenchmarkReport.SetInfo("stress_seed", mStressObjectCount > 0 ? mStressSeed : 0);
+	mBenchmarkReport.SetInfo("timestep_s", mBenchmarkTimestep);
+	mBenchmarkReport.SetInfo("warmup_frames", mBenchmarkWarmupFrames);
+	mBenchmarkReport.SetInfo("frames", mBenchmarkFrameCount);
+
+	bool isWritten = mBenchmarkReport.WriteJson(mBenchmarkReportFile);
+
+	BenchmarkReport::Summary cpu = mBenchmarkReport.Summarize("cpu.frame");
+	BenchmarkReport::Summary gpu = mBenchmarkReport.Summarize("gpu.frame");
+	wchar_t buffer[256];
+	swprintf_s(buffer, L"Benchmark: CPU %.2f ms (p99 %.2f), GPU %.2f ms (p99 %.2f), report %s%s\n",
+		cpu.AvgMs, cpu.P99Ms, gpu.AvgMs, gpu.P99Ms, mBenchmarkReportFile.c_str(), isWritten ? L"" : L" not written");
+	OutputDebugString(buffer);
+
+	// The exit code tells a script whether the report was written.
+	PostQuitMessage(isWritten ? 0 : 1);
+}
+
+void ShapesApp::BuildRootSignature()
+{
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+
+	// Create root CBVs.  Binding the object and pass constants as root descriptors
+	// means we do not need a CBV descriptor per object per frame resource.
+	slotRootParameter[0].InitAsConstantBufferView(0);
+	slotRootParameter[1].InitAsConstantBufferView(1);
 
-	// Create root CBVs.
-	slotRootParameter[0].InitAsDescriptorTable(1, &cbvTable0);
-	slotRootParameter[1].InitAsDescriptorTable(1, &cbvTable1);
+	// Instance buffer and the index of the first instance of a batch.
+	slotRootParameter[2].InitAsShaderResourceView(0, 1);
+	slotRootParameter[3].InitAsConstants(1, 2);
+
+	// The view-projections of a multi-view pass.
+	slotRootParameter[4].InitAsConstantBufferView(5);
 
 	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter, 0, nullptr,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter, 0, nullptr,
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 	// create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
@@ -514,552 +2109,1016 @@ void ShapesApp::BuildRootSignature()
 
 void ShapesApp::BuildShadersAndInputLayout()
 {
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "PS", "ps_5_1");
-
-	mInputLayout =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
+	mInputLayout = mVertexFormat.InputLayout();
+
+	// The shaders themselves are loaded by the first PSO compile that needs them.
+	GraphicsProgram opaque;
+	opaque.RootSignature = mRootSignature;
+	opaque.InputLayout = mInputLayout;
+	opaque.Filename = L"Shaders\\color.hlsl";
+	opaque.Defines = mVertexFormat.ShaderDefines();
+	opaque.VS = "VS";
+	opaque.PS = "PS";
+	mOpaqueProgram = mPsoManager->AddProgram("opaque", opaque);
+
+	GraphicsProgram opaqueInstanced = opaque;
+	opaqueInstanced.VS = "InstancedVS";
+	mOpaqueInstancedProgram = mPsoManager->AddProgram("opaque_instanced", opaqueInstanced);
+
+	GraphicsProgram opaqueMultiView = opaque;
+	opaqueMultiView.VS = "InstancedMultiViewVS";
+	mOpaqueMultiViewProgram = mPsoManager->AddProgram("opaque_multiview", opaqueMultiView);
+
+	// The depth pre-pass only reads positions, and has no pixel shader.
+	GraphicsProgram depthInstanced = opaqueInstanced;
+	depthInstanced.InputLayout = mVertexFormat.PositionInputLayout();
+	depthInstanced.VS = "InstancedDepthVS";
+	depthInstanced.PS.clear();
+	mDepthInstancedProgram = mPsoManager->AddProgram("depth_instanced", depthInstanced);
 }
 
 void ShapesApp::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData box = geoGen.CreateBox(2.0f, 3.0f, 15.0f, 3);
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(50.0f, 50.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.5f, 3.0f, 20, 20);
-	//------------------------------
-	// CUSTOM SHAPES - TEST HERE
-	//------------------------------
-	GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1.0f, 1.0f);
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0f, 1.0f, 1.0f);
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(1.0f, 1.0f, 16);
-	GeometryGenerator::MeshData halfCone = geoGen.CreateHalfCone(0.5f, 1.0f, 1.0f, 16);
-	GeometryGenerator::MeshData prism = geoGen.CreatePrism(2.0f, 1.0f, 1.0f);
-	GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(1.0f, 1.0f, 1.0f);
+	MeshCacheKey key;
+	key.Add(ShapeGeneratorVersion);
+	key.Add(MaxLodCount);
+	key.Add(mVertexFormat.Position);
+	key.Add(mVertexFormat.Color);
+	key.Add(mVertexFormat.SplitPositions);
+	key.Add(mOptimizeMeshes);
+	for (const ShapeRecipe& recipe : ShapeRecipes)
+	{
+		key.Add(recipe.Name);
+		key.Add(recipe.Params);
+		key.Add(recipe.Color);
+	}
 
-	//
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
-	// define the regions in the buffer each submesh covers.
-	//
+	// Warm starts map the cache and upload straight from the mapping.  The shapes
+	// are only generated again when the recipes change, and if the cache cannot be
+	// written the generated image is used from memory instead.
+	MeshCacheFile cache;
+	if (!cache.Open(ShapeMeshCacheFile, key.Value()))
+	{
+		std::vector<BYTE> image = GenerateShapeGeometry(key.Value());
+		if (!MeshCacheFile::Write(ShapeMeshCacheFile, image) || !cache.Open(ShapeMeshCacheFile, key.Value()))
+			cache.Open(std::move(image), key.Value());
+	}
 
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-	UINT pyramidVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-	UINT wedgeVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-	UINT coneVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-	UINT halfConeVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-	UINT prismVertexOffset = halfConeVertexOffset + (UINT)halfCone.Vertices.size();
-	UINT diamondVertexOffset = prismVertexOffset + (UINT)prism.Vertices.size();
-
-
-	// Cache the starting index for each object in the concatenated index buffer.
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-	UINT pyramidIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-	UINT wedgeIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-	UINT coneIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-	UINT halfConeIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-	UINT prismIndexOffset = halfConeIndexOffset + (UINT)halfCone.Indices32.size();
-	UINT diamondIndexOffset = prismIndexOffset + (UINT)prism.Indices32.size();
-
-
-	// Define the SubmeshGeometry that cover different 
-	// regions of the vertex/index buffers.
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-	SubmeshGeometry pyramidSubmesh;
-	pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-	pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-	pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-	SubmeshGeometry wedgeSubmesh;
-	wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-	wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-	wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-	SubmeshGeometry coneSubmesh;
-	coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-	coneSubmesh.StartIndexLocation = coneIndexOffset;
-	coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-	SubmeshGeometry halfConeSubmesh;
-	halfConeSubmesh.IndexCount = (UINT)halfCone.Indices32.size();
-	halfConeSubmesh.StartIndexLocation = halfConeIndexOffset;
-	halfConeSubmesh.BaseVertexLocation = halfConeVertexOffset;
-
-	SubmeshGeometry prismSubmesh;
-	prismSubmesh.IndexCount = (UINT)prism.Indices32.size();
-	prismSubmesh.StartIndexLocation = prismIndexOffset;
-	prismSubmesh.BaseVertexLocation = prismVertexOffset;
-
-	SubmeshGeometry diamondSubmesh;
-	diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-	diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-	diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
+	Registry<MeshBatchBuilder::Submesh> submeshes;
+	cache.GetSubmeshes(submeshes);
 
-	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
-	//
+	// One geometry per page.  The buffers are sub-allocated from shared pages and
+	// filled on the copy queue, which owns the staging memory, so there are no
+	// uploaders to keep alive.
+	std::vector<std::unique_ptr<MeshGeometry>> geos;
+	for (UINT page = 0; page < cache.PageCount(); ++page)
+	{
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = "shapeGeo" + std::to_string(page);
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size() +
-		pyramid.Vertices.size() +
-		wedge.Vertices.size() +
-		cone.Vertices.size() +
-		halfCone.Vertices.size() +
-		prism.Vertices.size() +
-		diamond.Vertices.size();
+		BufferAllocation vb = mBufferAllocator->CreateDefaultBuffer(*mUploadQueue, cache.VertexData(page), cache.VertexByteSize(page));
+		geo->VertexBufferGPU = vb.Resource;
+		geo->VertexBufferOffset = vb.Offset;
 
-	std::vector<Vertex> vertices(totalVertexCount);
+		if (cache.AttributeByteStride() > 0)
+		{
+			BufferAllocation attributes = mBufferAllocator->CreateDefaultBuffer(*mUploadQueue, cache.AttributeData(page), cache.AttributeByteSize(page));
+			geo->AttributeBufferGPU = attributes.Resource;
+			geo->AttributeBufferOffset = attributes.Offset;
+			geo->AttributeByteStride = cache.AttributeByteStride();
+			geo->AttributeBufferByteSize = cache.AttributeByteSize(page);
+		}
 
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Purple);
-	}
+		BufferAllocation ib = mBufferAllocator->CreateDefaultBuffer(*mUploadQueue, cache.IndexData(page), cache.IndexByteSize(page));
+		geo->IndexBufferGPU = ib.Resource;
+		geo->IndexBufferOffset = ib.Offset;
 
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Gray);
-	}
+		// The meshlets are only read by mesh shaders.
+		if (mMeshletRenderer != nullptr && cache.MeshletCount(page) > 0)
+		{
+			MeshletBufferLayout layout = cache.GetMeshletBufferLayout(page);
+			BufferAllocation meshlets = mBufferAllocator->CreateDefaultBuffer(*mUploadQueue, cache.MeshletBufferData(page), layout.ByteSize);
+			geo->MeshletBufferGPU = meshlets.Resource;
+			geo->MeshletBufferOffset = meshlets.Offset;
+			geo->MeshletCullDataOffset = layout.CullDataOffset;
+			geo->MeshletVertexIndexOffset = layout.VertexIndexOffset;
+			geo->MeshletPrimitiveOffset = layout.PrimitiveOffset;
+		}
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::LightBlue);
-	}
+		geo->VertexByteStride = cache.VertexByteStride();
+		geo->VertexBufferByteSize = cache.VertexByteSize(page);
+		geo->IndexFormat = cache.IndexFormat(page);
+		geo->IndexBufferByteSize = cache.IndexByteSize(page);
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
+		geos.push_back(std::move(geo));
 	}
 
-	for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
+	for (UINT i = 0; i < submeshes.Size(); ++i)
 	{
-		vertices[k].Pos = pyramid.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Yellow);
+		auto handle = submeshes.At(i);
+		geos[submeshes[handle].Page]->DrawArgs.Add(submeshes.Name(handle), submeshes[handle].Geometry);
 	}
 
-	for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = wedge.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
-	}
+	// All copies go out in one batch, without waiting for it to finish.  They have
+	// been staged already, so the mapping can be closed when this returns.
+	UINT64 uploadTicket = mUploadQueue->Submit();
 
-	for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
+	for (auto& geo : geos)
 	{
-		vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Pink);
-	}
+		geo->UploadTicket = uploadTicket;
 
-	for (size_t i = 0; i < halfCone.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = halfCone.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::LightGreen);
+		std::string name = geo->Name;
+		mGeometries.Add(name, std::move(geo));
 	}
+}
 
-	for (size_t i = 0; i < prism.Vertices.size(); ++i, ++k)
+std::vector<BYTE> ShapesApp::GenerateShapeGeometry(UINT64 cacheKey)
+{
+	// Only the positions are drawn, so vertices that differ in their normals or
+	// texture coordinates alone are welded together.
+	MeshOptimizer::Options optimizerOptions;
+	optimizerOptions.WeldPositionsOnly = true;
+
+	// A shape's LOD chain, ready to be packed.
+	struct GeneratedShape
 	{
-		vertices[k].Pos = prism.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Orange);
-	}
+		GeometryGenerator::LodChain Lods;
+		BoundingBox Bounds;
+		std::wstring Log;
+	};
 
-	for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
+	//
+	// The shapes are independent, so each is generated, optimized and bounded on a
+	// worker.  Only the packing below is serial, to keep the layout of the pages,
+	// and so the cache image, the same from run to run.
+	//
+
+	const bool optimizeMeshes = mOptimizeMeshes;
+	std::vector<std::future<GeneratedShape>> tasks;
+	for (const ShapeRecipe& recipe : ShapeRecipes)
 	{
-		vertices[k].Pos = diamond.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Silver);
+		tasks.push_back(mThreadPool->Enqueue([&recipe, optimizeMeshes, optimizerOptions]()
+		{
+			GeometryGenerator geoGen;
+
+			GeneratedShape shape;
+			shape.Lods = recipe.Create(geoGen, recipe.Params);
+
+			// The levels share one set of bounds and dequantization, so switching
+			// levels leaves the object constants alone.
+			for (UINT lod = 0; lod < (UINT)shape.Lods.size(); ++lod)
+			{
+				GeometryGenerator::MeshData& mesh = shape.Lods[lod].Mesh;
+
+				if (optimizeMeshes)
+				{
+					MeshOptimizer::Stats stats = MeshOptimizer::Optimize(mesh, optimizerOptions);
+
+					shape.Log += AnsiToWString(ShapeLodName(recipe.Name, lod)) + L": " +
+						std::to_wstring(stats.VerticesBefore) + L" -> " +
+						std::to_wstring(stats.VerticesAfter) + L" vertices, ACMR " +
+						std::to_wstring(stats.AcmrBefore) + L" -> " +
+						std::to_wstring(stats.AcmrAfter) + L"\n";
+				}
+
+				BoundingBox bounds;
+				BoundingBox::CreateFromPoints(bounds, mesh.Vertices.size(),
+					&mesh.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+
+				if (lod == 0)
+					shape.Bounds = bounds;
+				else
+					BoundingBox::CreateMerged(shape.Bounds, shape.Bounds, bounds);
+			}
+
+			return shape;
+		}));
 	}
 
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-	indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(halfCone.GetIndices16()), std::end(halfCone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(prism.GetIndices16()), std::end(prism.GetIndices16()));
-	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
+	//
+	// Pack the vertex elements we are interested in, in the chosen format, into
+	// one vertex stream, or two if the positions are split out.  The builder
+	// places each shape in a page and works out its draw arguments, and the
+	// vertices are encoded straight into the page.
+	//
 
+	MeshBatchBuilder batch(mVertexFormat.PositionStreamStride(), mVertexFormat.AttributeStreamStride());
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	for (UINT i = 0; i < _countof(ShapeRecipes); ++i)
+	{
+		const ShapeRecipe& recipe = ShapeRecipes[i];
+		GeneratedShape shape = tasks[i].get();
+		OutputDebugString(shape.Log.c_str());
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
+		SubmeshGeometry submesh;
+		submesh.Bounds = shape.Bounds;
+		mVertexFormat.GetDequantization(submesh.Bounds, submesh.PositionScale, submesh.PositionBias);
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		for (UINT lod = 0; lod < (UINT)shape.Lods.size(); ++lod)
+		{
+			const GeometryGenerator::MeshData& mesh = shape.Lods[lod].Mesh;
+			const UINT vertexCount = (UINT)mesh.Vertices.size();
+			const UINT indexCount = (UINT)mesh.Indices32.size();
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+			submesh.LodError = shape.Lods[lod].Error;
+			MeshBatchBuilder::Allocation allocation = batch.Allocate(ShapeLodName(recipe.Name, lod), submesh, vertexCount, indexCount);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+			mVertexFormat.Encode(&mesh.Vertices[0].Position, sizeof(GeometryGenerator::Vertex),
+				recipe.Color, vertexCount, submesh.Bounds, allocation.Vertices, allocation.Attributes);
+			MeshBatchBuilder::StoreIndices(allocation, mesh.Indices32.data(), indexCount);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+			// The meshlets are cached whether or not this device draws them.
+			batch.AddMeshlets(allocation, &mesh.Vertices[0].Position, sizeof(GeometryGenerator::Vertex),
+				vertexCount, mesh.Indices32.data(), indexCount);
+		}
+	}
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	return MeshCacheFile::Serialize(cacheKey, batch);
+}
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-	geo->DrawArgs["pyramid"] = pyramidSubmesh;
-	geo->DrawArgs["wedge"] = wedgeSubmesh;
-	geo->DrawArgs["cone"] = coneSubmesh;
-	geo->DrawArgs["halfCone"] = halfConeSubmesh;
-	geo->DrawArgs["prism"] = prismSubmesh;
-	geo->DrawArgs["diamond"] = diamondSubmesh;
+MeshGeometry* ShapesApp::FindShapeGeometry(const std::string& submeshName)
+{
+	// The shapes are spread over as many page geometries as they need.
+	for (auto& geo : mGeometries)
+	{
+		if (geo->DrawArgs.Find(submeshName).IsValid())
+			return geo.get();
+	}
 
+	throw DxException(E_INVALIDARG, L"ShapesApp::FindShapeGeometry", AnsiToWString(__FILE__), __LINE__);
+}
 
+std::vector<RenderItemLod> ShapesApp::GetShapeLods(const std::string& shapeName)
+{
+	std::vector<RenderItemLod> lods;
+	for (UINT lod = 0; lod < MaxLodCount; ++lod)
+	{
+		std::string name = ShapeLodName(shapeName, lod);
+		UINT geoIndex = 0;
+		for (auto& geo : mGeometries)
+		{
+			auto handle = geo->DrawArgs.Find(name);
+			if (!handle.IsValid())
+			{
+				++geoIndex;
+				continue;
+			}
+
+			const SubmeshGeometry& submesh = geo->DrawArgs[handle];
+
+			RenderItemLod level;
+			level.Geo = geo.get();
+			level.IndexCount = submesh.IndexCount;
+			level.StartIndexLocation = submesh.StartIndexLocation;
+			level.BaseVertexLocation = submesh.BaseVertexLocation;
+			level.MeshletOffset = submesh.MeshletOffset;
+			level.MeshletCount = submesh.MeshletCount;
+			level.GeoIndex = geoIndex++;
+			level.Error = submesh.LodError;
+			lods.push_back(level);
+		}
+	}
 
-	mGeometries[geo->Name] = std::move(geo);
+	return lods;
 }
 
 void ShapesApp::BuildPSOs()
 {
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
-
-	//
-	// PSO for opaque objects.
-	//
-	ZeroMemory(&opaquePsoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
-	opaquePsoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
-	opaquePsoDesc.pRootSignature = mRootSignature.Get();
-	opaquePsoDesc.VS =
+	// Queue the PSO the first frame draws with first (the GPU culled path draws
+	// non-instanced), then warm the variants the keys and the MSAA toggle select,
+	// so switching to them does not wait on a compile.
+	std::vector<bool> msaaStates = { m4xMsaaState };
+	if (m4xMsaaQuality > 0)
+		msaaStates.push_back(!m4xMsaaState);
+
+	for (bool isMsaa : msaaStates)
 	{
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()),
-		mShaders["standardVS"]->GetBufferSize()
-	};
-	opaquePsoDesc.PS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
-	};
-	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
-	opaquePsoDesc.SampleMask = UINT_MAX;
-	opaquePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	opaquePsoDesc.NumRenderTargets = 1;
-	opaquePsoDesc.RTVFormats[0] = mBackBufferFormat;
-	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
-	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
-	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+		for (bool isWireframe : { false, true })
+		{
+			for (bool isInstanced : { false, true })
+				mPsoManager->Request(OpaquePsoKey(isInstanced, isWireframe, isMsaa));
+
+			if (mIsMultiView && mViewCount > 1)
+				mPsoManager->Request(OpaquePsoKey(true, isWireframe, isMsaa, true));
+		}
 
+		if (mIsDepthPrepass)
+			mPsoManager->Request(DepthPsoKey(isMsaa));
 
-	//
-	// PSO for opaque wireframe objects.
-	//
+		// Built here and now, since the workers look them up while recording.
+		if (mMeshletRenderer != nullptr)
+		{
+			for (bool isWireframe : { false, true })
+				mMeshletRenderer->BuildPso(OpaquePsoKey(true, isWireframe, isMsaa));
+		}
+	}
+}
+
+PsoKey ShapesApp::OpaquePsoKey(bool isInstanced, bool isWireframe, bool isMsaa, bool isMultiView)const
+{
+	PsoKey key;
+	key.Program = isInstanced ? mOpaqueInstancedProgram : mOpaqueProgram;
+	if (isMultiView)
+		key.Program = mOpaqueMultiViewProgram;
+	key.FillMode = isWireframe ? D3D12_FILL_MODE_WIREFRAME : D3D12_FILL_MODE_SOLID;
+	key.RtvFormat = mBackBufferFormat;
+	key.DsvFormat = mDepthStencilFormat;
+	key.SampleCount = isMsaa ? 4 : 1;
+	key.SampleQuality = isMsaa ? (m4xMsaaQuality - 1) : 0;
+
+	// The occluders are drawn again over their own pre-pass depths.
+	if (mIsDepthPrepass)
+		key.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+	return key;
+}
 
-	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueWireframePsoDesc = opaquePsoDesc;
-	opaqueWireframePsoDesc.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaqueWireframePsoDesc, IID_PPV_ARGS(&mPSOs["opaque_wireframe"])));
+PsoKey ShapesApp::DepthPsoKey(bool isMsaa)const
+{
+	PsoKey key = OpaquePsoKey(true, false, isMsaa);
+	key.Program = mDepthInstancedProgram;
+	key.RtvFormat = DXGI_FORMAT_UNKNOWN;
+	key.DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+	return key;
 }
 
 void ShapesApp::BuildFrameResources()
 {
+	mUploadRing = std::make_unique<UploadRing>(md3dDevice.Get(), UploadRingByteSize);
+
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size()));
+			(UINT)mAllRitems.size(), mThreadPool->ThreadCount()));
 	}
+
+	// The dequantization constants of an item never change, so they are written
+	// once, on each frame resource's first use, like those of items added later.
+	// The world matrices are streamed alongside them.
+	for (auto& ri : mAllRitems)
+		mObjectChanges.MarkChanged(ri->ObjCBIndex);
 }
 
 void ShapesApp::BuildRenderItems()
 {
+	if (mStressObjectCount > 0)
+		BuildStressRenderItems();
+	else
+		BuildCastleRenderItems();
 
-	int objIndex = 0;
+	BuildInstanceBatches();
+
+	// All the render items are opaque.  mAllRitems is in ObjCBIndex order now.
+	for (auto& e : mAllRitems)
+	{
+		mOpaqueRitems.push_back(e.get());
+		if (e->IsOccluder)
+			mOccluderRitems.push_back(e.get());
+	}
+
+	BuildBvh();
+
+	// The projectiles are small spheres, copied from a prototype as they are thrown.
+	if (mProjectileCount > 0)
+	{
+		MeshGeometry* sphereGeo = FindShapeGeometry("sphere");
+		const SubmeshGeometry& sphereSubmesh = sphereGeo->DrawArgs.Get("sphere");
+
+		mProjectilePrototype.Geo = sphereGeo;
+		mProjectilePrototype.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		mProjectilePrototype.IndexCount = sphereSubmesh.IndexCount;
+		mProjectilePrototype.StartIndexLocation = sphereSubmesh.StartIndexLocation;
+		mProjectilePrototype.BaseVertexLocation = sphereSubmesh.BaseVertexLocation;
+		mProjectilePrototype.Bounds = sphereSubmesh.Bounds;
+		mProjectilePrototype.PositionScale = sphereSubmesh.PositionScale;
+		mProjectilePrototype.PositionBias = sphereSubmesh.PositionBias;
+		mProjectilePrototype.Lods = GetShapeLods("sphere");
+	}
+}
+
+void ShapesApp::BuildCastleRenderItems()
+{
+	// Resolve the names once, rather than for every item.
+	MeshGeometry* boxGeo = FindShapeGeometry("box");
+	MeshGeometry* cylinderGeo = FindShapeGeometry("cylinder");
+	MeshGeometry* coneGeo = FindShapeGeometry("cone");
+	MeshGeometry* gridGeo = FindShapeGeometry("grid");
+	MeshGeometry* sphereGeo = FindShapeGeometry("sphere");
+	MeshGeometry* pyramidGeo = FindShapeGeometry("pyramid");
+	MeshGeometry* wedgeGeo = FindShapeGeometry("wedge");
+	MeshGeometry* halfConeGeo = FindShapeGeometry("halfCone");
+	MeshGeometry* prismGeo = FindShapeGeometry("prism");
+	MeshGeometry* diamondGeo = FindShapeGeometry("diamond");
+
+	const SubmeshGeometry& boxSubmesh = boxGeo->DrawArgs.Get("box");
+	const SubmeshGeometry& cylinderSubmesh = cylinderGeo->DrawArgs.Get("cylinder");
+	const SubmeshGeometry& coneSubmesh = coneGeo->DrawArgs.Get("cone");
+	const SubmeshGeometry& gridSubmesh = gridGeo->DrawArgs.Get("grid");
+	const SubmeshGeometry& sphereSubmesh = sphereGeo->DrawArgs.Get("sphere");
+	const SubmeshGeometry& pyramidSubmesh = pyramidGeo->DrawArgs.Get("pyramid");
+	const SubmeshGeometry& wedgeSubmesh = wedgeGeo->DrawArgs.Get("wedge");
+	const SubmeshGeometry& halfConeSubmesh = halfConeGeo->DrawArgs.Get("halfCone");
+	const SubmeshGeometry& prismSubmesh = prismGeo->DrawArgs.Get("prism");
+	const SubmeshGeometry& diamondSubmesh = diamondGeo->DrawArgs.Get("diamond");
+
+	const std::vector<RenderItemLod> boxLods = GetShapeLods("box");
+	const std::vector<RenderItemLod> cylinderLods = GetShapeLods("cylinder");
+	const std::vector<RenderItemLod> coneLods = GetShapeLods("cone");
+	const std::vector<RenderItemLod> gridLods = GetShapeLods("grid");
+	const std::vector<RenderItemLod> sphereLods = GetShapeLods("sphere");
+	const std::vector<RenderItemLod> pyramidLods = GetShapeLods("pyramid");
+	const std::vector<RenderItemLod> wedgeLods = GetShapeLods("wedge");
+	const std::vector<RenderItemLod> halfConeLods = GetShapeLods("halfCone");
+	const std::vector<RenderItemLod> prismLods = GetShapeLods("prism");
+	const std::vector<RenderItemLod> diamondLods = GetShapeLods("diamond");
 
 	auto leftWallRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&leftWallRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(8.5f, 1.5f, 3.0f));
-	leftWallRitem->ObjCBIndex = objIndex++;
-	leftWallRitem->Geo = mGeometries["shapeGeo"].get();
+	leftWallRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(8.5f, 1.5f, 3.0f));
+	leftWallRitem->Geo = boxGeo;
 	leftWallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	leftWallRitem->IndexCount = leftWallRitem->Geo->DrawArgs["box"].IndexCount;
-	leftWallRitem->StartIndexLocation = leftWallRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	leftWallRitem->BaseVertexLocation = leftWallRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	leftWallRitem->IndexCount = boxSubmesh.IndexCount;
+	leftWallRitem->StartIndexLocation = boxSubmesh.StartIndexLocation;
+	leftWallRitem->BaseVertexLocation = boxSubmesh.BaseVertexLocation;
+	leftWallRitem->Bounds = boxSubmesh.Bounds;
+	leftWallRitem->PositionScale = boxSubmesh.PositionScale;
+	leftWallRitem->PositionBias = boxSubmesh.PositionBias;
+	leftWallRitem->Lods = boxLods;
+	leftWallRitem->IsOccluder = true;
 	mAllRitems.push_back(std::move(leftWallRitem));
 
 	auto rightWallRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&rightWallRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-8.5f, 1.5f, 3.0f));
-	rightWallRitem->ObjCBIndex = objIndex++;
-	rightWallRitem->Geo = mGeometries["shapeGeo"].get();
+	rightWallRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-8.5f, 1.5f, 3.0f));
+	rightWallRitem->Geo = boxGeo;
 	rightWallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	rightWallRitem->IndexCount = rightWallRitem->Geo->DrawArgs["box"].IndexCount;
-	rightWallRitem->StartIndexLocation = rightWallRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	rightWallRitem->BaseVertexLocation = rightWallRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	rightWallRitem->IndexCount = boxSubmesh.IndexCount;
+	rightWallRitem->StartIndexLocation = boxSubmesh.StartIndexLocation;
+	rightWallRitem->BaseVertexLocation = boxSubmesh.BaseVertexLocation;
+	rightWallRitem->Bounds = boxSubmesh.Bounds;
+	rightWallRitem->PositionScale = boxSubmesh.PositionScale;
+	rightWallRitem->PositionBias = boxSubmesh.PositionBias;
+	rightWallRitem->Lods = boxLods;
+	rightWallRitem->IsOccluder = true;
 	mAllRitems.push_back(std::move(rightWallRitem));
 
 	auto backWallRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&backWallRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-11.5f, 1.5f, 0.0f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
-	backWallRitem->ObjCBIndex = objIndex++;
-	backWallRitem->Geo = mGeometries["shapeGeo"].get();
+	backWallRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-11.5f, 1.5f, 0.0f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
+	backWallRitem->Geo = boxGeo;
 	backWallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	backWallRitem->IndexCount = backWallRitem->Geo->DrawArgs["box"].IndexCount;
-	backWallRitem->StartIndexLocation = backWallRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	backWallRitem->BaseVertexLocation = backWallRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	backWallRitem->IndexCount = boxSubmesh.IndexCount;
+	backWallRitem->StartIndexLocation = boxSubmesh.StartIndexLocation;
+	backWallRitem->BaseVertexLocation = boxSubmesh.BaseVertexLocation;
+	backWallRitem->Bounds = boxSubmesh.Bounds;
+	backWallRitem->PositionScale = boxSubmesh.PositionScale;
+	backWallRitem->PositionBias = boxSubmesh.PositionBias;
+	backWallRitem->Lods = boxLods;
+	backWallRitem->IsOccluder = true;
 	mAllRitems.push_back(std::move(backWallRitem));
 
 	auto frontLWallRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&frontLWallRitem->World, XMMatrixScaling(1.0f, 1.0f, 0.4f)*XMMatrixTranslation(5.5f, 1.5f, 4.5f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
-	frontLWallRitem->ObjCBIndex = objIndex++;
-	frontLWallRitem->Geo = mGeometries["shapeGeo"].get();
+	frontLWallRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 0.4f)*XMMatrixTranslation(5.5f, 1.5f, 4.5f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
+	frontLWallRitem->Geo = boxGeo;
 	frontLWallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	frontLWallRitem->IndexCount = frontLWallRitem->Geo->DrawArgs["box"].IndexCount;
-	frontLWallRitem->StartIndexLocation = frontLWallRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	frontLWallRitem->BaseVertexLocation = frontLWallRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	frontLWallRitem->IndexCount = boxSubmesh.IndexCount;
+	frontLWallRitem->StartIndexLocation = boxSubmesh.StartIndexLocation;
+	frontLWallRitem->BaseVertexLocation = boxSubmesh.BaseVertexLocation;
+	frontLWallRitem->Bounds = boxSubmesh.Bounds;
+	frontLWallRitem->PositionScale = boxSubmesh.PositionScale;
+	frontLWallRitem->PositionBias = boxSubmesh.PositionBias;
+	frontLWallRitem->Lods = boxLods;
+	frontLWallRitem->IsOccluder = true;
 	mAllRitems.push_back(std::move(frontLWallRitem));
 
 	auto frontRWallRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&frontRWallRitem->World, XMMatrixScaling(1.0f, 1.0f, 0.4f)*XMMatrixTranslation(5.5f, 1.5f, -4.5f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
-	frontRWallRitem->ObjCBIndex = objIndex++;
-	frontRWallRitem->Geo = mGeometries["shapeGeo"].get();
+	frontRWallRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 0.4f)*XMMatrixTranslation(5.5f, 1.5f, -4.5f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
+	frontRWallRitem->Geo = boxGeo;
 	frontRWallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	frontRWallRitem->IndexCount = frontRWallRitem->Geo->DrawArgs["box"].IndexCount;
-	frontRWallRitem->StartIndexLocation = frontRWallRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	frontRWallRitem->BaseVertexLocation = frontRWallRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	frontRWallRitem->IndexCount = boxSubmesh.IndexCount;
+	frontRWallRitem->StartIndexLocation = boxSubmesh.StartIndexLocation;
+	frontRWallRitem->BaseVertexLocation = boxSubmesh.BaseVertexLocation;
+	frontRWallRitem->Bounds = boxSubmesh.Bounds;
+	frontRWallRitem->PositionScale = boxSubmesh.PositionScale;
+	frontRWallRitem->PositionBias = boxSubmesh.PositionBias;
+	frontRWallRitem->Lods = boxLods;
+	frontRWallRitem->IsOccluder = true;
 	mAllRitems.push_back(std::move(frontRWallRitem));
 
 	auto cylinder1Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylinder1Ritem->World, XMMatrixScaling(3.5f, 2.0f, 3.5f)*XMMatrixTranslation(9.0f, 2.8f, 11.5f));
-	cylinder1Ritem->ObjCBIndex = objIndex++;
-	cylinder1Ritem->Geo = mGeometries["shapeGeo"].get();
+	cylinder1Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(3.5f, 2.0f, 3.5f)*XMMatrixTranslation(9.0f, 2.8f, 11.5f));
+	cylinder1Ritem->Geo = cylinderGeo;
 	cylinder1Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinder1Ritem->IndexCount = cylinder1Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinder1Ritem->StartIndexLocation = cylinder1Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinder1Ritem->BaseVertexLocation = cylinder1Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+	cylinder1Ritem->IndexCount = cylinderSubmesh.IndexCount;
+	cylinder1Ritem->StartIndexLocation = cylinderSubmesh.StartIndexLocation;
+	cylinder1Ritem->BaseVertexLocation = cylinderSubmesh.BaseVertexLocation;
+	cylinder1Ritem->Bounds = cylinderSubmesh.Bounds;
+	cylinder1Ritem->PositionScale = cylinderSubmesh.PositionScale;
+	cylinder1Ritem->PositionBias = cylinderSubmesh.PositionBias;
+	cylinder1Ritem->Lods = cylinderLods;
+	cylinder1Ritem->IsOccluder = true;
 	mAllRitems.push_back(std::move(cylinder1Ritem));
 
 	auto cylinder2Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylinder2Ritem->World, XMMatrixScaling(3.5f, 2.0f, 3.5f)*XMMatrixTranslation(-9.0f, 2.8f, 11.5f));
-	cylinder2Ritem->ObjCBIndex = objIndex++;
-	cylinder2Ritem->Geo = mGeometries["shapeGeo"].get();
+	cylinder2Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(3.5f, 2.0f, 3.5f)*XMMatrixTranslation(-9.0f, 2.8f, 11.5f));
+	cylinder2Ritem->Geo = cylinderGeo;
 	cylinder2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinder2Ritem->IndexCount = cylinder2Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinder2Ritem->StartIndexLocation = cylinder2Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinder2Ritem->BaseVertexLocation = cylinder2Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+	cylinder2Ritem->IndexCount = cylinderSubmesh.IndexCount;
+	cylinder2Ritem->StartIndexLocation = cylinderSubmesh.StartIndexLocation;
+	cylinder2Ritem->BaseVertexLocation = cylinderSubmesh.BaseVertexLocation;
+	cylinder2Ritem->Bounds = cylinderSubmesh.Bounds;
+	cylinder2Ritem->PositionScale = cylinderSubmesh.PositionScale;
+	cylinder2Ritem->PositionBias = cylinderSubmesh.PositionBias;
+	cylinder2Ritem->Lods = cylinderLods;
+	cylinder2Ritem->IsOccluder = true;
 	mAllRitems.push_back(std::move(cylinder2Ritem));
 
 	auto cylinder3Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylinder3Ritem->World, XMMatrixScaling(3.5f, 1.5f, 3.5f)*XMMatrixTranslation(-9.0f, 2.3f, -5.7f));
-	cylinder3Ritem->ObjCBIndex = objIndex++;
-	cylinder3Ritem->Geo = mGeometries["shapeGeo"].get();
+	cylinder3Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(3.5f, 1.5f, 3.5f)*XMMatrixTranslation(-9.0f, 2.3f, -5.7f));
+	cylinder3Ritem->Geo = cylinderGeo;
 	cylinder3Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinder3Ritem->IndexCount = cylinder3Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinder3Ritem->StartIndexLocation = cylinder3Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinder3Ritem->BaseVertexLocation = cylinder3Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+	cylinder3Ritem->IndexCount = cylinderSubmesh.IndexCount;
+	cylinder3Ritem->StartIndexLocation = cylinderSubmesh.StartIndexLocation;
+	cylinder3Ritem->BaseVertexLocation = cylinderSubmesh.BaseVertexLocation;
+	cylinder3Ritem->Bounds = cylinderSubmesh.Bounds;
+	cylinder3Ritem->PositionScale = cylinderSubmesh.PositionScale;
+	cylinder3Ritem->PositionBias = cylinderSubmesh.PositionBias;
+	cylinder3Ritem->Lods = cylinderLods;
+	cylinder3Ritem->IsOccluder = true;
 	mAllRitems.push_back(std::move(cylinder3Ritem));
 
 	auto cylinder4Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cylinder4Ritem->World, XMMatrixScaling(3.5f, 1.5f, 3.5f)*XMMatrixTranslation(9.0f, 2.3f, -5.7f));
-	cylinder4Ritem->ObjCBIndex = objIndex++;
-	cylinder4Ritem->Geo = mGeometries["shapeGeo"].get();
+	cylinder4Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(3.5f, 1.5f, 3.5f)*XMMatrixTranslation(9.0f, 2.3f, -5.7f));
+	cylinder4Ritem->Geo = cylinderGeo;
 	cylinder4Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cylinder4Ritem->IndexCount = cylinder4Ritem->Geo->DrawArgs["cylinder"].IndexCount;
-	cylinder4Ritem->StartIndexLocation = cylinder4Ritem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	cylinder4Ritem->BaseVertexLocation = cylinder4Ritem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+	cylinder4Ritem->IndexCount = cylinderSubmesh.IndexCount;
+	cylinder4Ritem->StartIndexLocation = cylinderSubmesh.StartIndexLocation;
+	cylinder4Ritem->BaseVertexLocation = cylinderSubmesh.BaseVertexLocation;
+	cylinder4Ritem->Bounds = cylinderSubmesh.Bounds;
+	cylinder4Ritem->PositionScale = cylinderSubmesh.PositionScale;
+	cylinder4Ritem->PositionBias = cylinderSubmesh.PositionBias;
+	cylinder4Ritem->Lods = cylinderLods;
+	cylinder4Ritem->IsOccluder = true;
 	mAllRitems.push_back(std::move(cylinder4Ritem));
 
 	auto coneRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&coneRitem->World, XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(9.0f, 5.6f, 11.5f));
-	coneRitem->ObjCBIndex = objIndex++;
-	coneRitem->Geo = mGeometries["shapeGeo"].get();
+	coneRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(9.0f, 5.6f, 11.5f));
+	coneRitem->Geo = coneGeo;
 	coneRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem->IndexCount = coneRitem->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem->StartIndexLocation = coneRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem->BaseVertexLocation = coneRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
+	coneRitem->IndexCount = coneSubmesh.IndexCount;
+	coneRitem->StartIndexLocation = coneSubmesh.StartIndexLocation;
+	coneRitem->BaseVertexLocation = coneSubmesh.BaseVertexLocation;
+	coneRitem->Bounds = coneSubmesh.Bounds;
+	coneRitem->PositionScale = coneSubmesh.PositionScale;
+	coneRitem->PositionBias = coneSubmesh.PositionBias;
+	coneRitem->Lods = coneLods;
 	mAllRitems.push_back(std::move(coneRitem));
 
 	auto cone1Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cone1Ritem->World, XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(-9.0f, 5.6f, 11.5f));
-	cone1Ritem->ObjCBIndex = objIndex++;
-	cone1Ritem->Geo = mGeometries["shapeGeo"].get();
+	cone1Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(-9.0f, 5.6f, 11.5f));
+	cone1Ritem->Geo = coneGeo;
 	cone1Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cone1Ritem->IndexCount = cone1Ritem->Geo->DrawArgs["cone"].IndexCount;
-	cone1Ritem->StartIndexLocation = cone1Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-	cone1Ritem->BaseVertexLocation = cone1Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
+	cone1Ritem->IndexCount = coneSubmesh.IndexCount;
+	cone1Ritem->StartIndexLocation = coneSubmesh.StartIndexLocation;
+	cone1Ritem->BaseVertexLocation = coneSubmesh.BaseVertexLocation;
+	cone1Ritem->Bounds = coneSubmesh.Bounds;
+	cone1Ritem->PositionScale = coneSubmesh.PositionScale;
+	cone1Ritem->PositionBias = coneSubmesh.PositionBias;
+	cone1Ritem->Lods = coneLods;
 	mAllRitems.push_back(std::move(cone1Ritem));
 
 	auto cone2Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cone2Ritem->World, XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(-9.0f, 4.6f, -5.7f));
-	cone2Ritem->ObjCBIndex = objIndex++;
-	cone2Ritem->Geo = mGeometries["shapeGeo"].get();
+	cone2Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(-9.0f, 4.6f, -5.7f));
+	cone2Ritem->Geo = coneGeo;
 	cone2Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cone2Ritem->IndexCount = cone2Ritem->Geo->DrawArgs["cone"].IndexCount;
-	cone2Ritem->StartIndexLocation = cone2Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-	cone2Ritem->BaseVertexLocation = cone2Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
+	cone2Ritem->IndexCount = coneSubmesh.IndexCount;
+	cone2Ritem->StartIndexLocation = coneSubmesh.StartIndexLocation;
+	cone2Ritem->BaseVertexLocation = coneSubmesh.BaseVertexLocation;
+	cone2Ritem->Bounds = coneSubmesh.Bounds;
+	cone2Ritem->PositionScale = coneSubmesh.PositionScale;
+	cone2Ritem->PositionBias = coneSubmesh.PositionBias;
+	cone2Ritem->Lods = coneLods;
 	mAllRitems.push_back(std::move(cone2Ritem));
 
 	auto cone3Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&cone3Ritem->World, XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(9.0f, 4.6f, -5.7f));
-	cone3Ritem->ObjCBIndex = objIndex++;
-	cone3Ritem->Geo = mGeometries["shapeGeo"].get();
+	cone3Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(2.0f, 3.0f, 2.0f)*XMMatrixTranslation(9.0f, 4.6f, -5.7f));
+	cone3Ritem->Geo = coneGeo;
 	cone3Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	cone3Ritem->IndexCount = cone3Ritem->Geo->DrawArgs["cone"].IndexCount;
-	cone3Ritem->StartIndexLocation = cone3Ritem->Geo->DrawArgs["cone"].StartIndexLocation;
-	cone3Ritem->BaseVertexLocation = cone3Ritem->Geo->DrawArgs["cone"].BaseVertexLocation;
+	cone3Ritem->IndexCount = coneSubmesh.IndexCount;
+	cone3Ritem->StartIndexLocation = coneSubmesh.StartIndexLocation;
+	cone3Ritem->BaseVertexLocation = coneSubmesh.BaseVertexLocation;
+	cone3Ritem->Bounds = coneSubmesh.Bounds;
+	cone3Ritem->PositionScale = coneSubmesh.PositionScale;
+	cone3Ritem->PositionBias = coneSubmesh.PositionBias;
+	cone3Ritem->Lods = coneLods;
 	mAllRitems.push_back(std::move(cone3Ritem));
 
 	auto gridRitem = std::make_unique<RenderItem>();
-	gridRitem->World = MathHelper::Identity4x4();
-	gridRitem->ObjCBIndex = objIndex++;
-	gridRitem->Geo = mGeometries["shapeGeo"].get();
+	gridRitem->ObjCBIndex = mTransforms.Add(MathHelper::Identity4x4());
+	gridRitem->Geo = gridGeo;
 	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+	gridRitem->IndexCount = gridSubmesh.IndexCount;
+	gridRitem->StartIndexLocation = gridSubmesh.StartIndexLocation;
+	gridRitem->BaseVertexLocation = gridSubmesh.BaseVertexLocation;
+	gridRitem->Bounds = gridSubmesh.Bounds;
+	gridRitem->PositionScale = gridSubmesh.PositionScale;
+	gridRitem->PositionBias = gridSubmesh.PositionBias;
+	gridRitem->Lods = gridLods;
 	mAllRitems.push_back(std::move(gridRitem));
 
 	auto sphereRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&sphereRitem->World, XMMatrixScaling(1.5f, 1.5f, 1.5f)*XMMatrixTranslation(0.0f, 6.7f, -5.4f));
-	sphereRitem->ObjCBIndex = objIndex++;
-	sphereRitem->Geo = mGeometries["shapeGeo"].get();
+	sphereRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.5f, 1.5f, 1.5f)*XMMatrixTranslation(0.0f, 6.7f, -5.4f));
+	sphereRitem->Geo = sphereGeo;
 	sphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	sphereRitem->IndexCount = sphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-	sphereRitem->StartIndexLocation = sphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-	sphereRitem->BaseVertexLocation = sphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+	sphereRitem->IndexCount = sphereSubmesh.IndexCount;
+	sphereRitem->StartIndexLocation = sphereSubmesh.StartIndexLocation;
+	sphereRitem->BaseVertexLocation = sphereSubmesh.BaseVertexLocation;
+	sphereRitem->Bounds = sphereSubmesh.Bounds;
+	sphereRitem->PositionScale = sphereSubmesh.PositionScale;
+	sphereRitem->PositionBias = sphereSubmesh.PositionBias;
+	sphereRitem->Lods = sphereLods;
 	mAllRitems.push_back(std::move(sphereRitem));
 
 	auto pyramidRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyramidRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-3.0f, 3.0f, -5.4f));
-	pyramidRitem->ObjCBIndex = objIndex++;
-	pyramidRitem->Geo = mGeometries["shapeGeo"].get();
+	pyramidRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-3.0f, 3.0f, -5.4f));
+	pyramidRitem->Geo = pyramidGeo;
 	pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
+	pyramidRitem->IndexCount = pyramidSubmesh.IndexCount;
+	pyramidRitem->StartIndexLocation = pyramidSubmesh.StartIndexLocation;
+	pyramidRitem->BaseVertexLocation = pyramidSubmesh.BaseVertexLocation;
+	pyramidRitem->Bounds = pyramidSubmesh.Bounds;
+	pyramidRitem->PositionScale = pyramidSubmesh.PositionScale;
+	pyramidRitem->PositionBias = pyramidSubmesh.PositionBias;
+	pyramidRitem->Lods = pyramidLods;
 	mAllRitems.push_back(std::move(pyramidRitem));
 
 	auto pyramid1Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyramid1Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(3.0f, 3.0f, -5.4f));
-	pyramid1Ritem->ObjCBIndex = objIndex++;
-	pyramid1Ritem->Geo = mGeometries["shapeGeo"].get();
+	pyramid1Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(3.0f, 3.0f, -5.4f));
+	pyramid1Ritem->Geo = pyramidGeo;
 	pyramid1Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyramid1Ritem->IndexCount = pyramid1Ritem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyramid1Ritem->StartIndexLocation = pyramid1Ritem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyramid1Ritem->BaseVertexLocation = pyramid1Ritem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
+	pyramid1Ritem->IndexCount = pyramidSubmesh.IndexCount;
+	pyramid1Ritem->StartIndexLocation = pyramidSubmesh.StartIndexLocation;
+	pyramid1Ritem->BaseVertexLocation = pyramidSubmesh.BaseVertexLocation;
+	pyramid1Ritem->Bounds = pyramidSubmesh.Bounds;
+	pyramid1Ritem->PositionScale = pyramidSubmesh.PositionScale;
+	pyramid1Ritem->PositionBias = pyramidSubmesh.PositionBias;
+	pyramid1Ritem->Lods = pyramidLods;
 	mAllRitems.push_back(std::move(pyramid1Ritem));
 
 	auto wedgeRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wedgeRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-7.0f, 0.0f, -2.0f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
-	wedgeRitem->ObjCBIndex = objIndex++;
-	wedgeRitem->Geo = mGeometries["shapeGeo"].get();
+	wedgeRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(-7.0f, 0.0f, -2.0f)*XMMatrixRotationRollPitchYaw(0.0f, 1.57f, 0.0f));
+	wedgeRitem->Geo = wedgeGeo;
 	wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-	wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-	wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	wedgeRitem->IndexCount = wedgeSubmesh.IndexCount;
+	wedgeRitem->StartIndexLocation = wedgeSubmesh.StartIndexLocation;
+	wedgeRitem->BaseVertexLocation = wedgeSubmesh.BaseVertexLocation;
+	wedgeRitem->Bounds = wedgeSubmesh.Bounds;
+	wedgeRitem->PositionScale = wedgeSubmesh.PositionScale;
+	wedgeRitem->PositionBias = wedgeSubmesh.PositionBias;
+	wedgeRitem->Lods = wedgeLods;
 	mAllRitems.push_back(std::move(wedgeRitem));
 
 	auto wedge1Ritem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wedge1Ritem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(7.0f, 0.0f, -2.0f)*XMMatrixRotationRollPitchYaw(0.0f, -1.57f, 0.0f));
-	wedge1Ritem->ObjCBIndex = objIndex++;
-	wedge1Ritem->Geo = mGeometries["shapeGeo"].get();
+	wedge1Ritem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(7.0f, 0.0f, -2.0f)*XMMatrixRotationRollPitchYaw(0.0f, -1.57f, 0.0f));
+	wedge1Ritem->Geo = wedgeGeo;
 	wedge1Ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wedge1Ritem->IndexCount = wedge1Ritem->Geo->DrawArgs["wedge"].IndexCount;
-	wedge1Ritem->StartIndexLocation = wedge1Ritem->Geo->DrawArgs["wedge"].StartIndexLocation;
-	wedge1Ritem->BaseVertexLocation = wedge1Ritem->Geo->DrawArgs["wedge"].BaseVertexLocation;
+	wedge1Ritem->IndexCount = wedgeSubmesh.IndexCount;
+	wedge1Ritem->StartIndexLocation = wedgeSubmesh.StartIndexLocation;
+	wedge1Ritem->BaseVertexLocation = wedgeSubmesh.BaseVertexLocation;
+	wedge1Ritem->Bounds = wedgeSubmesh.Bounds;
+	wedge1Ritem->PositionScale = wedgeSubmesh.PositionScale;
+	wedge1Ritem->PositionBias = wedgeSubmesh.PositionBias;
+	wedge1Ritem->Lods = wedgeLods;
 	mAllRitems.push_back(std::move(wedge1Ritem));
 
 	auto halfConeRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&halfConeRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(0.0f, 0.0f, 7.0f));
-	halfConeRitem->ObjCBIndex = objIndex++;
-	halfConeRitem->Geo = mGeometries["shapeGeo"].get();
+	halfConeRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(0.0f, 0.0f, 7.0f));
+	halfConeRitem->Geo = halfConeGeo;
 	halfConeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	halfConeRitem->IndexCount = halfConeRitem->Geo->DrawArgs["halfCone"].IndexCount;
-	halfConeRitem->StartIndexLocation = halfConeRitem->Geo->DrawArgs["halfCone"].StartIndexLocation;
-	halfConeRitem->BaseVertexLocation = halfConeRitem->Geo->DrawArgs["halfCone"].BaseVertexLocation;
+	halfConeRitem->IndexCount = halfConeSubmesh.IndexCount;
+	halfConeRitem->StartIndexLocation = halfConeSubmesh.StartIndexLocation;
+	halfConeRitem->BaseVertexLocation = halfConeSubmesh.BaseVertexLocation;
+	halfConeRitem->Bounds = halfConeSubmesh.Bounds;
+	halfConeRitem->PositionScale = halfConeSubmesh.PositionScale;
+	halfConeRitem->PositionBias = halfConeSubmesh.PositionBias;
+	halfConeRitem->Lods = halfConeLods;
 	mAllRitems.push_back(std::move(halfConeRitem));
 
 	auto prismRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&prismRitem->World, XMMatrixScaling(3.0f, 3.0f, 1.0f)*XMMatrixTranslation(0.0f, 3.0f, -5.4f));
-	prismRitem->ObjCBIndex = objIndex++;
-	prismRitem->Geo = mGeometries["shapeGeo"].get();
+	prismRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(3.0f, 3.0f, 1.0f)*XMMatrixTranslation(0.0f, 3.0f, -5.4f));
+	prismRitem->Geo = prismGeo;
 	prismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	prismRitem->IndexCount = prismRitem->Geo->DrawArgs["prism"].IndexCount;
-	prismRitem->StartIndexLocation = prismRitem->Geo->DrawArgs["prism"].StartIndexLocation;
-	prismRitem->BaseVertexLocation = prismRitem->Geo->DrawArgs["prism"].BaseVertexLocation;
+	prismRitem->IndexCount = prismSubmesh.IndexCount;
+	prismRitem->StartIndexLocation = prismSubmesh.StartIndexLocation;
+	prismRitem->BaseVertexLocation = prismSubmesh.BaseVertexLocation;
+	prismRitem->Bounds = prismSubmesh.Bounds;
+	prismRitem->PositionScale = prismSubmesh.PositionScale;
+	prismRitem->PositionBias = prismSubmesh.PositionBias;
+	prismRitem->Lods = prismLods;
 	mAllRitems.push_back(std::move(prismRitem));
 
 	auto diamondRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&diamondRitem->World, XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(0.0f, 1.0f, 7.0f));
-	diamondRitem->ObjCBIndex = objIndex++;
-	diamondRitem->Geo = mGeometries["shapeGeo"].get();
+	diamondRitem->ObjCBIndex = mTransforms.Add(XMMatrixScaling(1.0f, 1.0f, 1.0f)*XMMatrixTranslation(0.0f, 1.0f, 7.0f));
+	diamondRitem->Geo = diamondGeo;
 	diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
+	diamondRitem->IndexCount = diamondSubmesh.IndexCount;
+	diamondRitem->StartIndexLocation = diamondSubmesh.StartIndexLocation;
+	diamondRitem->BaseVertexLocation = diamondSubmesh.BaseVertexLocation;
+	diamondRitem->Bounds = diamondSubmesh.Bounds;
+	diamondRitem->PositionScale = diamondSubmesh.PositionScale;
+	diamondRitem->PositionBias = diamondSubmesh.PositionBias;
+	diamondRitem->Lods = diamondLods;
 	mAllRitems.push_back(std::move(diamondRitem));
+}
 
-	// All the render items are opaque.
-	for (auto& e : mAllRitems)
-		mOpaqueRitems.push_back(e.get());
+void ShapesApp::BuildStressRenderItems()
+{
+	struct Shape
+	{
+		MeshGeometry* Geo;
+		const SubmeshGeometry* Submesh;
+		std::vector<RenderItemLod> Lods;
+		bool IsOccluder;
+	};
+
+	// Resolve the names once, rather than for every item.  The grid is laid under
+	// the other shapes as the ground.  The boxes and cylinders stand in for the
+	// castle's walls and towers as occluders.
+	auto findShape = [&](const std::string& name)
+	{
+		MeshGeometry* geo = FindShapeGeometry(name);
+		bool isOccluder = (name == "box" || name == "cylinder");
+		return Shape{ geo, &geo->DrawArgs.Get(name), GetShapeLods(name), isOccluder };
+	};
+
+	Shape ground = findShape("grid");
+	std::vector<Shape> shapes;
+	for (const ShapeRecipe& recipe : ShapeRecipes)
+	{
+		if (std::string(recipe.Name) != "grid")
+			shapes.push_back(findShape(recipe.Name));
+	}
+
+	auto addItem = [&](const Shape& shape, FXMMATRIX world)
+	{
+		auto ritem = std::make_unique<RenderItem>();
+		ritem->ObjCBIndex = mTransforms.Add(world);
+		ritem->Geo = shape.Geo;
+		ritem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ritem->IndexCount = shape.Submesh->IndexCount;
+		ritem->StartIndexLocation = shape.Submesh->StartIndexLocation;
+		ritem->BaseVertexLocation = shape.Submesh->BaseVertexLocation;
+		ritem->Bounds = shape.Submesh->Bounds;
+		ritem->PositionScale = shape.Submesh->PositionScale;
+		ritem->PositionBias = shape.Submesh->PositionBias;
+		ritem->Lods = shape.Lods;
+		ritem->IsOccluder = shape.IsOccluder;
+		mAllRitems.push_back(std::move(ritem));
+	};
+
+	// One shape in each cell of a square field, centered on the origin.
+	UINT side = (UINT)std::ceil(std::sqrt((double)mStressObjectCount));
+	float fieldSize = side * StressCellSize;
+	float fieldOrigin = -0.5f*fieldSize + 0.5f*StressCellSize;
+
+	// The engine is named so the scene is the same on every standard library
+	// that has it, and each draw is a statement of its own so the order is too.
+	std::mt19937 random(mStressSeed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	for (UINT i = 0; i < mStressObjectCount; ++i)
+	{
+		const Shape& shape = shapes[random() % shapes.size()];
+
+		float scale = 0.5f + unit(random);
+		float yaw = XM_2PI * unit(random);
+		float jitterX = 0.25f*StressCellSize*(unit(random) - 0.5f);
+		float jitterZ = 0.25f*StressCellSize*(unit(random) - 0.5f);
+
+		// Stand the shape on the ground.
+		const BoundingBox& bounds = shape.Submesh->Bounds;
+		float height = scale*(bounds.Extents.y - bounds.Center.y);
+
+		float x = fieldOrigin + (i % side)*StressCellSize + jitterX;
+		float z = fieldOrigin + (i / side)*StressCellSize + jitterZ;
+		addItem(shape, XMMatrixScaling(scale, scale, scale)*XMMatrixRotationY(yaw)*XMMatrixTranslation(x, height, z));
+	}
+
+	// The grid shape is 50 units across.
+	float groundScale = fieldSize / 50.0f;
+	addItem(ground, XMMatrixScaling(groundScale, 1.0f, groundScale));
+
+	mSceneRadius = 0.75f*fieldSize;
+	mRadius = MathHelper::Clamp(mSceneRadius, 5.0f, 150.0f);
 }
 
-void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShapesApp::BuildInstanceBatches()
 {
+	// Two render items can be drawn in the same batch if they draw the same submesh.
+	auto sameSubmesh = [](const RenderItem& a, const RenderItem& b)
+	{
+		return a.Geo == b.Geo &&
+			a.PrimitiveType == b.PrimitiveType &&
+			a.IndexCount == b.IndexCount &&
+			a.StartIndexLocation == b.StartIndexLocation &&
+			a.BaseVertexLocation == b.BaseVertexLocation;
+	};
+
+	// Order the render items so that items drawing the same submesh are adjacent.
+	std::stable_sort(mAllRitems.begin(), mAllRitems.end(),
+		[](const std::unique_ptr<RenderItem>& a, const std::unique_ptr<RenderItem>& b)
+	{
+		if (a->Geo != b->Geo)
+			return a->Geo < b->Geo;
+		if (a->PrimitiveType != b->PrimitiveType)
+			return a->PrimitiveType < b->PrimitiveType;
+		if (a->StartIndexLocation != b->StartIndexLocation)
+			return a->StartIndexLocation < b->StartIndexLocation;
+		if (a->BaseVertexLocation != b->BaseVertexLocation)
+			return a->BaseVertexLocation < b->BaseVertexLocation;
+		if (a->IndexCount != b->IndexCount)
+			return a->IndexCount < b->IndexCount;
+
+		// The occluders of a batch come first, so the pre-pass draws them as one run.
+		return a->IsOccluder && !b->IsOccluder;
+	});
+
+	// Reassign the object indices in the new order so each batch covers a
+	// contiguous range of the object cbuffer and instance buffer, and move the
+	// transforms along with them.  No slot has been freed yet, so the slots come
+	// out in order too.
+	TransformArray sortedTransforms(gNumFrameResources);
+
+	mInstanceBatches.clear();
+	mBatchOfObject.clear();
+	for (UINT i = 0; i < (UINT)mAllRitems.size(); ++i)
+	{
+		RenderItem* ri = mAllRitems[i].get();
+		UINT slot = mObjectSlots.Allocate();
+		assert(slot == sortedTransforms.Size());
+		sortedTransforms.Add(mTransforms.Get(ri->ObjCBIndex));
+		ri->ObjCBIndex = slot;
+
+		if (mInstanceBatches.empty() || !sameSubmesh(*mAllRitems[i - 1], *ri))
+		{
+			InstanceBatch batch;
+			batch.Geo = ri->Geo;
+			batch.PrimitiveType = ri->PrimitiveType;
+			batch.IndexCount = ri->IndexCount;
+			batch.StartIndexLocation = ri->StartIndexLocation;
+			batch.BaseVertexLocation = ri->BaseVertexLocation;
+			batch.StartInstanceLocation = i;
+			mInstanceBatches.push_back(batch);
+		}
+
+		mInstanceBatches.back().InstanceCount++;
+		mBatchOfObject.push_back((UINT)mInstanceBatches.size() - 1);
+	}
+
+	mTransforms = std::move(sortedTransforms);
+}
+
+void ShapesApp::BuildBvh()
+{
+	// Free slots stand in as empty boxes at the origin, switched off until an
+	// added item takes them.
+	std::vector<BoundingBox> boxes(mOpaqueRitems.size(), BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f)));
+	for (size_t i = 0; i < mOpaqueRitems.size(); ++i)
+	{
+		RenderItem* ri = mOpaqueRitems[i];
+		if (ri == nullptr)
+			continue;
+
+		XMMATRIX world = XMLoadFloat4x4(&mTransforms.Get(ri->ObjCBIndex));
+		ri->Bounds.Transform(boxes[i], world);
+	}
+
+	mOpaqueBvh.Build(boxes);
+	for (UINT i = 0; i < (UINT)mOpaqueRitems.size(); ++i)
+	{
+		if (mOpaqueRitems[i] == nullptr)
+			mOpaqueBvh.SetActive(i, false);
+	}
+	mBvhInsertCount = 0;
+	mIsBvhStale = false;
+}
+
+void ShapesApp::BuildGpuCuller()
+{
+	UINT objectCount = mObjectSlots.SlotCount();
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+
+	// The object cbuffer is bound through root parameter 0.
+	mGpuCuller = std::make_unique<GpuCuller>(md3dDevice.Get(), mRootSignature.Get(),
+		0, objCBByteSize, objectCount, MaxLodCount, mShaderSource, mPipelineCache.get());
+
+	std::vector<CullObject> objects(objectCount);
+	std::vector<IndirectCommand> commands((size_t)objectCount*MaxLodCount);
+	for (UINT i = 0; i < objectCount; ++i)
+		GetCullObject(i, objects[i], &commands[(size_t)i*MaxLodCount]);
+
+	mGpuCuller->Upload(mCommandList.Get(), objects, commands);
+}
+
+void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems, size_t begin, size_t end)
+{
+	CpuScope scope("DrawRenderItems");
+
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
+	D3D12_GPU_VIRTUAL_ADDRESS objectCBBase = objectCB->GetGPUVirtualAddress();
+
+	// The items are sorted by state, so only set what differs from the last draw.
+	MeshGeometry* boundGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
 
-	// For each render item...
-	for (size_t i = 0; i < ritems.size(); ++i)
+	// For each render item in [begin, end)...
+	for (size_t i = begin; i < end; ++i)
 	{
 		auto ri = ritems[i];
 
-		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		if (ri->Geo != boundGeo)
+		{
+			D3D12_VERTEX_BUFFER_VIEW vbvs[] = { ri->Geo->VertexBufferView(), ri->Geo->AttributeBufferView() };
+			cmdList->IASetVertexBuffers(0, _countof(vbvs), vbvs);
+			cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+			boundGeo = ri->Geo;
+		}
+
+		if (ri->PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			boundTopology = ri->PrimitiveType;
+		}
 
-		// Offset to the CBV in the descriptor heap for this object and for this frame resource.
-		UINT cbvIndex = mCurrFrameResourceIndex * (UINT)mOpaqueRitems.size() + ri->ObjCBIndex;
-		auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mCbvHeap->GetGPUDescriptorHandleForHeapStart());
-		cbvHandle.Offset(cbvIndex, mCbvSrvUavDescriptorSize);
+		// Point the root CBV at this object's constants in this frame resource's buffer.
+		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCBBase + (UINT64)ri->ObjCBIndex*objCBByteSize;
 
-		cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
+		cmdList->SetGraphicsRootConstantBufferView(0, objCBAddress);
 
 		cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
 	}
 }
+
+void ShapesApp::DrawInstanceBatches(ID3D12GraphicsCommandList* cmdList, const std::vector<InstanceBatch>& batches,
+	size_t begin, size_t end, UINT viewCount)
+{
+	CpuScope scope("DrawInstanceBatches");
+
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+	cmdList->SetGraphicsRootShaderResourceView(2, instanceBuffer->GetGPUVirtualAddress());
+
+	// The batches are sorted by state, so only set what differs from the last draw.
+	MeshGeometry* boundGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+	// For each batch in [begin, end)...
+	for (size_t i = begin; i < end; ++i)
+	{
+		const InstanceBatch& b = batches[i];
+
+		if (b.Geo != boundGeo)
+		{
+			D3D12_VERTEX_BUFFER_VIEW vbvs[] = { b.Geo->VertexBufferView(), b.Geo->AttributeBufferView() };
+			cmdList->IASetVertexBuffers(0, _countof(vbvs), vbvs);
+			cmdList->IASetIndexBuffer(&b.Geo->IndexBufferView());
+			boundGeo = b.Geo;
+		}
+
+		if (b.PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(b.PrimitiveType);
+			boundTopology = b.PrimitiveType;
+		}
+
+		// The shader offsets SV_InstanceID by the batch's first instance.
+		cmdList->SetGraphicsRoot32BitConstant(3, b.StartInstanceLocation, 0);
+
+		// A multi-view pass draws every instance once for each view.
+		cmdList->DrawIndexedInstanced(b.IndexCount, b.InstanceCount*viewCount, b.StartIndexLocation, b.BaseVertexLocation, 0);
+	}
+}
+
+void ShapesApp::DrawMeshletBatches(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* pso, UINT view,
+	const std::vector<InstanceBatch>& batches, size_t begin, size_t end)
+{
+	CpuScope scope("DrawMeshletBatches");
+
+	// Mesh shaders output triangle lists, which is all the shapes are made of.
+	// Workers record chunks side by side, so each converts its own.
+	std::vector<MeshletDraw> draws(end - begin);
+	for (size_t i = begin; i < end; ++i)
+	{
+		const InstanceBatch& b = batches[i];
+
+		MeshletDraw& draw = draws[i - begin];
+		draw.Geo = b.Geo;
+		draw.MeshletOffset = b.MeshletOffset;
+		draw.MeshletCount = b.MeshletCount;
+		draw.BaseVertexLocation = b.BaseVertexLocation;
+		draw.InstanceCount = b.InstanceCount;
+		draw.StartInstanceLocation = b.StartInstanceLocation;
+	}
+
+	XMMATRIX viewProj = XMMatrixTranspose(XMLoadFloat4x4(&mViews[view].PassCB.ViewProj));
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+	mMeshletRenderer->Draw(cmdList, pso, mCurrFrameResource->PassCBAddresses[view], instanceBuffer->GetGPUVirtualAddress(),
+		viewProj, draws.data(), draws.size());
+}
@@ -0,0 +1,158 @@
+//***************************************************************************************
+// BenchmarkReport.cpp
+//***************************************************************************************
+
+#include <windows.h>
+#include "BenchmarkReport.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+void BenchmarkReport::SetInfo(const std::string& key, const std::string& value)
+{
+    SetInfoJson(key, ToJsonString(value));
+}
+
+void BenchmarkReport::SetInfo(const std::string& key, const std::wstring& value)
+{
+    // Adapter descriptions and file names can be outside the ANSI code page.
+    std::string utf8;
+    int length = WideCharToMultiByte(CP_UTF8, 0, value.c_str(), (int)value.size(), nullptr, 0, nullptr, nullptr);
+    if(length > 0)
+    {
+        utf8.resize(length);
+        WideCharToMultiByte(CP_UTF8, 0, value.c_str(), (int)value.size(), &utf8[0], length, nullptr, nullptr);
+    }
+
+    SetInfo(key, utf8);
+}
+
+void BenchmarkReport::SetInfo(const std::string& key, double value)
+{
+    std::ostringstream json;
+    json.precision(10);
+    json << value;
+    SetInfoJson(key, json.str());
+}
+
+void BenchmarkReport::AddSample(const std::string& series, double ms)
+{
+    auto it = std::find_if(mSeries.begin(), mSeries.end(), [&](const Series& s) { return s.Name == series; });
+    if(it == mSeries.end())
+    {
+        mSeries.push_back({ series, {} });
+        it = mSeries.end() - 1;
+    }
+
+    it->Samples.push_back(ms);
+}
+
+BenchmarkReport::Summary BenchmarkReport::Summarize(const std::string& series)const
+{
+    for(const Series& s : mSeries)
+    {
+        if(s.Name == series)
+            return Summarize(s.Samples);
+    }
+
+    return Summary();
+}
+
+bool BenchmarkReport::WriteJson(const std::wstring& fileName)const
+{
+    std::ofstream fout(fileName, std::ios::trunc);
+    if(!fout)
+        return false;
+
+    fout << "{\n  \"info\": {";
+    for(size_t i = 0; i < mInfo.size(); ++i)
+        fout << (i == 0 ? "\n" : ",\n") << "    " << ToJsonString(mInfo[i].first) << ": " << mInfo[i].second;
+    fout << "\n  },\n";
+
+    fout.setf(std::ios::fixed);
+    fout.precision(4);
+
+    fout << "  \"series\": {";
+    for(size_t i = 0; i < mSeries.size(); ++i)
+    {
+        Summary summary = Summarize(mSeries[i].Samples);
+
+        fout << (i == 0 ? "\n" : ",\n") << "    " << ToJsonString(mSeries[i].Name) << ": {"
+            << " \"count\": " << summary.Count
+            << ", \"min_ms\": " << summary.MinMs
+            << ", \"avg_ms\": " << summary.AvgMs
+            << ", \"p50_ms\": " << summary.P50Ms
+            << ", \"p90_ms\": " << summary.P90Ms
+            << ", \"p95_ms\": " << summary.P95Ms
+            << ", \"p99_ms\": " << summary.P99Ms
+            << ", \"max_ms\": " << summary.MaxMs << " }";
+    }
+    fout << "\n  }\n}\n";
+
+    return (bool)fout;
+}
+
+void BenchmarkReport::SetInfoJson(const std::string& key, const std::string& json)
+{
+    for(auto& info : mInfo)
+    {
+        if(info.first == key)
+        {
+            info.second = json;
+            return;
+        }
+    }
+
+    mInfo.push_back({ key, json });
+}
+
+std::string BenchmarkReport::ToJsonString(const std::string& s)
+{
+    std::string json = "\"";
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\')
+        {
+            json += '\\';
+            json += c;
+        }
+        else if((unsigned char)c >= 0x20)
+        {
+            json += c;
+        }
+    }
+    json += '"';
+
+    return json;
+}
+
+BenchmarkReport::Summary BenchmarkReport::Summarize(std::vector<double> samples)
+{
+    Summary summary;
+    if(samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for(double ms : samples)
+        sum += ms;
+
+    auto percentile = [&](double p)
+    {
+        size_t rank = (size_t)std::ceil(p * samples.size());
+        return samples[std::min<size_t>(std::max<size_t>(rank, 1), samples.size()) - 1];
+    };
+
+    summary.Count = samples.size();
+    summary.MinMs = samples.front();
+    summary.AvgMs = sum / samples.size();
+    summary.P50Ms = percentile(0.50);
+    summary.P90Ms = percentile(0.90);
+    summary.P95Ms = percentile(0.95);
+    summary.P99Ms = percentile(0.99);
+    summary.MaxMs = samples.back();
+
+    return summary;
+}
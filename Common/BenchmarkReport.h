@@ -0,0 +1,58 @@
+//***************************************************************************************
+// BenchmarkReport.h
+//
+// Collects the per-frame times of a benchmark run into named series and writes
+// them out as JSON, with the run's settings and each series' percentiles, so
+// runs can be compared by a script rather than read off the window caption.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+class BenchmarkReport
+{
+public:
+    // Of the samples of a series, in milliseconds.  Percentiles are nearest rank.
+    struct Summary
+    {
+        size_t Count = 0;
+        double MinMs = 0.0;
+        double AvgMs = 0.0;
+        double P50Ms = 0.0;
+        double P90Ms = 0.0;
+        double P95Ms = 0.0;
+        double P99Ms = 0.0;
+        double MaxMs = 0.0;
+    };
+
+    // Describe the run, in the order set.  Setting a key again replaces its value.
+    void SetInfo(const std::string& key, const std::string& value);
+    void SetInfo(const std::string& key, const std::wstring& value);
+    void SetInfo(const std::string& key, double value);
+
+    // Series are written in the order they first get a sample.
+    void AddSample(const std::string& series, double ms);
+
+    Summary Summarize(const std::string& series)const;
+
+    // Returns false if the file could not be written.
+    bool WriteJson(const std::wstring& fileName)const;
+
+private:
+    struct Series
+    {
+        std::string Name;
+        std::vector<double> Samples;
+    };
+
+    void SetInfoJson(const std::string& key, const std::string& json);
+    static std::string ToJsonString(const std::string& s);
+    static Summary Summarize(std::vector<double> samples);
+
+private:
+    // Values are kept as JSON.
+    std::vector<std::pair<std::string, std::string>> mInfo;
+    std::vector<Series> mSeries;
+};
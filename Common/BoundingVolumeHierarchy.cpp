@@ -0,0 +1,202 @@
+//***************************************************************************************
+// BoundingVolumeHierarchy.cpp
+//***************************************************************************************
+
+#include "BoundingVolumeHierarchy.h"
+#include <functional>
+
+using namespace DirectX;
+
+void BoundingVolumeHierarchy::Build(const std::vector<BoundingBox>& boxes)
+{
+    mObjectBounds = boxes;
+
+    UINT objectCount = (UINT)boxes.size();
+
+    mObjects.resize(objectCount);
+    for(UINT i = 0; i < objectCount; ++i)
+        mObjects[i] = i;
+
+    mLeafOfObject.assign(objectCount, -1);
+    mIsObjectActive.assign(objectCount, true);
+    mInactiveCount = 0;
+    mDirtyLeaves.clear();
+
+    mNodes.clear();
+    mNodes.reserve(2*objectCount);
+
+    if(objectCount > 0)
+        BuildNode(-1, 0, objectCount);
+}
+
+UINT BoundingVolumeHierarchy::ObjectCount()const
+{
+    return (UINT)mObjectBounds.size();
+}
+
+UINT BoundingVolumeHierarchy::NodeCount()const
+{
+    return (UINT)mNodes.size();
+}
+
+int BoundingVolumeHierarchy::BuildNode(int parent, UINT first, UINT count)
+{
+    int index = (int)mNodes.size();
+    mNodes.push_back(Node());
+
+    Node node;
+    node.Bounds = ObjectRangeBounds(first, count);
+    node.Parent = parent;
+    node.FirstObject = first;
+    node.ObjectCount = count;
+
+    if(count <= MaxLeafObjects)
+    {
+        for(UINT i = first; i < first + count; ++i)
+            mLeafOfObject[mObjects[i]] = index;
+
+        mNodes[index] = node;
+        return index;
+    }
+
+    // Split at the median of the object centers along the longest axis of the
+    // node, which keeps the tree balanced.
+    XMFLOAT3 extents = node.Bounds.Extents;
+    int axis = 0;
+    if(extents.y > extents.x)
+        axis = 1;
+    if(extents.z > (axis == 0 ? extents.x : extents.y))
+        axis = 2;
+
+    auto center = [&](UINT object)
+    {
+        const XMFLOAT3& c = mObjectBounds[object].Center;
+        return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+    };
+
+    UINT half = count / 2;
+    std::nth_element(mObjects.begin() + first, mObjects.begin() + first + half,
+        mObjects.begin() + first + count,
+        [&](UINT a, UINT b) { return center(a) < center(b); });
+
+    BuildNode(index, first, half);
+    node.RightChild = BuildNode(index, first + half, count - half);
+
+    mNodes[index] = node;
+    return index;
+}
+
+BoundingBox BoundingVolumeHierarchy::ObjectRangeBounds(UINT first, UINT count)const
+{
+    BoundingBox bounds = mObjectBounds[mObjects[first]];
+    for(UINT i = first + 1; i < first + count; ++i)
+        BoundingBox::CreateMerged(bounds, bounds, mObjectBounds[mObjects[i]]);
+
+    return bounds;
+}
+
+void BoundingVolumeHierarchy::SetBounds(UINT object, const BoundingBox& box)
+{
+    mObjectBounds[object] = box;
+    mDirtyLeaves.push_back(mLeafOfObject[object]);
+}
+
+void BoundingVolumeHierarchy::Refit()
+{
+    if(mDirtyLeaves.empty())
+        return;
+
+    // Collect every node above a changed object.  The walk up stops at nodes
+    // that are already collected, so each node is visited once.
+    std::vector<int> dirtyNodes;
+    std::vector<bool> isDirty(mNodes.size(), false);
+    for(int leaf : mDirtyLeaves)
+    {
+        for(int n = leaf; n >= 0 && !isDirty[n]; n = mNodes[n].Parent)
+        {
+            isDirty[n] = true;
+            dirtyNodes.push_back(n);
+        }
+    }
+    mDirtyLeaves.clear();
+
+    // Children come after their parents, so refitting from the back updates
+    // every child before the parent that merges it.
+    std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<int>());
+
+    for(int n : dirtyNodes)
+    {
+        Node& node = mNodes[n];
+        if(node.IsLeaf())
+            node.Bounds = ObjectRangeBounds(node.FirstObject, node.ObjectCount);
+        else
+            BoundingBox::CreateMerged(node.Bounds, mNodes[n + 1].Bounds, mNodes[node.RightChild].Bounds);
+    }
+}
+
+void BoundingVolumeHierarchy::SetActive(UINT object, bool isActive)
+{
+    if(mIsObjectActive[object] == isActive)
+        return;
+
+    mIsObjectActive[object] = isActive;
+    if(isActive)
+        --mInactiveCount;
+    else
+        ++mInactiveCount;
+}
+
+void BoundingVolumeHierarchy::Query(const BoundingFrustum& frustum, std::vector<UINT>& visible)const
+{
+    if(mNodes.empty())
+        return;
+
+    size_t firstVisible = visible.size();
+
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const Node& node = mNodes[stack[--stackSize]];
+
+        ContainmentType containment = frustum.Contains(node.Bounds);
+        if(containment == DISJOINT)
+            continue;
+
+        // Everything under a node that is inside the frustum is visible without
+        // testing any further.
+        if(containment == CONTAINS && mInactiveCount == 0)
+        {
+            visible.insert(visible.end(), mObjects.begin() + node.FirstObject,
+                mObjects.begin() + node.FirstObject + node.ObjectCount);
+        }
+        else if(containment == CONTAINS)
+        {
+            for(UINT i = node.FirstObject; i < node.FirstObject + node.ObjectCount; ++i)
+            {
+                if(mIsObjectActive[mObjects[i]])
+                    visible.push_back(mObjects[i]);
+            }
+        }
+        else if(node.IsLeaf())
+        {
+            for(UINT i = node.FirstObject; i < node.FirstObject + node.ObjectCount; ++i)
+            {
+                if(mIsObjectActive[mObjects[i]] && frustum.Intersects(mObjectBounds[mObjects[i]]))
+                    visible.push_back(mObjects[i]);
+            }
+        }
+        else
+        {
+            // Median splits keep the depth near log2 of the leaf count, far below
+            // the size of the stack.
+            assert(stackSize + 2 <= _countof(stack));
+            stack[stackSize++] = node.RightChild;
+            stack[stackSize++] = (int)(&node - mNodes.data()) + 1;
+        }
+    }
+
+    std::sort(visible.begin() + firstVisible, visible.end());
+}
@@ -0,0 +1,80 @@
+//***************************************************************************************
+// BoundingVolumeHierarchy.h
+//
+// Binary tree of axis-aligned boxes over a set of objects, for culling whole groups
+// of objects with one test.  Moving objects are handled by refitting the boxes of
+// the nodes above them instead of rebuilding the tree, and objects that come and
+// go by switching them off and on.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class BoundingVolumeHierarchy
+{
+public:
+    BoundingVolumeHierarchy() = default;
+    BoundingVolumeHierarchy(const BoundingVolumeHierarchy& rhs) = delete;
+    BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy& rhs) = delete;
+
+    // Builds the tree over world space boxes.  Object i is boxes[i].  Every object
+    // starts out active.
+    void Build(const std::vector<DirectX::BoundingBox>& boxes);
+
+    UINT ObjectCount()const;
+    UINT NodeCount()const;
+
+    // Changes the box of an object.  The tree is not updated until Refit.
+    void SetBounds(UINT object, const DirectX::BoundingBox& box);
+
+    // Grows or shrinks the nodes above the objects changed since the last Refit.
+    // The tree keeps its shape, so it only stays efficient while objects move
+    // moderately; rebuild it after large changes.
+    void Refit();
+
+    // Inactive objects are never reported by Query.  They keep their place in
+    // the tree, so one can be given new bounds and switched back on in place of
+    // a new object.
+    void SetActive(UINT object, bool isActive);
+
+    // Appends the active objects whose boxes intersect the frustum to visible, in
+    // increasing order.
+    void Query(const DirectX::BoundingFrustum& frustum, std::vector<UINT>& visible)const;
+
+private:
+    // Nodes are stored depth first, so the left child of node i is node i+1 and
+    // every child comes after its parent.  The objects under a node are
+    // mObjects[FirstObject, FirstObject + ObjectCount).
+    struct Node
+    {
+        DirectX::BoundingBox Bounds;
+        int Parent = -1;
+        int RightChild = -1;
+        UINT FirstObject = 0;
+        UINT ObjectCount = 0;
+
+        bool IsLeaf()const { return RightChild < 0; }
+    };
+
+    int BuildNode(int parent, UINT first, UINT count);
+    DirectX::BoundingBox ObjectRangeBounds(UINT first, UINT count)const;
+
+private:
+    // Most objects stored in one leaf.
+    static const UINT MaxLeafObjects = 4;
+
+    std::vector<Node> mNodes;
+
+    // Object indices ordered so that each node covers a contiguous range.
+    std::vector<UINT> mObjects;
+
+    std::vector<DirectX::BoundingBox> mObjectBounds;
+    std::vector<int> mLeafOfObject;
+
+    std::vector<bool> mIsObjectActive;
+    UINT mInactiveCount = 0;
+
+    // Leaves holding objects changed since the last Refit.
+    std::vector<int> mDirtyLeaves;
+};
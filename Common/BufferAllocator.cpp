@@ -0,0 +1,185 @@
+//***************************************************************************************
+// BufferAllocator.cpp
+//***************************************************************************************
+
+#include "BufferAllocator.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // Allocations are aligned so that any of them can back a constant buffer view.
+    const UINT64 AllocationAlignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+
+    inline UINT64 AlignUp(UINT64 value, UINT64 alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+BufferAllocator::BufferAllocator(ID3D12Device* device, UINT64 pageByteSize)
+    : md3dDevice(device),
+    mPageByteSize(AlignUp(pageByteSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT))
+{
+}
+
+BufferAllocation BufferAllocator::CreateDefaultBuffer(UploadQueue& uploadQueue,
+    const void* initData, UINT64 byteSize)
+{
+    BufferAllocation allocation = Allocate(byteSize);
+
+    // Buffers are always simultaneous-access, so the copy queue may write this
+    // range while the direct queue reads other allocations in the page.
+    uploadQueue.CopyBuffer(allocation.Resource, allocation.Offset, initData, byteSize);
+
+    return allocation;
+}
+
+void BufferAllocator::Free(const BufferAllocation& allocation, UINT64 fenceValue)
+{
+    mPendingFrees.push_back({ allocation, fenceValue });
+}
+
+void BufferAllocator::Retire(UINT64 completedFenceValue)
+{
+    auto freeDone = [=](const PendingFree& p) { return p.FenceValue <= completedFenceValue; };
+    for(const PendingFree& p : mPendingFrees)
+    {
+        if(freeDone(p))
+            ReleaseToPage(p.Allocation);
+    }
+    mPendingFrees.erase(std::remove_if(mPendingFrees.begin(), mPendingFrees.end(), freeDone),
+        mPendingFrees.end());
+}
+
+BufferAllocator::Stats BufferAllocator::GetStats()const
+{
+    Stats stats;
+    stats.PageCount = (UINT)mPages.size();
+
+    for(const Page& page : mPages)
+    {
+        stats.ReservedBytes += page.ByteSize;
+        stats.AllocationCount += page.AllocationCount;
+        stats.FreeBlockCount += (UINT)page.FreeBlocks.size();
+
+        for(const auto& block : page.FreeBlocks)
+        {
+            stats.FreeBytes += block.second;
+            stats.LargestFreeBlock = std::max<UINT64>(stats.LargestFreeBlock, block.second);
+        }
+    }
+
+    stats.AllocatedBytes = stats.ReservedBytes - stats.FreeBytes;
+
+    if(stats.FreeBytes > 0)
+        stats.Fragmentation = 1.0f - (float)stats.LargestFreeBlock / (float)stats.FreeBytes;
+
+    return stats;
+}
+
+BufferAllocation BufferAllocator::Allocate(UINT64 byteSize)
+{
+    UINT64 alignedSize = AlignUp(byteSize, AllocationAlignment);
+
+    // First fit over the existing pages, then a new page.
+    BufferAllocation allocation;
+    for(UINT i = 0; i < (UINT)mPages.size(); ++i)
+    {
+        if(AllocateFromPage(i, alignedSize, allocation))
+        {
+            allocation.ByteSize = byteSize;
+            return allocation;
+        }
+    }
+
+    UINT page = CreatePage(std::max<UINT64>(alignedSize, mPageByteSize));
+    bool allocated = AllocateFromPage(page, alignedSize, allocation);
+    assert(allocated);
+
+    allocation.ByteSize = byteSize;
+    return allocation;
+}
+
+bool BufferAllocator::AllocateFromPage(UINT pageIndex, UINT64 byteSize, BufferAllocation& allocation)
+{
+    Page& page = mPages[pageIndex];
+
+    // Every block offset and size is a multiple of the alignment, so the block
+    // start can be used as is.
+    for(auto it = page.FreeBlocks.begin(); it != page.FreeBlocks.end(); ++it)
+    {
+        if(it->second < byteSize)
+            continue;
+
+        UINT64 offset = it->first;
+        UINT64 remaining = it->second - byteSize;
+
+        page.FreeBlocks.erase(it);
+        if(remaining > 0)
+            page.FreeBlocks[offset + byteSize] = remaining;
+
+        page.AllocationCount++;
+
+        allocation.Resource = page.Buffer.Get();
+        allocation.Offset = offset;
+        allocation.Page = pageIndex;
+        return true;
+    }
+
+    return false;
+}
+
+UINT BufferAllocator::CreatePage(UINT64 byteSize)
+{
+    Page page;
+    page.ByteSize = AlignUp(byteSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+    CD3DX12_HEAP_DESC heapDesc(page.ByteSize, D3D12_HEAP_TYPE_DEFAULT, 0,
+        D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+    ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&page.Heap)));
+
+    ThrowIfFailed(md3dDevice->CreatePlacedResource(
+        page.Heap.Get(),
+        0,
+        &CD3DX12_RESOURCE_DESC::Buffer(page.ByteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&page.Buffer)));
+
+    page.FreeBlocks[0] = page.ByteSize;
+
+    mPages.push_back(std::move(page));
+    return (UINT)mPages.size() - 1;
+}
+
+void BufferAllocator::ReleaseToPage(const BufferAllocation& allocation)
+{
+    Page& page = mPages[allocation.Page];
+
+    UINT64 offset = allocation.Offset;
+    UINT64 size = AlignUp(allocation.ByteSize, AllocationAlignment);
+
+    // Merge with the free block after this one...
+    auto next = page.FreeBlocks.lower_bound(offset);
+    if(next != page.FreeBlocks.end() && next->first == offset + size)
+    {
+        size += next->second;
+        next = page.FreeBlocks.erase(next);
+    }
+
+    // ...and the one before it.
+    if(next != page.FreeBlocks.begin())
+    {
+        auto prev = std::prev(next);
+        if(prev->first + prev->second == offset)
+        {
+            offset = prev->first;
+            size += prev->second;
+            page.FreeBlocks.erase(prev);
+        }
+    }
+
+    page.FreeBlocks[offset] = size;
+    page.AllocationCount--;
+}
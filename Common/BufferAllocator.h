@@ -0,0 +1,105 @@
+//***************************************************************************************
+// BufferAllocator.h
+//
+// Sub-allocates static default heap buffers from large pages instead of creating a
+// committed resource per buffer.  Each page is an ID3D12Heap with one placed buffer
+// spanning it, so an allocation is a page buffer plus an offset.  Initial data is
+// copied in on an UploadQueue.  Pages are left in D3D12_RESOURCE_STATE_COMMON, which
+// buffers decay to after every copy, so pages need no state tracking.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "UploadQueue.h"
+#include <map>
+
+struct BufferAllocation
+{
+    // Page buffer the allocation lives in.  Shared with other allocations.
+    ID3D12Resource* Resource = nullptr;
+    UINT64 Offset = 0;
+    UINT64 ByteSize = 0;
+
+    D3D12_GPU_VIRTUAL_ADDRESS GpuAddress()const
+    {
+        return Resource->GetGPUVirtualAddress() + Offset;
+    }
+
+private:
+    friend class BufferAllocator;
+    UINT Page = 0;
+};
+
+class BufferAllocator
+{
+public:
+    struct Stats
+    {
+        UINT PageCount = 0;
+        UINT AllocationCount = 0;
+
+        // Bytes in all pages, in live allocations, and free.
+        UINT64 ReservedBytes = 0;
+        UINT64 AllocatedBytes = 0;
+        UINT64 FreeBytes = 0;
+
+        UINT FreeBlockCount = 0;
+        UINT64 LargestFreeBlock = 0;
+
+        // 1 - LargestFreeBlock/FreeBytes: 0 when the free space is one block,
+        // approaching 1 as it is split into many small ones.
+        float Fragmentation = 0.0f;
+    };
+
+    // Buffers larger than pageByteSize get a page of their own.
+    BufferAllocator(ID3D12Device* device, UINT64 pageByteSize = 4*1024*1024);
+    BufferAllocator(const BufferAllocator& rhs) = delete;
+    BufferAllocator& operator=(const BufferAllocator& rhs) = delete;
+    ~BufferAllocator() = default;
+
+    // Allocates a default heap buffer and records the copy of initData into it in
+    // the upload queue's current batch.  The buffer holds the data once the batch's
+    // ticket completes; until then it must not be read.
+    BufferAllocation CreateDefaultBuffer(UploadQueue& uploadQueue,
+        const void* initData, UINT64 byteSize);
+
+    // Returns the allocation to its page once the GPU reaches fenceValue.
+    void Free(const BufferAllocation& allocation, UINT64 fenceValue);
+
+    // Recycles the freed allocations the GPU is done with.
+    void Retire(UINT64 completedFenceValue);
+
+    Stats GetStats()const;
+
+private:
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        UINT64 ByteSize = 0;
+
+        // Free blocks by offset.  Adjacent blocks are always merged.
+        std::map<UINT64, UINT64> FreeBlocks;
+        UINT AllocationCount = 0;
+    };
+
+    struct PendingFree
+    {
+        BufferAllocation Allocation;
+        UINT64 FenceValue;
+    };
+
+    BufferAllocation Allocate(UINT64 byteSize);
+    bool AllocateFromPage(UINT pageIndex, UINT64 byteSize, BufferAllocation& allocation);
+    UINT CreatePage(UINT64 byteSize);
+    void ReleaseToPage(const BufferAllocation& allocation);
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    UINT64 mPageByteSize = 0;
+
+    std::vector<Page> mPages;
+
+    std::vector<PendingFree> mPendingFrees;
+};
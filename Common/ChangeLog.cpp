@@ -0,0 +1,78 @@
+//***************************************************************************************
+// ChangeLog.cpp
+//***************************************************************************************
+
+#include "ChangeLog.h"
+#include <algorithm>
+
+namespace
+{
+    // Marks a log entry whose element was logged again later.
+    const unsigned SupersededIndex = 0xffffffff;
+
+    // Of an element that has not been logged.
+    const std::uint64_t NoEpoch = ~0ull;
+}
+
+ChangeLog::ChangeLog(unsigned frameCount) :
+    mSyncedEpoch(frameCount, 0)
+{
+}
+
+void ChangeLog::MarkChanged(unsigned index)
+{
+    if(index >= mLoggedEpoch.size())
+        mLoggedEpoch.resize(index + 1, NoEpoch);
+
+    std::uint64_t logged = mLoggedEpoch[index];
+    if(logged != NoEpoch)
+    {
+        // No frame resource has taken the entry yet, so it covers this change too.
+        if(logged >= mNewestSyncedEpoch)
+            return;
+
+        // Some frame resource took it already, so the change needs an entry of its
+        // own; the others would see the element twice if the old one stayed.
+        if(logged >= mLogBase)
+            mLog[(size_t)(logged - mLogBase)] = SupersededIndex;
+    }
+
+    mLoggedEpoch[index] = EndEpoch();
+    mLog.push_back(index);
+}
+
+void ChangeLog::TakeChanges(unsigned frameIndex, std::vector<unsigned>& indices)
+{
+    indices.clear();
+
+    std::uint64_t end = EndEpoch();
+    for(std::uint64_t epoch = mSyncedEpoch[frameIndex]; epoch < end; ++epoch)
+    {
+        unsigned index = mLog[(size_t)(epoch - mLogBase)];
+        if(index != SupersededIndex)
+            indices.push_back(index);
+    }
+
+    mSyncedEpoch[frameIndex] = end;
+    mNewestSyncedEpoch = std::max<std::uint64_t>(mNewestSyncedEpoch, end);
+
+    Compact();
+}
+
+std::uint64_t ChangeLog::EndEpoch()const
+{
+    return mLogBase + mLog.size();
+}
+
+void ChangeLog::Compact()
+{
+    // Drop the entries every frame resource has taken once they are at least half
+    // the log, so the erase is paid for by the appends since the last one.
+    std::uint64_t oldest = *std::min_element(mSyncedEpoch.begin(), mSyncedEpoch.end());
+    size_t dropCount = (size_t)(oldest - mLogBase);
+    if(dropCount == 0 || 2*dropCount < mLog.size())
+        return;
+
+    mLog.erase(mLog.begin(), mLog.begin() + dropCount);
+    mLogBase = oldest;
+}
@@ -0,0 +1,47 @@
+//***************************************************************************************
+// ChangeLog.h
+//
+// Tracks which elements of an array changed, for every frame resource that keeps
+// a copy of it.  A change appends the element's index to a log once, and each
+// frame resource only remembers the epoch, or log position, it has synced up to,
+// so both marking and collecting the changes cost in proportion to the changes
+// rather than to the size of the array.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class ChangeLog
+{
+public:
+    explicit ChangeLog(unsigned frameCount);
+
+    // Marks an element changed for every frame resource.  Indices need not be
+    // added first; one not seen before counts as changed.
+    void MarkChanged(unsigned index);
+
+    // Replaces indices with the elements that changed since frameIndex last took
+    // its changes, each once, and marks them synced for it.
+    void TakeChanges(unsigned frameIndex, std::vector<unsigned>& indices);
+
+private:
+    std::uint64_t EndEpoch()const;
+    void Compact();
+
+private:
+    // The element changed at each epoch from mLogBase on.  An element changed
+    // again while some frame resource still has it pending moves to the end, and
+    // its old entry is superseded, so no frame resource sees it twice.
+    std::vector<unsigned> mLog;
+    std::uint64_t mLogBase = 0;
+
+    // Epoch of each element's latest entry, if it has one.
+    std::vector<std::uint64_t> mLoggedEpoch;
+
+    // Every epoch before these has been taken, per frame resource and by the one
+    // furthest along.
+    std::vector<std::uint64_t> mSyncedEpoch;
+    std::uint64_t mNewestSyncedEpoch = 0;
+};
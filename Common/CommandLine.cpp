@@ -0,0 +1,85 @@
+//***************************************************************************************
+// CommandLine.cpp
+//***************************************************************************************
+
+#include "CommandLine.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+CommandLine::CommandLine(const char* cmdLine)
+{
+    if(cmdLine == nullptr)
+        return;
+
+    std::vector<std::string> tokens;
+    std::istringstream stream(cmdLine);
+    std::string token;
+    while(stream >> token)
+        tokens.push_back(token);
+
+    auto isName = [](const std::string& t)
+    {
+        return t.size() > 1 && (t[0] == '-' || t[0] == '/') && !std::isdigit((unsigned char)t[1]);
+    };
+
+    for(size_t i = 0; i < tokens.size(); ++i)
+    {
+        if(!isName(tokens[i]))
+            continue;
+
+        std::string name = ToLower(tokens[i].substr(1));
+
+        std::string value;
+        if(i + 1 < tokens.size() && !isName(tokens[i + 1]))
+            value = tokens[++i];
+
+        mOptions[name] = value;
+    }
+}
+
+bool CommandLine::Has(const std::string& name)const
+{
+    return mOptions.find(ToLower(name)) != mOptions.end();
+}
+
+std::string CommandLine::Get(const std::string& name, const std::string& defaultValue)const
+{
+    auto it = mOptions.find(ToLower(name));
+    if(it == mOptions.end() || it->second.empty())
+        return defaultValue;
+
+    return it->second;
+}
+
+int CommandLine::GetInt(const std::string& name, int defaultValue)const
+{
+    std::string value = Get(name, "");
+    if(value.empty())
+        return defaultValue;
+
+    char* end = nullptr;
+    long result = std::strtol(value.c_str(), &end, 10);
+    return *end == '\0' ? (int)result : defaultValue;
+}
+
+float CommandLine::GetFloat(const std::string& name, float defaultValue)const
+{
+    std::string value = Get(name, "");
+    if(value.empty())
+        return defaultValue;
+
+    char* end = nullptr;
+    float result = std::strtof(value.c_str(), &end);
+    return *end == '\0' ? result : defaultValue;
+}
+
+std::string CommandLine::ToLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+        [](unsigned char c) { return (char)std::tolower(c); });
+    return s;
+}
@@ -0,0 +1,33 @@
+//***************************************************************************************
+// CommandLine.h
+//
+// Parses "-name value" and "-flag" options from the command line passed to WinMain.
+// Names are matched without the leading '-' or '/' and ignoring case.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+class CommandLine
+{
+public:
+    CommandLine() = default;
+    explicit CommandLine(const char* cmdLine);
+
+    // True if the option appears, with or without a value.
+    bool Has(const std::string& name)const;
+
+    // The value following the option, or defaultValue if the option is missing
+    // or has no value.  GetInt also returns defaultValue for a non-numeric value.
+    std::string Get(const std::string& name, const std::string& defaultValue)const;
+    int GetInt(const std::string& name, int defaultValue)const;
+    float GetFloat(const std::string& name, float defaultValue)const;
+
+private:
+    static std::string ToLower(std::string s);
+
+private:
+    std::unordered_map<std::string, std::string> mOptions;
+};
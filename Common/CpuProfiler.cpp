@@ -0,0 +1,255 @@
+//***************************************************************************************
+// CpuProfiler.cpp
+//***************************************************************************************
+
+#include <windows.h>
+#include "CpuProfiler.h"
+#include "GameTimer.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct Event
+    {
+        std::atomic<const char*> Name{ nullptr };
+        std::atomic<__int64> Begin{ 0 };
+        std::atomic<__int64> End{ 0 };
+    };
+
+    // Written by its thread only.  Reserved is bumped before a slot is
+    // overwritten and Head after, so a reader can tell which of the slots it
+    // copied may have changed under it.
+    struct ThreadRing
+    {
+        DWORD ThreadId = 0;
+        std::atomic<const char*> ThreadName{ nullptr };
+
+        std::atomic<unsigned __int64> Reserved{ 0 };
+        std::atomic<unsigned __int64> Head{ 0 };
+        std::unique_ptr<Event[]> Events;
+    };
+
+    struct CapturedEvent
+    {
+        const char* Name;
+        __int64 Begin;
+        __int64 End;
+        const ThreadRing* Ring;
+    };
+
+    // Rings are kept until exit, so the scopes of a thread that has ended can
+    // still be written out.
+    std::mutex gRingsMutex;
+    std::vector<std::unique_ptr<ThreadRing>> gRings;
+
+    std::atomic<bool> gIsEnabled{ true };
+
+    // Trace times are relative to the first scope recorded.
+    std::atomic<__int64> gEpoch{ 0 };
+
+    thread_local ThreadRing* tRing = nullptr;
+
+    ThreadRing& GetThreadRing()
+    {
+        if(tRing == nullptr)
+        {
+            auto ring = std::make_unique<ThreadRing>();
+            ring->ThreadId = GetCurrentThreadId();
+            ring->Events = std::make_unique<Event[]>(CpuProfiler::RingSize);
+
+            std::lock_guard<std::mutex> lock(gRingsMutex);
+            tRing = ring.get();
+            gRings.push_back(std::move(ring));
+        }
+
+        return *tRing;
+    }
+
+    // Every scope still in a ring, in the order they began.
+    std::vector<CapturedEvent> Capture()
+    {
+        std::vector<CapturedEvent> events;
+
+        std::lock_guard<std::mutex> lock(gRingsMutex);
+        for(const auto& ring : gRings)
+        {
+            unsigned __int64 head = ring->Head.load(std::memory_order_acquire);
+            unsigned __int64 first = head > CpuProfiler::RingSize ? head - CpuProfiler::RingSize : 0;
+
+            size_t start = events.size();
+            for(unsigned __int64 i = first; i < head; ++i)
+            {
+                const Event& e = ring->Events[i % CpuProfiler::RingSize];
+
+                CapturedEvent captured;
+                captured.Name = e.Name.load(std::memory_order_relaxed);
+                captured.Begin = e.Begin.load(std::memory_order_relaxed);
+                captured.End = e.End.load(std::memory_order_relaxed);
+                captured.Ring = ring.get();
+                events.push_back(captured);
+            }
+
+            // Drop the slots the thread has begun to overwrite since head was read.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            unsigned __int64 reserved = ring->Reserved.load(std::memory_order_relaxed);
+            unsigned __int64 firstIntact = reserved > CpuProfiler::RingSize ? reserved - CpuProfiler::RingSize : 0;
+            if(firstIntact > first)
+            {
+                size_t torn = (size_t)std::min<unsigned __int64>(firstIntact - first, head - first);
+                events.erase(events.begin() + start, events.begin() + start + torn);
+            }
+        }
+
+        std::sort(events.begin(), events.end(), [](const CapturedEvent& a, const CapturedEvent& b)
+        {
+            return a.Begin < b.Begin;
+        });
+
+        return events;
+    }
+
+    double ToMicroseconds(__int64 ticks)
+    {
+        return (double)ticks * GameTimer::SecondsPerCount() * 1000000.0;
+    }
+
+    // Scope names are identifiers in practice, but keep the JSON valid regardless.
+    void WriteJsonString(std::ofstream& fout, const char* s)
+    {
+        fout << '"';
+        for(; s != nullptr && *s != '\0'; ++s)
+        {
+            if(*s == '"' || *s == '\\')
+                fout << '\\' << *s;
+            else if((unsigned char)*s >= 0x20)
+                fout << *s;
+        }
+        fout << '"';
+    }
+}
+
+void CpuProfiler::SetEnabled(bool enabled)
+{
+    gIsEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool CpuProfiler::IsEnabled()
+{
+    return gIsEnabled.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::SetThreadName(const char* name)
+{
+    GetThreadRing().ThreadName.store(name, std::memory_order_relaxed);
+}
+
+void CpuProfiler::Record(const char* name, __int64 begin, __int64 end)
+{
+    ThreadRing& ring = GetThreadRing();
+
+    __int64 noEpoch = 0;
+    gEpoch.compare_exchange_strong(noEpoch, begin, std::memory_order_relaxed);
+
+    unsigned __int64 head = ring.Head.load(std::memory_order_relaxed);
+    ring.Reserved.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Event& e = ring.Events[head % RingSize];
+    e.Name.store(name, std::memory_order_relaxed);
+    e.Begin.store(begin, std::memory_order_relaxed);
+    e.End.store(end, std::memory_order_relaxed);
+
+    ring.Head.store(head + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::wstring& fileName)
+{
+    std::vector<CapturedEvent> events = Capture();
+    __int64 epoch = gEpoch.load(std::memory_order_relaxed);
+
+    std::ofstream fout(fileName, std::ios::trunc);
+    if(!fout)
+        return false;
+
+    fout << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    bool isFirst = true;
+    {
+        std::lock_guard<std::mutex> lock(gRingsMutex);
+        for(const auto& ring : gRings)
+        {
+            const char* threadName = ring->ThreadName.load(std::memory_order_relaxed);
+            if(threadName == nullptr)
+                continue;
+
+            fout << (isFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+                << ring->ThreadId << ",\"args\":{\"name\":";
+            WriteJsonString(fout, threadName);
+            fout << "}}";
+            isFirst = false;
+        }
+    }
+
+    fout.setf(std::ios::fixed);
+    fout.precision(3);
+    for(const CapturedEvent& e : events)
+    {
+        fout << (isFirst ? "" : ",\n") << "{\"name\":";
+        WriteJsonString(fout, e.Name);
+        fout << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.Ring->ThreadId
+            << ",\"ts\":" << ToMicroseconds(e.Begin - epoch)
+            << ",\"dur\":" << ToMicroseconds(e.End - e.Begin) << "}";
+        isFirst = false;
+    }
+
+    fout << "\n]}\n";
+
+    return (bool)fout;
+}
+
+bool CpuProfiler::WriteCsv(const std::wstring& fileName)
+{
+    std::vector<CapturedEvent> events = Capture();
+    __int64 epoch = gEpoch.load(std::memory_order_relaxed);
+
+    std::ofstream fout(fileName, std::ios::trunc);
+    if(!fout)
+        return false;
+
+    fout << "thread,thread_name,scope,begin_ms,duration_ms\n";
+
+    fout.setf(std::ios::fixed);
+    fout.precision(4);
+    for(const CapturedEvent& e : events)
+    {
+        const char* threadName = e.Ring->ThreadName.load(std::memory_order_relaxed);
+
+        fout << e.Ring->ThreadId << ','
+            << (threadName != nullptr ? threadName : "") << ','
+            << e.Name << ','
+            << ToMicroseconds(e.Begin - epoch) / 1000.0 << ','
+            << ToMicroseconds(e.End - e.Begin) / 1000.0 << '\n';
+    }
+
+    return (bool)fout;
+}
+
+CpuScope::CpuScope(const char* name)
+{
+    if(CpuProfiler::IsEnabled())
+    {
+        mName = name;
+        mBegin = GameTimer::Now();
+    }
+}
+
+CpuScope::~CpuScope()
+{
+    if(mName != nullptr)
+        CpuProfiler::Record(mName, mBegin, GameTimer::Now());
+}
@@ -0,0 +1,52 @@
+//***************************************************************************************
+// CpuProfiler.h
+//
+// Scoped CPU timers for the hot paths of a frame, on GameTimer's performance
+// counter.  Each thread records into a ring buffer of its own without taking a
+// lock, so a scope costs two counter reads and a few stores, and the rings always
+// hold the last RingSize scopes of every thread.  They can be written out as a
+// Chrome trace (chrome://tracing or Perfetto) or as CSV at any time, so a hitch
+// can be looked into after it happens, without a profiling build.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+
+class CpuProfiler
+{
+public:
+    // Scopes each thread keeps before its oldest are overwritten.
+    static const unsigned RingSize = 16384;
+
+    // Recording is on by default.  Scopes begun while it is off are dropped.
+    static void SetEnabled(bool enabled);
+    static bool IsEnabled();
+
+    // Names the calling thread in the trace.  name must outlive the profiler.
+    static void SetThreadName(const char* name);
+
+    // Records a scope of the calling thread, in performance counter ticks.  name
+    // must outlive the profiler, as a string literal does.
+    static void Record(const char* name, __int64 begin, __int64 end);
+
+    // Write the scopes in the rings when called.  A thread can keep recording
+    // meanwhile; scopes it overwrites during the write are left out.  Return false
+    // if the file could not be written.
+    static bool WriteChromeTrace(const std::wstring& fileName);
+    static bool WriteCsv(const std::wstring& fileName);
+};
+
+// Times the rest of the enclosing block on the calling thread.
+class CpuScope
+{
+public:
+    explicit CpuScope(const char* name);
+    CpuScope(const CpuScope& rhs) = delete;
+    CpuScope& operator=(const CpuScope& rhs) = delete;
+    ~CpuScope();
+
+private:
+    const char* mName = nullptr;
+    __int64 mBegin = 0;
+};
@@ -24,6 +24,8 @@
 #include <wrl.h>
 
 #include "DDSTextureLoader.h" 
+#include "MappedFile.h"
+#include "UploadQueue.h"
 
 using namespace Microsoft::WRL;
 
@@ -268,6 +270,65 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
     return S_OK;
 }
 
+//--------------------------------------------------------------------------------------
+// Validates DDS data already in memory, such as a mapped file, and points into it.
+static HRESULT GetTextureDataFromMemory12( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                                           _In_ size_t ddsDataSize,
+                                           const DDS_HEADER** header,
+                                           const uint8_t** bitData,
+                                           size_t* bitSize
+                                         )
+{
+    if (!ddsData || !header || !bitData || !bitSize)
+    {
+        return E_POINTER;
+    }
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (ddsDataSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) ) )
+    {
+        return E_FAIL;
+    }
+
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t dwMagicNumber = *( const uint32_t* )( ddsData );
+    if (dwMagicNumber != DDS_MAGIC)
+    {
+        return E_FAIL;
+    }
+
+    auto hdr = reinterpret_cast<const DDS_HEADER*>( ddsData + sizeof( uint32_t ) );
+
+    // Verify header to validate DDS file
+    if (hdr->size != sizeof(DDS_HEADER) ||
+        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    {
+        return E_FAIL;
+    }
+
+    // Check for DX10 extension
+    bool bDXT10Header = false;
+    if ((hdr->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
+    {
+        // Must be long enough for both headers and magic value
+        if (ddsDataSize < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
+        {
+            return E_FAIL;
+        }
+
+        bDXT10Header = true;
+    }
+
+    *header = hdr;
+    ptrdiff_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
+                       + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
+    *bitData = ddsData + offset;
+    *bitSize = ddsDataSize - offset;
+
+    return S_OK;
+}
+
 
 //--------------------------------------------------------------------------------------
 // Return the BPP for a particular format
@@ -1230,6 +1291,7 @@ static HRESULT CreateD3DResources( _In_ ID3D11Device* d3dDevice,
 static HRESULT CreateD3DResources12(
 	ID3D12Device* device,
 	ID3D12GraphicsCommandList* cmdList,
+	UploadQueue* uploadQueue,
 	_In_ uint32_t resDim,
 	_In_ size_t width,
 	_In_ size_t height,
@@ -1283,6 +1345,13 @@ static HRESULT CreateD3DResources12(
 			texture = nullptr;
 			return hr;
 		}
+		else if (uploadQueue != nullptr)
+		{
+			// The copy queue brings its own staging memory, and the texture decays back
+			// to COMMON once the copy is done, from where reading it promotes it.
+			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
+			uploadQueue->CopyTexture(texture.Get(), 0, num2DSubresources, initData);
+		}
 		else
 		{
 			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
@@ -1669,16 +1738,12 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     return hr;
 }
 
-static HRESULT CreateTextureFromDDS12(
-	_In_ ID3D12Device* device,
-	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+static HRESULT GetTextureLayout12(
 	_In_ const DDS_HEADER* header,
 	_In_reads_bytes_(bitSize) const uint8_t* bitData,
 	_In_ size_t bitSize,
 	_In_ size_t maxsize,
-	_In_ bool forceSRGB,
-	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	DDSTextureLayout12& layout)
 {
 	HRESULT hr = S_OK;
 
@@ -1835,15 +1900,8 @@ static HRESULT CreateTextureFromDDS12(
 		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
 	}
 
-	// Create the texture
-	std::unique_ptr<D3D12_SUBRESOURCE_DATA[]> initData(
-		new (std::nothrow) D3D12_SUBRESOURCE_DATA[mipCount * arraySize]
-		);
-
-	if (!initData)
-	{
-		return E_OUTOFMEMORY;
-	}
+	// Point the subresources into the bits
+	layout.Subresources.resize(mipCount * arraySize);
 
 	size_t skipMip = 0;
 	size_t twidth = 0;
@@ -1852,20 +1910,62 @@ static HRESULT CreateTextureFromDDS12(
 
 	hr = FillInitData12(
 		width, height, depth, mipCount, arraySize, format, maxsize, bitSize, bitData,
-		twidth, theight, tdepth, skipMip, initData.get()
+		twidth, theight, tdepth, skipMip, layout.Subresources.data()
 		);
 
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	layout.Subresources.resize((mipCount - skipMip) * arraySize);
+	layout.IsCubeMap = isCubeMap;
+
+	ZeroMemory(&layout.Desc, sizeof(D3D12_RESOURCE_DESC));
+	layout.Desc.Dimension = static_cast<D3D12_RESOURCE_DIMENSION>(resDim);
+	layout.Desc.Width = twidth;
+	layout.Desc.Height = (uint32_t)theight;
+	layout.Desc.DepthOrArraySize = (resDim == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? (uint16_t)tdepth : (uint16_t)arraySize;
+	layout.Desc.MipLevels = (uint16_t)(mipCount - skipMip);
+	layout.Desc.Format = format;
+	layout.Desc.SampleDesc.Count = 1;
+	layout.Desc.SampleDesc.Quality = 0;
+	layout.Desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	layout.Desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	return S_OK;
+}
+
+static HRESULT CreateTextureFromDDS12(
+	_In_ ID3D12Device* device,
+	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+	_In_opt_ UploadQueue* uploadQueue,
+	_In_ const DDS_HEADER* header,
+	_In_reads_bytes_(bitSize) const uint8_t* bitData,
+	_In_ size_t bitSize,
+	_In_ size_t maxsize,
+	_In_ bool forceSRGB,
+	ComPtr<ID3D12Resource>& texture,
+	ComPtr<ID3D12Resource>& textureUploadHeap)
+{
+	DDSTextureLayout12 layout;
+	HRESULT hr = GetTextureLayout12(header, bitData, bitSize, maxsize, layout);
+
 	if (SUCCEEDED(hr))
 	{
+		const D3D12_RESOURCE_DESC& desc = layout.Desc;
+		bool isVolume = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D);
+
 		hr = CreateD3DResources12(
-			device, cmdList,
-			resDim, twidth, theight, tdepth,
-			mipCount - skipMip,
-			arraySize,
-			format,
+			device, cmdList, uploadQueue,
+			desc.Dimension, (size_t)desc.Width, desc.Height,
+			isVolume ? desc.DepthOrArraySize : 1,
+			desc.MipLevels,
+			isVolume ? 1 : desc.DepthOrArraySize,
+			desc.Format,
 			false, // forceSRGB
-			isCubeMap,
-			initData.get(),
+			layout.IsCubeMap,
+			layout.Subresources.data(),
 			texture, 
 			textureUploadHeap);
 	}
@@ -1902,6 +2002,34 @@ static DDS_ALPHA_MODE GetAlphaMode( _In_ const DDS_HEADER* header )
 }
 
 
+//--------------------------------------------------------------------------------------
+_Use_decl_annotations_
+HRESULT DirectX::GetDDSTextureLayout12(
+	const uint8_t* ddsData,
+	size_t ddsDataSize,
+	DDSTextureLayout12& layout,
+	size_t maxsize
+	)
+{
+	const DDS_HEADER* header = nullptr;
+	const uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	HRESULT hr = GetTextureDataFromMemory12(ddsData, ddsDataSize, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	hr = GetTextureLayout12(header, bitData, bitSize, maxsize, layout);
+	if (SUCCEEDED(hr))
+	{
+		layout.AlphaMode = GetAlphaMode(header);
+	}
+
+	return hr;
+}
+
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromMemory( ID3D11Device* d3dDevice,
@@ -1973,6 +2101,7 @@ HRESULT DirectX::CreateDDSTextureFromMemory12(
 	HRESULT hr = CreateTextureFromDDS12(
 		device,
 		cmdList,
+		nullptr,
 		header,
 		ddsData + offset,
 		ddsDataSize - offset,
@@ -2134,8 +2263,9 @@ HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                        texture, textureView, alphaMode );
 }
 
-HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
-	_In_ ID3D12GraphicsCommandList* cmdList,
+static HRESULT CreateTextureFromFile12(_In_ ID3D12Device* device,
+	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+	_In_opt_ UploadQueue* uploadQueue,
 	_In_z_ const wchar_t* szFileName,
 	_Out_ ComPtr<ID3D12Resource>& texture,
 	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap,
@@ -2160,18 +2290,25 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 		return E_INVALIDARG;
 	}
 
-	DDS_HEADER* header = nullptr;
-	uint8_t* bitData = nullptr;
+	// Map the file rather than read it, so the upload is what pulls its pages in.
+	MappedFile ddsFile;
+	HRESULT hr = ddsFile.Open(szFileName);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	const DDS_HEADER* header = nullptr;
+	const uint8_t* bitData = nullptr;
 	size_t bitSize = 0;
 
-	std::unique_ptr<uint8_t[]> ddsData;
-	HRESULT hr = LoadTextureDataFromFile(szFileName, ddsData, &header, &bitData, &bitSize);
+	hr = GetTextureDataFromMemory12(ddsFile.Data(), ddsFile.Size(), &header, &bitData, &bitSize);
 	if (FAILED(hr))
 	{
 		return hr;
 	}
 
-	hr = CreateTextureFromDDS12(device, cmdList, header,
+	hr = CreateTextureFromDDS12(device, cmdList, uploadQueue, header,
 		bitData, bitSize, maxsize, false, texture, textureUploadHeap);
 
 	if (SUCCEEDED(hr))
@@ -2228,6 +2365,30 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	return hr;
 }
 
+HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_z_ const wchar_t* szFileName,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode)
+{
+	return CreateTextureFromFile12(device, cmdList, nullptr, szFileName,
+		texture, textureUploadHeap, maxsize, alphaMode);
+}
+
+HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
+	_In_ UploadQueue& uploadQueue,
+	_In_z_ const wchar_t* szFileName,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode)
+{
+	ComPtr<ID3D12Resource> textureUploadHeap;
+	return CreateTextureFromFile12(device, nullptr, &uploadQueue, szFileName,
+		texture, textureUploadHeap, maxsize, alphaMode);
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            ID3D11DeviceContext* d3dContext,
@@ -32,6 +32,10 @@
 
 #pragma warning(pop)
 
+#include <vector>
+
+class UploadQueue;
+
 #if defined(_MSC_VER) && (_MSC_VER<1610) && !defined(_In_reads_)
 #define _In_reads_(exp)
 #define _Out_writes_(exp)
@@ -92,6 +96,34 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Records the copy into uploadQueue's current batch instead of a command list.
+	// The texture is left in D3D12_RESOURCE_STATE_COMMON and may be read once the
+	// batch's ticket completes.
+	HRESULT CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
+		                               _In_ UploadQueue& uploadQueue,
+		                               _In_z_ const wchar_t* szFileName,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                               _In_ size_t maxsize = 0,
+		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                               );
+
+	// Layout of the texture in a DDS file, for creating the resource and uploading
+	// it a few mips at a time.  Desc covers every mip not over maxsize, and
+	// Subresources holds each in D3D12 subresource order, pointing into ddsData.
+	struct DDSTextureLayout12
+	{
+		D3D12_RESOURCE_DESC Desc;
+		bool IsCubeMap = false;
+		DDS_ALPHA_MODE AlphaMode = DDS_ALPHA_MODE_UNKNOWN;
+		std::vector<D3D12_SUBRESOURCE_DATA> Subresources;
+	};
+
+	HRESULT GetDDSTextureLayout12(_In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+		                          _In_ size_t ddsDataSize,
+		                          _Out_ DDSTextureLayout12& layout,
+		                          _In_ size_t maxsize = 0
+		                          );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
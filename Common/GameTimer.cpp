@@ -7,17 +7,41 @@
 
 GameTimer::GameTimer()
 : mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
-  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
+  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false),
+  mFixedTimestep(0.0), mFixedTime(0.0)
 {
-	__int64 countsPerSec;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-	mSecondsPerCount = 1.0 / (double)countsPerSec;
+	mSecondsPerCount = SecondsPerCount();
+}
+
+__int64 GameTimer::Now()
+{
+	__int64 currTime;
+	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	return currTime;
+}
+
+double GameTimer::SecondsPerCount()
+{
+	// The frequency is fixed at boot, so it is only queried once.
+	static const double secondsPerCount = []()
+	{
+		__int64 countsPerSec;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		return 1.0 / (double)countsPerSec;
+	}();
+
+	return secondsPerCount;
 }
 
 // Returns the total time elapsed since Reset() was called, NOT counting any
 // time when the clock is stopped.
 float GameTimer::TotalTime()const
 {
+	if( mFixedTimestep > 0.0 )
+	{
+		return (float)mFixedTime;
+	}
+
 	// If we are stopped, do not count the time that has passed since we stopped.
 	// Moreover, if we previously already had a pause, the distance 
 	// mStopTime - mBaseTime includes paused time, which we do not want to count.
@@ -55,20 +79,18 @@ float GameTimer::DeltaTime()const
 
 void GameTimer::Reset()
 {
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	__int64 currTime = Now();
 
 	mBaseTime = currTime;
 	mPrevTime = currTime;
 	mStopTime = 0;
 	mStopped  = false;
+	mFixedTime = 0.0;
 }
 
 void GameTimer::Start()
 {
-	__int64 startTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
-
+	__int64 startTime = Now();
 
 	// Accumulate the time elapsed between stop and start pairs.
 	//
@@ -90,10 +112,7 @@ void GameTimer::Stop()
 {
 	if( !mStopped )
 	{
-		__int64 currTime;
-		QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
-
-		mStopTime = currTime;
+		mStopTime = Now();
 		mStopped  = true;
 	}
 }
@@ -106,9 +125,14 @@ void GameTimer::Tick()
 		return;
 	}
 
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
-	mCurrTime = currTime;
+	if( mFixedTimestep > 0.0 )
+	{
+		mDeltaTime = mFixedTimestep;
+		mFixedTime += mFixedTimestep;
+		return;
+	}
+
+	mCurrTime = Now();
 
 	// Time difference between this frame and the previous.
 	mDeltaTime = (mCurrTime - mPrevTime)*mSecondsPerCount;
@@ -125,3 +149,8 @@ void GameTimer::Tick()
 	}
 }
 
+void GameTimer::SetFixedTimestep(double seconds)
+{
+	mFixedTimestep = seconds > 0.0 ? seconds : 0.0;
+	mFixedTime = 0.0;
+}
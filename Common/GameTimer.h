@@ -18,6 +18,15 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// Makes every Tick advance the time by exactly seconds instead of the time
+	// that passed, so a run is the same however fast it is drawn.  0 goes back to
+	// real time.
+	void SetFixedTimestep(double seconds);
+
+	// The performance counter every timer reads, CpuProfiler's scopes included.
+	static __int64 Now();
+	static double SecondsPerCount();
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
@@ -29,6 +38,9 @@ private:
 	__int64 mCurrTime;
 
 	bool mStopped;
+
+	double mFixedTimestep;
+	double mFixedTime;
 };
 
 #endif // GAMETIMER_H
\ No newline at end of file
@@ -4,13 +4,26 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 
 using namespace DirectX;
 
+GeometryGenerator::MeshSize GeometryGenerator::BoxSize(uint32 numSubdivisions)
+{
+    return SubdividedSize(24, 36, std::min<uint32>(numSubdivisions, 6u));
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
     MeshData meshData;
+    WriteBox(width, height, depth, numSubdivisions, meshData.Resize(BoxSize(numSubdivisions)));
+    return meshData;
+}
 
+void GeometryGenerator::WriteBox(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out)
+{
     //
 	// Create the vertices.
 	//
@@ -56,8 +69,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	v[21] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
 	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
 	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[24]);
  
 	//
 	// Create the indices.
@@ -89,20 +100,33 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	i[30] = 20; i[31] = 21; i[32] = 22;
 	i[33] = 20; i[34] = 22; i[35] = 23;
 
-	meshData.Indices32.assign(&i[0], &i[36]);
-
     // Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
+    Subdivide(v, 24, i, 36, numSubdivisions, out);
+}
 
-    return meshData;
+GeometryGenerator::MeshSize GeometryGenerator::SphereSize(uint32 sliceCount, uint32 stackCount)
+{
+    // The poles, a ring per inner stack boundary, and a fan at each pole with two
+    // triangles per slice in between.
+    MeshSize size;
+    size.VertexCount = 2 + (stackCount-1)*(sliceCount+1);
+    size.IndexCount = 6*sliceCount*(stackCount-1);
+    return size;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+    WriteSphere(radius, sliceCount, stackCount, meshData.Resize(SphereSize(sliceCount, stackCount)));
+    return meshData;
+}
+
+void GeometryGenerator::WriteSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshSpan& out)
+{
+    Vertex* vertices = out.Vertices;
+    uint32* indices = out.Indices;
 
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
@@ -114,7 +138,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back( topVertex );
+	*vertices++ = topVertex;
 
 	float phiStep   = XM_PI/stackCount;
 	float thetaStep = 2.0f*XM_PI/sliceCount;
@@ -150,11 +174,11 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 			v.TexC.x = theta / XM_2PI;
 			v.TexC.y = phi / XM_PI;
 
-			meshData.Vertices.push_back( v );
+			*vertices++ = v;
 		}
 	}
 
-	meshData.Vertices.push_back( bottomVertex );
+	*vertices++ = bottomVertex;
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
@@ -163,9 +187,9 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 
     for(uint32 i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
+		*indices++ = 0;
+		*indices++ = i+1;
+		*indices++ = i;
 	}
 	
 	//
@@ -180,13 +204,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			*indices++ = baseIndex + i*ringVertexCount + j;
+			*indices++ = baseIndex + i*ringVertexCount + j+1;
+			*indices++ = baseIndex + (i+1)*ringVertexCount + j;
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			*indices++ = baseIndex + (i+1)*ringVertexCount + j;
+			*indices++ = baseIndex + i*ringVertexCount + j+1;
+			*indices++ = baseIndex + (i+1)*ringVertexCount + j+1;
 		}
 	}
 
@@ -196,19 +220,17 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
 	//
 
 	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 southPoleIndex = (uint32)(vertices - out.Vertices)-1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 	
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
+		*indices++ = southPoleIndex;
+		*indices++ = baseIndex+i;
+		*indices++ = baseIndex+i+1;
 	}
-
-    return meshData;
 }
  
 GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float baseWidth, float height, float thickness)
@@ -251,9 +273,27 @@ GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float baseWidth, floa
 	return meshdData;
 }
 
+GeometryGenerator::MeshSize GeometryGenerator::ConeSize(uint32 sliceCount)
+{
+    // The base ring, the tip and the base center; a side triangle and a base
+    // triangle per slice.
+    MeshSize size;
+    size.VertexCount = sliceCount + 3;
+    size.IndexCount = 3*sliceCount + 3*sliceCount;
+    return size;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateCone(float baseRadius, float height, uint32 sliceCount)
 {
 	MeshData meshData;
+	WriteCone(baseRadius, height, sliceCount, meshData.Resize(ConeSize(sliceCount)));
+	return meshData;
+}
+
+void GeometryGenerator::WriteCone(float baseRadius, float height, uint32 sliceCount, const MeshSpan& out)
+{
+	Vertex* vertices = out.Vertices;
+	uint32* indices = out.Indices;
 
 	float dTheta = 2.0f*XM_PI / sliceCount;
 
@@ -263,33 +303,32 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCone(float baseRadius, floa
 		float x = baseRadius * cosf(i*dTheta);
 		float z = baseRadius * sinf(i*dTheta);
 
-		meshData.Vertices.push_back(Vertex(x, 0.0f, z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+		*vertices++ = Vertex(x, 0.0f, z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	}
 
 	//Top point
-	meshData.Vertices.push_back(Vertex(0.0f, height, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
-	meshData.Vertices.push_back(Vertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+	*vertices++ = Vertex(0.0f, height, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	*vertices++ = Vertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 
-	uint32 topPointIndex = (uint32)meshData.Vertices.size() - 2;
-	uint32 bottomCenterIndex = (uint32)meshData.Vertices.size() - 1;
+	uint32 topPointIndex = sliceCount + 1;
+	uint32 bottomCenterIndex = sliceCount + 2;
 
 	// Creating triangles
 	for (uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(topPointIndex);
-		meshData.Indices32.push_back(i + 1);
-		meshData.Indices32.push_back(i);
+		*indices++ = topPointIndex;
+		*indices++ = i + 1;
+		*indices++ = i;
 	}
 
 	//// Create bottom face
-	for (uint32 i = 0; i <= sliceCount; ++i)
+	// The fan stops at the last ring vertex; one more triangle would reach the tip.
+	for (uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(bottomCenterIndex);
-		meshData.Indices32.push_back(i); //counter clockwise since its bottom face
-		meshData.Indices32.push_back(i+1);
+		*indices++ = bottomCenterIndex;
+		*indices++ = i; //counter clockwise since its bottom face
+		*indices++ = i+1;
 	}
-
-	return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float w, float h, float depth)
@@ -346,9 +385,26 @@ GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float w, float h, f
 	return meshData;
 }
 
+GeometryGenerator::MeshSize GeometryGenerator::HalfConeSize(uint32 sliceCount)
+{
+    // A ring per cap; a fan over each cap and two triangles per side.
+    MeshSize size;
+    size.VertexCount = 2*(sliceCount+1);
+    size.IndexCount = 3*(sliceCount+1) + 3*sliceCount + 6*(sliceCount+1);
+    return size;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateHalfCone(float topRadius, float bottomRadius, float height, uint32 sliceCount)
 {
 	MeshData meshData;
+	WriteHalfCone(topRadius, bottomRadius, height, sliceCount, meshData.Resize(HalfConeSize(sliceCount)));
+	return meshData;
+}
+
+void GeometryGenerator::WriteHalfCone(float topRadius, float bottomRadius, float height, uint32 sliceCount, const MeshSpan& out)
+{
+	Vertex* vertices = out.Vertices;
+	uint32* indices = out.Indices;
 
 	#pragma region TOP_CAP
 
@@ -360,40 +416,41 @@ GeometryGenerator::MeshData GeometryGenerator::CreateHalfCone(float topRadius, f
 		float x = topRadius * cosf(i*dTheta);
 		float z = topRadius * sinf(i*dTheta);
 
-		meshData.Vertices.push_back(Vertex(x, height, z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+		*vertices++ = Vertex(x, height, z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	}
 
-	uint32 startVertexIndex = meshData.Vertices.size() - 1;
+	uint32 startVertexIndex = sliceCount;
 
 	for (uint32 i = 0; i <= sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(startVertexIndex);
-		meshData.Indices32.push_back(i + 1);
-		meshData.Indices32.push_back(i);
+		*indices++ = startVertexIndex;
+		*indices++ = i + 1;
+		*indices++ = i;
 	}
 
 	#pragma endregion
 	
 	#pragma region BOTTOM_HALF
 
-	uint32 baseIndexStart = meshData.Vertices.size() - 1;
+	uint32 baseIndexStart = sliceCount;
 
 	for (uint32 i = 0; i <= sliceCount; ++i)
 	{
 		float x = bottomRadius * cosf(i*dTheta);
 		float z = bottomRadius * sinf(i*dTheta);
 
-		meshData.Vertices.push_back(Vertex(x, 0.0f, z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+		*vertices++ = Vertex(x, 0.0f, z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	}
 
 
-	startVertexIndex = meshData.Vertices.size() - 1;
+	startVertexIndex = 2*sliceCount + 1;
 
-	for (uint32 i = 0; i <= sliceCount; ++i)
+	// The fan stops at the last ring vertex; one more triangle would reach past it.
+	for (uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(startVertexIndex);
-		meshData.Indices32.push_back(baseIndexStart + i + 1);
-		meshData.Indices32.push_back(baseIndexStart + i + 2);
+		*indices++ = startVertexIndex;
+		*indices++ = baseIndexStart + i + 1;
+		*indices++ = baseIndexStart + i + 2;
 	}
 
 	#pragma endregion
@@ -402,18 +459,16 @@ GeometryGenerator::MeshData GeometryGenerator::CreateHalfCone(float topRadius, f
 
 	uint32 offset = sliceCount - 1;
 
-	for (int i = 0; i <= sliceCount; i++)
+	for (uint32 i = 0; i <= sliceCount; i++)
 	{
-		meshData.Indices32.push_back(i);
-		meshData.Indices32.push_back(i + 1);
-		meshData.Indices32.push_back(i + offset + 2);
+		*indices++ = i;
+		*indices++ = i + 1;
+		*indices++ = i + offset + 2;
 		
-		meshData.Indices32.push_back(i + offset + 2);
-		meshData.Indices32.push_back(i + offset + 1);
-		meshData.Indices32.push_back(i);
+		*indices++ = i + offset + 2;
+		*indices++ = i + offset + 1;
+		*indices++ = i;
 	}
-
-	return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreatePrism(float length, float height, float width)
@@ -467,15 +522,43 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePrism(float length, float h
 	return meshData;
 }
 
-void GeometryGenerator::Subdivide(MeshData& meshData)
+GeometryGenerator::MeshSize GeometryGenerator::SubdividedSize(uint32 vertexCount, uint32 indexCount, uint32 numSubdivisions)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
+    if(numSubdivisions == 0)
+        return { vertexCount, indexCount };
+
+    // Each level splits a triangle in four.  The last level writes six vertices
+    // and four triangles for every triangle of the level before.
+    uint32 triangleCount = indexCount/3;
+    for(uint32 i = 1; i < numSubdivisions; ++i)
+        triangleCount *= 4;
+
+    return { triangleCount*6, triangleCount*12 };
+}
 
+void GeometryGenerator::Subdivide(const Vertex* vertices, uint32 vertexCount, const uint32* indices, uint32 indexCount,
+                                  uint32 numSubdivisions, const MeshSpan& out)
+{
+	if(numSubdivisions == 0)
+	{
+		std::copy(vertices, vertices + vertexCount, out.Vertices);
+		std::copy(indices, indices + indexCount, out.Indices);
+		return;
+	}
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+	// Every level is refined depth first, straight into the output, so no level
+	// but the last is ever stored.
+	uint32 triangle = 0;
+	for(uint32 i = 0; i + 2 < indexCount; i += 3)
+	{
+		SubdivideTriangle(vertices[indices[i+0]], vertices[indices[i+1]], vertices[indices[i+2]],
+			numSubdivisions, out, triangle);
+	}
+}
 
+void GeometryGenerator::SubdivideTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+                                          uint32 numSubdivisions, const MeshSpan& out, uint32& triangle)
+{
 	//       v1
 	//       *
 	//      / \
@@ -486,48 +569,46 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
-	for(uint32 i = 0; i < numTris; ++i)
+	//
+	// Generate the midpoints.
+	//
+
+    Vertex m0 = MidPoint(v0, v1);
+    Vertex m1 = MidPoint(v1, v2);
+    Vertex m2 = MidPoint(v0, v2);
+
+	// The four children in the order a whole level would emit them, so a mesh
+	// comes out the same as subdividing it one level at a time.
+	if(numSubdivisions > 1)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
-
-		//
-		// Generate the midpoints.
-		//
-
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
-
-		//
-		// Add new geometry.
-		//
-
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		SubdivideTriangle(v0, m0, m2, numSubdivisions-1, out, triangle);
+		SubdivideTriangle(m0, m1, m2, numSubdivisions-1, out, triangle);
+		SubdivideTriangle(m2, m1, v2, numSubdivisions-1, out, triangle);
+		SubdivideTriangle(m0, v1, m1, numSubdivisions-1, out, triangle);
+		return;
+	}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+	//
+	// Add new geometry.
+	//
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+	uint32 base = triangle*6;
+	Vertex* v = out.Vertices + base;
+	uint32* k = out.Indices + triangle*12;
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
-	}
+	v[0] = v0;
+	v[1] = v1;
+	v[2] = v2;
+	v[3] = m0;
+	v[4] = m1;
+	v[5] = m2;
+
+	k[0]  = base+0; k[1]  = base+3; k[2]  = base+5;
+	k[3]  = base+3; k[4]  = base+4; k[5]  = base+5;
+	k[6]  = base+5; k[7]  = base+4; k[8]  = base+2;
+	k[9]  = base+3; k[10] = base+1; k[11] = base+4;
+
+	++triangle;
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -560,10 +641,20 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
     return v;
 }
 
+GeometryGenerator::MeshSize GeometryGenerator::GeosphereSize(uint32 numSubdivisions)
+{
+    return SubdividedSize(12, 60, std::min<uint32>(numSubdivisions, 6u));
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
 {
     MeshData meshData;
+    WriteGeosphere(radius, numSubdivisions, meshData.Resize(GeosphereSize(numSubdivisions)));
+    return meshData;
+}
 
+void GeometryGenerator::WriteGeosphere(float radius, uint32 numSubdivisions, const MeshSpan& out)
+{
 	// Put a cap on the number of subdivisions.
     numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
 
@@ -590,54 +681,71 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
-    meshData.Indices32.assign(&k[0], &k[60]);
-
+	// Only the positions matter; the rest is derived after projecting.
+	Vertex v[12];
 	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+		v[i] = Vertex(pos[i], XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f));
 
-	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	Subdivide(v, 12, k, 60, numSubdivisions, out);
 
 	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
+	uint32 vertexCount = SubdividedSize(12, 60, numSubdivisions).VertexCount;
+	for(uint32 i = 0; i < vertexCount; ++i)
 	{
+		Vertex& vertex = out.Vertices[i];
+
 		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertex.Position));
 
 		// Project onto sphere.
 		XMVECTOR p = radius*n;
 
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+		XMStoreFloat3(&vertex.Position, p);
+		XMStoreFloat3(&vertex.Normal, n);
 
 		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
+        float theta = atan2f(vertex.Position.z, vertex.Position.x);
 
         // Put in [0, 2pi].
         if(theta < 0.0f)
             theta += XM_2PI;
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+		float phi = acosf(vertex.Position.y / radius);
 
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
+		vertex.TexC.x = theta/XM_2PI;
+		vertex.TexC.y = phi/XM_PI;
 
 		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
+		vertex.TangentU.x = -radius*sinf(phi)*sinf(theta);
+		vertex.TangentU.y = 0.0f;
+		vertex.TangentU.z = +radius*sinf(phi)*cosf(theta);
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
+		XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
+		XMStoreFloat3(&vertex.TangentU, XMVector3Normalize(T));
 	}
+}
 
-    return meshData;
+GeometryGenerator::MeshSize GeometryGenerator::CylinderSize(uint32 sliceCount, uint32 stackCount)
+{
+    // A ring per stack boundary and two triangles per slice of each stack, then
+    // a ring, a center and a fan for each cap.
+    MeshSize size;
+    size.VertexCount = (stackCount+1)*(sliceCount+1) + 2*(sliceCount+2);
+    size.IndexCount = 6*sliceCount*stackCount + 2*3*sliceCount;
+    return size;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
     MeshData meshData;
+    WriteCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, meshData.Resize(CylinderSize(sliceCount, stackCount)));
+    return meshData;
+}
+
+void GeometryGenerator::WriteCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshSpan& out)
+{
+	Vertex* vertices = out.Vertices;
+	uint32* indices = out.Indices;
 
 	//
 	// Build Stacks.
@@ -700,7 +808,7 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			*vertices++ = vertex;
 		}
 	}
 
@@ -713,27 +821,26 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius
 	{
 		for(uint32 j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
+			*indices++ = i*ringVertexCount + j;
+			*indices++ = (i+1)*ringVertexCount + j;
+			*indices++ = (i+1)*ringVertexCount + j+1;
 
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			*indices++ = i*ringVertexCount + j;
+			*indices++ = (i+1)*ringVertexCount + j+1;
+			*indices++ = i*ringVertexCount + j+1;
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-
-    return meshData;
+	// Each cap writes sliceCount+2 vertices and sliceCount triangles.
+	uint32 baseIndex = ringCount*ringVertexCount;
+	BuildCylinderTopCap(topRadius, height, sliceCount, baseIndex, vertices, indices);
+	BuildCylinderBottomCap(bottomRadius, height, sliceCount, baseIndex + sliceCount+2,
+		vertices + sliceCount+2, indices + 3*sliceCount);
 }
 
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+void GeometryGenerator::BuildCylinderTopCap(float topRadius, float height, uint32 sliceCount,
+											uint32 baseIndex, Vertex* vertices, uint32* indices)
 {
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-
 	float y = 0.5f*height;
 	float dTheta = 2.0f*XM_PI/sliceCount;
 
@@ -748,31 +855,30 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		*vertices++ = Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	*vertices++ = Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
 	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = baseIndex + sliceCount+1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		*indices++ = centerIndex;
+		*indices++ = baseIndex + i+1;
+		*indices++ = baseIndex + i;
 	}
 }
 
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float height, uint32 sliceCount,
+											   uint32 baseIndex, Vertex* vertices, uint32* indices)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
 	float y = -0.5f*height;
 
 	// vertices of ring
@@ -787,30 +893,40 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x/height + 0.5f;
 		float v = z/height + 0.5f;
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		*vertices++ = Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	*vertices++ = Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
 	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
+	uint32 centerIndex = baseIndex + sliceCount+1;
 
 	for(uint32 i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
+		*indices++ = centerIndex;
+		*indices++ = baseIndex + i;
+		*indices++ = baseIndex + i+1;
 	}
 }
 
+GeometryGenerator::MeshSize GeometryGenerator::GridSize(uint32 m, uint32 n)
+{
+    MeshSize size;
+    size.VertexCount = m*n;
+    size.IndexCount = (m-1)*(n-1)*2*3;
+    return size;
+}
+
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
     MeshData meshData;
+    WriteGrid(width, depth, m, n, meshData.Resize(GridSize(m, n)));
+    return meshData;
+}
 
-	uint32 vertexCount = m*n;
-	uint32 faceCount   = (m-1)*(n-1)*2;
-
+void GeometryGenerator::WriteGrid(float width, float depth, uint32 m, uint32 n, const MeshSpan& out)
+{
 	//
 	// Create the vertices.
 	//
@@ -824,7 +940,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	float du = 1.0f / (n-1);
 	float dv = 1.0f / (m-1);
 
-	meshData.Vertices.resize(vertexCount);
 	for(uint32 i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i*dz;
@@ -832,13 +947,13 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 		{
 			float x = -halfWidth + j*dx;
 
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			out.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
+			out.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			out.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
 			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
+			out.Vertices[i*n+j].TexC.x = j*du;
+			out.Vertices[i*n+j].TexC.y = i*dv;
 		}
 	}
  
@@ -846,27 +961,23 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float dep
 	// Create the indices.
 	//
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
-
 	// Iterate over each quad and compute indices.
 	uint32 k = 0;
 	for(uint32 i = 0; i < m-1; ++i)
 	{
 		for(uint32 j = 0; j < n-1; ++j)
 		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
+			out.Indices[k]   = i*n+j;
+			out.Indices[k+1] = i*n+j+1;
+			out.Indices[k+2] = (i+1)*n+j;
 
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
+			out.Indices[k+3] = (i+1)*n+j;
+			out.Indices[k+4] = i*n+j+1;
+			out.Indices[k+5] = (i+1)*n+j+1;
 
 			k += 6; // next quad
 		}
 	}
-
-    return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
@@ -989,3 +1100,256 @@ GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float baseWidth, fl
 	return meshData;
 }
 
+
+namespace
+{
+    // Distance by which a circle of the given radius strays from a polygon of
+    // segmentCount sides spanning the angle sweep.
+    float ChordError(float radius, GeometryGenerator::uint32 segmentCount, float sweep)
+    {
+        return radius*(1.0f - cosf(0.5f*sweep/segmentCount));
+    }
+
+    // Halves a tessellation count, but not below minCount.
+    GeometryGenerator::uint32 Coarsen(GeometryGenerator::uint32 count, GeometryGenerator::uint32 minCount)
+    {
+        return std::max<GeometryGenerator::uint32>(count/2, std::min<GeometryGenerator::uint32>(count, minCount));
+    }
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateBoxLods(float width, float height, float depth, uint32 numSubdivisions, uint32 lodCount)
+{
+    // Subdividing a flat face leaves it flat, so every level is exact.
+    LodChain lods;
+    for(uint32 lod = 0; lod < lodCount; ++lod)
+    {
+        LodMeshData level;
+        level.Mesh = CreateBox(width, height, depth, numSubdivisions);
+        lods.push_back(std::move(level));
+
+        if(numSubdivisions == 0)
+            break;
+        numSubdivisions /= 2;
+    }
+
+    return lods;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 lodCount)
+{
+    auto error = [radius](uint32 slices, uint32 stacks)
+    {
+        return std::max<float>(ChordError(radius, slices, XM_2PI), ChordError(radius, stacks, XM_PI));
+    };
+
+    float finestError = error(sliceCount, stackCount);
+
+    LodChain lods;
+    for(uint32 lod = 0; lod < lodCount; ++lod)
+    {
+        LodMeshData level;
+        level.Mesh = CreateSphere(radius, sliceCount, stackCount);
+        level.Error = error(sliceCount, stackCount) - finestError;
+        lods.push_back(std::move(level));
+
+        uint32 nextSlices = Coarsen(sliceCount, 4);
+        uint32 nextStacks = Coarsen(stackCount, 2);
+        if(nextSlices == sliceCount && nextStacks == stackCount)
+            break;
+
+        sliceCount = nextSlices;
+        stackCount = nextStacks;
+    }
+
+    return lods;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 lodCount)
+{
+    // The sides are straight along y, so only the slices add error.
+    float radius = std::max<float>(bottomRadius, topRadius);
+    float finestError = ChordError(radius, sliceCount, XM_2PI);
+
+    LodChain lods;
+    for(uint32 lod = 0; lod < lodCount; ++lod)
+    {
+        LodMeshData level;
+        level.Mesh = CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount);
+        level.Error = ChordError(radius, sliceCount, XM_2PI) - finestError;
+        lods.push_back(std::move(level));
+
+        uint32 nextSlices = Coarsen(sliceCount, 4);
+        uint32 nextStacks = Coarsen(stackCount, 1);
+        if(nextSlices == sliceCount && nextStacks == stackCount)
+            break;
+
+        sliceCount = nextSlices;
+        stackCount = nextStacks;
+    }
+
+    return lods;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateGridLods(float width, float depth, uint32 m, uint32 n, uint32 lodCount)
+{
+    // The grid is flat, so every level is exact.
+    LodChain lods;
+    for(uint32 lod = 0; lod < lodCount; ++lod)
+    {
+        LodMeshData level;
+        level.Mesh = CreateGrid(width, depth, m, n);
+        lods.push_back(std::move(level));
+
+        uint32 nextM = Coarsen(m, 2);
+        uint32 nextN = Coarsen(n, 2);
+        if(nextM == m && nextN == n)
+            break;
+
+        m = nextM;
+        n = nextN;
+    }
+
+    return lods;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateConeLods(float baseRadius, float height, uint32 sliceCount, uint32 lodCount)
+{
+    float finestError = ChordError(baseRadius, sliceCount, XM_2PI);
+
+    LodChain lods;
+    for(uint32 lod = 0; lod < lodCount; ++lod)
+    {
+        LodMeshData level;
+        level.Mesh = CreateCone(baseRadius, height, sliceCount);
+        level.Error = ChordError(baseRadius, sliceCount, XM_2PI) - finestError;
+        lods.push_back(std::move(level));
+
+        uint32 nextSlices = Coarsen(sliceCount, 4);
+        if(nextSlices == sliceCount)
+            break;
+        sliceCount = nextSlices;
+    }
+
+    return lods;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateHalfConeLods(float topRadius, float bottomRadius, float height, uint32 sliceCount, uint32 lodCount)
+{
+    float radius = std::max<float>(topRadius, bottomRadius);
+    float finestError = ChordError(radius, sliceCount, XM_2PI);
+
+    LodChain lods;
+    for(uint32 lod = 0; lod < lodCount; ++lod)
+    {
+        LodMeshData level;
+        level.Mesh = CreateHalfCone(topRadius, bottomRadius, height, sliceCount);
+        level.Error = ChordError(radius, sliceCount, XM_2PI) - finestError;
+        lods.push_back(std::move(level));
+
+        uint32 nextSlices = Coarsen(sliceCount, 4);
+        if(nextSlices == sliceCount)
+            break;
+        sliceCount = nextSlices;
+    }
+
+    return lods;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateSimplifiedLods(const MeshData& meshData, uint32 lodCount)
+{
+    LodChain lods;
+    if(lodCount == 0)
+        return lods;
+
+    LodMeshData finest;
+    finest.Mesh = meshData;
+    lods.push_back(std::move(finest));
+
+    if(meshData.Vertices.empty())
+        return lods;
+
+    XMVECTOR vMin = XMLoadFloat3(&meshData.Vertices[0].Position);
+    XMVECTOR vMax = vMin;
+    for(const Vertex& v : meshData.Vertices)
+    {
+        XMVECTOR p = XMLoadFloat3(&v.Position);
+        vMin = XMVectorMin(vMin, p);
+        vMax = XMVectorMax(vMax, p);
+    }
+
+    XMFLOAT3 boundsMin;
+    XMStoreFloat3(&boundsMin, vMin);
+    float diagonal = XMVectorGetX(XMVector3Length(vMax - vMin));
+
+    // Coarser grids than this would collapse the mesh into a few points.
+    for(float cellSize = diagonal / 64.0f; cellSize <= diagonal / 4.0f && lods.size() < lodCount; cellSize *= 2.0f)
+    {
+        // Merge the vertices in each cell into one at their average.
+        std::unordered_map<uint64_t, uint32> cells;
+        std::vector<uint32> cellOfVertex(meshData.Vertices.size());
+        std::vector<uint32> cellVertexCount;
+
+        LodMeshData level;
+        for(size_t i = 0; i < meshData.Vertices.size(); ++i)
+        {
+            const Vertex& v = meshData.Vertices[i];
+            uint64_t x = (uint64_t)((v.Position.x - boundsMin.x) / cellSize);
+            uint64_t y = (uint64_t)((v.Position.y - boundsMin.y) / cellSize);
+            uint64_t z = (uint64_t)((v.Position.z - boundsMin.z) / cellSize);
+            uint64_t key = (x << 42) | (y << 21) | z;
+
+            auto inserted = cells.insert({ key, (uint32)level.Mesh.Vertices.size() });
+            uint32 cell = inserted.first->second;
+            if(inserted.second)
+            {
+                level.Mesh.Vertices.push_back(v);
+                cellVertexCount.push_back(1);
+            }
+            else
+            {
+                Vertex& merged = level.Mesh.Vertices[cell];
+                float t = 1.0f / ++cellVertexCount[cell];
+                XMStoreFloat3(&merged.Position, XMVectorLerp(XMLoadFloat3(&merged.Position), XMLoadFloat3(&v.Position), t));
+                XMStoreFloat3(&merged.Normal, XMLoadFloat3(&merged.Normal) + XMLoadFloat3(&v.Normal));
+            }
+
+            cellOfVertex[i] = cell;
+        }
+
+        for(Vertex& v : level.Mesh.Vertices)
+            XMStoreFloat3(&v.Normal, XMVector3Normalize(XMLoadFloat3(&v.Normal)));
+
+        // Drop the triangles that collapsed, and the copies of ones that now
+        // share all three vertices with another.
+        std::set<std::tuple<uint32, uint32, uint32>> triangles;
+        for(size_t i = 0; i + 2 < meshData.Indices32.size(); i += 3)
+        {
+            uint32 a = cellOfVertex[meshData.Indices32[i + 0]];
+            uint32 b = cellOfVertex[meshData.Indices32[i + 1]];
+            uint32 c = cellOfVertex[meshData.Indices32[i + 2]];
+            if(a == b || b == c || a == c)
+                continue;
+
+            uint32 sorted[3] = { a, b, c };
+            std::sort(sorted, sorted + 3);
+            if(!triangles.insert(std::make_tuple(sorted[0], sorted[1], sorted[2])).second)
+                continue;
+
+            level.Mesh.Indices32.push_back(a);
+            level.Mesh.Indices32.push_back(b);
+            level.Mesh.Indices32.push_back(c);
+        }
+
+        // A vertex moves at most across the diagonal of its cell.
+        level.Error = cellSize * 1.7320508f;
+
+        size_t previousIndexCount = lods.back().Mesh.Indices32.size();
+        // Not worth a level yet, so try larger cells.
+        if(level.Mesh.Indices32.empty() || level.Mesh.Indices32.size() * 4 > previousIndexCount * 3)
+            continue;
+
+        lods.push_back(std::move(level));
+    }
+
+    return lods;
+}
@@ -53,27 +53,76 @@ public:
         DirectX::XMFLOAT2 TexC;
 	};
 
+	///<summary>
+	/// Exact vertex and index counts of a generated mesh, from the *Size functions,
+	/// so storage can be sized once before a Write* function fills it.
+	///</summary>
+	struct MeshSize
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
+	///<summary>
+	/// Caller owned storage a Write* function fills, with room for at least the
+	/// counts its *Size function returns.  Indices are relative to Vertices.
+	///</summary>
+	struct MeshSpan
+	{
+		Vertex* Vertices = nullptr;
+		uint32* Indices = nullptr;
+	};
+
 	struct MeshData
 	{
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
-        std::vector<uint16>& GetIndices16()
+        // Sizes the mesh in one allocation, for a Write* function to fill.
+        MeshSpan Resize(const MeshSize& size)
         {
-			if(mIndices16.empty())
-			{
-				mIndices16.resize(Indices32.size());
-				for(size_t i = 0; i < Indices32.size(); ++i)
-					mIndices16[i] = static_cast<uint16>(Indices32[i]);
-			}
-
-			return mIndices16;
+            Vertices.resize(size.VertexCount);
+            Indices32.resize(size.IndexCount);
+            return { Vertices.data(), Indices32.data() };
         }
+	};
 
-	private:
-		std::vector<uint16> mIndices16;
+	///<summary>
+	/// One level of a LOD chain, finest first.  Error is the object space distance
+	/// by which the surface of this level may stray from the finest level.
+	///</summary>
+	struct LodMeshData
+	{
+		MeshData Mesh;
+		float Error = 0.0f;
 	};
 
+	using LodChain = std::vector<LodMeshData>;
+
+	///<summary>
+	/// Output sizes of the parametric primitives, for their Write* functions.
+	///</summary>
+	MeshSize BoxSize(uint32 numSubdivisions);
+	MeshSize SphereSize(uint32 sliceCount, uint32 stackCount);
+	MeshSize GeosphereSize(uint32 numSubdivisions);
+	MeshSize CylinderSize(uint32 sliceCount, uint32 stackCount);
+	MeshSize GridSize(uint32 m, uint32 n);
+	MeshSize ConeSize(uint32 sliceCount);
+	MeshSize HalfConeSize(uint32 sliceCount);
+
+	///<summary>
+	/// Write the same meshes as the matching Create* functions into caller owned
+	/// storage, without allocating.  They touch nothing but out, so independent
+	/// meshes can be written from several threads at once.
+	///</summary>
+	void WriteBox(float width, float height, float depth, uint32 numSubdivisions, const MeshSpan& out);
+	void WriteSphere(float radius, uint32 sliceCount, uint32 stackCount, const MeshSpan& out);
+	void WriteGeosphere(float radius, uint32 numSubdivisions, const MeshSpan& out);
+	void WriteCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, const MeshSpan& out);
+	void WriteGrid(float width, float depth, uint32 m, uint32 n, const MeshSpan& out);
+	void WriteCone(float baseRadius, float height, uint32 sliceCount, const MeshSpan& out);
+	void WriteHalfCone(float topRadius, float bottomRadius, float height, uint32 sliceCount, const MeshSpan& out);
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -140,10 +189,37 @@ public:
 	///</summary>
 	MeshData CreatePrism(float length, float height, float width);
 
+	///<summary>
+	/// LOD chains of the parametric primitives, of up to lodCount levels.  Each
+	/// level halves the tessellation of the one before, down to the coarsest
+	/// tessellation that still has the shape's topology.
+	///</summary>
+	LodChain CreateBoxLods(float width, float height, float depth, uint32 numSubdivisions, uint32 lodCount);
+	LodChain CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 lodCount);
+	LodChain CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 lodCount);
+	LodChain CreateGridLods(float width, float depth, uint32 m, uint32 n, uint32 lodCount);
+	LodChain CreateConeLods(float baseRadius, float height, uint32 sliceCount, uint32 lodCount);
+	LodChain CreateHalfConeLods(float topRadius, float bottomRadius, float height, uint32 sliceCount, uint32 lodCount);
+
+	///<summary>
+	/// LOD chain of a mesh that has no generator parameters, such as a baked mesh.
+	/// The coarser levels are made by vertex clustering on ever larger grids, and
+	/// the chain ends early once a level no longer removes a quarter of the
+	/// triangles of the one before.
+	///</summary>
+	LodChain CreateSimplifiedLods(const MeshData& meshData, uint32 lodCount);
+
 private:
-	void Subdivide(MeshData& meshData);
+	// Subdivides a base mesh numSubdivisions times, straight into out.
+	MeshSize SubdividedSize(uint32 vertexCount, uint32 indexCount, uint32 numSubdivisions);
+	void Subdivide(const Vertex* vertices, uint32 vertexCount, const uint32* indices, uint32 indexCount,
+		uint32 numSubdivisions, const MeshSpan& out);
+	void SubdivideTriangle(const Vertex& v0, const Vertex& v1, const Vertex& v2,
+		uint32 numSubdivisions, const MeshSpan& out, uint32& triangle);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+
+    // Write a cap's ring, center and fan, where the ring starts at vertex baseIndex.
+    void BuildCylinderTopCap(float topRadius, float height, uint32 sliceCount, uint32 baseIndex, Vertex* vertices, uint32* indices);
+    void BuildCylinderBottomCap(float bottomRadius, float height, uint32 sliceCount, uint32 baseIndex, Vertex* vertices, uint32* indices);
 };
 
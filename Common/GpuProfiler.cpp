@@ -0,0 +1,243 @@
+//***************************************************************************************
+// GpuProfiler.cpp
+//***************************************************************************************
+
+#include "GpuProfiler.h"
+#include <cmath>
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+GpuProfiler::GpuProfiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameCount,
+    UINT maxScopes, UINT historySize)
+    : mMaxScopes(maxScopes), mHistorySize(std::max<UINT>(historySize, 1u))
+{
+    ThrowIfFailed(queue->GetTimestampFrequency(&mTimestampFrequency));
+
+    D3D12_QUERY_HEAP_DESC heapDesc = {};
+    heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    heapDesc.Count = 2*maxScopes;
+
+    for(UINT i = 0; i < frameCount; ++i)
+    {
+        auto frame = std::make_unique<Frame>();
+
+        ThrowIfFailed(device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(frame->QueryHeap.GetAddressOf())));
+
+        ThrowIfFailed(device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+            D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(2*maxScopes*sizeof(UINT64)),
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr,
+            IID_PPV_ARGS(frame->Readback.GetAddressOf())));
+
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(frame->CmdListAlloc.GetAddressOf())));
+
+        ThrowIfFailed(device->CreateCommandList(
+            0,
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            frame->CmdListAlloc.Get(),
+            nullptr,
+            IID_PPV_ARGS(frame->CmdList.GetAddressOf())));
+
+        // Start off in a closed state, since EndFrame resets it first.
+        frame->CmdList->Close();
+
+        frame->Names.resize(maxScopes);
+        frame->IsEnded.resize(maxScopes);
+
+        mFrames.push_back(std::move(frame));
+    }
+}
+
+bool GpuProfiler::BeginFrame(UINT frameIndex)
+{
+    mCurrFrame = mFrames[frameIndex].get();
+
+    bool isReadBack = ReadBack(*mCurrFrame);
+
+    mCurrFrame->ScopeCount = 0;
+    mCurrFrame->ResolvedCount = 0;
+
+    return isReadBack;
+}
+
+GpuProfiler::Scope GpuProfiler::BeginScope(ID3D12GraphicsCommandList* cmdList, const char* name)
+{
+    Scope scope = mCurrFrame->ScopeCount++;
+    if(scope >= mMaxScopes)
+        return InvalidScope;
+
+    mCurrFrame->Names[scope] = name;
+    mCurrFrame->IsEnded[scope] = false;
+    cmdList->EndQuery(mCurrFrame->QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2*scope);
+
+    return scope;
+}
+
+void GpuProfiler::EndScope(ID3D12GraphicsCommandList* cmdList, Scope scope)
+{
+    if(scope == InvalidScope)
+        return;
+
+    cmdList->EndQuery(mCurrFrame->QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, 2*scope + 1);
+    mCurrFrame->IsEnded[scope] = true;
+}
+
+ID3D12CommandList* GpuProfiler::EndFrame()
+{
+    Frame& frame = *mCurrFrame;
+
+    // The last use of the list was by this slot's previous frame, which the
+    // caller waited on before BeginFrame.
+    ThrowIfFailed(frame.CmdListAlloc->Reset());
+    ThrowIfFailed(frame.CmdList->Reset(frame.CmdListAlloc.Get(), nullptr));
+
+    frame.ResolvedCount = std::min<UINT>(frame.ScopeCount, mMaxScopes);
+    for(UINT i = 0; i < frame.ResolvedCount; ++i)
+    {
+        if(!frame.IsEnded[i])
+            EndScope(frame.CmdList.Get(), i);
+    }
+
+    if(frame.ResolvedCount > 0)
+    {
+        frame.CmdList->ResolveQueryData(frame.QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+            0, 2*frame.ResolvedCount, frame.Readback.Get(), 0);
+    }
+
+    ThrowIfFailed(frame.CmdList->Close());
+
+    return frame.CmdList.Get();
+}
+
+const GpuProfiler::ScopeStats* GpuProfiler::FindStats(const std::string& name)const
+{
+    auto it = mScopeIndices.find(name);
+    return it != mScopeIndices.end() ? &mStats[it->second] : nullptr;
+}
+
+void GpuProfiler::DrawOverlay(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtv,
+    const D3D12_RECT& area, float budgetMs)const
+{
+    static const XMVECTORF32 palette[] =
+    {
+        Colors::Orange, Colors::LimeGreen, Colors::DeepSkyBlue, Colors::Gold,
+        Colors::HotPink, Colors::MediumPurple, Colors::Tomato, Colors::Turquoise
+    };
+
+    const LONG barHeight = 6;
+    const LONG barSpacing = 3;
+    const LONG width = area.right - area.left;
+
+    auto barLength = [=](float ms)
+    {
+        return (LONG)std::min<float>(width, width * ms / budgetMs);
+    };
+
+    LONG bottom = area.top + barSpacing + (LONG)mStats.size()*(barHeight + barSpacing);
+    D3D12_RECT background = { area.left, area.top, area.right, std::min<LONG>(bottom, area.bottom) };
+    cmdList->ClearRenderTargetView(rtv, Colors::Black, 1, &background);
+
+    LONG y = area.top + barSpacing;
+    for(size_t i = 0; i < mStats.size() && y + barHeight <= area.bottom; ++i)
+    {
+        const ScopeStats& stats = mStats[i];
+
+        D3D12_RECT bar = { area.left, y, area.left + barLength(stats.AvgMs), y + barHeight };
+        if(bar.right > bar.left)
+            cmdList->ClearRenderTargetView(rtv, palette[i % _countof(palette)], 1, &bar);
+
+        LONG p99 = area.left + barLength(stats.P99Ms);
+        D3D12_RECT tick = { std::max<LONG>(area.left, p99 - 1), y, std::min<LONG>(area.right, p99 + 1), y + barHeight };
+        cmdList->ClearRenderTargetView(rtv, Colors::White, 1, &tick);
+
+        y += barHeight + barSpacing;
+    }
+}
+
+bool GpuProfiler::ReadBack(Frame& frame)
+{
+    if(frame.ResolvedCount == 0)
+        return false;
+
+    D3D12_RANGE readRange = { 0, 2*frame.ResolvedCount*sizeof(UINT64) };
+    UINT64* timestamps = nullptr;
+    ThrowIfFailed(frame.Readback->Map(0, &readRange, reinterpret_cast<void**>(&timestamps)));
+
+    // Add up the scopes that share a name before they go into the window.
+    std::vector<float> frameMs(mStats.size(), 0.0f);
+    std::vector<char> isTimed(mStats.size(), 0);
+    for(UINT i = 0; i < frame.ResolvedCount; ++i)
+    {
+        auto inserted = mScopeIndices.insert({ frame.Names[i], (UINT)mStats.size() });
+        UINT index = inserted.first->second;
+        if(inserted.second)
+        {
+            ScopeStats stats;
+            stats.Name = frame.Names[i];
+            mStats.push_back(stats);
+
+            History history;
+            history.Samples.resize(mHistorySize);
+            mHistories.push_back(std::move(history));
+
+            frameMs.push_back(0.0f);
+            isTimed.push_back(0);
+        }
+
+        // A scope whose end executed before its begin reads as zero rather than wrapping.
+        UINT64 begin = timestamps[2*i];
+        UINT64 end = timestamps[2*i + 1];
+        if(end > begin)
+            frameMs[index] += (float)((double)(end - begin) * 1000.0 / (double)mTimestampFrequency);
+        isTimed[index] = 1;
+    }
+
+    D3D12_RANGE writeRange = { 0, 0 };
+    frame.Readback->Unmap(0, &writeRange);
+
+    for(UINT index = 0; index < (UINT)mStats.size(); ++index)
+    {
+        if(!isTimed[index])
+        {
+            mStats[index].LastMs = 0.0f;
+            continue;
+        }
+
+        History& history = mHistories[index];
+        history.Samples[history.Next] = frameMs[index];
+        history.Next = (history.Next + 1) % mHistorySize;
+        history.Count = std::min<UINT>(history.Count + 1, mHistorySize);
+
+        mStats[index].LastMs = frameMs[index];
+        UpdateStats(index);
+    }
+
+    return true;
+}
+
+void GpuProfiler::UpdateStats(UINT scope)
+{
+    const History& history = mHistories[scope];
+    ScopeStats& stats = mStats[scope];
+
+    // Until the window is full, the samples are the ones before Next.
+    mSortScratch.assign(history.Samples.begin(), history.Samples.begin() + history.Count);
+    std::sort(mSortScratch.begin(), mSortScratch.end());
+
+    float sum = 0.0f;
+    for(float ms : mSortScratch)
+        sum += ms;
+
+    UINT p99 = (UINT)std::ceil(0.99f * history.Count) - 1;
+
+    stats.SampleCount = history.Count;
+    stats.MinMs = mSortScratch.front();
+    stats.MaxMs = mSortScratch.back();
+    stats.AvgMs = sum / history.Count;
+    stats.P99Ms = mSortScratch[std::min<UINT>(p99, history.Count - 1)];
+}
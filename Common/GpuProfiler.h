@@ -0,0 +1,111 @@
+//***************************************************************************************
+// GpuProfiler.h
+//
+// Times named scopes of a frame on the GPU with timestamp queries.  Every frame
+// resource slot has a query heap and readback buffer of its own; a slot's
+// timestamps are resolved at the end of its frame and read back when the slot
+// comes round again, once its fence has passed, so reading them never stalls.
+// Each scope keeps a rolling window of per-frame times for its min, average, max
+// and 99th percentile.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <atomic>
+
+class GpuProfiler
+{
+public:
+    // Milliseconds of GPU time per frame over the rolling window.  Scopes begun
+    // more than once in a frame, such as one per worker command list, add up.
+    // LastMs is of the frame read back last, and zero if the scope was not begun.
+    struct ScopeStats
+    {
+        std::string Name;
+        float LastMs = 0.0f;
+        float MinMs = 0.0f;
+        float AvgMs = 0.0f;
+        float MaxMs = 0.0f;
+        float P99Ms = 0.0f;
+        UINT SampleCount = 0;
+    };
+
+    using Scope = UINT;
+    static const Scope InvalidScope = 0xffffffff;
+
+    // Scopes beyond maxScopes in one frame are not timed.
+    GpuProfiler(ID3D12Device* device, ID3D12CommandQueue* queue, UINT frameCount,
+        UINT maxScopes = 32, UINT historySize = 240);
+    GpuProfiler(const GpuProfiler& rhs) = delete;
+    GpuProfiler& operator=(const GpuProfiler& rhs) = delete;
+    ~GpuProfiler() = default;
+
+    // Reads back the last frame recorded in this slot, whose fence must have
+    // passed, and starts a new one.  Call before any scope of the frame begins.
+    // Returns true if a frame with scopes was read back.
+    bool BeginFrame(UINT frameIndex);
+
+    // Scopes can be begun and ended from any thread, on any command list of the
+    // frame's submission, as long as the end executes after the begin.  name must
+    // outlive the frame, as a string literal does.
+    Scope BeginScope(ID3D12GraphicsCommandList* cmdList, const char* name);
+    void EndScope(ID3D12GraphicsCommandList* cmdList, Scope scope);
+
+    // Ends the scopes still open and resolves the frame's timestamps.  Returns the
+    // command list that does so, to be executed after every list of the frame.
+    ID3D12CommandList* EndFrame();
+
+    // In the order the scopes were first begun, as of the last BeginFrame.
+    const std::vector<ScopeStats>& GetStats()const { return mStats; }
+    const ScopeStats* FindStats(const std::string& name)const;
+
+    // Draws a bar per scope down from the top left of area: its length is the
+    // average time, with budgetMs across the whole area, and a tick marks the
+    // 99th percentile.  Reads only what the last BeginFrame computed.
+    void DrawOverlay(ID3D12GraphicsCommandList* cmdList, D3D12_CPU_DESCRIPTOR_HANDLE rtv,
+        const D3D12_RECT& area, float budgetMs)const;
+
+private:
+    struct Frame
+    {
+        Microsoft::WRL::ComPtr<ID3D12QueryHeap> QueryHeap;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Readback;
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CmdList;
+
+        // Begin and end timestamps of scope i are queries 2i and 2i+1.
+        std::atomic<UINT> ScopeCount{ 0 };
+        std::vector<const char*> Names;
+        std::vector<char> IsEnded;
+
+        // Scopes resolved by EndFrame, waiting to be read back.
+        UINT ResolvedCount = 0;
+    };
+
+    // The per-frame times of a scope, oldest first from Next once the window is full.
+    struct History
+    {
+        std::vector<float> Samples;
+        UINT Next = 0;
+        UINT Count = 0;
+    };
+
+    bool ReadBack(Frame& frame);
+    void UpdateStats(UINT scope);
+
+private:
+    UINT mMaxScopes = 0;
+    UINT mHistorySize = 0;
+    UINT64 mTimestampFrequency = 1;
+
+    std::vector<std::unique_ptr<Frame>> mFrames;
+    Frame* mCurrFrame = nullptr;
+
+    // By index into mStats.
+    std::unordered_map<std::string, UINT> mScopeIndices;
+    std::vector<History> mHistories;
+    std::vector<ScopeStats> mStats;
+
+    std::vector<float> mSortScratch;
+};
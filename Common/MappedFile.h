@@ -0,0 +1,40 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// A file mapped read-only into the address space instead of read into a heap
+// buffer.  The OS pages the file in as it is first touched, so only the parts that
+// are used cost I/O and memory, and clean pages can be dropped again under memory
+// pressure.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile& rhs) = delete;
+    MappedFile& operator=(const MappedFile& rhs) = delete;
+    ~MappedFile();
+
+    // Maps the whole file, closing any file mapped before.  Fails with the Win32
+    // error of opening or mapping it; an empty file can not be mapped.
+    HRESULT Open(const std::wstring& fileName);
+    void Close();
+
+    bool IsOpen()const { return mData != nullptr; }
+
+    const uint8_t* Data()const { return mData; }
+    size_t Size()const { return mSize; }
+
+private:
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+};
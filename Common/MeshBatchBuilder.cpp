@@ -0,0 +1,117 @@
+//***************************************************************************************
+// MeshBatchBuilder.cpp
+//***************************************************************************************
+
+#include "MeshBatchBuilder.h"
+
+MeshBatchBuilder::MeshBatchBuilder(UINT vertexByteStride, UINT attributeByteStride, UINT64 pageByteSize) :
+    mVertexByteStride(vertexByteStride),
+    mAttributeByteStride(attributeByteStride),
+    mPageByteSize(pageByteSize)
+{
+}
+
+MeshBatchBuilder::Allocation MeshBatchBuilder::Allocate(const std::string& name,
+    const SubmeshGeometry& geometry, UINT vertexCount, UINT indexCount)
+{
+    DXGI_FORMAT indexFormat = vertexCount <= 0x10000 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+    UINT indexByteStride = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+
+    UINT pageIndex = GetPage(indexFormat, vertexCount, indexCount);
+    Page& page = mPages[pageIndex];
+
+    Submesh submesh;
+    submesh.Page = pageIndex;
+    submesh.Geometry = geometry;
+    submesh.Geometry.IndexCount = indexCount;
+    submesh.Geometry.StartIndexLocation = page.IndexCount;
+    submesh.Geometry.BaseVertexLocation = (INT)page.VertexCount;
+
+    size_t vertexOffset = (size_t)page.VertexCount*mVertexByteStride;
+    size_t attributeOffset = (size_t)page.VertexCount*mAttributeByteStride;
+    size_t indexOffset = (size_t)page.IndexCount*indexByteStride;
+
+    page.Vertices.resize(vertexOffset + (size_t)vertexCount*mVertexByteStride);
+    page.Attributes.resize(attributeOffset + (size_t)vertexCount*mAttributeByteStride);
+    page.Indices.resize(indexOffset + (size_t)indexCount*indexByteStride);
+
+    page.VertexCount += vertexCount;
+    page.IndexCount += indexCount;
+
+    Allocation allocation;
+    allocation.Handle = mSubmeshes.Add(name, submesh);
+    allocation.Vertices = page.Vertices.data() + vertexOffset;
+    allocation.Attributes = mAttributeByteStride > 0 ? page.Attributes.data() + attributeOffset : nullptr;
+    allocation.IndexFormat = indexFormat;
+    allocation.Indices = page.Indices.data() + indexOffset;
+
+    return allocation;
+}
+
+void MeshBatchBuilder::StoreIndices(const Allocation& allocation, const std::uint32_t* indices, UINT indexCount)
+{
+    if(allocation.IndexFormat == DXGI_FORMAT_R16_UINT)
+    {
+        std::uint16_t* dst = static_cast<std::uint16_t*>(allocation.Indices);
+        for(UINT i = 0; i < indexCount; ++i)
+            dst[i] = (std::uint16_t)indices[i];
+    }
+    else
+    {
+        memcpy(allocation.Indices, indices, (size_t)indexCount*sizeof(std::uint32_t));
+    }
+}
+
+void MeshBatchBuilder::AddMeshlets(const Allocation& allocation, const DirectX::XMFLOAT3* positions,
+    UINT positionStride, UINT vertexCount, const std::uint32_t* indices, UINT indexCount)
+{
+    Submesh& submesh = mSubmeshes[allocation.Handle];
+    MeshletData& meshlets = mPages[submesh.Page].Meshlets;
+
+    submesh.Geometry.MeshletOffset = BuildMeshlets(positions, positionStride, vertexCount, indices, indexCount, meshlets);
+    submesh.Geometry.MeshletCount = (UINT)meshlets.Meshlets.size() - submesh.Geometry.MeshletOffset;
+}
+
+Registry<MeshBatchBuilder::Submesh>::Handle MeshBatchBuilder::Add(const std::string& name,
+    const SubmeshGeometry& geometry, const void* vertices, const void* attributes, UINT vertexCount,
+    const std::uint32_t* indices, UINT indexCount)
+{
+    Allocation allocation = Allocate(name, geometry, vertexCount, indexCount);
+
+    memcpy(allocation.Vertices, vertices, (size_t)vertexCount*mVertexByteStride);
+    if(allocation.Attributes != nullptr)
+        memcpy(allocation.Attributes, attributes, (size_t)vertexCount*mAttributeByteStride);
+
+    StoreIndices(allocation, indices, indexCount);
+
+    return allocation.Handle;
+}
+
+UINT MeshBatchBuilder::GetPage(DXGI_FORMAT indexFormat, UINT vertexCount, UINT indexCount)
+{
+    UINT& openPage = indexFormat == DXGI_FORMAT_R16_UINT ? mOpenPage16 : mOpenPage32;
+    UINT indexByteStride = indexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+
+    // An oversized submesh takes the open page if nothing is in it yet, rather
+    // than leaving it empty behind a page of its own.
+    if(openPage != NoPage)
+    {
+        const Page& page = mPages[openPage];
+
+        UINT64 vertexByteSize = (UINT64)(page.VertexCount + vertexCount) * (mVertexByteStride + mAttributeByteStride);
+        UINT64 indexByteSize = (UINT64)(page.IndexCount + indexCount) * indexByteStride;
+        bool isEmpty = page.VertexCount == 0 && page.IndexCount == 0;
+
+        if(!isEmpty && (vertexByteSize > mPageByteSize || indexByteSize > mPageByteSize))
+            openPage = NoPage;
+    }
+
+    if(openPage == NoPage)
+    {
+        openPage = (UINT)mPages.size();
+        mPages.emplace_back();
+        mPages.back().IndexFormat = indexFormat;
+    }
+
+    return openPage;
+}
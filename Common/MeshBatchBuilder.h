@@ -0,0 +1,103 @@
+//***************************************************************************************
+// MeshBatchBuilder.h
+//
+// Packs any number of submeshes into shared vertex/index pages.  A page is closed
+// once it would exceed its byte budget, so there is no limit on the size of the
+// scene.  Indices stay relative to the submesh's BaseVertexLocation, which lets
+// every page whose submeshes have at most 65,536 vertices each use 16-bit indices;
+// larger submeshes are kept apart in pages with 32-bit indices.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "Meshlets.h"
+#include <cstdint>
+
+class MeshBatchBuilder
+{
+public:
+    struct Page
+    {
+        UINT VertexCount = 0;
+        std::vector<BYTE> Vertices;
+
+        // The second vertex stream.  Empty for interleaved vertices.
+        std::vector<BYTE> Attributes;
+
+        DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+        UINT IndexCount = 0;
+        std::vector<BYTE> Indices;
+
+        // Meshlets of the submeshes that have them.
+        MeshletData Meshlets;
+    };
+
+    // Where a submesh ended up: the page whose buffers it is drawn from, and its
+    // draw arguments within them.
+    struct Submesh
+    {
+        UINT Page = 0;
+        SubmeshGeometry Geometry;
+    };
+
+    // The vertex and index data of a page each stay within pageByteSize, unless a
+    // single submesh is larger, in which case it gets a page of its own.
+    MeshBatchBuilder(UINT vertexByteStride, UINT attributeByteStride, UINT64 pageByteSize = 4*1024*1024);
+    MeshBatchBuilder(const MeshBatchBuilder& rhs) = delete;
+    MeshBatchBuilder& operator=(const MeshBatchBuilder& rhs) = delete;
+    ~MeshBatchBuilder() = default;
+
+    // Room for a submesh in a page, for its data to be written in place.  The
+    // pointers stay valid until the next Allocate or Add.  Attributes is null when
+    // the attribute stride is zero; Indices holds IndexFormat indices.
+    struct Allocation
+    {
+        Registry<Submesh>::Handle Handle;
+        BYTE* Vertices = nullptr;
+        BYTE* Attributes = nullptr;
+        DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+        void* Indices = nullptr;
+    };
+
+    // Places a submesh in a page like Add, but leaves its data to the caller.
+    Allocation Allocate(const std::string& name, const SubmeshGeometry& geometry,
+        UINT vertexCount, UINT indexCount);
+
+    // Converts 32-bit indices into an allocation's index format.
+    static void StoreIndices(const Allocation& allocation, const std::uint32_t* indices, UINT indexCount);
+
+    // Splits an allocated submesh into meshlets, from its float positions and its
+    // 32-bit indices, and records them in its geometry.
+    void AddMeshlets(const Allocation& allocation, const DirectX::XMFLOAT3* positions,
+        UINT positionStride, UINT vertexCount, const std::uint32_t* indices, UINT indexCount);
+
+    // Copies a submesh into a page.  geometry supplies the bounds and the
+    // dequantization; the draw arguments are filled in here.  attributes may be
+    // null when the attribute stride is zero.
+    Registry<Submesh>::Handle Add(const std::string& name, const SubmeshGeometry& geometry,
+        const void* vertices, const void* attributes, UINT vertexCount,
+        const std::uint32_t* indices, UINT indexCount);
+
+    UINT VertexByteStride()const { return mVertexByteStride; }
+    UINT AttributeByteStride()const { return mAttributeByteStride; }
+
+    const std::vector<Page>& Pages()const { return mPages; }
+    const Registry<Submesh>& Submeshes()const { return mSubmeshes; }
+
+private:
+    UINT GetPage(DXGI_FORMAT indexFormat, UINT vertexCount, UINT indexCount);
+
+private:
+    UINT mVertexByteStride = 0;
+    UINT mAttributeByteStride = 0;
+    UINT64 mPageByteSize = 0;
+
+    std::vector<Page> mPages;
+    Registry<Submesh> mSubmeshes;
+
+    // The page still being filled for each index format.
+    static const UINT NoPage = 0xffffffff;
+    UINT mOpenPage16 = NoPage;
+    UINT mOpenPage32 = NoPage;
+};
@@ -0,0 +1,442 @@
+//***************************************************************************************
+// MeshCache.cpp
+//***************************************************************************************
+
+#include "MeshCache.h"
+
+using namespace DirectX;
+
+//
+// File layout: Header, the page table and the submesh table, then the vertex
+// stream, the attribute stream, the index stream and the meshlet buffer of each
+// page at the offsets its page record gives.  Every section starts 16 byte aligned.
+//
+
+struct MeshCacheFile::Header
+{
+    UINT Magic;
+    UINT Version;
+    UINT64 Key;
+
+    UINT VertexByteStride;
+    UINT AttributeByteStride;
+    UINT PageCount;
+    UINT SubmeshCount;
+
+    UINT64 PageTableOffset;
+    UINT64 SubmeshTableOffset;
+};
+
+struct MeshCacheFile::PageRecord
+{
+    UINT VertexCount;
+    UINT IndexCount;
+    UINT IndexFormat;
+    UINT Pad;
+
+    UINT64 VertexDataOffset;
+    UINT64 AttributeDataOffset;
+    UINT64 IndexDataOffset;
+
+    UINT MeshletCount;
+    UINT MeshletVertexIndexCount;
+    UINT MeshletPrimitiveCount;
+    UINT Pad2;
+
+    UINT64 MeshletDataOffset;
+};
+
+struct MeshCacheFile::SubmeshRecord
+{
+    char Name[48];
+
+    UINT Page;
+    UINT IndexCount;
+    UINT StartIndexLocation;
+    INT BaseVertexLocation;
+
+    XMFLOAT3 BoundsCenter;
+    XMFLOAT3 BoundsExtents;
+
+    XMFLOAT3 PositionScale;
+    XMFLOAT3 PositionBias;
+
+    float LodError;
+
+    UINT MeshletOffset;
+    UINT MeshletCount;
+};
+
+namespace
+{
+    const UINT Magic = 'M' | ('S' << 8) | ('H' << 16) | ('C' << 24);
+
+    inline UINT64 AlignUp(UINT64 value)
+    {
+        return (value + 15) & ~15ull;
+    }
+
+    inline UINT IndexByteStride(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_R32_UINT ? 4 : 2;
+    }
+}
+
+void MeshCacheKey::Add(const void* data, size_t byteSize)
+{
+    const BYTE* bytes = static_cast<const BYTE*>(data);
+    for(size_t i = 0; i < byteSize; ++i)
+    {
+        mHash ^= bytes[i];
+        mHash *= 1099511628211ull;
+    }
+}
+
+void MeshCacheKey::Add(const char* str)
+{
+    // Include the terminator, so "ab","c" and "a","bc" hash differently.
+    Add(str, strlen(str) + 1);
+}
+
+MeshCacheFile::~MeshCacheFile()
+{
+    Close();
+}
+
+std::vector<BYTE> MeshCacheFile::Serialize(UINT64 key, const MeshBatchBuilder& batch)
+{
+    const std::vector<MeshBatchBuilder::Page>& pages = batch.Pages();
+    const Registry<MeshBatchBuilder::Submesh>& submeshes = batch.Submeshes();
+
+    Header header = {};
+    header.Magic = Magic;
+    header.Version = Version;
+    header.Key = key;
+    header.VertexByteStride = batch.VertexByteStride();
+    header.AttributeByteStride = batch.AttributeByteStride();
+    header.PageCount = (UINT)pages.size();
+    header.SubmeshCount = submeshes.Size();
+    header.PageTableOffset = AlignUp(sizeof(Header));
+    header.SubmeshTableOffset = AlignUp(header.PageTableOffset + pages.size() * sizeof(PageRecord));
+
+    std::vector<PageRecord> pageRecords(pages.size());
+    UINT64 byteSize = AlignUp(header.SubmeshTableOffset + submeshes.Size() * sizeof(SubmeshRecord));
+    for(size_t i = 0; i < pages.size(); ++i)
+    {
+        PageRecord& record = pageRecords[i];
+        record.VertexCount = pages[i].VertexCount;
+        record.IndexCount = pages[i].IndexCount;
+        record.IndexFormat = (UINT)pages[i].IndexFormat;
+        record.Pad = 0;
+
+        record.VertexDataOffset = byteSize;
+        record.AttributeDataOffset = AlignUp(record.VertexDataOffset + pages[i].Vertices.size());
+        record.IndexDataOffset = AlignUp(record.AttributeDataOffset + pages[i].Attributes.size());
+
+        const MeshletData& meshlets = pages[i].Meshlets;
+        record.MeshletCount = (UINT)meshlets.Meshlets.size();
+        record.MeshletVertexIndexCount = (UINT)meshlets.VertexIndices.size();
+        record.MeshletPrimitiveCount = (UINT)meshlets.Primitives.size();
+        record.Pad2 = 0;
+
+        record.MeshletDataOffset = AlignUp(record.IndexDataOffset + pages[i].Indices.size());
+        byteSize = record.MeshletDataOffset + ::GetMeshletBufferLayout(record.MeshletCount,
+            record.MeshletVertexIndexCount, record.MeshletPrimitiveCount).ByteSize;
+    }
+
+    std::vector<BYTE> image((size_t)byteSize, 0);
+    memcpy(&image[0], &header, sizeof(Header));
+    if(!pageRecords.empty())
+        memcpy(&image[(size_t)header.PageTableOffset], pageRecords.data(), pageRecords.size() * sizeof(PageRecord));
+
+    for(size_t i = 0; i < pages.size(); ++i)
+    {
+        const MeshBatchBuilder::Page& page = pages[i];
+        if(!page.Vertices.empty())
+            memcpy(&image[(size_t)pageRecords[i].VertexDataOffset], page.Vertices.data(), page.Vertices.size());
+        if(!page.Attributes.empty())
+            memcpy(&image[(size_t)pageRecords[i].AttributeDataOffset], page.Attributes.data(), page.Attributes.size());
+        if(!page.Indices.empty())
+            memcpy(&image[(size_t)pageRecords[i].IndexDataOffset], page.Indices.data(), page.Indices.size());
+        if(!page.Meshlets.Meshlets.empty())
+            WriteMeshletBuffer(page.Meshlets, &image[(size_t)pageRecords[i].MeshletDataOffset]);
+    }
+
+    SubmeshRecord* records = reinterpret_cast<SubmeshRecord*>(&image[(size_t)header.SubmeshTableOffset]);
+    // Records are in handle order, so loading the file hands out the same handles.
+    for(UINT i = 0; i < submeshes.Size(); ++i)
+    {
+        auto handle = submeshes.At(i);
+        const std::string& name = submeshes.Name(handle);
+        const MeshBatchBuilder::Submesh& submesh = submeshes[handle];
+
+        if(name.size() >= sizeof(records->Name))
+        {
+            throw DxException(E_INVALIDARG, L"MeshCacheFile::Serialize",
+                AnsiToWString(__FILE__), __LINE__);
+        }
+
+        SubmeshRecord& record = records[i];
+        memcpy(record.Name, name.c_str(), name.size() + 1);
+        record.Page = submesh.Page;
+        record.IndexCount = submesh.Geometry.IndexCount;
+        record.StartIndexLocation = submesh.Geometry.StartIndexLocation;
+        record.BaseVertexLocation = submesh.Geometry.BaseVertexLocation;
+        record.BoundsCenter = submesh.Geometry.Bounds.Center;
+        record.BoundsExtents = submesh.Geometry.Bounds.Extents;
+        record.PositionScale = submesh.Geometry.PositionScale;
+        record.PositionBias = submesh.Geometry.PositionBias;
+        record.LodError = submesh.Geometry.LodError;
+        record.MeshletOffset = submesh.Geometry.MeshletOffset;
+        record.MeshletCount = submesh.Geometry.MeshletCount;
+    }
+
+    return image;
+}
+
+bool MeshCacheFile::Write(const std::wstring& fileName, const std::vector<BYTE>& image)
+{
+    // Write to a temporary file and move it over the old one, so a crash mid-write
+    // never leaves a truncated cache behind.
+    std::wstring tempName = fileName + L".tmp";
+
+    HANDLE file = CreateFileW(tempName.c_str(), GENERIC_WRITE, 0, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD written = 0;
+    BOOL ok = WriteFile(file, image.data(), (DWORD)image.size(), &written, nullptr);
+    CloseHandle(file);
+
+    if(!ok || written != image.size() ||
+       !MoveFileExW(tempName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tempName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshCacheFile::Open(const std::wstring& fileName, UINT64 key)
+{
+    Close();
+
+    mFile = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(mFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Header))
+    {
+        Close();
+        return false;
+    }
+
+    mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mMapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    mByteSize = (UINT64)fileSize.QuadPart;
+
+    return Validate(key);
+}
+
+bool MeshCacheFile::Open(std::vector<BYTE>&& image, UINT64 key)
+{
+    Close();
+
+    mImage = std::move(image);
+    mData = mImage.empty() ? nullptr : mImage.data();
+    mByteSize = mImage.size();
+
+    return Validate(key);
+}
+
+void MeshCacheFile::Close()
+{
+    if(mMapping != nullptr && mData != nullptr)
+        UnmapViewOfFile(mData);
+
+    if(mMapping != nullptr)
+        CloseHandle(mMapping);
+
+    if(mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = nullptr;
+    mImage.clear();
+    mImage.shrink_to_fit();
+    mData = nullptr;
+    mByteSize = 0;
+}
+
+UINT MeshCacheFile::PageCount()const
+{
+    return GetHeader().PageCount;
+}
+
+UINT MeshCacheFile::VertexByteStride()const
+{
+    return GetHeader().VertexByteStride;
+}
+
+UINT MeshCacheFile::AttributeByteStride()const
+{
+    return GetHeader().AttributeByteStride;
+}
+
+const void* MeshCacheFile::VertexData(UINT page)const
+{
+    return mData + GetPage(page).VertexDataOffset;
+}
+
+UINT MeshCacheFile::VertexCount(UINT page)const
+{
+    return GetPage(page).VertexCount;
+}
+
+UINT MeshCacheFile::VertexByteSize(UINT page)const
+{
+    return VertexCount(page) * VertexByteStride();
+}
+
+const void* MeshCacheFile::AttributeData(UINT page)const
+{
+    return mData + GetPage(page).AttributeDataOffset;
+}
+
+UINT MeshCacheFile::AttributeByteSize(UINT page)const
+{
+    return VertexCount(page) * AttributeByteStride();
+}
+
+const void* MeshCacheFile::IndexData(UINT page)const
+{
+    return mData + GetPage(page).IndexDataOffset;
+}
+
+UINT MeshCacheFile::IndexCount(UINT page)const
+{
+    return GetPage(page).IndexCount;
+}
+
+DXGI_FORMAT MeshCacheFile::IndexFormat(UINT page)const
+{
+    return (DXGI_FORMAT)GetPage(page).IndexFormat;
+}
+
+UINT MeshCacheFile::IndexByteSize(UINT page)const
+{
+    return IndexCount(page) * IndexByteStride(IndexFormat(page));
+}
+
+const void* MeshCacheFile::MeshletBufferData(UINT page)const
+{
+    return mData + GetPage(page).MeshletDataOffset;
+}
+
+UINT MeshCacheFile::MeshletCount(UINT page)const
+{
+    return GetPage(page).MeshletCount;
+}
+
+MeshletBufferLayout MeshCacheFile::GetMeshletBufferLayout(UINT page)const
+{
+    const PageRecord& record = GetPage(page);
+    return ::GetMeshletBufferLayout(record.MeshletCount, record.MeshletVertexIndexCount, record.MeshletPrimitiveCount);
+}
+
+void MeshCacheFile::GetSubmeshes(Registry<MeshBatchBuilder::Submesh>& submeshes)const
+{
+    const Header& header = GetHeader();
+    const SubmeshRecord* records = reinterpret_cast<const SubmeshRecord*>(mData + header.SubmeshTableOffset);
+
+    for(UINT i = 0; i < header.SubmeshCount; ++i)
+    {
+        const SubmeshRecord& record = records[i];
+
+        MeshBatchBuilder::Submesh submesh;
+        submesh.Page = record.Page;
+        submesh.Geometry.IndexCount = record.IndexCount;
+        submesh.Geometry.StartIndexLocation = record.StartIndexLocation;
+        submesh.Geometry.BaseVertexLocation = record.BaseVertexLocation;
+        submesh.Geometry.Bounds = BoundingBox(record.BoundsCenter, record.BoundsExtents);
+        submesh.Geometry.PositionScale = record.PositionScale;
+        submesh.Geometry.PositionBias = record.PositionBias;
+        submesh.Geometry.LodError = record.LodError;
+        submesh.Geometry.MeshletOffset = record.MeshletOffset;
+        submesh.Geometry.MeshletCount = record.MeshletCount;
+
+        submeshes.Add(record.Name, submesh);
+    }
+}
+
+bool MeshCacheFile::Validate(UINT64 key)
+{
+    bool valid = mData != nullptr && mByteSize >= sizeof(Header);
+
+    if(valid)
+    {
+        const Header& header = GetHeader();
+
+        valid = header.Magic == Magic &&
+            header.Version == Version &&
+            header.Key == key &&
+            header.PageTableOffset + (UINT64)header.PageCount * sizeof(PageRecord) <= mByteSize &&
+            header.SubmeshTableOffset + (UINT64)header.SubmeshCount * sizeof(SubmeshRecord) <= mByteSize;
+    }
+
+    if(valid)
+    {
+        const Header& header = GetHeader();
+        for(UINT i = 0; i < header.PageCount && valid; ++i)
+        {
+            const PageRecord& page = GetPage(i);
+            DXGI_FORMAT indexFormat = (DXGI_FORMAT)page.IndexFormat;
+
+            valid = (indexFormat == DXGI_FORMAT_R16_UINT || indexFormat == DXGI_FORMAT_R32_UINT) &&
+                page.VertexDataOffset + (UINT64)page.VertexCount * header.VertexByteStride <= mByteSize &&
+                page.AttributeDataOffset + (UINT64)page.VertexCount * header.AttributeByteStride <= mByteSize &&
+                page.IndexDataOffset + (UINT64)page.IndexCount * IndexByteStride(indexFormat) <= mByteSize &&
+                page.MeshletDataOffset + ::GetMeshletBufferLayout(page.MeshletCount,
+                    page.MeshletVertexIndexCount, page.MeshletPrimitiveCount).ByteSize <= mByteSize;
+        }
+    }
+
+    if(valid)
+    {
+        // Names must be terminated inside their record, and pages and meshlets must exist.
+        const Header& header = GetHeader();
+        const SubmeshRecord* records = reinterpret_cast<const SubmeshRecord*>(mData + header.SubmeshTableOffset);
+        for(UINT i = 0; i < header.SubmeshCount && valid; ++i)
+        {
+            valid = memchr(records[i].Name, 0, sizeof(records[i].Name)) != nullptr &&
+                records[i].Page < header.PageCount &&
+                (UINT64)records[i].MeshletOffset + records[i].MeshletCount <= GetPage(records[i].Page).MeshletCount;
+        }
+    }
+
+    if(!valid)
+        Close();
+
+    return valid;
+}
+
+const MeshCacheFile::Header& MeshCacheFile::GetHeader()const
+{
+    return *reinterpret_cast<const Header*>(mData);
+}
+
+const MeshCacheFile::PageRecord& MeshCacheFile::GetPage(UINT page)const
+{
+    const PageRecord* records = reinterpret_cast<const PageRecord*>(mData + GetHeader().PageTableOffset);
+    return records[page];
+}
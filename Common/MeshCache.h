@@ -0,0 +1,109 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// A versioned binary file holding the vertex and index pages of a MeshBatchBuilder
+// together with its submesh table.  The vertices may be split into a position
+// stream and an attribute stream, as laid out by a VertexFormat, and each page may
+// carry the meshlets of its submeshes.  Files are memory-mapped, so the streams
+// can be uploaded straight from the mapping.  Each file is stamped with a key
+// hashed from the parameters it was generated from; a file whose version or key
+// does not match is treated as missing and regenerated.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "MeshBatchBuilder.h"
+
+// FNV-1a hash of everything a cached mesh was generated from.
+class MeshCacheKey
+{
+public:
+    void Add(const void* data, size_t byteSize);
+    void Add(const char* str);
+
+    template<typename T>
+    void Add(const T& value)
+    {
+        Add(&value, sizeof(T));
+    }
+
+    UINT64 Value()const { return mHash; }
+
+private:
+    UINT64 mHash = 14695981039346656037ull;
+};
+
+class MeshCacheFile
+{
+public:
+    static const UINT Version = 5;
+
+    MeshCacheFile() = default;
+    MeshCacheFile(const MeshCacheFile& rhs) = delete;
+    MeshCacheFile& operator=(const MeshCacheFile& rhs) = delete;
+    ~MeshCacheFile();
+
+    // Lays out a complete file in memory.
+    static std::vector<BYTE> Serialize(UINT64 key, const MeshBatchBuilder& batch);
+
+    // Writes an image made by Serialize.  Returns false if the file could not be
+    // written, which only costs the next launch a regeneration.
+    static bool Write(const std::wstring& fileName, const std::vector<BYTE>& image);
+
+    // Maps the file.  Returns false if it is missing, truncated, of another
+    // version, or was generated with another key.
+    bool Open(const std::wstring& fileName, UINT64 key);
+
+    // Adopts an image made by Serialize, for when the file cannot be written.
+    bool Open(std::vector<BYTE>&& image, UINT64 key);
+
+    void Close();
+
+    bool IsOpen()const { return mData != nullptr; }
+
+    UINT PageCount()const;
+
+    UINT VertexByteStride()const;
+    UINT AttributeByteStride()const;
+
+    const void* VertexData(UINT page)const;
+    UINT VertexCount(UINT page)const;
+    UINT VertexByteSize(UINT page)const;
+
+    // The second vertex stream.  Empty for interleaved vertices.
+    const void* AttributeData(UINT page)const;
+    UINT AttributeByteSize(UINT page)const;
+
+    const void* IndexData(UINT page)const;
+    UINT IndexCount(UINT page)const;
+    DXGI_FORMAT IndexFormat(UINT page)const;
+    UINT IndexByteSize(UINT page)const;
+
+    // The page's meshlets in the buffer layout of Meshlets.h.  Empty for pages
+    // without meshlets.
+    const void* MeshletBufferData(UINT page)const;
+    UINT MeshletCount(UINT page)const;
+    MeshletBufferLayout GetMeshletBufferLayout(UINT page)const;
+
+    // Adds the submesh table to submeshes.
+    void GetSubmeshes(Registry<MeshBatchBuilder::Submesh>& submeshes)const;
+
+private:
+    struct Header;
+    struct PageRecord;
+    struct SubmeshRecord;
+
+    bool Validate(UINT64 key);
+    const Header& GetHeader()const;
+    const PageRecord& GetPage(UINT page)const;
+
+private:
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+
+    std::vector<BYTE> mImage;
+
+    const BYTE* mData = nullptr;
+    UINT64 mByteSize = 0;
+};
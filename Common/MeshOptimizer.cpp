@@ -0,0 +1,325 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+using namespace DirectX;
+
+MeshOptimizer::Stats MeshOptimizer::Optimize(GeometryGenerator::MeshData& mesh, const Options& options)
+{
+    Stats stats;
+    stats.VerticesBefore = (uint32)mesh.Vertices.size();
+    stats.AcmrBefore = ComputeAcmr(mesh.Indices32, stats.VerticesBefore, options.CacheSize);
+
+    WeldVertices(mesh, options.WeldPositionsOnly);
+
+    std::vector<uint32> clusterStarts;
+    std::vector<uint32> triangleOrder = Tipsify(mesh.Indices32, (uint32)mesh.Vertices.size(),
+        options.CacheSize, clusterStarts);
+
+    if(options.OptimizeOverdraw)
+        triangleOrder = SortClustersForOverdraw(mesh, triangleOrder, clusterStarts);
+
+    std::vector<uint32> indices(mesh.Indices32.size());
+    for(size_t i = 0; i < triangleOrder.size(); ++i)
+    {
+        uint32 t = triangleOrder[i];
+        indices[i*3 + 0] = mesh.Indices32[t*3 + 0];
+        indices[i*3 + 1] = mesh.Indices32[t*3 + 1];
+        indices[i*3 + 2] = mesh.Indices32[t*3 + 2];
+    }
+    mesh.Indices32.swap(indices);
+
+    OptimizeVertexFetch(mesh);
+
+    stats.VerticesAfter = (uint32)mesh.Vertices.size();
+    stats.AcmrAfter = ComputeAcmr(mesh.Indices32, stats.VerticesAfter, options.CacheSize);
+
+    return stats;
+}
+
+float MeshOptimizer::ComputeAcmr(const std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize)
+{
+    if(indices.size() < 3)
+        return 0.0f;
+
+    // Time each vertex was last put in the FIFO.  A vertex is a hit while fewer
+    // than cacheSize misses happened since then.
+    std::vector<uint32> insertedAt(vertexCount, 0);
+    std::vector<bool> cached(vertexCount, false);
+    uint32 misses = 0;
+
+    for(uint32 v : indices)
+    {
+        if(!cached[v] || misses - insertedAt[v] >= cacheSize)
+        {
+            cached[v] = true;
+            insertedAt[v] = misses++;
+        }
+    }
+
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+void MeshOptimizer::WeldVertices(GeometryGenerator::MeshData& mesh, bool positionsOnly)
+{
+    // Floats that compare equal must give equal keys, so -0 is folded into +0.
+    const size_t floatCount = positionsOnly ? 3 : sizeof(GeometryGenerator::Vertex) / sizeof(float);
+
+    std::unordered_map<std::string, uint32> unique;
+    std::vector<GeometryGenerator::Vertex> vertices;
+    std::vector<uint32> remap(mesh.Vertices.size());
+
+    std::string key(floatCount * sizeof(float), '\0');
+    for(size_t i = 0; i < mesh.Vertices.size(); ++i)
+    {
+        const float* src = reinterpret_cast<const float*>(&mesh.Vertices[i]);
+        for(size_t j = 0; j < floatCount; ++j)
+        {
+            float f = src[j] + 0.0f;
+            memcpy(&key[j*sizeof(float)], &f, sizeof(float));
+        }
+
+        auto inserted = unique.insert({ key, (uint32)vertices.size() });
+        if(inserted.second)
+            vertices.push_back(mesh.Vertices[i]);
+
+        remap[i] = inserted.first->second;
+    }
+
+    for(uint32& index : mesh.Indices32)
+        index = remap[index];
+
+    mesh.Vertices.swap(vertices);
+}
+
+std::vector<MeshOptimizer::uint32> MeshOptimizer::Tipsify(const std::vector<uint32>& indices, uint32 vertexCount,
+    uint32 cacheSize, std::vector<uint32>& clusterStarts)
+{
+    const uint32 triangleCount = (uint32)(indices.size() / 3);
+
+    // Triangles using each vertex, as offsets into one array.
+    std::vector<uint32> adjacencyOffsets(vertexCount + 1, 0);
+    for(uint32 v : indices)
+        adjacencyOffsets[v + 1]++;
+    for(uint32 v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+    std::vector<uint32> adjacency(indices.size());
+    std::vector<uint32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for(uint32 t = 0; t < triangleCount; ++t)
+    {
+        for(uint32 k = 0; k < 3; ++k)
+            adjacency[fill[indices[t*3 + k]]++] = t;
+    }
+
+    // Triangles not yet emitted that use each vertex.
+    std::vector<uint32> liveTriangles(vertexCount);
+    for(uint32 v = 0; v < vertexCount; ++v)
+        liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+
+    std::vector<uint32> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32> deadEnd;
+    std::vector<uint32> candidates;
+
+    std::vector<uint32> order;
+    order.reserve(triangleCount);
+    clusterStarts.clear();
+
+    uint32 timeStamp = cacheSize + 1;
+    uint32 cursor = 0;
+    int fanning = vertexCount > 0 ? 0 : -1;
+    bool restarted = true;
+
+    while(fanning >= 0)
+    {
+        // Emit every live triangle around the fanning vertex.
+        candidates.clear();
+        for(uint32 a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a)
+        {
+            uint32 t = adjacency[a];
+            if(emitted[t])
+                continue;
+
+            if(restarted)
+            {
+                clusterStarts.push_back((uint32)order.size());
+                restarted = false;
+            }
+
+            order.push_back(t);
+            emitted[t] = true;
+
+            for(uint32 k = 0; k < 3; ++k)
+            {
+                uint32 v = indices[t*3 + k];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+
+                // Not in the cache any more, so this fetch puts it back.
+                if(timeStamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timeStamp++;
+            }
+        }
+
+        // Next fanning vertex: the candidate that stays in the cache the longest
+        // while we fan around it, if any will.
+        int next = -1;
+        int bestPriority = -1;
+        for(uint32 v : candidates)
+        {
+            if(liveTriangles[v] == 0)
+                continue;
+
+            int priority = 0;
+            if(timeStamp - cacheTime[v] + 2*liveTriangles[v] <= cacheSize)
+                priority = (int)(timeStamp - cacheTime[v]);
+
+            if(priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = (int)v;
+            }
+        }
+
+        if(next == -1)
+        {
+            // Dead end.  Go back to a recently used vertex that still has live
+            // triangles, and failing that, scan for any such vertex.
+            while(!deadEnd.empty() && next == -1)
+            {
+                uint32 v = deadEnd.back();
+                deadEnd.pop_back();
+                if(liveTriangles[v] > 0)
+                    next = (int)v;
+            }
+
+            while(next == -1 && cursor < vertexCount)
+            {
+                if(liveTriangles[cursor] > 0)
+                    next = (int)cursor;
+                ++cursor;
+            }
+
+            restarted = true;
+        }
+
+        fanning = next;
+    }
+
+    return order;
+}
+
+std::vector<MeshOptimizer::uint32> MeshOptimizer::SortClustersForOverdraw(const GeometryGenerator::MeshData& mesh,
+    const std::vector<uint32>& triangleOrder, const std::vector<uint32>& clusterStarts)
+{
+    struct Cluster
+    {
+        uint32 Begin;
+        uint32 End;
+        float Score;
+    };
+
+    auto position = [&](uint32 t, uint32 k) -> XMFLOAT3
+    {
+        return mesh.Vertices[mesh.Indices32[t*3 + k]].Position;
+    };
+
+    // Mesh centroid, from the vertices the triangles use.
+    float mx = 0.0f, my = 0.0f, mz = 0.0f;
+    for(uint32 index : mesh.Indices32)
+    {
+        const XMFLOAT3& p = mesh.Vertices[index].Position;
+        mx += p.x; my += p.y; mz += p.z;
+    }
+    float invCount = mesh.Indices32.empty() ? 0.0f : 1.0f / (float)mesh.Indices32.size();
+    mx *= invCount; my *= invCount; mz *= invCount;
+
+    // Clusters facing away from the centroid are likely to occlude the rest of
+    // the mesh, so they are drawn first (Sander et al., section 4).
+    std::vector<Cluster> clusters;
+    for(size_t c = 0; c < clusterStarts.size(); ++c)
+    {
+        Cluster cluster;
+        cluster.Begin = clusterStarts[c];
+        cluster.End = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : (uint32)triangleOrder.size();
+
+        float cx = 0.0f, cy = 0.0f, cz = 0.0f;
+        float nx = 0.0f, ny = 0.0f, nz = 0.0f;
+        float area = 0.0f;
+        for(uint32 i = cluster.Begin; i < cluster.End; ++i)
+        {
+            uint32 t = triangleOrder[i];
+            XMFLOAT3 p0 = position(t, 0), p1 = position(t, 1), p2 = position(t, 2);
+
+            float ex = p1.x - p0.x, ey = p1.y - p0.y, ez = p1.z - p0.z;
+            float fx = p2.x - p0.x, fy = p2.y - p0.y, fz = p2.z - p0.z;
+
+            // Cross product, twice the area in length, whichever the winding.
+            float x = ey*fz - ez*fy, y = ez*fx - ex*fz, z = ex*fy - ey*fx;
+            float a = std::sqrt(x*x + y*y + z*z);
+
+            nx += x; ny += y; nz += z;
+            cx += a*(p0.x + p1.x + p2.x) / 3.0f;
+            cy += a*(p0.y + p1.y + p2.y) / 3.0f;
+            cz += a*(p0.z + p1.z + p2.z) / 3.0f;
+            area += a;
+        }
+
+        float length = std::sqrt(nx*nx + ny*ny + nz*nz);
+        if(area > 0.0f && length > 0.0f)
+        {
+            cx /= area; cy /= area; cz /= area;
+            cluster.Score = ((cx - mx)*nx + (cy - my)*ny + (cz - mz)*nz) / length;
+        }
+        else
+        {
+            cluster.Score = 0.0f;
+        }
+
+        clusters.push_back(cluster);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(),
+        [](const Cluster& a, const Cluster& b) { return a.Score > b.Score; });
+
+    std::vector<uint32> order;
+    order.reserve(triangleOrder.size());
+    for(const Cluster& cluster : clusters)
+        order.insert(order.end(), triangleOrder.begin() + cluster.Begin, triangleOrder.begin() + cluster.End);
+
+    return order;
+}
+
+void MeshOptimizer::OptimizeVertexFetch(GeometryGenerator::MeshData& mesh)
+{
+    // Number the vertices in the order the index buffer first uses them, which
+    // makes the fetches walk the vertex buffer sequentially.  Vertices no
+    // triangle uses are dropped.
+    const uint32 unused = 0xffffffff;
+    std::vector<uint32> remap(mesh.Vertices.size(), unused);
+    std::vector<GeometryGenerator::Vertex> vertices;
+    vertices.reserve(mesh.Vertices.size());
+
+    for(uint32& index : mesh.Indices32)
+    {
+        if(remap[index] == unused)
+        {
+            remap[index] = (uint32)vertices.size();
+            vertices.push_back(mesh.Vertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    mesh.Vertices.swap(vertices);
+}
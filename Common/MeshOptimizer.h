@@ -0,0 +1,59 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Optional build-time pass over GeometryGenerator output.  Welds duplicate vertices,
+// reorders triangles for the post-transform vertex cache (Tipsify, Sander et al.
+// 2007) and then orders the resulting clusters to reduce overdraw, and finally
+// renumbers the vertices in the order they are first fetched.
+//***************************************************************************************
+
+#pragma once
+
+#include "GeometryGenerator.h"
+
+class MeshOptimizer
+{
+public:
+    using uint32 = GeometryGenerator::uint32;
+
+    struct Options
+    {
+        // Weld vertices that share a position even if their other attributes
+        // differ.  Only for consumers that read nothing but positions.
+        bool WeldPositionsOnly = false;
+
+        // Entries of the vertex cache the triangle order is tuned for.
+        uint32 CacheSize = 16;
+
+        bool OptimizeOverdraw = true;
+    };
+
+    struct Stats
+    {
+        uint32 VerticesBefore = 0;
+        uint32 VerticesAfter = 0;
+
+        // Average cache miss ratio: vertex shader invocations per triangle with a
+        // FIFO cache of Options::CacheSize entries.  0.5 is the ideal for large
+        // regular meshes, 3 the worst case.
+        float AcmrBefore = 0.0f;
+        float AcmrAfter = 0.0f;
+    };
+
+    static Stats Optimize(GeometryGenerator::MeshData& mesh, const Options& options);
+
+    static float ComputeAcmr(const std::vector<uint32>& indices, uint32 vertexCount, uint32 cacheSize);
+
+private:
+    static void WeldVertices(GeometryGenerator::MeshData& mesh, bool positionsOnly);
+
+    // Returns the triangle order and, in clusterStarts, the first triangle of each
+    // run of triangles the algorithm emitted without restarting.
+    static std::vector<uint32> Tipsify(const std::vector<uint32>& indices, uint32 vertexCount,
+        uint32 cacheSize, std::vector<uint32>& clusterStarts);
+
+    static std::vector<uint32> SortClustersForOverdraw(const GeometryGenerator::MeshData& mesh,
+        const std::vector<uint32>& triangleOrder, const std::vector<uint32>& clusterStarts);
+
+    static void OptimizeVertexFetch(GeometryGenerator::MeshData& mesh);
+};
@@ -0,0 +1,172 @@
+//***************************************************************************************
+// Meshlets.cpp
+//***************************************************************************************
+
+#include "Meshlets.h"
+
+using namespace DirectX;
+
+static_assert(sizeof(Meshlet) == 16, "Meshlet must match the HLSL layout.");
+static_assert(sizeof(MeshletCullData) == 32, "MeshletCullData must match the HLSL layout.");
+
+namespace
+{
+    inline UINT64 AlignUp(UINT64 value)
+    {
+        return (value + 15) & ~15ull;
+    }
+
+    inline XMVECTOR LoadPosition(const BYTE* positions, UINT positionStride, UINT index)
+    {
+        return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(positions + (size_t)index*positionStride));
+    }
+
+    MeshletCullData ComputeCullData(const BYTE* positions, UINT positionStride,
+        const Meshlet& meshlet, const MeshletData& data, std::vector<XMFLOAT3>& points)
+    {
+        const UINT* vertexIndices = data.VertexIndices.data() + meshlet.VertexOffset;
+
+        points.resize(meshlet.VertexCount);
+        for(UINT i = 0; i < meshlet.VertexCount; ++i)
+            XMStoreFloat3(&points[i], LoadPosition(positions, positionStride, vertexIndices[i]));
+
+        BoundingSphere sphere;
+        BoundingSphere::CreateFromPoints(sphere, points.size(), points.data(), sizeof(XMFLOAT3));
+
+        // Clockwise triangles are front facing, and the left-handed cross product
+        // of their edges points out of the front.
+        XMVECTOR normals[MeshletMaxPrimitives];
+        UINT normalCount = 0;
+        XMVECTOR sum = XMVectorZero();
+        for(UINT i = 0; i < meshlet.PrimitiveCount; ++i)
+        {
+            UINT primitive = data.Primitives[meshlet.PrimitiveOffset + i];
+            XMVECTOR p0 = XMLoadFloat3(&points[primitive & 0xff]);
+            XMVECTOR p1 = XMLoadFloat3(&points[(primitive >> 8) & 0xff]);
+            XMVECTOR p2 = XMLoadFloat3(&points[(primitive >> 16) & 0xff]);
+
+            // Degenerate triangles are never drawn, so they do not widen the cone.
+            XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+            if(XMVectorGetX(XMVector3LengthSq(n)) < 1e-12f)
+                continue;
+
+            n = XMVector3Normalize(n);
+            normals[normalCount++] = n;
+            sum += n;
+        }
+
+        MeshletCullData cull;
+        cull.Center = sphere.Center;
+        cull.Radius = sphere.Radius;
+        cull.ConeAxis = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        cull.ConeCutoff = 1.0f;
+
+        if(normalCount == 0 || XMVectorGetX(XMVector3LengthSq(sum)) < 1e-12f)
+            return cull;
+
+        // Every normal lies within the angle acos(minDot) of the axis, so the
+        // meshlet faces away from any view direction within 90 degrees less of it.
+        XMVECTOR axis = XMVector3Normalize(sum);
+        float minDot = 1.0f;
+        for(UINT i = 0; i < normalCount; ++i)
+            minDot = std::min<float>(minDot, XMVectorGetX(XMVector3Dot(axis, normals[i])));
+
+        XMStoreFloat3(&cull.ConeAxis, axis);
+        if(minDot > 0.0f)
+            cull.ConeCutoff = sqrtf(1.0f - minDot*minDot);
+
+        return cull;
+    }
+}
+
+UINT BuildMeshlets(const XMFLOAT3* positions, UINT positionStride, UINT vertexCount,
+    const std::uint32_t* indices, UINT indexCount, MeshletData& data)
+{
+    const BYTE* src = reinterpret_cast<const BYTE*>(positions);
+    const UINT firstMeshlet = (UINT)data.Meshlets.size();
+
+    // Index of each vertex in the meshlet being filled, if it is in it.
+    const UINT NotInMeshlet = 0xffffffff;
+    std::vector<UINT> localIndices(vertexCount, NotInMeshlet);
+    std::vector<XMFLOAT3> points;
+
+    Meshlet meshlet = { 0, (UINT)data.VertexIndices.size(), 0, (UINT)data.Primitives.size() };
+
+    auto finishMeshlet = [&]()
+    {
+        if(meshlet.PrimitiveCount == 0)
+            return;
+
+        for(UINT i = 0; i < meshlet.VertexCount; ++i)
+            localIndices[data.VertexIndices[meshlet.VertexOffset + i]] = NotInMeshlet;
+
+        data.Meshlets.push_back(meshlet);
+        data.CullData.push_back(ComputeCullData(src, positionStride, meshlet, data, points));
+
+        meshlet = { 0, (UINT)data.VertexIndices.size(), 0, (UINT)data.Primitives.size() };
+    };
+
+    for(UINT i = 0; i + 2 < indexCount; i += 3)
+    {
+        const std::uint32_t* triangle = indices + i;
+
+        UINT newVertexCount = 0;
+        for(UINT k = 0; k < 3; ++k)
+        {
+            if(localIndices[triangle[k]] == NotInMeshlet)
+                ++newVertexCount;
+        }
+
+        if(meshlet.VertexCount + newVertexCount > MeshletMaxVertices ||
+           meshlet.PrimitiveCount == MeshletMaxPrimitives)
+        {
+            finishMeshlet();
+        }
+
+        UINT primitive = 0;
+        for(UINT k = 0; k < 3; ++k)
+        {
+            UINT& localIndex = localIndices[triangle[k]];
+            if(localIndex == NotInMeshlet)
+            {
+                localIndex = meshlet.VertexCount++;
+                data.VertexIndices.push_back(triangle[k]);
+            }
+
+            primitive |= localIndex << (8*k);
+        }
+
+        data.Primitives.push_back(primitive);
+        meshlet.PrimitiveCount++;
+    }
+
+    finishMeshlet();
+
+    return firstMeshlet;
+}
+
+MeshletBufferLayout GetMeshletBufferLayout(UINT meshletCount, UINT vertexIndexCount, UINT primitiveCount)
+{
+    MeshletBufferLayout layout;
+    layout.CullDataOffset = AlignUp((UINT64)meshletCount*sizeof(Meshlet));
+    layout.VertexIndexOffset = AlignUp(layout.CullDataOffset + (UINT64)meshletCount*sizeof(MeshletCullData));
+    layout.PrimitiveOffset = AlignUp(layout.VertexIndexOffset + (UINT64)vertexIndexCount*sizeof(UINT));
+    layout.ByteSize = AlignUp(layout.PrimitiveOffset + (UINT64)primitiveCount*sizeof(UINT));
+
+    return layout;
+}
+
+void WriteMeshletBuffer(const MeshletData& data, BYTE* dst)
+{
+    MeshletBufferLayout layout = GetMeshletBufferLayout((UINT)data.Meshlets.size(),
+        (UINT)data.VertexIndices.size(), (UINT)data.Primitives.size());
+
+    memset(dst, 0, (size_t)layout.ByteSize);
+    if(!data.Meshlets.empty())
+    {
+        memcpy(dst, data.Meshlets.data(), data.Meshlets.size()*sizeof(Meshlet));
+        memcpy(dst + layout.CullDataOffset, data.CullData.data(), data.CullData.size()*sizeof(MeshletCullData));
+        memcpy(dst + layout.VertexIndexOffset, data.VertexIndices.data(), data.VertexIndices.size()*sizeof(UINT));
+        memcpy(dst + layout.PrimitiveOffset, data.Primitives.data(), data.Primitives.size()*sizeof(UINT));
+    }
+}
@@ -0,0 +1,73 @@
+//***************************************************************************************
+// Meshlets.h
+//
+// Splits indexed triangle lists into meshlets: clusters of at most
+// MeshletMaxVertices vertices and MeshletMaxPrimitives triangles, each drawn by
+// one mesh shader thread group.  Every meshlet keeps a bounding sphere and a cone
+// around the normals of its triangles, so an amplification shader can drop the
+// meshlets that are outside the frustum or face away from the eye.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <cstdint>
+
+// Limits of a meshlet.  Must match Shaders/meshlet.hlsl.
+const UINT MeshletMaxVertices = 64;
+const UINT MeshletMaxPrimitives = 126;
+
+// Ranges of a meshlet in the vertex index and primitive arrays of its
+// MeshletData.  Must match Meshlet in Shaders/meshlet.hlsl.
+struct Meshlet
+{
+    UINT VertexCount;
+    UINT VertexOffset;
+    UINT PrimitiveCount;
+    UINT PrimitiveOffset;
+};
+
+// Object space bounds and normal cone of a meshlet.  Every triangle faces away
+// from an eye at e when dot(Center - e, ConeAxis) >= ConeCutoff*|Center - e| + Radius.
+// ConeCutoff is 1 when the normals are too spread out for that to ever hold.
+// Must match MeshletCullData in Shaders/meshlet.hlsl.
+struct MeshletCullData
+{
+    DirectX::XMFLOAT3 Center;
+    float Radius;
+    DirectX::XMFLOAT3 ConeAxis;
+    float ConeCutoff;
+};
+
+// The meshlets of any number of meshes.  The vertex indices are relative to the
+// mesh's first vertex, like its index buffer indices, and each primitive packs
+// the three meshlet local vertex indices of a triangle into the low three bytes.
+struct MeshletData
+{
+    std::vector<Meshlet> Meshlets;
+    std::vector<MeshletCullData> CullData;
+    std::vector<UINT> VertexIndices;
+    std::vector<UINT> Primitives;
+};
+
+// Byte offsets of the arrays of a MeshletData laid out back to back in one
+// buffer, meshlets first, each 16 byte aligned.
+struct MeshletBufferLayout
+{
+    UINT64 CullDataOffset = 0;
+    UINT64 VertexIndexOffset = 0;
+    UINT64 PrimitiveOffset = 0;
+    UINT64 ByteSize = 0;
+};
+
+// Appends the meshlets of a triangle list to data, walking the triangles in
+// index order, so a list optimized for the vertex cache gives compact meshlets.
+// Returns the index of the first meshlet appended.
+UINT BuildMeshlets(const DirectX::XMFLOAT3* positions, UINT positionStride, UINT vertexCount,
+    const std::uint32_t* indices, UINT indexCount, MeshletData& data);
+
+MeshletBufferLayout GetMeshletBufferLayout(UINT meshletCount, UINT vertexIndexCount, UINT primitiveCount);
+
+// Writes data in the layout GetMeshletBufferLayout gives to dst, which holds
+// ByteSize bytes.
+void WriteMeshletBuffer(const MeshletData& data, BYTE* dst);
@@ -0,0 +1,299 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // FNV-1a over everything in a PSO description that the library matches on,
+    // following the pointers to the shaders and the input layout.  The root
+    // signature is only compared by the library itself, and an entry that fails
+    // that comparison is healed by the next Save.
+    class DescHash
+    {
+    public:
+        void Add(const void* data, size_t byteSize)
+        {
+            const BYTE* bytes = static_cast<const BYTE*>(data);
+            for(size_t i = 0; i < byteSize; ++i)
+            {
+                mHash ^= bytes[i];
+                mHash *= 1099511628211ull;
+            }
+        }
+
+        template<typename T>
+        void Add(const T& value)
+        {
+            Add(&value, sizeof(T));
+        }
+
+        void Add(const D3D12_SHADER_BYTECODE& shader)
+        {
+            Add(shader.BytecodeLength);
+            Add(shader.pShaderBytecode, shader.BytecodeLength);
+        }
+
+        std::wstring Suffix()const
+        {
+            std::wostringstream text;
+            text << L"_" << std::hex << std::setw(16) << std::setfill(L'0') << mHash;
+            return text.str();
+        }
+
+    private:
+        UINT64 mHash = 14695981039346656037ull;
+    };
+
+    std::wstring GraphicsKey(const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+    {
+        DescHash hash;
+        hash.Add(desc.VS);
+        hash.Add(desc.PS);
+        hash.Add(desc.DS);
+        hash.Add(desc.HS);
+        hash.Add(desc.GS);
+        hash.Add(desc.StreamOutput.NumEntries);
+        hash.Add(desc.BlendState);
+        hash.Add(desc.SampleMask);
+        hash.Add(desc.RasterizerState);
+        hash.Add(desc.DepthStencilState);
+
+        for(UINT i = 0; i < desc.InputLayout.NumElements; ++i)
+        {
+            D3D12_INPUT_ELEMENT_DESC element = desc.InputLayout.pInputElementDescs[i];
+            hash.Add(element.SemanticName, strlen(element.SemanticName) + 1);
+            element.SemanticName = nullptr;
+            hash.Add(element);
+        }
+
+        hash.Add(desc.IBStripCutValue);
+        hash.Add(desc.PrimitiveTopologyType);
+        hash.Add(desc.NumRenderTargets);
+        hash.Add(desc.RTVFormats);
+        hash.Add(desc.DSVFormat);
+        hash.Add(desc.SampleDesc);
+        hash.Add(desc.NodeMask);
+        hash.Add(desc.Flags);
+
+        return name + hash.Suffix();
+    }
+
+    std::wstring ComputeKey(const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+    {
+        DescHash hash;
+        hash.Add(desc.CS);
+        hash.Add(desc.NodeMask);
+        hash.Add(desc.Flags);
+
+        return name + hash.Suffix();
+    }
+}
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& fileStem) :
+    md3dDevice(device)
+{
+    // Name the file after the adapter and the version of its user mode driver.
+    std::wostringstream fileName;
+    fileName << fileStem;
+
+    ComPtr<IDXGIFactory4> factory;
+    ComPtr<IDXGIAdapter> adapter;
+    if(SUCCEEDED(CreateDXGIFactory1(IID_PPV_ARGS(&factory))) &&
+       SUCCEEDED(factory->EnumAdapterByLuid(device->GetAdapterLuid(), IID_PPV_ARGS(&adapter))))
+    {
+        DXGI_ADAPTER_DESC desc;
+        LARGE_INTEGER driverVersion = {};
+        adapter->GetDesc(&desc);
+        adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driverVersion);
+
+        fileName << std::hex << L"_" << desc.VendorId << L"_" << desc.DeviceId << std::dec <<
+            L"_" << HIWORD(driverVersion.HighPart) << L"." << LOWORD(driverVersion.HighPart) <<
+            L"." << HIWORD(driverVersion.LowPart) << L"." << LOWORD(driverVersion.LowPart);
+    }
+
+    fileName << L".psolib";
+    mFileName = fileName.str();
+
+    OpenLibrary();
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateGraphicsPipelineState(
+    const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+    ComPtr<ID3D12PipelineState> pso;
+    std::wstring key = GraphicsKey(name, desc);
+
+    // Loaded through a reference of its own, since Save may replace the library
+    // meanwhile.
+    ComPtr<ID3D12PipelineLibrary> library = Library();
+    if(library != nullptr && SUCCEEDED(library->LoadGraphicsPipeline(key.c_str(), &desc, IID_PPV_ARGS(&pso))))
+    {
+        mHitCount++;
+        Remember(key, pso.Get());
+        return pso;
+    }
+
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+    mMissCount++;
+
+    Store(key, pso.Get());
+    return pso;
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::CreateComputePipelineState(
+    const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+    ComPtr<ID3D12PipelineState> pso;
+    std::wstring key = ComputeKey(name, desc);
+
+    // Loaded through a reference of its own, since Save may replace the library
+    // meanwhile.
+    ComPtr<ID3D12PipelineLibrary> library = Library();
+    if(library != nullptr && SUCCEEDED(library->LoadComputePipeline(key.c_str(), &desc, IID_PPV_ARGS(&pso))))
+    {
+        mHitCount++;
+        Remember(key, pso.Get());
+        return pso;
+    }
+
+    ThrowIfFailed(md3dDevice->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso)));
+    mMissCount++;
+
+    Store(key, pso.Get());
+    return pso;
+}
+
+bool PipelineCache::Save()
+{
+    std::lock_guard<std::mutex> lock(mStoreMutex);
+
+    if(mLibrary == nullptr || !mIsDirty)
+        return true;
+
+    if(mIsStale && !RebuildLibrary())
+        return false;
+
+    std::vector<BYTE> data(mLibrary->GetSerializedSize());
+    if(FAILED(mLibrary->Serialize(data.data(), data.size())))
+        return false;
+
+    // Write to a temporary file and move it over the old one, so a crash mid-write
+    // never leaves a truncated library behind.
+    std::wstring tempName = mFileName + L".tmp";
+    {
+        std::ofstream fout(tempName, std::ios::binary | std::ios::trunc);
+        fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if(!fout)
+            return false;
+    }
+
+    if(!MoveFileExW(tempName.c_str(), mFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tempName.c_str());
+        return false;
+    }
+
+    mIsDirty = false;
+    return true;
+}
+
+void PipelineCache::OpenLibrary()
+{
+    ComPtr<ID3D12Device1> device1;
+    if(FAILED(md3dDevice.As(&device1)))
+        return;
+
+    std::ifstream fin(mFileName, std::ios::binary);
+    if(fin)
+    {
+        fin.seekg(0, std::ios_base::end);
+        mLibraryData.resize((size_t)fin.tellg());
+        fin.seekg(0, std::ios_base::beg);
+        fin.read(reinterpret_cast<char*>(mLibraryData.data()), mLibraryData.size());
+
+        if(!fin || mLibraryData.empty())
+            mLibraryData.clear();
+    }
+
+    // A library from another driver or a damaged file is dropped, and an empty
+    // library started in its place.
+    if(!mLibraryData.empty() &&
+       SUCCEEDED(device1->CreatePipelineLibrary(mLibraryData.data(), mLibraryData.size(), IID_PPV_ARGS(&mLibrary))))
+    {
+        return;
+    }
+
+    mLibraryData.clear();
+    mLibraryData.shrink_to_fit();
+    if(FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+        mLibrary = nullptr;
+}
+
+ComPtr<ID3D12PipelineLibrary> PipelineCache::Library()
+{
+    std::lock_guard<std::mutex> lock(mStoreMutex);
+    return mLibrary;
+}
+
+void PipelineCache::Store(const std::wstring& key, ID3D12PipelineState* pso)
+{
+    std::lock_guard<std::mutex> lock(mStoreMutex);
+    if(mLibrary == nullptr)
+        return;
+
+    mPipelines.emplace_back(key, pso);
+
+    // Fails if another thread stored the same PSO first, which is harmless.  A key
+    // taken by nothing stored this launch is a stale entry of the file, which the
+    // library can not overwrite.
+    if(SUCCEEDED(mLibrary->StorePipeline(key.c_str(), pso)))
+    {
+        mStoredKeys.insert(key);
+        mIsDirty = true;
+    }
+    else if(mStoredKeys.count(key) == 0)
+    {
+        mIsStale = true;
+        mIsDirty = true;
+    }
+}
+
+void PipelineCache::Remember(const std::wstring& key, ID3D12PipelineState* pso)
+{
+    std::lock_guard<std::mutex> lock(mStoreMutex);
+    if(mLibrary == nullptr)
+        return;
+
+    mPipelines.emplace_back(key, pso);
+}
+
+bool PipelineCache::RebuildLibrary()
+{
+    // Stores this launch's PSOs into an empty library, which replaces the loaded
+    // one.  PSOs of the file that were not used this launch are dropped with it.
+    ComPtr<ID3D12Device1> device1;
+    ComPtr<ID3D12PipelineLibrary> library;
+    if(FAILED(md3dDevice.As(&device1)) ||
+       FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&library))))
+    {
+        return false;
+    }
+
+    mStoredKeys.clear();
+    for(const auto& pipeline : mPipelines)
+    {
+        if(SUCCEEDED(library->StorePipeline(pipeline.first.c_str(), pipeline.second.Get())))
+            mStoredKeys.insert(pipeline.first);
+    }
+
+    mLibrary = library;
+    mIsStale = false;
+    return true;
+}
@@ -0,0 +1,76 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Creates pipeline state objects through an ID3D12PipelineLibrary that is kept on
+// disk, so PSOs compiled by the driver on one launch are reloaded on the next
+// instead of being compiled again.  The file name carries the adapter's vendor and
+// device IDs and the driver version, so a driver update starts a library of its
+// own rather than failing to load an incompatible one.  An entry stored under a
+// key that no longer matches its PSO, such as one built with an older root
+// signature, can not be replaced in place, so Save writes a fresh library of this
+// launch's PSOs instead.  On runtimes without pipeline libraries the PSOs are
+// simply created.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+class PipelineCache
+{
+public:
+    PipelineCache(ID3D12Device* device, const std::wstring& fileStem);
+    PipelineCache(const PipelineCache& rhs) = delete;
+    PipelineCache& operator=(const PipelineCache& rhs) = delete;
+    ~PipelineCache() = default;
+
+    // Loads the PSO stored under name if its description is unchanged, and
+    // otherwise creates it and stores it in the library.  Safe to call from
+    // several threads at once.
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateGraphicsPipelineState(
+        const std::wstring& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> CreateComputePipelineState(
+        const std::wstring& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+    // Writes the library if PSOs were added to it.  Returns false if it could not
+    // be written, which only costs the next launch the compiles.
+    bool Save();
+
+    const std::wstring& FileName()const { return mFileName; }
+
+    // PSOs loaded from the library, and created because they were not in it.
+    UINT HitCount()const { return mHitCount; }
+    UINT MissCount()const { return mMissCount; }
+
+private:
+    void OpenLibrary();
+    Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> Library();
+    void Store(const std::wstring& key, ID3D12PipelineState* pso);
+    void Remember(const std::wstring& key, ID3D12PipelineState* pso);
+    bool RebuildLibrary();
+
+private:
+    Microsoft::WRL::ComPtr<ID3D12Device> md3dDevice;
+    Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+
+    std::wstring mFileName;
+
+    // The library reads its PSOs from this memory, so it lives as long as the library.
+    std::vector<BYTE> mLibraryData;
+
+    // Guards mLibrary, which Save may replace, and everything below.
+    std::mutex mStoreMutex;
+    bool mIsDirty = false;
+
+    // Every PSO created or loaded this launch, for rebuilding the library once an
+    // entry of the file turns out stale, and the keys stored into it this launch.
+    std::vector<std::pair<std::wstring, Microsoft::WRL::ComPtr<ID3D12PipelineState>>> mPipelines;
+    std::unordered_set<std::wstring> mStoredKeys;
+    bool mIsStale = false;
+
+    std::atomic<UINT> mHitCount{ 0 };
+    std::atomic<UINT> mMissCount{ 0 };
+};
@@ -0,0 +1,219 @@
+//***************************************************************************************
+// PsoManager.cpp
+//***************************************************************************************
+
+#include "PsoManager.h"
+
+using Microsoft::WRL::ComPtr;
+
+bool PsoKey::operator==(const PsoKey& rhs)const
+{
+    return Program == rhs.Program &&
+        FillMode == rhs.FillMode &&
+        CullMode == rhs.CullMode &&
+        DepthFunc == rhs.DepthFunc &&
+        RtvFormat == rhs.RtvFormat &&
+        DsvFormat == rhs.DsvFormat &&
+        SampleCount == rhs.SampleCount &&
+        SampleQuality == rhs.SampleQuality;
+}
+
+size_t PsoKeyHash::operator()(const PsoKey& key)const
+{
+    UINT64 values[] =
+    {
+        key.Program.Index(),
+        (UINT64)key.FillMode | ((UINT64)key.CullMode << 8) | ((UINT64)key.SampleCount << 16) | ((UINT64)key.DepthFunc << 24),
+        (UINT64)key.RtvFormat | ((UINT64)key.DsvFormat << 32),
+        key.SampleQuality
+    };
+
+    UINT64 hash = 14695981039346656037ull;
+    for(UINT64 value : values)
+    {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    }
+
+    return (size_t)hash;
+}
+
+PsoManager::PsoManager(PipelineCache* pipelineCache, d3dUtil::ShaderSource shaderSource, unsigned threadCount) :
+    mPipelineCache(pipelineCache),
+    mShaderSource(shaderSource),
+    mWorkers(std::make_unique<ThreadPool>(threadCount))
+{
+}
+
+PsoManager::~PsoManager()
+{
+    mIsStopping = true;
+    mWorkers = nullptr;
+}
+
+PsoManager::ProgramHandle PsoManager::AddProgram(const std::string& name, GraphicsProgram program)
+{
+    auto state = std::make_shared<ProgramState>();
+    state->Name = name;
+    state->Desc = program;
+
+    ProgramHandle handle = mPrograms.Add(name, std::move(program));
+    if(handle.Index() < mProgramStates.size())
+        mProgramStates[handle.Index()] = state;
+    else
+        mProgramStates.push_back(state);
+
+    return handle;
+}
+
+PsoManager::PsoFuture PsoManager::Request(const PsoKey& key)
+{
+    return FindOrRequest(key).Future;
+}
+
+ID3D12PipelineState* PsoManager::TryGet(const PsoKey& key)
+{
+    Entry& entry = FindOrRequest(key);
+    return IsReady(entry) ? entry.Ready : nullptr;
+}
+
+ID3D12PipelineState* PsoManager::Get(const PsoKey& key)
+{
+    Entry& entry = FindOrRequest(key);
+    if(entry.Ready == nullptr)
+        entry.Ready = entry.Future.get().Get();
+
+    return entry.Ready;
+}
+
+ID3D12PipelineState* PsoManager::GetOrFallback(const PsoKey& key, const PsoKey& fallback)
+{
+    Entry& entry = FindOrRequest(key);
+    if(IsReady(entry))
+        return entry.Ready;
+
+    Entry& fallbackEntry = FindOrRequest(fallback);
+    if(IsReady(fallbackEntry))
+        return fallbackEntry.Ready;
+
+    return Get(key);
+}
+
+PsoManager::Entry& PsoManager::FindOrRequest(const PsoKey& key)
+{
+    auto it = mEntries.find(key);
+    if(it != mEntries.end())
+        return it->second;
+
+    std::shared_ptr<ProgramState> program = mProgramStates[key.Program.Index()];
+
+    mPendingCount++;
+    std::future<ComPtr<ID3D12PipelineState>> future = mWorkers->Enqueue([this, program, key]()
+    {
+        ComPtr<ID3D12PipelineState> pso;
+        std::exception_ptr error;
+        try
+        {
+            if(!mIsStopping)
+                pso = Compile(*program, key);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+
+        // The last compile of a burst writes the library, off the thread that draws.
+        if(--mPendingCount == 0 && !mIsStopping)
+            mPipelineCache->Save();
+
+        if(error)
+            std::rethrow_exception(error);
+
+        return pso;
+    });
+
+    Entry& entry = mEntries[key];
+    entry.Future = future.share();
+    return entry;
+}
+
+bool PsoManager::IsReady(Entry& entry)
+{
+    if(entry.Ready != nullptr)
+        return true;
+
+    if(entry.Future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+
+    // Rethrows the error of a failed compile.
+    entry.Ready = entry.Future.get().Get();
+    return true;
+}
+
+ComPtr<ID3D12PipelineState> PsoManager::Compile(ProgramState& program, const PsoKey& key)
+{
+    const GraphicsProgram& desc = program.Desc;
+
+    std::call_once(program.ShadersLoaded, [&]()
+    {
+        const D3D_SHADER_MACRO* defines = desc.Defines.empty() ? nullptr : desc.Defines.data();
+
+        program.VS = d3dUtil::LoadShader(desc.Filename, defines, desc.VS, desc.VSTarget, mShaderSource);
+        if(!desc.PS.empty())
+            program.PS = d3dUtil::LoadShader(desc.Filename, defines, desc.PS, desc.PSTarget, mShaderSource);
+    });
+
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc;
+    ZeroMemory(&psoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
+    psoDesc.InputLayout = { desc.InputLayout.data(), (UINT)desc.InputLayout.size() };
+    psoDesc.pRootSignature = desc.RootSignature.Get();
+    psoDesc.VS =
+    {
+        reinterpret_cast<BYTE*>(program.VS->GetBufferPointer()),
+        program.VS->GetBufferSize()
+    };
+    if(program.PS != nullptr)
+    {
+        psoDesc.PS =
+        {
+            reinterpret_cast<BYTE*>(program.PS->GetBufferPointer()),
+            program.PS->GetBufferSize()
+        };
+    }
+    psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+    psoDesc.RasterizerState.FillMode = key.FillMode;
+    psoDesc.RasterizerState.CullMode = key.CullMode;
+    psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+    psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+    psoDesc.DepthStencilState.DepthFunc = key.DepthFunc;
+    psoDesc.SampleMask = UINT_MAX;
+    psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+    psoDesc.NumRenderTargets = key.RtvFormat != DXGI_FORMAT_UNKNOWN ? 1 : 0;
+    psoDesc.RTVFormats[0] = key.RtvFormat;
+    psoDesc.SampleDesc.Count = key.SampleCount;
+    psoDesc.SampleDesc.Quality = key.SampleQuality;
+    psoDesc.DSVFormat = key.DsvFormat;
+
+    return mPipelineCache->CreateGraphicsPipelineState(PsoName(program, key), psoDesc);
+}
+
+std::wstring PsoManager::PsoName(const ProgramState& program, const PsoKey& key)
+{
+    // The cache tells descriptions apart by their hash, so the name only has to
+    // keep the library readable.
+    std::wstring name = AnsiToWString(program.Name);
+    if(key.FillMode == D3D12_FILL_MODE_WIREFRAME)
+        name += L"_wireframe";
+    if(key.CullMode == D3D12_CULL_MODE_NONE)
+        name += L"_cullnone";
+    else if(key.CullMode == D3D12_CULL_MODE_FRONT)
+        name += L"_cullfront";
+    if(key.DepthFunc == D3D12_COMPARISON_FUNC_LESS_EQUAL)
+        name += L"_lessequal";
+    else if(key.DepthFunc != D3D12_COMPARISON_FUNC_LESS)
+        name += L"_depthfunc" + std::to_wstring(key.DepthFunc);
+    if(key.SampleCount > 1)
+        name += L"_msaa" + std::to_wstring(key.SampleCount);
+
+    return name;
+}
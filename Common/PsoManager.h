@@ -0,0 +1,140 @@
+//***************************************************************************************
+// PsoManager.h
+//
+// Builds graphics PSOs from a shader program and a small state key (fill mode, cull
+// mode, formats and multisampling) instead of hand-copied pipeline descriptions.
+// PSOs are compiled on worker threads of the manager's own, so a variant that is
+// requested for the first time never stalls a frame, and the program's shaders are
+// only loaded when the first PSO that uses them is compiled.  Requests, lookups and
+// AddProgram are made from one thread; only the compiles run on the workers.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "PipelineCache.h"
+#include "Registry.h"
+#include "ThreadPool.h"
+#include <atomic>
+
+// Shaders, root signature and input layout of a family of PSOs.  Defines is
+// terminated by a null entry, as for CompileShader.  The strings that Defines and
+// InputLayout point to must outlive the manager, as string literals do.
+struct GraphicsProgram
+{
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> InputLayout;
+
+    std::wstring Filename;
+    std::vector<D3D_SHADER_MACRO> Defines;
+
+    std::string VS;
+    std::string PS;
+    std::string VSTarget = "vs_5_1";
+    std::string PSTarget = "ps_5_1";
+};
+
+// Everything that tells the PSOs of a program apart.
+struct PsoKey
+{
+    Registry<GraphicsProgram>::Handle Program;
+
+    D3D12_FILL_MODE FillMode = D3D12_FILL_MODE_SOLID;
+    D3D12_CULL_MODE CullMode = D3D12_CULL_MODE_BACK;
+    D3D12_COMPARISON_FUNC DepthFunc = D3D12_COMPARISON_FUNC_LESS;
+
+    DXGI_FORMAT RtvFormat = DXGI_FORMAT_UNKNOWN;
+    DXGI_FORMAT DsvFormat = DXGI_FORMAT_UNKNOWN;
+    UINT SampleCount = 1;
+    UINT SampleQuality = 0;
+
+    bool operator==(const PsoKey& rhs)const;
+    bool operator!=(const PsoKey& rhs)const { return !(*this == rhs); }
+};
+
+struct PsoKeyHash
+{
+    size_t operator()(const PsoKey& key)const;
+};
+
+class PsoManager
+{
+public:
+    using ProgramHandle = Registry<GraphicsProgram>::Handle;
+    using PsoFuture = std::shared_future<Microsoft::WRL::ComPtr<ID3D12PipelineState>>;
+
+    PsoManager(PipelineCache* pipelineCache, d3dUtil::ShaderSource shaderSource, unsigned threadCount = 2);
+    PsoManager(const PsoManager& rhs) = delete;
+    PsoManager& operator=(const PsoManager& rhs) = delete;
+
+    // Compiles still queued are dropped; the ones running are waited for.
+    ~PsoManager();
+
+    ProgramHandle AddProgram(const std::string& name, GraphicsProgram program);
+
+    // Queues the PSO for compiling unless it was requested before.  Requests are
+    // compiled in the order they are made, so warm the likely variants after the
+    // ones the next frame needs.  An error in compiling is rethrown by the future.
+    PsoFuture Request(const PsoKey& key);
+
+    // The PSO if it has finished compiling, and otherwise nullptr.  Requests it.
+    ID3D12PipelineState* TryGet(const PsoKey& key);
+
+    // The PSO, waiting for it to compile if it has not yet.
+    ID3D12PipelineState* Get(const PsoKey& key);
+
+    // The PSO if it is ready, and otherwise the fallback PSO if that is, so a frame
+    // can draw with a related variant while the one it wants compiles.  Waits for
+    // the PSO if neither is ready.  The fallback must be drawable in its place: the
+    // same program, formats and multisampling.
+    ID3D12PipelineState* GetOrFallback(const PsoKey& key, const PsoKey& fallback);
+
+    // PSOs requested but not yet compiled.
+    UINT PendingCount()const { return mPendingCount; }
+
+private:
+    // A program and the bytecode of its shaders, loaded by the first compile that
+    // needs them.
+    struct ProgramState
+    {
+        std::string Name;
+        GraphicsProgram Desc;
+
+        std::once_flag ShadersLoaded;
+        Microsoft::WRL::ComPtr<ID3DBlob> VS;
+        Microsoft::WRL::ComPtr<ID3DBlob> PS;
+    };
+
+    struct Entry
+    {
+        PsoFuture Future;
+
+        // Set once the future has been seen to be ready, so later lookups of a
+        // compiled PSO skip the future.
+        ID3D12PipelineState* Ready = nullptr;
+    };
+
+    Entry& FindOrRequest(const PsoKey& key);
+    static bool IsReady(Entry& entry);
+
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> Compile(ProgramState& program, const PsoKey& key);
+    static std::wstring PsoName(const ProgramState& program, const PsoKey& key);
+
+private:
+    PipelineCache* mPipelineCache = nullptr;
+    d3dUtil::ShaderSource mShaderSource;
+
+    Registry<GraphicsProgram> mPrograms;
+
+    // A copy of each program, by handle index, that the workers compile from.
+    // Programs added later never move one out from under a worker.
+    std::vector<std::shared_ptr<ProgramState>> mProgramStates;
+
+    std::unordered_map<PsoKey, Entry, PsoKeyHash> mEntries;
+
+    std::atomic<UINT> mPendingCount{ 0 };
+    std::atomic<bool> mIsStopping{ false };
+
+    // Last, so the workers are joined before anything they use is destroyed.
+    std::unique_ptr<ThreadPool> mWorkers;
+};
@@ -0,0 +1,54 @@
+//***************************************************************************************
+// RadixSort.cpp
+//***************************************************************************************
+
+#include "RadixSort.h"
+#include <cstring>
+#include <utility>
+
+void RadixSort(std::vector<RadixSortEntry>& entries, std::vector<RadixSortEntry>& scratch)
+{
+    const size_t count = entries.size();
+    if(count < 2)
+        return;
+
+    scratch.resize(count);
+
+    // Histogram every byte in a single read of the keys.
+    size_t histograms[8][256];
+    std::memset(histograms, 0, sizeof(histograms));
+    for(const RadixSortEntry& e : entries)
+    {
+        for(int b = 0; b < 8; ++b)
+            histograms[b][(e.Key >> (8*b)) & 0xff]++;
+    }
+
+    RadixSortEntry* src = entries.data();
+    RadixSortEntry* dst = scratch.data();
+    for(int b = 0; b < 8; ++b)
+    {
+        size_t* histogram = histograms[b];
+
+        // Every key has the same byte here, so the pass would not move anything.
+        if(histogram[(src[0].Key >> (8*b)) & 0xff] == count)
+            continue;
+
+        // Turn the counts into the first position of each digit.
+        size_t offset = 0;
+        for(int digit = 0; digit < 256; ++digit)
+        {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+
+        for(size_t i = 0; i < count; ++i)
+            dst[histogram[(src[i].Key >> (8*b)) & 0xff]++] = src[i];
+
+        std::swap(src, dst);
+    }
+
+    // An odd number of passes leaves the result in the scratch buffer.
+    if(src != entries.data())
+        entries.swap(scratch);
+}
@@ -0,0 +1,23 @@
+//***************************************************************************************
+// RadixSort.h
+//
+// Least significant digit radix sort of 64-bit keys carrying a 32-bit value, such
+// as draw sort keys carrying the index of their draw.  It is stable and runs in
+// linear time.  A pass over a byte that every key shares is skipped, so keys whose
+// high bits hold state that rarely differs sort in few passes.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct RadixSortEntry
+{
+    std::uint64_t Key;
+    std::uint32_t Value;
+};
+
+// Sorts entries by ascending key.  scratch is resized to match and can be reused
+// between calls to save the allocation.
+void RadixSort(std::vector<RadixSortEntry>& entries, std::vector<RadixSortEntry>& scratch);
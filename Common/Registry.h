@@ -0,0 +1,119 @@
+//***************************************************************************************
+// Registry.h
+//
+// Named resources stored in a dense array and referred to by typed integer handles.
+// Names are resolved once, when the resource is loaded or looked up at build time;
+// using a handle afterwards is an array index with no hashing or string compares.
+//***************************************************************************************
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+template<typename T>
+class Registry
+{
+public:
+    // Index into the registry.  The value type is part of the handle type, so a
+    // handle of one registry can not be used with a registry of another type.
+    class Handle
+    {
+    public:
+        static const std::uint32_t InvalidIndex = 0xffffffff;
+
+        Handle() = default;
+
+        bool IsValid()const { return mIndex != InvalidIndex; }
+        std::uint32_t Index()const { return mIndex; }
+
+        bool operator==(const Handle& rhs)const { return mIndex == rhs.mIndex; }
+        bool operator!=(const Handle& rhs)const { return mIndex != rhs.mIndex; }
+
+    private:
+        friend class Registry;
+        explicit Handle(std::uint32_t index) : mIndex(index) {}
+
+        std::uint32_t mIndex = InvalidIndex;
+    };
+
+    // Adds value under name and returns its handle.  If the name is taken, its
+    // entry is replaced and keeps its handle.
+    Handle Add(const std::string& name, T value = T())
+    {
+        auto it = mIndices.find(name);
+        if(it != mIndices.end())
+        {
+            mEntries[it->second] = std::move(value);
+            return Handle(it->second);
+        }
+
+        std::uint32_t index = (std::uint32_t)mEntries.size();
+        mEntries.push_back(std::move(value));
+        mNames.push_back(name);
+        mIndices[name] = index;
+        return Handle(index);
+    }
+
+    // Returns an invalid handle if there is no entry with that name.
+    Handle Find(const std::string& name)const
+    {
+        auto it = mIndices.find(name);
+        return it != mIndices.end() ? Handle(it->second) : Handle();
+    }
+
+    // Name lookups, for load and build time only.  Throws std::out_of_range if
+    // there is no entry with that name.
+    T& Get(const std::string& name) { return mEntries[IndexOf(name)]; }
+    const T& Get(const std::string& name)const { return mEntries[IndexOf(name)]; }
+
+    T& operator[](Handle handle)
+    {
+        assert(handle.mIndex < mEntries.size());
+        return mEntries[handle.mIndex];
+    }
+
+    const T& operator[](Handle handle)const
+    {
+        assert(handle.mIndex < mEntries.size());
+        return mEntries[handle.mIndex];
+    }
+
+    const std::string& Name(Handle handle)const
+    {
+        assert(handle.mIndex < mNames.size());
+        return mNames[handle.mIndex];
+    }
+
+    // Handle of the entry at a dense index, for walking the whole registry.
+    Handle At(std::uint32_t index)const
+    {
+        assert(index < mEntries.size());
+        return Handle(index);
+    }
+
+    std::uint32_t Size()const { return (std::uint32_t)mEntries.size(); }
+
+    typename std::vector<T>::iterator begin() { return mEntries.begin(); }
+    typename std::vector<T>::iterator end() { return mEntries.end(); }
+    typename std::vector<T>::const_iterator begin()const { return mEntries.begin(); }
+    typename std::vector<T>::const_iterator end()const { return mEntries.end(); }
+
+private:
+    std::uint32_t IndexOf(const std::string& name)const
+    {
+        auto it = mIndices.find(name);
+        if(it == mIndices.end())
+            throw std::out_of_range("Registry has no entry named \"" + name + "\"");
+        return it->second;
+    }
+
+private:
+    std::vector<T> mEntries;
+    std::vector<std::string> mNames;
+    std::unordered_map<std::string, std::uint32_t> mIndices;
+};
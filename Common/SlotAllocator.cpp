@@ -0,0 +1,45 @@
+//***************************************************************************************
+// SlotAllocator.cpp
+//***************************************************************************************
+
+#include "SlotAllocator.h"
+
+UINT SlotAllocator::Allocate()
+{
+    ++mLiveCount;
+
+    if(mFreeSlots.empty())
+        return mSlotCount++;
+
+    UINT slot = mFreeSlots.top();
+    mFreeSlots.pop();
+    return slot;
+}
+
+void SlotAllocator::Free(UINT slot, UINT64 fenceValue)
+{
+    assert(slot < mSlotCount && mLiveCount > 0);
+    assert(mPendingFrees.empty() || mPendingFrees.back().FenceValue <= fenceValue);
+
+    --mLiveCount;
+    mPendingFrees.push_back({ slot, fenceValue });
+}
+
+void SlotAllocator::Retire(UINT64 completedFenceValue)
+{
+    while(!mPendingFrees.empty() && mPendingFrees.front().FenceValue <= completedFenceValue)
+    {
+        mFreeSlots.push(mPendingFrees.front().Slot);
+        mPendingFrees.pop_front();
+    }
+}
+
+UINT SlotAllocator::SlotCount()const
+{
+    return mSlotCount;
+}
+
+UINT SlotAllocator::LiveCount()const
+{
+    return mLiveCount;
+}
@@ -0,0 +1,56 @@
+//***************************************************************************************
+// SlotAllocator.h
+//
+// Hands out indices into arrays that live on both the CPU and the GPU, such as the
+// per-object constants, so objects can come and go without the arrays being
+// rebuilt.  A freed slot may still be read by the frames in flight, so it only
+// joins the free list once the GPU reaches the fence value of the frame that
+// freed it.  The lowest free slot is reused first, which keeps the arrays dense.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <deque>
+#include <functional>
+#include <queue>
+
+class SlotAllocator
+{
+public:
+    SlotAllocator() = default;
+    SlotAllocator(const SlotAllocator& rhs) = delete;
+    SlotAllocator& operator=(const SlotAllocator& rhs) = delete;
+    ~SlotAllocator() = default;
+
+    // Returns the lowest free slot, or a new one past the end if none is free.
+    UINT Allocate();
+
+    // Returns the slot to the free list once the GPU reaches fenceValue.  Fence
+    // values must not decrease from one call to the next.
+    void Free(UINT slot, UINT64 fenceValue);
+
+    // Frees the slots of every frame whose fence value has been reached.
+    void Retire(UINT64 completedFenceValue);
+
+    // Slots ever handed out, the size the arrays indexed by them must have.
+    UINT SlotCount()const;
+
+    // Slots allocated and not freed.
+    UINT LiveCount()const;
+
+private:
+    struct PendingFree
+    {
+        UINT Slot;
+        UINT64 FenceValue;
+    };
+
+    UINT mSlotCount = 0;
+    UINT mLiveCount = 0;
+
+    std::priority_queue<UINT, std::vector<UINT>, std::greater<UINT>> mFreeSlots;
+
+    // Oldest first, so the ones the GPU is done with are at the front.
+    std::deque<PendingFree> mPendingFrees;
+};
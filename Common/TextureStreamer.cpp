@@ -0,0 +1,493 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cmath>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    // Tiles in each heap of the tile pool: 4MB heaps.
+    const UINT TilesPerHeap = 64;
+
+    const UINT64 TileByteSize = D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+
+    UINT64 MipExtent(UINT64 size, UINT mip)
+    {
+        return std::max<UINT64>(size >> mip, 1);
+    }
+}
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, UploadQueue* uploadQueue, const Options& options) :
+    md3dDevice(device),
+    mUploadQueue(uploadQueue),
+    mOptions(options)
+{
+    D3D12_FEATURE_DATA_D3D12_OPTIONS features = {};
+    if(SUCCEEDED(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &features, sizeof(features))))
+        mHasTiledResources = (features.TiledResourcesTier != D3D12_TILED_RESOURCES_TIER_NOT_SUPPORTED);
+}
+
+TextureStreamer::Handle TextureStreamer::Load(const std::string& name, const std::wstring& fileName)
+{
+    Handle existing = mTextures.Find(name);
+    if(existing.IsValid())
+        return existing;
+
+    auto texture = std::make_unique<Texture>();
+    ThrowIfFailed(texture->File.Open(fileName));
+    ThrowIfFailed(DirectX::GetDDSTextureLayout12(texture->File.Data(), texture->File.Size(), texture->Layout));
+
+    const D3D12_RESOURCE_DESC& desc = texture->Layout.Desc;
+    texture->MipCount = desc.MipLevels;
+    texture->ArraySize = (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? 1 : desc.DepthOrArraySize;
+
+    // Load every mip no larger than LoadedMipSize, and at least the coarsest.
+    UINT loadedMip = texture->MipCount - 1;
+    while(loadedMip > 0 &&
+          std::max<UINT64>(MipExtent(desc.Width, loadedMip - 1), MipExtent(desc.Height, loadedMip - 1)) <= mOptions.LoadedMipSize)
+    {
+        --loadedMip;
+    }
+
+    if(CanReserve(desc))
+    {
+        CreateReserved(*texture);
+
+        // The packed mips are one unit of tiles, so they are loaded whole.
+        const D3D12_PACKED_MIP_INFO& packed = texture->PackedMips;
+        loadedMip = std::min<UINT>(loadedMip, packed.NumStandardMips);
+        if(packed.NumPackedMips > 0)
+            MapTiles(*texture, packed.NumStandardMips);
+        for(UINT mip = loadedMip; mip < packed.NumStandardMips; ++mip)
+            MapTiles(*texture, mip);
+    }
+    else
+    {
+        ThrowIfFailed(md3dDevice->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+            D3D12_HEAP_FLAG_NONE,
+            &desc,
+            D3D12_RESOURCE_STATE_COMMON,
+            nullptr,
+            IID_PPV_ARGS(&texture->Resource)));
+
+        texture->CommittedBytes = md3dDevice->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+    }
+
+    CopyMips(*texture, loadedMip, texture->MipCount);
+
+    texture->LoadedMip = loadedMip;
+    texture->ResidentMip = texture->MipCount;
+    texture->StreamingMip = loadedMip;
+    texture->StreamingTicket = mUploadQueue->PendingTicket();
+    texture->RequestedMip = texture->MipCount - 1;
+
+    return mTextures.Add(name, std::move(texture));
+}
+
+TextureStreamer::Handle TextureStreamer::Find(const std::string& name)const
+{
+    return mTextures.Find(name);
+}
+
+ID3D12Resource* TextureStreamer::GetResource(Handle texture)const
+{
+    return mTextures[texture]->Resource.Get();
+}
+
+bool TextureStreamer::IsResident(Handle texture)const
+{
+    const Texture& t = *mTextures[texture];
+    return t.ResidentMip < t.MipCount;
+}
+
+UINT TextureStreamer::ResidentMip(Handle texture)const
+{
+    return mTextures[texture]->ResidentMip;
+}
+
+void TextureStreamer::CreateShaderResourceView(Handle texture, D3D12_CPU_DESCRIPTOR_HANDLE descriptor)const
+{
+    const Texture& t = *mTextures[texture];
+    const D3D12_RESOURCE_DESC& desc = t.Layout.Desc;
+
+    // Before the loaded mips arrive there is nothing to clamp to; the view is
+    // written anyway, but must not be sampled.
+    float minLod = (float)std::min<UINT>(t.ResidentMip, t.MipCount - 1);
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    srvDesc.Format = desc.Format;
+
+    if(desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
+        srvDesc.Texture3D.MipLevels = (UINT)-1;
+        srvDesc.Texture3D.ResourceMinLODClamp = minLod;
+    }
+    else if(desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE1D)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE1DARRAY;
+        srvDesc.Texture1DArray.MipLevels = (UINT)-1;
+        srvDesc.Texture1DArray.ArraySize = t.ArraySize;
+        srvDesc.Texture1DArray.ResourceMinLODClamp = minLod;
+    }
+    else if(t.Layout.IsCubeMap && t.ArraySize == 6)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
+        srvDesc.TextureCube.MipLevels = (UINT)-1;
+        srvDesc.TextureCube.ResourceMinLODClamp = minLod;
+    }
+    else if(t.Layout.IsCubeMap)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBEARRAY;
+        srvDesc.TextureCubeArray.MipLevels = (UINT)-1;
+        srvDesc.TextureCubeArray.NumCubes = t.ArraySize / 6;
+        srvDesc.TextureCubeArray.ResourceMinLODClamp = minLod;
+    }
+    else if(t.ArraySize > 1)
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+        srvDesc.Texture2DArray.MipLevels = (UINT)-1;
+        srvDesc.Texture2DArray.ArraySize = t.ArraySize;
+        srvDesc.Texture2DArray.ResourceMinLODClamp = minLod;
+    }
+    else
+    {
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = (UINT)-1;
+        srvDesc.Texture2D.ResourceMinLODClamp = minLod;
+    }
+
+    md3dDevice->CreateShaderResourceView(t.Resource.Get(), &srvDesc, descriptor);
+}
+
+void TextureStreamer::Request(Handle texture, float screenSize)
+{
+    Texture& t = *mTextures[texture];
+    const D3D12_RESOURCE_DESC& desc = t.Layout.Desc;
+
+    // The coarsest mip that still has a texel for every pixel the texture covers.
+    float textureSize = (float)std::max<UINT64>(desc.Width, desc.Height);
+    UINT mip = t.MipCount - 1;
+    if(screenSize >= textureSize)
+        mip = 0;
+    else if(screenSize > 0.0f)
+        mip = std::min<UINT>(mip, (UINT)std::log2(textureSize / screenSize));
+
+    t.RequestedMip = std::min<UINT>(t.RequestedMip, mip);
+}
+
+void TextureStreamer::Update(UINT64 retireFenceValue, UINT64 completedFenceValue)
+{
+    // Tiles of dropped mips go back to the pool once no frame can sample them.
+    for(const Eviction& eviction : mEvictions)
+    {
+        if(eviction.FenceValue <= completedFenceValue)
+            UnmapTiles(*eviction.Target, eviction.Mip);
+    }
+
+    mEvictions.erase(std::remove_if(mEvictions.begin(), mEvictions.end(),
+        [=](const Eviction& e) { return e.FenceValue <= completedFenceValue; }), mEvictions.end());
+
+    bool isOverBudget = mUsedTileCount * TileByteSize > mOptions.ResidentByteBudget;
+
+    // Textures that want a finer mip, by how many mips they are short.
+    std::vector<std::pair<UINT, Texture*>> wanting;
+
+    for(auto& texturePtr : mTextures)
+    {
+        Texture& texture = *texturePtr;
+
+        if(texture.StreamingMip < texture.ResidentMip && mUploadQueue->IsComplete(texture.StreamingTicket))
+        {
+            texture.ResidentMip = texture.StreamingMip;
+            ++mResidencyVersion;
+        }
+
+        UINT requestedMip = texture.RequestedMip;
+        texture.RequestedMip = texture.MipCount - 1;
+
+        // Only one mip of a texture is in flight at a time.
+        if(texture.StreamingMip != texture.ResidentMip)
+            continue;
+
+        if(requestedMip < texture.ResidentMip)
+        {
+            wanting.push_back(std::make_pair(texture.ResidentMip - requestedMip, &texture));
+            texture.UnwantedUpdates = 0;
+        }
+        else if(requestedMip > texture.ResidentMip && texture.IsReserved && texture.ResidentMip < texture.LoadedMip)
+        {
+            // Drop the finest mip.  The view clamp moves off it now, and its tiles
+            // are unmapped once the frames that may still sample it are done.
+            if(++texture.UnwantedUpdates >= (isOverBudget ? 0u : mOptions.EvictDelay))
+            {
+                mEvictions.push_back({ &texture, texture.ResidentMip, retireFenceValue });
+                texture.ResidentMip++;
+                texture.StreamingMip = texture.ResidentMip;
+                texture.UnwantedUpdates = 0;
+                ++mResidencyVersion;
+            }
+        }
+        else
+        {
+            texture.UnwantedUpdates = 0;
+        }
+    }
+
+    std::stable_sort(wanting.begin(), wanting.end(),
+        [](const std::pair<UINT, Texture*>& a, const std::pair<UINT, Texture*>& b) { return a.first > b.first; });
+
+    UINT64 bytesLeft = mOptions.UpdateByteBudget;
+    bool isRecorded = false;
+
+    for(auto& entry : wanting)
+    {
+        Texture& texture = *entry.second;
+        UINT mip = texture.ResidentMip - 1;
+
+        if(CancelEviction(texture, mip))
+            continue;
+
+        if(texture.IsReserved && isOverBudget)
+            continue;
+
+        // A mip larger than the whole budget still streams, on its own.
+        UINT64 byteSize = MipByteSize(texture, mip);
+        if(byteSize > bytesLeft && bytesLeft != mOptions.UpdateByteBudget)
+            break;
+        bytesLeft -= std::min<UINT64>(byteSize, bytesLeft);
+
+        if(texture.IsReserved)
+            MapTiles(texture, mip);
+        CopyMips(texture, mip, mip + 1);
+
+        texture.StreamingMip = mip;
+        texture.StreamingTicket = mUploadQueue->PendingTicket();
+        isRecorded = true;
+    }
+
+    if(isRecorded)
+        mUploadQueue->Submit();
+}
+
+TextureStreamer::Stats TextureStreamer::GetStats()const
+{
+    Stats stats;
+    stats.TextureCount = mTextures.Size();
+    stats.ResidentTileBytes = mUsedTileCount * TileByteSize;
+    stats.PoolTileBytes = (UINT64)mTileHeaps.size() * TilesPerHeap * TileByteSize;
+
+    for(const auto& texture : mTextures)
+    {
+        if(texture->IsReserved)
+            stats.ReservedTextureCount++;
+        if(texture->StreamingMip != texture->ResidentMip)
+            stats.StreamingMipCount++;
+
+        stats.CommittedBytes += texture->CommittedBytes;
+    }
+
+    return stats;
+}
+
+bool TextureStreamer::CanReserve(const D3D12_RESOURCE_DESC& desc)const
+{
+    // Volume textures need tier 3, and a texture of one mip gains nothing.
+    return mOptions.UseReservedResources && mHasTiledResources &&
+        desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE2D && desc.MipLevels > 1;
+}
+
+void TextureStreamer::CreateReserved(Texture& texture)
+{
+    D3D12_RESOURCE_DESC desc = texture.Layout.Desc;
+    desc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+
+    ThrowIfFailed(md3dDevice->CreateReservedResource(
+        &desc,
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&texture.Resource)));
+
+    // The tilings of the first slice; every slice is tiled alike.
+    UINT tileCount = 0;
+    UINT tilingCount = texture.MipCount;
+    D3D12_TILE_SHAPE tileShape;
+    texture.Tilings.resize(tilingCount);
+    md3dDevice->GetResourceTiling(texture.Resource.Get(), &tileCount, &texture.PackedMips,
+        &tileShape, &tilingCount, 0, texture.Tilings.data());
+
+    texture.IsReserved = true;
+    texture.MipTiles.resize(texture.PackedMips.NumStandardMips + 1);
+}
+
+UINT64 TextureStreamer::MipByteSize(const Texture& texture, UINT mip)const
+{
+    UINT depth = (texture.Layout.Desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ?
+        (UINT)MipExtent(texture.Layout.Desc.DepthOrArraySize, mip) : 1;
+
+    UINT64 byteSize = 0;
+    for(UINT slice = 0; slice < texture.ArraySize; ++slice)
+    {
+        UINT subresource = D3D12CalcSubresource(mip, slice, 0, texture.MipCount, texture.ArraySize);
+        byteSize += (UINT64)texture.Layout.Subresources[subresource].SlicePitch * depth;
+    }
+
+    return byteSize;
+}
+
+void TextureStreamer::MapTiles(Texture& texture, UINT mip)
+{
+    std::vector<D3D12_TILED_RESOURCE_COORDINATE> coordinates;
+    GetTileCoordinates(texture, mip, coordinates);
+
+    std::vector<Tile>& tiles = texture.MipTiles[mip];
+    tiles.resize(coordinates.size());
+    for(Tile& tile : tiles)
+        tile = AllocateTile();
+
+    // One UpdateTileMappings per heap the tiles came from, each region a tile.
+    std::vector<UINT> order(tiles.size());
+    for(UINT i = 0; i < (UINT)order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+        [&](UINT a, UINT b) { return tiles[a].Heap < tiles[b].Heap; });
+
+    std::vector<D3D12_TILED_RESOURCE_COORDINATE> regionCoordinates;
+    std::vector<UINT> heapOffsets;
+    std::vector<D3D12_TILE_REGION_SIZE> regionSizes(order.size(), { 1, FALSE, 0, 0, 0 });
+    std::vector<UINT> rangeTileCounts(order.size(), 1);
+
+    for(size_t begin = 0; begin < order.size(); )
+    {
+        UINT heap = tiles[order[begin]].Heap;
+
+        regionCoordinates.clear();
+        heapOffsets.clear();
+
+        size_t end = begin;
+        for(; end < order.size() && tiles[order[end]].Heap == heap; ++end)
+        {
+            regionCoordinates.push_back(coordinates[order[end]]);
+            heapOffsets.push_back(tiles[order[end]].Index);
+        }
+
+        // Mapped on the copy queue, so the mapping is in place before the copies
+        // of the batch submitted next.
+        UINT count = (UINT)(end - begin);
+        mUploadQueue->Queue()->UpdateTileMappings(texture.Resource.Get(),
+            count, regionCoordinates.data(), regionSizes.data(),
+            mTileHeaps[heap].Get(),
+            count, nullptr, heapOffsets.data(), rangeTileCounts.data(),
+            D3D12_TILE_MAPPING_FLAG_NONE);
+
+        begin = end;
+    }
+}
+
+void TextureStreamer::UnmapTiles(Texture& texture, UINT mip)
+{
+    std::vector<D3D12_TILED_RESOURCE_COORDINATE> coordinates;
+    GetTileCoordinates(texture, mip, coordinates);
+
+    std::vector<D3D12_TILE_REGION_SIZE> regionSizes(coordinates.size(), { 1, FALSE, 0, 0, 0 });
+    D3D12_TILE_RANGE_FLAGS nullRange = D3D12_TILE_RANGE_FLAG_NULL;
+    UINT count = (UINT)coordinates.size();
+
+    mUploadQueue->Queue()->UpdateTileMappings(texture.Resource.Get(),
+        count, coordinates.data(), regionSizes.data(),
+        nullptr,
+        1, &nullRange, nullptr, &count,
+        D3D12_TILE_MAPPING_FLAG_NONE);
+
+    std::vector<Tile>& tiles = texture.MipTiles[mip];
+    mFreeTiles.insert(mFreeTiles.end(), tiles.begin(), tiles.end());
+    mUsedTileCount -= (UINT)tiles.size();
+    tiles.clear();
+}
+
+void TextureStreamer::GetTileCoordinates(const Texture& texture, UINT mip,
+    std::vector<D3D12_TILED_RESOURCE_COORDINATE>& coordinates)const
+{
+    const D3D12_PACKED_MIP_INFO& packed = texture.PackedMips;
+
+    coordinates.clear();
+    for(UINT slice = 0; slice < texture.ArraySize; ++slice)
+    {
+        UINT subresource = D3D12CalcSubresource(mip, slice, 0, texture.MipCount, texture.ArraySize);
+
+        // The packed mips are addressed as a run of tiles from their first mip.
+        if(mip >= packed.NumStandardMips)
+        {
+            for(UINT i = 0; i < packed.NumTilesForPackedMips; ++i)
+                coordinates.push_back({ i, 0, 0, subresource });
+            continue;
+        }
+
+        const D3D12_SUBRESOURCE_TILING& tiling = texture.Tilings[mip];
+        for(UINT z = 0; z < tiling.DepthInTiles; ++z)
+        {
+            for(UINT y = 0; y < tiling.HeightInTiles; ++y)
+            {
+                for(UINT x = 0; x < tiling.WidthInTiles; ++x)
+                    coordinates.push_back({ x, y, z, subresource });
+            }
+        }
+    }
+}
+
+TextureStreamer::Tile TextureStreamer::AllocateTile()
+{
+    if(mFreeTiles.empty())
+    {
+        D3D12_HEAP_DESC heapDesc = {};
+        heapDesc.SizeInBytes = TilesPerHeap * TileByteSize;
+        heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+        heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+        heapDesc.Flags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+
+        ComPtr<ID3D12Heap> heap;
+        ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+
+        // Pushed in reverse, so the heap's tiles are handed out in order.
+        UINT heapIndex = (UINT)mTileHeaps.size();
+        mTileHeaps.push_back(heap);
+        for(UINT i = TilesPerHeap; i > 0; --i)
+            mFreeTiles.push_back({ heapIndex, i - 1 });
+    }
+
+    Tile tile = mFreeTiles.back();
+    mFreeTiles.pop_back();
+    mUsedTileCount++;
+    return tile;
+}
+
+bool TextureStreamer::CancelEviction(Texture& texture, UINT mip)
+{
+    auto it = std::find_if(mEvictions.begin(), mEvictions.end(),
+        [&](const Eviction& e) { return e.Target == &texture && e.Mip == mip; });
+    if(it == mEvictions.end())
+        return false;
+
+    mEvictions.erase(it);
+    texture.ResidentMip = mip;
+    texture.StreamingMip = mip;
+    ++mResidencyVersion;
+    return true;
+}
+
+void TextureStreamer::CopyMips(Texture& texture, UINT firstMip, UINT lastMip)
+{
+    // The mips of a slice are consecutive subresources, so one copy per slice.
+    for(UINT slice = 0; slice < texture.ArraySize; ++slice)
+    {
+        UINT subresource = D3D12CalcSubresource(firstMip, slice, 0, texture.MipCount, texture.ArraySize);
+        mUploadQueue->CopyTexture(texture.Resource.Get(), subresource, lastMip - firstMip,
+            &texture.Layout.Subresources[subresource]);
+    }
+}
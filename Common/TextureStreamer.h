@@ -0,0 +1,183 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Streams DDS textures in a mip at a time instead of loading them whole.  Files are
+// memory mapped and stay mapped, so a mip is only read from disk when it is copied.
+// Loading a texture uploads its low mips; finer mips are then copied in on the
+// upload queue as Request reports the texture covering more of the screen.
+//
+// With reserved resources, the mips of a texture are backed by 64KB tiles from a
+// shared pool, only for as long as they are wanted, so resident memory follows what
+// is on screen rather than what is loaded.  Without them (or on hardware without
+// tiled resources) textures are committed whole and only the upload is deferred.
+//
+// Shaders must not sample finer than ResidentMip: views from
+// CreateShaderResourceView are clamped to it, and have to be recreated when
+// ResidencyVersion changes.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "DDSTextureLoader.h"
+#include "MappedFile.h"
+#include "Registry.h"
+#include "UploadQueue.h"
+
+class TextureStreamer
+{
+public:
+    struct Options
+    {
+        // Mips no larger than this are uploaded when the texture is loaded.
+        UINT LoadedMipSize = 128;
+
+        // Most bytes copied in by one Update, so streaming never floods the copy queue.
+        UINT64 UpdateByteBudget = 8*1024*1024;
+
+        // Tile memory above which mips that are not wanted are dropped at once
+        // instead of after EvictDelay updates, and no further mips are streamed.
+        UINT64 ResidentByteBudget = 256*1024*1024;
+
+        // Updates a mip goes unwanted before its tiles are returned to the pool.
+        UINT EvictDelay = 120;
+
+        bool UseReservedResources = true;
+    };
+
+    struct Stats
+    {
+        UINT TextureCount = 0;
+        UINT ReservedTextureCount = 0;
+
+        // Tiles in use and held by the pool, and committed texture memory.
+        UINT64 ResidentTileBytes = 0;
+        UINT64 PoolTileBytes = 0;
+        UINT64 CommittedBytes = 0;
+
+        // Mips whose copies are still in flight.
+        UINT StreamingMipCount = 0;
+    };
+
+private:
+    struct Tile
+    {
+        UINT Heap = 0;
+        UINT Index = 0;
+    };
+
+    struct Texture
+    {
+        MappedFile File;
+        DirectX::DDSTextureLayout12 Layout;
+        Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+
+        UINT MipCount = 0;
+        UINT ArraySize = 0;
+
+        // Coarsest mip the texture is ever dropped to: the ones uploaded at load.
+        UINT LoadedMip = 0;
+
+        // Finest mip the GPU may read, and the finest whose copy has been issued.
+        // Both are MipCount until the loaded mips arrive.
+        UINT ResidentMip = 0;
+        UINT StreamingMip = 0;
+        UINT64 StreamingTicket = 0;
+
+        // Finest mip asked for since the last Update.
+        UINT RequestedMip = 0;
+        UINT UnwantedUpdates = 0;
+
+        // Reserved textures only.  Mips from PackedMips.NumStandardMips on share
+        // the packed tiles, which are mapped at load and kept.
+        bool IsReserved = false;
+        D3D12_PACKED_MIP_INFO PackedMips = {};
+        std::vector<D3D12_SUBRESOURCE_TILING> Tilings;
+        std::vector<std::vector<Tile>> MipTiles;
+
+        UINT64 CommittedBytes = 0;
+    };
+
+public:
+    using Handle = Registry<std::unique_ptr<Texture>>::Handle;
+
+    TextureStreamer(ID3D12Device* device, UploadQueue* uploadQueue, const Options& options = Options());
+    TextureStreamer(const TextureStreamer& rhs) = delete;
+    TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+    ~TextureStreamer() = default;
+
+    // Maps the file, creates the texture and records the upload of its low mips in
+    // the upload queue's current batch.  Throws a DxException if the file can not
+    // be mapped or is not a DDS texture.  Loading a name again returns the texture
+    // already loaded under it.
+    Handle Load(const std::string& name, const std::wstring& fileName);
+    Handle Find(const std::string& name)const;
+
+    ID3D12Resource* GetResource(Handle texture)const;
+
+    // False until the loaded mips have arrived; the texture must not be read before.
+    bool IsResident(Handle texture)const;
+    UINT ResidentMip(Handle texture)const;
+
+    // Writes a view of the texture clamped to its resident mips.
+    void CreateShaderResourceView(Handle texture, D3D12_CPU_DESCRIPTOR_HANDLE descriptor)const;
+
+    // Bumped whenever a texture's ResidentMip changes.
+    UINT64 ResidencyVersion()const { return mResidencyVersion; }
+
+    // Reports the texture as drawn this frame, with its largest side covering
+    // screenSize pixels.  The finest mip reported between Updates is streamed in.
+    void Request(Handle texture, float screenSize);
+
+    // Advances the residency of each texture a mip towards what was requested and
+    // submits the copies.  Mips dropped now are kept mapped until the GPU reaches
+    // retireFenceValue, the fence of the last frame that may still sample them.
+    void Update(UINT64 retireFenceValue, UINT64 completedFenceValue);
+
+    Stats GetStats()const;
+
+private:
+    struct Eviction
+    {
+        Texture* Target;
+        UINT Mip;
+        UINT64 FenceValue;
+    };
+
+    bool CanReserve(const D3D12_RESOURCE_DESC& desc)const;
+    void CreateReserved(Texture& texture);
+    UINT64 MipByteSize(const Texture& texture, UINT mip)const;
+
+    // Backs the tiles of a standard mip, or with mip == NumStandardMips the packed
+    // mips, in every array slice.
+    void MapTiles(Texture& texture, UINT mip);
+    void UnmapTiles(Texture& texture, UINT mip);
+    void GetTileCoordinates(const Texture& texture, UINT mip,
+        std::vector<D3D12_TILED_RESOURCE_COORDINATE>& coordinates)const;
+    Tile AllocateTile();
+
+    // Takes back the eviction of a mip whose tiles are still mapped, so it is
+    // resident again without a copy.  False if there is no such eviction.
+    bool CancelEviction(Texture& texture, UINT mip);
+
+    // Records the copies of mips [firstMip, lastMip) of every array slice.
+    void CopyMips(Texture& texture, UINT firstMip, UINT lastMip);
+
+private:
+    ID3D12Device* md3dDevice = nullptr;
+    UploadQueue* mUploadQueue = nullptr;
+    Options mOptions;
+
+    bool mHasTiledResources = false;
+
+    Registry<std::unique_ptr<Texture>> mTextures;
+
+    // The tile pool.  Heaps are only ever added; freed tiles are reused.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> mTileHeaps;
+    std::vector<Tile> mFreeTiles;
+    UINT mUsedTileCount = 0;
+
+    std::vector<Eviction> mEvictions;
+
+    UINT64 mResidencyVersion = 0;
+};
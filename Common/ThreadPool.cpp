@@ -0,0 +1,59 @@
+//***************************************************************************************
+// ThreadPool.cpp
+//***************************************************************************************
+
+#include "ThreadPool.h"
+#include "CpuProfiler.h"
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+    if(threadCount == 0)
+    {
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    mThreads.reserve(threadCount);
+    for(unsigned i = 0; i < threadCount; ++i)
+        mThreads.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+
+    // Workers drain the queue before exiting, so no queued future is left unsatisfied.
+    for(auto& t : mThreads)
+        t.join();
+}
+
+unsigned ThreadPool::ThreadCount()const
+{
+    return (unsigned)mThreads.size();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    CpuProfiler::SetThreadName("worker");
+
+    for(;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+
+            if(mStopping && mTasks.empty())
+                return;
+
+            task = std::move(mTasks.front());
+            mTasks.pop();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,59 @@
+//***************************************************************************************
+// ThreadPool.h
+//
+// Fixed-size pool of worker threads.  Tasks are queued with Enqueue and their
+// results (or exceptions) are returned through std::future.
+//***************************************************************************************
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // A threadCount of 0 creates one thread per hardware thread, minus one for
+    // the calling (main) thread.  At least one thread is always created.
+    explicit ThreadPool(unsigned threadCount = 0);
+    ThreadPool(const ThreadPool& rhs) = delete;
+    ThreadPool& operator=(const ThreadPool& rhs) = delete;
+    ~ThreadPool();
+
+    unsigned ThreadCount()const;
+
+    // Queues f to run on a worker thread.  An exception thrown by f is rethrown
+    // by future::get().
+    template<typename F>
+    auto Enqueue(F&& f) -> std::future<decltype(f())>
+    {
+        using R = decltype(f());
+
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTasks.emplace([task]() { (*task)(); });
+        }
+        mCondition.notify_one();
+
+        return result;
+    }
+
+private:
+    void WorkerLoop();
+
+private:
+    std::vector<std::thread> mThreads;
+    std::queue<std::function<void()>> mTasks;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping = false;
+};
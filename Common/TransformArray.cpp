@@ -0,0 +1,115 @@
+//***************************************************************************************
+// TransformArray.cpp
+//***************************************************************************************
+
+#include "TransformArray.h"
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+TransformArray::TransformArray(UINT frameCount) :
+    mChanges(frameCount)
+{
+}
+
+UINT TransformArray::Size()const
+{
+    return (UINT)mWorld.size();
+}
+
+UINT TransformArray::Add(const XMFLOAT4X4& world)
+{
+    UINT index = (UINT)mWorld.size();
+    mWorld.push_back(world);
+    mChanges.MarkChanged(index);
+
+    return index;
+}
+
+UINT TransformArray::Add(FXMMATRIX world)
+{
+    XMFLOAT4X4 w;
+    XMStoreFloat4x4(&w, world);
+    return Add(w);
+}
+
+const XMFLOAT4X4& TransformArray::Get(UINT index)const
+{
+    return mWorld[index];
+}
+
+void TransformArray::Set(UINT index, const XMFLOAT4X4& world)
+{
+    mWorld[index] = world;
+    mChanges.MarkChanged(index);
+}
+
+UINT TransformArray::StreamDirty(UINT frameIndex, const StreamTarget* targets, UINT targetCount, ThreadPool* pool)
+{
+    // Each transform appears once, so the batches never write the same element.
+    mChanges.TakeChanges(frameIndex, mDirtyIndices);
+
+    const UINT* indices = mDirtyIndices.data();
+    UINT dirtyCount = (UINT)mDirtyIndices.size();
+
+    if(pool == nullptr || dirtyCount < ParallelThreshold)
+    {
+        StreamRange(indices, dirtyCount, targets, targetCount);
+    }
+    else
+    {
+        // The calling thread takes the first batch while the pool takes the rest.
+        const UINT batchSize = TransformsPerBatch;
+
+        std::vector<std::future<void>> batches;
+        for(UINT first = batchSize; first < dirtyCount; first += batchSize)
+        {
+            UINT count = std::min<UINT>(batchSize, dirtyCount - first);
+            batches.push_back(pool->Enqueue([=]()
+            {
+                StreamRange(indices + first, count, targets, targetCount);
+            }));
+        }
+
+        StreamRange(indices, std::min<UINT>(batchSize, dirtyCount), targets, targetCount);
+
+        for(auto& b : batches)
+            b.get();
+    }
+
+    return dirtyCount;
+}
+
+void TransformArray::StreamRange(const UINT* indices, UINT count, const StreamTarget* targets, UINT targetCount)
+{
+    for(UINT i = 0; i < count; ++i)
+    {
+        UINT index = indices[i];
+
+        // HLSL expects column-major matrices.
+        XMMATRIX world = XMMatrixTranspose(XMLoadFloat4x4(&mWorld[index]));
+
+        for(UINT t = 0; t < targetCount; ++t)
+        {
+            float* dst = reinterpret_cast<float*>(targets[t].MappedData + (size_t)index*targets[t].ElementByteSize);
+            assert(((size_t)dst & 15) == 0);
+
+#if defined(_XM_SSE_INTRINSICS_)
+            // Upload heaps are write-combined, so write whole rows with non-temporal
+            // stores that bypass the cache instead of going through memcpy.
+            _mm_stream_ps(dst + 0, world.r[0]);
+            _mm_stream_ps(dst + 4, world.r[1]);
+            _mm_stream_ps(dst + 8, world.r[2]);
+            _mm_stream_ps(dst + 12, world.r[3]);
+#else
+            XMStoreFloat4x4A(reinterpret_cast<XMFLOAT4X4A*>(dst), world);
+#endif
+        }
+    }
+
+#if defined(_XM_SSE_INTRINSICS_)
+    // Non-temporal stores are weakly ordered; make them visible before the GPU
+    // work that reads them is submitted.
+    _mm_sfence();
+#endif
+}
@@ -0,0 +1,62 @@
+//***************************************************************************************
+// TransformArray.h
+//
+// Dense array of world matrices whose changes are tracked for every frame
+// resource by a ChangeLog.  Changed transforms are transposed and streamed
+// straight into mapped upload buffers, so a frame costs in proportion to the
+// transforms that moved, however large the scene.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "ChangeLog.h"
+
+class ThreadPool;
+
+class TransformArray
+{
+public:
+    // An upload buffer to stream the transposed matrices into.  Element i is
+    // written at MappedData + i*ElementByteSize, which must be 16-byte aligned.
+    struct StreamTarget
+    {
+        BYTE* MappedData = nullptr;
+        UINT ElementByteSize = 0;
+    };
+
+    explicit TransformArray(UINT frameCount);
+
+    UINT Size()const;
+
+    // Appends a transform and returns its index.  It starts out dirty for every frame.
+    UINT Add(const DirectX::XMFLOAT4X4& world);
+    UINT Add(DirectX::FXMMATRIX world);
+
+    const DirectX::XMFLOAT4X4& Get(UINT index)const;
+
+    // Changes a transform and marks it dirty for every frame.
+    void Set(UINT index, const DirectX::XMFLOAT4X4& world);
+
+    // Transposes every transform that changed since frameIndex was last streamed
+    // into each of the targets.  Large updates are split across the pool.
+    // Returns the number of transforms written.
+    UINT StreamDirty(UINT frameIndex, const StreamTarget* targets, UINT targetCount, ThreadPool* pool);
+
+private:
+    void StreamRange(const UINT* indices, UINT count, const StreamTarget* targets, UINT targetCount);
+
+private:
+    // Fewest dirty transforms worth splitting across worker threads.
+    static const UINT ParallelThreshold = 4096;
+
+    // Dirty transforms handled per task.
+    static const UINT TransformsPerBatch = 1024;
+
+    std::vector<DirectX::XMFLOAT4X4> mWorld;
+
+    ChangeLog mChanges;
+
+    // The transforms being streamed, reused between frames.
+    std::vector<UINT> mDirtyIndices;
+};
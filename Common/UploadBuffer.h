@@ -50,6 +50,18 @@ public:
         return mUploadBuffer.Get();
     }
 
+    // Start of the persistently mapped memory, for callers that write the
+    // elements themselves.  Element i begins at i*ElementByteSize().
+    BYTE* MappedData()const
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
@@ -0,0 +1,189 @@
+//***************************************************************************************
+// UploadQueue.cpp
+//***************************************************************************************
+
+#include "UploadQueue.h"
+
+using Microsoft::WRL::ComPtr;
+
+UploadQueue::UploadQueue(ID3D12Device* device, UINT64 stagingByteSize)
+    : md3dDevice(device), mStaging(device, stagingByteSize)
+{
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mQueue)));
+
+    ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+    mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+    if(mFenceEvent == nullptr)
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+UploadQueue::~UploadQueue()
+{
+    if(mBatchOpen)
+        Submit();
+
+    if(mFence != nullptr)
+        Wait(mLastSubmitted);
+
+    if(mFenceEvent != nullptr)
+        CloseHandle(mFenceEvent);
+}
+
+ID3D12CommandQueue* UploadQueue::Queue()const
+{
+    return mQueue.Get();
+}
+
+void UploadQueue::CopyBuffer(ID3D12Resource* dst, UINT64 dstOffset, const void* data, UINT64 byteSize)
+{
+    BeginBatch();
+
+    ID3D12Resource* staging = nullptr;
+    UINT64 stagingOffset = 0;
+    BYTE* cpuAddress = nullptr;
+    Stage(byteSize, 16, staging, stagingOffset, cpuAddress);
+
+    memcpy(cpuAddress, data, (size_t)byteSize);
+    mCommandList->CopyBufferRegion(dst, dstOffset, staging, stagingOffset, byteSize);
+}
+
+void UploadQueue::CopyTexture(ID3D12Resource* dst, UINT firstSubresource, UINT numSubresources,
+    const D3D12_SUBRESOURCE_DATA* data)
+{
+    BeginBatch();
+
+    UINT64 byteSize = GetRequiredIntermediateSize(dst, firstSubresource, numSubresources);
+
+    ID3D12Resource* staging = nullptr;
+    UINT64 stagingOffset = 0;
+    BYTE* cpuAddress = nullptr;
+    Stage(byteSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, staging, stagingOffset, cpuAddress);
+
+    // Lays the rows out with the footprint the copy expects and records the copies.
+    UpdateSubresources(mCommandList.Get(), dst, staging, stagingOffset,
+        firstSubresource, numSubresources, const_cast<D3D12_SUBRESOURCE_DATA*>(data));
+}
+
+UINT64 UploadQueue::PendingTicket()const
+{
+    return mLastSubmitted + 1;
+}
+
+UINT64 UploadQueue::Submit()
+{
+    if(!mBatchOpen)
+        return mLastSubmitted;
+
+    ThrowIfFailed(mCommandList->Close());
+    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+    mQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+    UINT64 ticket = ++mLastSubmitted;
+    ThrowIfFailed(mQueue->Signal(mFence.Get(), ticket));
+
+    mAllocators.push_back({ mCurrentAllocator, ticket });
+    mCurrentAllocator = nullptr;
+
+    mStaging.EndFrame(ticket);
+    for(auto& buffer : mBatchStaging)
+        mPendingStaging.push_back({ buffer, ticket });
+    mBatchStaging.clear();
+
+    mBatchOpen = false;
+    return ticket;
+}
+
+bool UploadQueue::IsComplete(UINT64 ticket)const
+{
+    return mFence->GetCompletedValue() >= ticket;
+}
+
+void UploadQueue::Wait(UINT64 ticket)
+{
+    if(mFence->GetCompletedValue() < ticket)
+    {
+        ThrowIfFailed(mFence->SetEventOnCompletion(ticket, mFenceEvent));
+        WaitForSingleObject(mFenceEvent, INFINITE);
+    }
+}
+
+void UploadQueue::WaitOnQueue(ID3D12CommandQueue* queue, UINT64 ticket)const
+{
+    ThrowIfFailed(queue->Wait(mFence.Get(), ticket));
+}
+
+void UploadQueue::Retire()
+{
+    UINT64 completed = mFence->GetCompletedValue();
+
+    mStaging.Retire(completed);
+
+    auto done = [=](const PendingStaging& p) { return p.Ticket <= completed; };
+    mPendingStaging.erase(std::remove_if(mPendingStaging.begin(), mPendingStaging.end(), done),
+        mPendingStaging.end());
+}
+
+void UploadQueue::BeginBatch()
+{
+    if(mBatchOpen)
+        return;
+
+    // Reuse the oldest allocator whose batch is done, or make a new one.
+    if(!mAllocators.empty() && IsComplete(mAllocators.front().Ticket))
+    {
+        mCurrentAllocator = mAllocators.front().Allocator;
+        mAllocators.erase(mAllocators.begin());
+        ThrowIfFailed(mCurrentAllocator->Reset());
+    }
+    else
+    {
+        ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+            IID_PPV_ARGS(&mCurrentAllocator)));
+    }
+
+    if(mCommandList == nullptr)
+    {
+        ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+            mCurrentAllocator.Get(), nullptr, IID_PPV_ARGS(&mCommandList)));
+    }
+    else
+    {
+        ThrowIfFailed(mCommandList->Reset(mCurrentAllocator.Get(), nullptr));
+    }
+
+    mBatchOpen = true;
+}
+
+void UploadQueue::Stage(UINT64 byteSize, UINT64 alignment,
+    ID3D12Resource*& buffer, UINT64& offset, BYTE*& cpuAddress)
+{
+    UploadRing::Allocation allocation;
+    if(mStaging.TryAllocate(byteSize, alignment, allocation))
+    {
+        buffer = allocation.Resource;
+        offset = allocation.Offset;
+        cpuAddress = allocation.CpuAddress;
+        return;
+    }
+
+    // Too big for the ring, or the ring is full of batches still in flight.
+    ComPtr<ID3D12Resource> dedicated;
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&dedicated)));
+
+    // Upload buffers can stay mapped until they are released.
+    ThrowIfFailed(dedicated->Map(0, nullptr, reinterpret_cast<void**>(&cpuAddress)));
+
+    buffer = dedicated.Get();
+    offset = 0;
+    mBatchStaging.push_back(dedicated);
+}
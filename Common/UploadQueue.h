@@ -0,0 +1,87 @@
+//***************************************************************************************
+// UploadQueue.h
+//
+// Streams data into default heap resources on a dedicated copy queue, so uploads
+// neither block the CPU nor the direct queue.  Copies are batched into one command
+// list per Submit, and each batch is identified by a ticket: the value the upload
+// fence reaches once the batch has executed.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "UploadRing.h"
+
+class UploadQueue
+{
+public:
+    UploadQueue(ID3D12Device* device, UINT64 stagingByteSize = 32*1024*1024);
+    UploadQueue(const UploadQueue& rhs) = delete;
+    UploadQueue& operator=(const UploadQueue& rhs) = delete;
+
+    // Waits for every submitted batch, since their resources may be released next.
+    ~UploadQueue();
+
+    ID3D12CommandQueue* Queue()const;
+
+    // Record copies into the current batch.  The destination must be in
+    // D3D12_RESOURCE_STATE_COMMON.  The copy queue promotes it to COPY_DEST and it
+    // decays back to COMMON once the batch is done, so the direct queue can then
+    // read it without a barrier.
+    void CopyBuffer(ID3D12Resource* dst, UINT64 dstOffset, const void* data, UINT64 byteSize);
+    void CopyTexture(ID3D12Resource* dst, UINT firstSubresource, UINT numSubresources,
+        const D3D12_SUBRESOURCE_DATA* data);
+
+    // The ticket the current batch will be submitted with.
+    UINT64 PendingTicket()const;
+
+    // Executes the current batch and returns its ticket.  Returns the ticket of
+    // the last batch if nothing was recorded since.
+    UINT64 Submit();
+
+    bool IsComplete(UINT64 ticket)const;
+
+    // Blocks the CPU until the batch is done.
+    void Wait(UINT64 ticket);
+
+    // Makes queue wait for the batch on the GPU, without blocking the CPU.
+    void WaitOnQueue(ID3D12CommandQueue* queue, UINT64 ticket)const;
+
+    // Recycles the staging memory and command allocators of finished batches.
+    void Retire();
+
+private:
+    void BeginBatch();
+    void Stage(UINT64 byteSize, UINT64 alignment, ID3D12Resource*& buffer, UINT64& offset, BYTE*& cpuAddress);
+
+private:
+    struct PendingAllocator
+    {
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator;
+        UINT64 Ticket;
+    };
+
+    struct PendingStaging
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        UINT64 Ticket;
+    };
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mQueue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCurrentAllocator;
+    std::vector<PendingAllocator> mAllocators;
+
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    HANDLE mFenceEvent = nullptr;
+    UINT64 mLastSubmitted = 0;
+    bool mBatchOpen = false;
+
+    UploadRing mStaging;
+
+    // Upload buffers for copies that did not fit in the staging ring.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mBatchStaging;
+    std::vector<PendingStaging> mPendingStaging;
+};
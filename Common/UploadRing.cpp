@@ -0,0 +1,148 @@
+//***************************************************************************************
+// UploadRing.cpp
+//***************************************************************************************
+
+#include "UploadRing.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+    const UINT64 RingAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    inline UINT64 AlignUp(UINT64 value, UINT64 alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 byteSize)
+{
+    mCapacity = AlignUp(byteSize, RingAlignment);
+
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(mCapacity),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&mBuffer)));
+
+    // Upload heaps can stay mapped for their whole lifetime.
+    ThrowIfFailed(mBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+}
+
+UploadRing::~UploadRing()
+{
+    if(mBuffer != nullptr)
+        mBuffer->Unmap(0, nullptr);
+
+    mMappedData = nullptr;
+}
+
+UINT64 UploadRing::Capacity()const
+{
+    return mCapacity;
+}
+
+UINT64 UploadRing::UsedBytes()const
+{
+    return mHead - mTail;
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+    Allocation allocation;
+    if(!TryAllocate(byteSize, alignment, allocation))
+    {
+        throw DxException(E_OUTOFMEMORY, L"UploadRing::Allocate",
+            AnsiToWString(__FILE__), __LINE__);
+    }
+
+    return allocation;
+}
+
+bool UploadRing::TryAllocate(UINT64 byteSize, UINT64 alignment, Allocation& allocation)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && alignment <= RingAlignment);
+
+    UINT64 offset = AlignUp(mHead % mCapacity, alignment);
+
+    // An allocation never straddles the end of the buffer; skip to the start
+    // instead.  The capacity is a multiple of every allowed alignment.
+    if(offset + byteSize > mCapacity)
+        offset = mCapacity;
+
+    UINT64 start = mHead - (mHead % mCapacity) + offset;
+    if(start + byteSize - mTail > mCapacity)
+        return false;
+
+    mHead = start + byteSize;
+
+    allocation.CpuAddress = mMappedData + start % mCapacity;
+    allocation.GpuAddress = mBuffer->GetGPUVirtualAddress() + start % mCapacity;
+    allocation.ByteSize = byteSize;
+    allocation.Resource = mBuffer.Get();
+    allocation.Offset = start % mCapacity;
+    return true;
+}
+
+UploadRing::Allocation UploadRing::AllocateConstants(const void* data, UINT64 byteSize)
+{
+    Allocation allocation = Allocate(
+        AlignUp(byteSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT),
+        D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+    memcpy(allocation.CpuAddress, data, (size_t)byteSize);
+    return allocation;
+}
+
+D3D12_VERTEX_BUFFER_VIEW UploadRing::AllocateVertices(const void* data, UINT vertexCount, UINT byteStride)
+{
+    UINT byteSize = vertexCount*byteStride;
+    Allocation allocation = Allocate(byteSize, 16);
+    memcpy(allocation.CpuAddress, data, byteSize);
+
+    D3D12_VERTEX_BUFFER_VIEW vbv;
+    vbv.BufferLocation = allocation.GpuAddress;
+    vbv.StrideInBytes = byteStride;
+    vbv.SizeInBytes = byteSize;
+    return vbv;
+}
+
+D3D12_INDEX_BUFFER_VIEW UploadRing::AllocateIndices(const void* data, UINT indexCount, DXGI_FORMAT format)
+{
+    assert(format == DXGI_FORMAT_R16_UINT || format == DXGI_FORMAT_R32_UINT);
+
+    UINT byteSize = indexCount*(format == DXGI_FORMAT_R16_UINT ? 2 : 4);
+    Allocation allocation = Allocate(byteSize, 16);
+    memcpy(allocation.CpuAddress, data, byteSize);
+
+    D3D12_INDEX_BUFFER_VIEW ibv;
+    ibv.BufferLocation = allocation.GpuAddress;
+    ibv.Format = format;
+    ibv.SizeInBytes = byteSize;
+    return ibv;
+}
+
+void UploadRing::EndFrame(UINT64 fenceValue)
+{
+    if(mHead == mFrameStart)
+        return;
+
+    Frame frame;
+    frame.FenceValue = fenceValue;
+    frame.Head = mHead;
+    mFrames.push_back(frame);
+
+    mFrameStart = mHead;
+}
+
+void UploadRing::Retire(UINT64 completedFenceValue)
+{
+    while(!mFrames.empty() && mFrames.front().FenceValue <= completedFenceValue)
+    {
+        mTail = mFrames.front().Head;
+        mFrames.pop_front();
+    }
+}
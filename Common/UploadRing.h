@@ -0,0 +1,84 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// Ring of sub-allocations in one persistently mapped upload heap buffer, for data
+// that is written by the CPU every frame and read by the GPU once.  Space is
+// reclaimed a frame at a time, once the fence value of that frame is reached.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <deque>
+
+class UploadRing
+{
+public:
+    struct Allocation
+    {
+        BYTE* CpuAddress = nullptr;
+        D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+        UINT64 ByteSize = 0;
+
+        // The ring's buffer and the allocation's offset in it, for copies.
+        ID3D12Resource* Resource = nullptr;
+        UINT64 Offset = 0;
+    };
+
+    // byteSize is rounded up to a multiple of 64KB.
+    UploadRing(ID3D12Device* device, UINT64 byteSize);
+    UploadRing(const UploadRing& rhs) = delete;
+    UploadRing& operator=(const UploadRing& rhs) = delete;
+    ~UploadRing();
+
+    UINT64 Capacity()const;
+    UINT64 UsedBytes()const;
+
+    // Returns byteSize bytes aligned to alignment, which must be a power of two no
+    // larger than 64KB.  Throws a DxException with E_OUTOFMEMORY if the ring is
+    // full of data the GPU may still be reading.
+    Allocation Allocate(UINT64 byteSize, UINT64 alignment);
+
+    // As Allocate, but returns false instead of throwing when the ring is full.
+    bool TryAllocate(UINT64 byteSize, UINT64 alignment, Allocation& allocation);
+
+    // Copies the data into a constant buffer sized and aligned to 256 bytes.
+    Allocation AllocateConstants(const void* data, UINT64 byteSize);
+
+    template<typename T>
+    Allocation AllocateConstants(const T& data)
+    {
+        return AllocateConstants(&data, sizeof(T));
+    }
+
+    // Copies the data into a vertex or index buffer and returns its view.
+    D3D12_VERTEX_BUFFER_VIEW AllocateVertices(const void* data, UINT vertexCount, UINT byteStride);
+    D3D12_INDEX_BUFFER_VIEW AllocateIndices(const void* data, UINT indexCount, DXGI_FORMAT format);
+
+    // Tags everything allocated since the last call with the fence value that is
+    // signaled once the GPU is done with it.
+    void EndFrame(UINT64 fenceValue);
+
+    // Reclaims the space of every frame whose fence value has been reached.
+    void Retire(UINT64 completedFenceValue);
+
+private:
+    struct Frame
+    {
+        UINT64 FenceValue;
+        UINT64 Head;
+    };
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> mBuffer;
+    BYTE* mMappedData = nullptr;
+    UINT64 mCapacity = 0;
+
+    // Positions only ever grow; the byte offset in the buffer is the position
+    // modulo mCapacity.  Everything in [mTail, mHead) may still be in use.
+    UINT64 mHead = 0;
+    UINT64 mTail = 0;
+    UINT64 mFrameStart = 0;
+
+    // Frames submitted but not yet retired, oldest first.
+    std::deque<Frame> mFrames;
+};
@@ -0,0 +1,165 @@
+//***************************************************************************************
+// VertexFormat.cpp
+//***************************************************************************************
+
+#include "VertexFormat.h"
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+UINT VertexFormat::PositionByteSize()const
+{
+    return Position == VertexPositionFormat::Float3 ? 12 : 8;
+}
+
+UINT VertexFormat::ColorByteSize()const
+{
+    return Color == VertexColorFormat::Float4 ? 16 : 4;
+}
+
+UINT VertexFormat::PositionStreamStride()const
+{
+    return SplitPositions ? PositionByteSize() : PositionByteSize() + ColorByteSize();
+}
+
+UINT VertexFormat::AttributeStreamStride()const
+{
+    return SplitPositions ? ColorByteSize() : 0;
+}
+
+std::vector<D3D12_INPUT_ELEMENT_DESC> VertexFormat::InputLayout()const
+{
+    std::vector<D3D12_INPUT_ELEMENT_DESC> layout = PositionInputLayout();
+
+    DXGI_FORMAT colorFormat = Color == VertexColorFormat::Float4 ?
+        DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    UINT colorSlot = SplitPositions ? 1 : 0;
+    UINT colorOffset = SplitPositions ? 0 : PositionByteSize();
+
+    layout.push_back({ "COLOR", 0, colorFormat, colorSlot, colorOffset,
+        D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 });
+
+    return layout;
+}
+
+std::vector<D3D12_INPUT_ELEMENT_DESC> VertexFormat::PositionInputLayout()const
+{
+    DXGI_FORMAT positionFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+    if(Position == VertexPositionFormat::Half4)
+        positionFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    else if(Position == VertexPositionFormat::UNorm16x4)
+        positionFormat = DXGI_FORMAT_R16G16B16A16_UNORM;
+
+    return { { "POSITION", 0, positionFormat, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 } };
+}
+
+std::vector<D3D_SHADER_MACRO> VertexFormat::ShaderDefines()const
+{
+    // Float positions need no scale and bias.
+    std::vector<D3D_SHADER_MACRO> defines;
+    if(Position != VertexPositionFormat::Float3)
+        defines.push_back({ "PACKED_POSITIONS", "1" });
+
+    defines.push_back({ nullptr, nullptr });
+    return defines;
+}
+
+void VertexFormat::GetDequantization(const BoundingBox& bounds, XMFLOAT3& scale, XMFLOAT3& bias)const
+{
+    switch(Position)
+    {
+    case VertexPositionFormat::Float3:
+        scale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+        bias = XMFLOAT3(0.0f, 0.0f, 0.0f);
+        break;
+
+    case VertexPositionFormat::Half4:
+        // Halfs are most precise near zero, so store offsets from the center.
+        scale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+        bias = bounds.Center;
+        break;
+
+    case VertexPositionFormat::UNorm16x4:
+        // [0,1] covers the box.  Flat boxes get a nonzero scale so encoding
+        // never divides by zero.
+        scale.x = std::max<float>(2.0f*bounds.Extents.x, 1e-6f);
+        scale.y = std::max<float>(2.0f*bounds.Extents.y, 1e-6f);
+        scale.z = std::max<float>(2.0f*bounds.Extents.z, 1e-6f);
+        bias.x = bounds.Center.x - bounds.Extents.x;
+        bias.y = bounds.Center.y - bounds.Extents.y;
+        bias.z = bounds.Center.z - bounds.Extents.z;
+        break;
+    }
+}
+
+void VertexFormat::Encode(const XMFLOAT3* positions, UINT positionStride,
+    const XMFLOAT4& color, UINT count, const BoundingBox& bounds,
+    BYTE* positionStream, BYTE* attributeStream)const
+{
+    XMFLOAT3 scale, bias;
+    GetDequantization(bounds, scale, bias);
+
+    XMVECTOR invScale = XMVectorReciprocal(XMLoadFloat3(&scale));
+    XMVECTOR biasV = XMLoadFloat3(&bias);
+
+    UINT positionStreamStride = PositionStreamStride();
+    UINT colorStride = SplitPositions ? AttributeStreamStride() : positionStreamStride;
+    BYTE* colorStream = SplitPositions ? attributeStream : positionStream + PositionByteSize();
+
+    const BYTE* src = reinterpret_cast<const BYTE*>(positions);
+
+    for(UINT i = 0; i < count; ++i)
+    {
+        const XMFLOAT3& p = *reinterpret_cast<const XMFLOAT3*>(src + (size_t)i*positionStride);
+        BYTE* dstPosition = positionStream + (size_t)i*positionStreamStride;
+        BYTE* dstColor = colorStream + (size_t)i*colorStride;
+
+        XMVECTOR stored = (XMLoadFloat3(&p) - biasV) * invScale;
+        stored = XMVectorSetW(stored, 1.0f);
+
+        switch(Position)
+        {
+        case VertexPositionFormat::Float3:
+            XMStoreFloat3(reinterpret_cast<XMFLOAT3*>(dstPosition), stored);
+            break;
+        case VertexPositionFormat::Half4:
+            XMStoreHalf4(reinterpret_cast<XMHALF4*>(dstPosition), stored);
+            break;
+        case VertexPositionFormat::UNorm16x4:
+            XMStoreUShortN4(reinterpret_cast<XMUSHORTN4*>(dstPosition), stored);
+            break;
+        }
+
+        if(Color == VertexColorFormat::Float4)
+            memcpy(dstColor, &color, sizeof(XMFLOAT4));
+        else
+            XMStoreUByteN4(reinterpret_cast<XMUBYTEN4*>(dstColor), XMLoadFloat4(&color));
+    }
+}
+
+bool VertexFormat::SetPosition(const std::string& name)
+{
+    if(name == "float")
+        Position = VertexPositionFormat::Float3;
+    else if(name == "half")
+        Position = VertexPositionFormat::Half4;
+    else if(name == "unorm16")
+        Position = VertexPositionFormat::UNorm16x4;
+    else
+        return false;
+
+    return true;
+}
+
+bool VertexFormat::SetColor(const std::string& name)
+{
+    if(name == "float")
+        Color = VertexColorFormat::Float4;
+    else if(name == "unorm8")
+        Color = VertexColorFormat::UNorm8x4;
+    else
+        return false;
+
+    return true;
+}
@@ -0,0 +1,68 @@
+//***************************************************************************************
+// VertexFormat.h
+//
+// Describes how vertex positions and colors are packed into vertex buffers, and
+// derives the input layout and shader defines that read them back.  Positions are
+// stored as floats, halfs relative to the submesh center, or 16-bit UNORM over the
+// submesh bounds; either way the vertex shader applies a per-submesh scale and bias
+// to recover them.  Positions can also be split into a stream of their own, so
+// depth-only passes fetch just them.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+enum class VertexPositionFormat
+{
+    Float3,     // R32G32B32_FLOAT, 12 bytes
+    Half4,      // R16G16B16A16_FLOAT, 8 bytes
+    UNorm16x4   // R16G16B16A16_UNORM, 8 bytes
+};
+
+enum class VertexColorFormat
+{
+    Float4,     // R32G32B32A32_FLOAT, 16 bytes
+    UNorm8x4    // R8G8B8A8_UNORM, 4 bytes
+};
+
+struct VertexFormat
+{
+    VertexPositionFormat Position = VertexPositionFormat::UNorm16x4;
+    VertexColorFormat Color = VertexColorFormat::UNorm8x4;
+
+    // Positions in vertex buffer slot 0 and colors in slot 1, instead of both
+    // interleaved in slot 0.
+    bool SplitPositions = false;
+
+    UINT PositionByteSize()const;
+    UINT ColorByteSize()const;
+
+    // Byte strides of the streams in slot 0 and slot 1.  The slot 1 stride is zero
+    // when the vertices are interleaved.
+    UINT PositionStreamStride()const;
+    UINT AttributeStreamStride()const;
+
+    // Elements for VertexIn in color.hlsl, and for a position-only vertex shader.
+    std::vector<D3D12_INPUT_ELEMENT_DESC> InputLayout()const;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> PositionInputLayout()const;
+
+    // Null terminated, for d3dUtil::CompileShader.  Points at static strings.
+    std::vector<D3D_SHADER_MACRO> ShaderDefines()const;
+
+    // The scale and bias the vertex shader maps stored positions in bounds back
+    // to object space with.
+    void GetDequantization(const DirectX::BoundingBox& bounds,
+        DirectX::XMFLOAT3& scale, DirectX::XMFLOAT3& bias)const;
+
+    // Packs count vertices with positions inside bounds.  attributeStream is
+    // ignored when the vertices are interleaved.
+    void Encode(const DirectX::XMFLOAT3* positions, UINT positionStride,
+        const DirectX::XMFLOAT4& color, UINT count, const DirectX::BoundingBox& bounds,
+        BYTE* positionStream, BYTE* attributeStream)const;
+
+    // Parses "float", "half" or "unorm16" and "float" or "unorm8".  Returns false
+    // and leaves the format unchanged for anything else.
+    bool SetPosition(const std::string& name);
+    bool SetColor(const std::string& name);
+};
@@ -35,6 +35,12 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitableObject != nullptr)
+		CloseHandle(mFrameLatencyWaitableObject);
+
+	if(mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -75,6 +81,8 @@ int D3DApp::Run()
  
 	mTimer.Reset();
 
+	CpuProfiler::SetThreadName("main");
+
 	while(msg.message != WM_QUIT)
 	{
 		// If there are Window messages then process them.
@@ -90,9 +98,19 @@ int D3DApp::Run()
 
 			if( !mAppPaused )
 			{
+				// Start the frame only once the swap chain can take it, so it is
+				// built from the latest input instead of queuing behind the display.
+				WaitForFrameLatency();
+
 				CalculateFrameStats();
-				Update(mTimer);	
-                Draw(mTimer);
+				{
+					CpuScope scope("Update");
+					Update(mTimer);
+				}
+				{
+					CpuScope scope("Draw");
+					Draw(mTimer);
+				}
 			}
 			else
 			{
@@ -159,7 +177,7 @@ void D3DApp::OnResize()
 		SwapChainBufferCount, 
 		mClientWidth, mClientHeight, 
 		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		SwapChainFlags()));
 
 	mCurrBackBuffer = 0;
  
@@ -243,7 +261,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	// We pause the game when the window is deactivated and unpause it 
 	// when it becomes active.  
 	case WM_ACTIVATE:
-		if( LOWORD(wParam) == WA_INACTIVE )
+		if( LOWORD(wParam) == WA_INACTIVE && !mRunWhenInactive )
 		{
 			mAppPaused = true;
 			mTimer.Stop();
@@ -365,6 +383,8 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         }
         else if((int)wParam == VK_F2)
             Set4xMsaaState(!m4xMsaaState);
+        else if((int)wParam == VK_F3)
+            WriteCpuTrace();
 
         return 0;
 	}
@@ -406,7 +426,7 @@ bool D3DApp::InitMainWindow()
 		return false;
 	}
 
-	ShowWindow(mhMainWnd, SW_SHOW);
+	ShowWindow(mhMainWnd, mShowWindow ? SW_SHOW : SW_HIDE);
 	UpdateWindow(mhMainWnd);
 
 	return true;
@@ -425,11 +445,15 @@ bool D3DApp::InitDirect3D()
 
 	ThrowIfFailed(CreateDXGIFactory1(IID_PPV_ARGS(&mdxgiFactory)));
 
-	// Try to create hardware device.
-	HRESULT hardwareResult = D3D12CreateDevice(
-		nullptr,             // default adapter
-		D3D_FEATURE_LEVEL_11_0,
-		IID_PPV_ARGS(&md3dDevice));
+	// Try to create hardware device, unless WARP was asked for.
+	HRESULT hardwareResult = E_FAIL;
+	if(md3dDriverType != D3D_DRIVER_TYPE_WARP)
+	{
+		hardwareResult = D3D12CreateDevice(
+			nullptr,             // default adapter
+			D3D_FEATURE_LEVEL_11_0,
+			IID_PPV_ARGS(&md3dDevice));
+	}
 
 	// Fallback to WARP device.
 	if(FAILED(hardwareResult))
@@ -446,6 +470,28 @@ bool D3DApp::InitDirect3D()
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
 
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	// Tearing needs DXGI 1.5 and support from the display and driver.
+	ComPtr<IDXGIFactory5> factory5;
+	if(SUCCEEDED(mdxgiFactory.As(&factory5)))
+	{
+		BOOL allowTearing = FALSE;
+		if(SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING,
+			&allowTearing, sizeof(allowTearing))))
+		{
+			mTearingSupported = (allowTearing == TRUE);
+		}
+	}
+
+	if(mPresentMode == PresentMode::Tearing && !mTearingSupported)
+	{
+		OutputDebugString(L"Tearing is not supported, presenting immediately instead.\n");
+		mPresentMode = PresentMode::Immediate;
+	}
+
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
 	mCbvSrvUavDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -507,6 +553,12 @@ void D3DApp::CreateSwapChain()
     // Release the previous swapchain we will be recreating.
     mSwapChain.Reset();
 
+	if(mFrameLatencyWaitableObject != nullptr)
+	{
+		CloseHandle(mFrameLatencyWaitableObject);
+		mFrameLatencyWaitableObject = nullptr;
+	}
+
     DXGI_SWAP_CHAIN_DESC sd;
     sd.BufferDesc.Width = mClientWidth;
     sd.BufferDesc.Height = mClientHeight;
@@ -522,13 +574,58 @@ void D3DApp::CreateSwapChain()
     sd.OutputWindow = mhMainWnd;
     sd.Windowed = true;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+    sd.Flags = SwapChainFlags();
 
 	// Note: Swap chain uses queue to perform flush.
     ThrowIfFailed(mdxgiFactory->CreateSwapChain(
 		mCommandQueue.Get(),
 		&sd, 
 		mSwapChain.GetAddressOf()));
+
+	// Presenting with tearing is not allowed in exclusive fullscreen, so keep
+	// Alt+Enter from switching to it.
+	if(mPresentMode == PresentMode::Tearing)
+		ThrowIfFailed(mdxgiFactory->MakeWindowAssociation(mhMainWnd, DXGI_MWA_NO_ALT_ENTER));
+
+	if(mUseWaitableSwapChain)
+	{
+		ComPtr<IDXGISwapChain2> swapChain2;
+		ThrowIfFailed(mSwapChain.As(&swapChain2));
+		ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+		mFrameLatencyWaitableObject = swapChain2->GetFrameLatencyWaitableObject();
+	}
+}
+
+UINT D3DApp::SwapChainFlags()const
+{
+	UINT flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+
+	if(mUseWaitableSwapChain)
+		flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
+	if(mPresentMode == PresentMode::Tearing)
+		flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+	return flags;
+}
+
+void D3DApp::Present()
+{
+	UINT syncInterval = (mPresentMode == PresentMode::VSync) ? 1 : 0;
+	UINT presentFlags = (mPresentMode == PresentMode::Tearing) ? DXGI_PRESENT_ALLOW_TEARING : 0;
+
+	CpuScope scope("Present");
+	ThrowIfFailed(mSwapChain->Present(syncInterval, presentFlags));
+	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+}
+
+void D3DApp::WaitForFrameLatency()
+{
+	if(mFrameLatencyWaitableObject != nullptr)
+	{
+		// Time out rather than hang if the swap chain never signals, e.g. while occluded.
+		WaitForSingleObjectEx(mFrameLatencyWaitableObject, 1000, TRUE);
+	}
 }
 
 void D3DApp::FlushCommandQueue()
@@ -542,19 +639,34 @@ void D3DApp::FlushCommandQueue()
     ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
 	// Wait until the GPU has completed commands up to this fence point.
-    if(mFence->GetCompletedValue() < mCurrentFence)
+	WaitForFence(mCurrentFence);
+}
+
+void D3DApp::WaitForFence(UINT64 fenceValue)
+{
+    if(mFence->GetCompletedValue() < fenceValue)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
+		CpuScope scope("WaitForFence");
 
-        // Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+        // Fire event when GPU hits the fence value.  
+        ThrowIfFailed(mFence->SetEventOnCompletion(fenceValue, mFenceEvent));
 
         // Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
+		WaitForSingleObject(mFenceEvent, INFINITE);
 	}
 }
 
+void D3DApp::WriteCpuTrace()
+{
+	// In the working directory, as the mesh and pipeline caches are.
+	bool isWritten = CpuProfiler::WriteChromeTrace(L"CpuTrace.json") &&
+		CpuProfiler::WriteCsv(L"CpuTrace.csv");
+
+	OutputDebugString(isWritten ?
+		L"CPU scopes written to CpuTrace.json and CpuTrace.csv.\n" :
+		L"Could not write CpuTrace.json or CpuTrace.csv.\n");
+}
+
 ID3D12Resource* D3DApp::CurrentBackBuffer()const
 {
 	return mSwapChainBuffer[mCurrBackBuffer].Get();
@@ -595,7 +707,8 @@ void D3DApp::CalculateFrameStats()
 
         wstring windowText = mMainWndCaption +
             L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+            L"   mspf: " + mspfStr +
+            GetFrameStatsText();
 
         SetWindowText(mhMainWnd, windowText.c_str());
 		
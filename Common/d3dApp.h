@@ -11,12 +11,22 @@
 
 #include "d3dUtil.h"
 #include "GameTimer.h"
+#include "CpuProfiler.h"
+#include <dxgi1_5.h>
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 #pragma comment(lib, "dxgi.lib")
 
+// How Present is synchronized with the display.
+enum class PresentMode
+{
+    VSync,      // Wait for the vertical blank.
+    Immediate,  // Present without waiting for the vertical blank.
+    Tearing,    // As Immediate, but also allow tearing, for variable refresh rate displays.
+};
+
 class D3DApp
 {
 protected:
@@ -62,12 +72,29 @@ protected:
 
 	void FlushCommandQueue();
 
+	// Blocks until mFence reaches fenceValue.
+	void WaitForFence(UINT64 fenceValue);
+
+	// Blocks until the swap chain is ready to queue another frame.  Only waits
+	// when the swap chain was created with a frame latency waitable object.
+	void WaitForFrameLatency();
+
+	// Presents the current back buffer with mPresentMode and advances to the next one.
+	void Present();
+	UINT SwapChainFlags()const;
+
 	ID3D12Resource* CurrentBackBuffer()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView()const;
 
 	void CalculateFrameStats();
 
+	// Appended to the frame stats in the window caption, such as GPU timings.
+	virtual std::wstring GetFrameStatsText()const { return std::wstring(); }
+
+	// Writes every thread's recent CPU scopes out, on F3.
+	void WriteCpuTrace();
+
     void LogAdapters();
     void LogAdapterOutputs(IDXGIAdapter* adapter);
     void LogOutputDisplayModes(IDXGIOutput* output, DXGI_FORMAT format);
@@ -97,6 +124,13 @@ protected:
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+
+	// Signaled by mFence in WaitForFence.  Created once and reused for every wait.
+	HANDLE mFenceEvent = nullptr;
+
+	// Signaled by the swap chain when it can queue another frame.
+	HANDLE mFrameLatencyWaitableObject = nullptr;
+	bool mTearingSupported = false;
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
@@ -119,10 +153,22 @@ protected:
 
 	// Derived class should set these in derived constructor to customize starting values.
 	std::wstring mMainWndCaption = L"d3d App";
-	D3D_DRIVER_TYPE md3dDriverType = D3D_DRIVER_TYPE_HARDWARE;
+	D3D_DRIVER_TYPE md3dDriverType = D3D_DRIVER_TYPE_HARDWARE;  // or D3D_DRIVER_TYPE_WARP
     DXGI_FORMAT mBackBufferFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	int mClientWidth = 800;
 	int mClientHeight = 600;
+
+	// Frame pacing.  A deeper frame latency lets the CPU run further ahead of the
+	// display for throughput, a shallower one lowers input latency.  Tearing falls
+	// back to Immediate when the display or driver does not support it.
+	PresentMode mPresentMode = PresentMode::Immediate;
+	UINT mMaxFrameLatency = 3;
+	bool mUseWaitableSwapChain = true;
+
+	// For unattended runs: the window can be left hidden, and drawing can go on
+	// while another window has the focus.
+	bool mShowWindow = true;
+	bool mRunWhenInactive = false;
 };
 
@@ -113,6 +113,45 @@ ComPtr<ID3DBlob> d3dUtil::CompileShader(
 	return byteCode;
 }
 
+std::wstring d3dUtil::ShaderBinaryName(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint)
+{
+	size_t slash = filename.find_last_of(L"\\/");
+	std::wstring directory = slash == std::wstring::npos ? L"" : filename.substr(0, slash + 1);
+	std::wstring stem = filename.substr(directory.size(), filename.find_last_of(L'.') - directory.size());
+
+	std::wstring name = directory + L"Compiled\\" + stem + L"_" + AnsiToWString(entrypoint);
+	for(const D3D_SHADER_MACRO* define = defines; define != nullptr && define->Name != nullptr; ++define)
+		name += L"_" + AnsiToWString(define->Name);
+
+	return name + L".cso";
+}
+
+ComPtr<ID3DBlob> d3dUtil::LoadShader(
+	const std::wstring& filename,
+	const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint,
+	const std::string& target,
+	ShaderSource source)
+{
+	if(source != ShaderSource::Hlsl)
+	{
+		std::wstring binaryName = ShaderBinaryName(filename, defines, entrypoint);
+		if(GetFileAttributesW(binaryName.c_str()) != INVALID_FILE_ATTRIBUTES)
+			return LoadBinary(binaryName);
+
+		if(source == ShaderSource::Precompiled)
+		{
+			throw DxException(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), L"d3dUtil::LoadShader " + binaryName,
+				AnsiToWString(__FILE__), __LINE__);
+		}
+	}
+
+	return CompileShader(filename, defines, entrypoint, target);
+}
+
 std::wstring DxException::ToString()const
 {
     // Get the string description of the error code.
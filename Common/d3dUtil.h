@@ -28,8 +28,9 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "Registry.h"
 
-extern const int gNumFrameResources;
+extern int gNumFrameResources;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -126,6 +127,34 @@ public:
 		const D3D_SHADER_MACRO* defines,
 		const std::string& entrypoint,
 		const std::string& target);
+
+	// Where LoadShader takes shader bytecode from.
+	enum class ShaderSource
+	{
+		// The .cso files written at build time.  Missing ones are an error.
+		Precompiled,
+
+		// The .cso files, compiling the HLSL of any that are missing.
+		PrecompiledOrHlsl,
+
+		// Always the HLSL, for editing shaders without rebuilding.
+		Hlsl
+	};
+
+	// Precompiled bytecode of an entry point of an HLSL file under a set of
+	// defines, as the build's shader compile step names it: Shaders\color.hlsl,
+	// "VS" and PACKED_POSITIONS give Shaders\Compiled\color_VS_PACKED_POSITIONS.cso.
+	static std::wstring ShaderBinaryName(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint);
+
+	static Microsoft::WRL::ComPtr<ID3DBlob> LoadShader(
+		const std::wstring& filename,
+		const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint,
+		const std::string& target,
+		ShaderSource source);
 };
 
 class DxException
@@ -155,6 +184,20 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// Maps the stored vertex positions of packed vertex formats back to object
+	// space: pos = stored*PositionScale + PositionBias.
+	DirectX::XMFLOAT3 PositionScale = { 1.0f, 1.0f, 1.0f };
+	DirectX::XMFLOAT3 PositionBias = { 0.0f, 0.0f, 0.0f };
+
+	// Object space distance by which this submesh may stray from the finest level
+	// of its LOD chain.  Zero for meshes without LODs.
+	float LodError = 0.0f;
+
+	// First meshlet of the submesh in its geometry's meshlet buffer, and how many
+	// it has.  Zero for geometry without meshlets.
+	UINT MeshletOffset = 0;
+	UINT MeshletCount = 0;
 };
 
 struct MeshGeometry
@@ -173,6 +216,31 @@ struct MeshGeometry
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 
+	// Byte offsets of the buffers in VertexBufferGPU and IndexBufferGPU, for
+	// geometry sub-allocated from a larger buffer.
+	UINT64 VertexBufferOffset = 0;
+	UINT64 IndexBufferOffset = 0;
+
+	// Optional second vertex stream, for vertex formats that keep the positions
+	// in VertexBufferGPU and the other attributes here.
+	Microsoft::WRL::ComPtr<ID3D12Resource> AttributeBufferGPU = nullptr;
+	UINT64 AttributeBufferOffset = 0;
+	UINT AttributeByteStride = 0;
+	UINT AttributeBufferByteSize = 0;
+
+	// Optional meshlets of the submeshes, for mesh shaders: the arrays of a
+	// MeshletData back to back, the meshlets first and the others at these byte
+	// offsets from them.  See Meshlets.h.
+	Microsoft::WRL::ComPtr<ID3D12Resource> MeshletBufferGPU = nullptr;
+	UINT64 MeshletBufferOffset = 0;
+	UINT64 MeshletCullDataOffset = 0;
+	UINT64 MeshletVertexIndexOffset = 0;
+	UINT64 MeshletPrimitiveOffset = 0;
+
+	// Upload queue ticket after which the GPU buffers hold their data.  Zero for
+	// geometry uploaded on the direct queue.
+	UINT64 UploadTicket = 0;
+
     // Data about the buffers.
 	UINT VertexByteStride = 0;
 	UINT VertexBufferByteSize = 0;
@@ -182,22 +250,36 @@ struct MeshGeometry
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
 	// the Submeshes individually.
-	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
+	Registry<SubmeshGeometry> DrawArgs;
 
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
 		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
+		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
 		vbv.StrideInBytes = VertexByteStride;
 		vbv.SizeInBytes = VertexBufferByteSize;
 
 		return vbv;
 	}
 
+	// A null view when there is no attribute stream, which leaves slot 1 unbound.
+	D3D12_VERTEX_BUFFER_VIEW AttributeBufferView()const
+	{
+		D3D12_VERTEX_BUFFER_VIEW vbv = {};
+		if(AttributeBufferGPU != nullptr)
+		{
+			vbv.BufferLocation = AttributeBufferGPU->GetGPUVirtualAddress() + AttributeBufferOffset;
+			vbv.StrideInBytes = AttributeByteStride;
+			vbv.SizeInBytes = AttributeBufferByteSize;
+		}
+
+		return vbv;
+	}
+
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
 	{
 		D3D12_INDEX_BUFFER_VIEW ibv;
-		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
+		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress() + IndexBufferOffset;
 		ibv.Format = IndexFormat;
 		ibv.SizeInBytes = IndexBufferByteSize;
 